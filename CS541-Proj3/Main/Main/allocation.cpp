@@ -0,0 +1,227 @@
+///////////////////////////////////////////////////////////////////////
+// Allocation tracking, the frame arena and the mesh pool.  See
+// allocation.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+
+#include "allocation.h"
+
+MemoryStats memoryStats;
+FrameArena frameArena;
+MeshPool meshPool;
+
+const char* MemoryStats::names[MEM_TAG_COUNT] =
+    {"other", "scene", "models", "graph", "shaders", "frame"};
+
+// Each block starts with this, just before the pointer handed out.
+struct BlockHeader
+{
+    size_t bytes;
+    int tag;
+    int offset;             // From the start of the malloc'ed block
+};
+
+static thread_local int currentTag = MEM_OTHER;
+
+static std::atomic<long long> liveCount[MEM_TAG_COUNT];
+static std::atomic<long long> liveBytes[MEM_TAG_COUNT];
+static std::atomic<long long> peakBytes[MEM_TAG_COUNT];
+static std::atomic<long long> totalCount(0);
+
+MemoryScope::MemoryScope(const int tag) :previous(currentTag)
+{
+    currentTag = tag;
+}
+
+MemoryScope::~MemoryScope()
+{
+    currentTag = previous;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Allocates bytes, aligned to alignment (a power of two, at least
+// 16), counted against tag.  Returns NULL on failure.
+void* MemoryAllocate(const size_t bytes, const int tag, const size_t alignment)
+{
+    size_t header = sizeof(BlockHeader);
+    char* base = (char*)malloc(bytes + header + alignment);
+    if (!base) return NULL;
+
+    char* p = (char*)((uintptr_t(base) + header + alignment-1) & ~uintptr_t(alignment-1));
+    BlockHeader* h = (BlockHeader*)p - 1;
+    h->bytes = bytes;
+    h->tag = tag;
+    h->offset = int(p - base);
+
+    long long live = liveBytes[tag] += bytes;
+    long long peak = peakBytes[tag];
+    while (live > peak && !peakBytes[tag].compare_exchange_weak(peak, live))
+        ;
+    liveCount[tag]++;
+    totalCount++;
+    return p;
+}
+
+void MemoryFree(void* p)
+{
+    if (!p) return;
+    BlockHeader* h = (BlockHeader*)p - 1;
+    liveBytes[h->tag] -= h->bytes;
+    liveCount[h->tag]--;
+    free((char*)p - h->offset);
+}
+
+size_t MemorySize(const void* p)
+{
+    return ((const BlockHeader*)p - 1)->bytes;
+}
+
+#if MEMORY_TRACKING
+
+// Every new and delete in the program goes through the tracking.
+void* operator new(size_t bytes)
+{
+    void* p = MemoryAllocate(bytes, currentTag);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t bytes)
+{
+    void* p = MemoryAllocate(bytes, currentTag);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+    return MemoryAllocate(bytes, currentTag);
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept
+{
+    return MemoryAllocate(bytes, currentTag);
+}
+
+void operator delete(void* p) noexcept             { MemoryFree(p); }
+void operator delete[](void* p) noexcept           { MemoryFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept   { MemoryFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { MemoryFree(p); }
+
+#endif
+
+////////////////////////////////////////////////////////////////////////
+MemoryStats::MemoryStats() :totalAllocations(0), frameAllocations(0)
+{
+    for (int t=0;  t<MEM_TAG_COUNT;  t++)
+        allocations[t] = kilobytes[t] = peakKilobytes[t] = 0;
+}
+
+// Copies the counters, and counts the allocations since the last
+// call.  Allocates nothing itself.
+void MemoryStats::Sample()
+{
+    for (int t=0;  t<MEM_TAG_COUNT;  t++) {
+        allocations[t] = int(liveCount[t]);
+        kilobytes[t] = int(liveBytes[t]/1024);
+        peakKilobytes[t] = int(peakBytes[t]/1024); }
+
+    int total = int(totalCount);
+    frameAllocations = total - totalAllocations;
+    totalAllocations = total;
+}
+
+////////////////////////////////////////////////////////////////////////
+FrameArena::FrameArena() :blockSize(256*1024), used(0), peak(0), offset(0), current(0), chained(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    for (unsigned int b=0;  b<blocks.size();  b++)
+        MemoryFree(blocks[b]);
+}
+
+// Frees everything allocated since the last Reset.  If that took
+// several blocks, they become a single one big enough for it all.
+void FrameArena::Reset()
+{
+    if (blocks.size() > 1) {
+        for (unsigned int b=0;  b<blocks.size();  b++)
+            MemoryFree(blocks[b]);
+        blocks.clear();
+        blockSize = chained;
+        blocks.push_back((char*)MemoryAllocate(blockSize, MEM_FRAME, 64));
+        current = chained = blockSize; }
+    offset = 0;
+    used = 0;
+}
+
+void* FrameArena::Allocate(const int bytes, const int alignment)
+{
+    int start = (offset + alignment-1) & ~(alignment-1);
+    if (blocks.empty() || start + bytes > current) {
+        int size = bytes + alignment > blockSize ? bytes + alignment : blockSize;
+        char* block = (char*)MemoryAllocate(size, MEM_FRAME, 64);
+        if (!block) {
+            printf("Frame arena:  out of memory (%d bytes)\n", size);
+            exit(-1); }
+        blocks.push_back(block);
+        current = size;
+        chained += size;
+        start = 0; }
+
+    offset = start + bytes;
+    used += bytes;
+    if (used > peak) peak = used;
+    return blocks.back() + start;
+}
+
+////////////////////////////////////////////////////////////////////////
+MeshPool::MeshPool() :reused(0), allocated(0), freeBytes(0)
+{
+}
+
+// A block of at least bytes, 64-byte aligned:  from the free list if
+// one fits without wasting more than half of it.
+void* MeshPool::Allocate(const size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> l(lock);
+        std::multimap<size_t, void*>::iterator it = freeList.lower_bound(bytes);
+        if (it != freeList.end() && it->first <= 2*bytes) {
+            void* p = it->second;
+            freeBytes -= it->first;
+            freeList.erase(it);
+            reused++;
+            return p; }
+        allocated++;
+    }
+
+    void* p = MemoryAllocate(bytes, MEM_MODELS, 64);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void MeshPool::Free(void* p)
+{
+    if (!p) return;
+    std::lock_guard<std::mutex> l(lock);
+    size_t bytes = MemorySize(p);
+    freeList.insert(std::make_pair(bytes, p));
+    freeBytes += bytes;
+}
+
+void MeshPool::Trim()
+{
+    std::lock_guard<std::mutex> l(lock);
+    for (std::multimap<size_t, void*>::iterator it=freeList.begin();  it!=freeList.end();  it++)
+        MemoryFree(it->second);
+    freeList.clear();
+    freeBytes = 0;
+}
@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////
+// Memory:  allocation tracking, a linear arena for per-frame scratch,
+// and pooled, aligned storage for mesh data.
+//
+// Tracking:  The global operator new and delete are replaced (in
+// allocation.cpp) so that every allocation is counted against a tag --
+// the subsystem responsible, set for the calling thread by
+//
+//     MemoryScope scope(MEM_MODELS);
+//
+// and otherwise MEM_OTHER.  Each tag keeps its live allocations,
+// live bytes and peak bytes, and the totals let the frame loop
+// measure the allocations made per frame, the number which should
+// be zero in the steady state.  Sample() copies the counters into
+// plain ints for display (see framework.cpp).  Define
+// MEMORY_TRACKING 0 to compile all of this out.
+//
+// Frame arena:  frameArena hands out scratch memory which lives until
+// the next Reset (at the start of each frame), by bumping an offset.
+// Only the main thread allocates from it (jobs may fill it).
+// When a frame needs more than the block holds, extra blocks are
+// chained on, and the next Reset replaces them all with one block of
+// the combined size, so after the first few frames it never
+// allocates at all.
+//
+//     float* scratch = frameArena.New<float>(n);
+//
+// Mesh pool:  MeshArray<T> (a std::vector with MeshAllocator) keeps
+// model data (see models.h) in 64-byte aligned blocks, tagged
+// MEM_MODELS, which meshPool recycles:  a freed block goes on a free
+// list, and is reused by a later request which it fits (without
+// wasting more than half of it), so replacing a model does not go
+// back to the system allocator.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _ALLOCATION_
+#define _ALLOCATION_
+
+#include <stddef.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#ifndef MEMORY_TRACKING
+#define MEMORY_TRACKING 1
+#endif
+
+enum MemoryTag {MEM_OTHER, MEM_SCENE, MEM_MODELS, MEM_GRAPH, MEM_SHADERS, MEM_FRAME,
+                MEM_TAG_COUNT};
+
+// Sets the calling thread's tag until the end of the scope.
+class MemoryScope
+{
+public:
+    MemoryScope(const int tag);
+    ~MemoryScope();
+private:
+    int previous;
+};
+
+void* MemoryAllocate(const size_t bytes, const int tag, const size_t alignment=16);
+void MemoryFree(void* p);
+size_t MemorySize(const void* p);      // Bytes requested for p
+
+class MemoryStats
+{
+public:
+    static const char* names[MEM_TAG_COUNT];
+
+    // Sample()'s copies of the counters
+    int allocations[MEM_TAG_COUNT];     // Live
+    int kilobytes[MEM_TAG_COUNT];       // Live
+    int peakKilobytes[MEM_TAG_COUNT];
+    int totalAllocations;               // Since startup
+    int frameAllocations;               // Since the previous Sample
+
+    MemoryStats();
+    void Sample();
+};
+
+extern MemoryStats memoryStats;
+
+////////////////////////////////////////////////////////////////////////
+class FrameArena
+{
+public:
+    int blockSize;
+    int used;               // Bytes handed out since Reset
+    int peak;               // Most used in any one frame
+
+    FrameArena();
+    ~FrameArena();
+    void Reset();
+    void* Allocate(const int bytes, const int alignment=16);
+    template <class T> T* New(const int n)
+    {
+        return (T*)Allocate(n*sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+    }
+
+private:
+    std::vector<char*> blocks;      // The current block is last
+    int offset;                     // In the current block
+    int current;                    // Size of the current block
+    int chained;                    // Bytes in all blocks
+};
+
+extern FrameArena frameArena;
+
+////////////////////////////////////////////////////////////////////////
+class MeshPool
+{
+public:
+    int reused, allocated;      // Requests served from the free list, and not
+    size_t freeBytes;           // Held on the free list
+
+    MeshPool();
+    void* Allocate(const size_t bytes);
+    void Free(void* p);
+    void Trim();                // Returns the free list to the system
+
+private:
+    std::mutex lock;
+    std::multimap<size_t, void*> freeList;
+};
+
+extern MeshPool meshPool;
+
+template <class T> class MeshAllocator
+{
+public:
+    typedef T value_type;
+    MeshAllocator() {}
+    template <class U> MeshAllocator(const MeshAllocator<U>&) {}
+    T* allocate(const size_t n) { return (T*)meshPool.Allocate(n*sizeof(T)); }
+    void deallocate(T* p, const size_t) { meshPool.Free(p); }
+    template <class U> bool operator==(const MeshAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const MeshAllocator<U>&) const { return false; }
+};
+
+template <class T> using MeshArray = std::vector<T, MeshAllocator<T> >;
+
+#endif
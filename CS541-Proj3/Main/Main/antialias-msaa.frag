@@ -0,0 +1,25 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader resolving the multisampled lighting pass (see
+// antialias.h):  the average of each pixel's samples.  For an HDR
+// frame, each is weighted by 1/(1+luminance) (Karis), so the edge
+// between a very bright and a dark surface still comes out partly
+// covered once tone mapped.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2DMS source;
+uniform int samples;
+uniform int hdr;
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec3 sum = vec3(0.0);
+    float total = 0.0;
+    for (int s=0;  s<samples;  s++) {
+        vec3 c = texelFetch(source, p, s).rgb;
+        float w = hdr != 0 ? 1.0/(1.0 + dot(c, vec3(0.2126, 0.7152, 0.0722))) : 1.0;
+        sum += w*c;
+        total += w; }
+    gl_FragColor = vec4(sum/total, 1.0);
+}
@@ -0,0 +1,95 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the temporal anti-aliasing resolve (see
+// antialias.h):  blends this (jittered) frame into the history of the
+// ones before.
+//
+// The history is found where the pixel was last frame:  its position
+// from the depth buffer (the nearest depth of its 3x3 neighborhood,
+// so edges move with the object in front), taken through reproject,
+// the last frame's view-projection times the inverse of this one's.
+// It is sampled with a Catmull-Rom filter (in five bilinear taps) so
+// that repeated resampling does not blur it, then clamped to the box
+// of the neighborhood's colors in YCoCg, which rejects what is no
+// longer there.  For an HDR frame the blend is weighted by
+// 1/(1+luminance), so a flickering highlight does not dominate it.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D current, history, depth;
+uniform mat4 reproject;
+uniform vec2 texel;
+uniform float feedback;     // The new frame's weight
+uniform int hasHistory;
+uniform int hdr;
+
+in vec2 uv;
+
+vec3 ToYCoCg(vec3 c)
+{
+    return vec3(0.25*c.r + 0.5*c.g + 0.25*c.b, 0.5*c.r - 0.5*c.b, -0.25*c.r + 0.5*c.g - 0.25*c.b);
+}
+
+vec3 FromYCoCg(vec3 c)
+{
+    return vec3(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z);
+}
+
+float Weight(vec3 c)
+{
+    return hdr != 0 ? 1.0/(1.0 + dot(c, vec3(0.2126, 0.7152, 0.0722))) : 1.0;
+}
+
+// Catmull-Rom filtered history, the 4x4 footprint's corners dropped
+vec3 History(vec2 p)
+{
+    vec2 t = p/texel;
+    vec2 t1 = floor(t - 0.5) + 0.5;
+    vec2 f = t - t1;
+    vec2 w0 = f*(-0.5 + f*(1.0 - 0.5*f));
+    vec2 w1 = 1.0 + f*f*(-2.5 + 1.5*f);
+    vec2 w2 = f*(0.5 + f*(2.0 - 1.5*f));
+    vec2 w3 = f*f*(-0.5 + 0.5*f);
+    vec2 w12 = w1 + w2;
+    vec2 p0 = (t1 - 1.0)*texel;
+    vec2 p3 = (t1 + 2.0)*texel;
+    vec2 p12 = (t1 + w2/w12)*texel;
+
+    vec3 c = texture(history, vec2(p12.x, p0.y)).rgb*(w12.x*w0.y)
+        + texture(history, vec2(p0.x, p12.y)).rgb*(w0.x*w12.y)
+        + texture(history, p12).rgb*(w12.x*w12.y)
+        + texture(history, vec2(p3.x, p12.y)).rgb*(w3.x*w12.y)
+        + texture(history, vec2(p12.x, p3.y)).rgb*(w12.x*w3.y);
+    float total = w12.x*w0.y + w0.x*w12.y + w12.x*w12.y + w3.x*w12.y + w12.x*w3.y;
+    return max(c/total, 0.0);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(current, 0) - 1;
+    vec3 color = texelFetch(current, pixel, 0).rgb;
+    if (hasHistory == 0) {
+        gl_FragColor = vec4(color, 1.0);
+        return; }
+
+    vec3 low = ToYCoCg(color), high = low;
+    float d = texelFetch(depth, pixel, 0).r;
+    for (int y=-1;  y<=1;  y++)
+        for (int x=-1;  x<=1;  x++) {
+            ivec2 q = clamp(pixel + ivec2(x, y), ivec2(0), last);
+            vec3 c = ToYCoCg(texelFetch(current, q, 0).rgb);
+            low = min(low, c);
+            high = max(high, c);
+            d = min(d, texelFetch(depth, q, 0).r); }
+
+    vec4 p = reproject*vec4(2.0*uv - 1.0, 2.0*d - 1.0, 1.0);
+    vec2 previous = 0.5*p.xy/p.w + 0.5;
+    if (any(lessThan(previous, vec2(0.0))) || any(greaterThan(previous, vec2(1.0)))) {
+        gl_FragColor = vec4(color, 1.0);
+        return; }
+
+    vec3 h = FromYCoCg(clamp(ToYCoCg(History(previous)), low, high));
+    float wc = feedback*Weight(color);
+    float wh = (1.0 - feedback)*Weight(h);
+    gl_FragColor = vec4((wc*color + wh*h)/(wc + wh), 1.0);
+}
@@ -0,0 +1,238 @@
+///////////////////////////////////////////////////////////////////////
+// Anti-aliasing:  MSAA, or TAA with reprojection.  See antialias.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "antialias.h"
+
+// Texture units used by the resolves (each its own program)
+#define SOURCE_UNIT  0
+#define HISTORY_UNIT 1
+#define DEPTH_UNIT   2
+
+Antialias::Antialias()
+    :mode(NONE), samples(4), feedback(0.1f), active(NONE), frame(0), msaaRequested(0),
+     taaFbo(0), taaTexture(0), taaDepth(0), currentHistory(0), historyValid(false),
+     width(0), height(0), emptyVao(0)
+{
+    for (int h=0;  h<2;  h++)
+        historyFbo[h] = historyTexture[h] = 0;
+}
+
+static void CreateResolveShader(ShaderProgram& shader, const char* frag)
+{
+    shader.CreateProgram();
+    shader.CreateShader("fullscreen.vert", GL_VERTEX_SHADER);
+    shader.CreateShader(frag, GL_FRAGMENT_SHADER);
+    shader.LinkProgram();
+}
+
+static unsigned int CreateTexture(const int w, const int h, const unsigned int format,
+                                  const unsigned int components, const unsigned int filter)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, components, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+static void CheckTarget(const char* name)
+{
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("%s FBO Error: %d\n", name, status);
+}
+
+void Antialias::Initialize()
+{
+    CreateResolveShader(msaaShader, "antialias-msaa.frag");
+    CreateResolveShader(taaShader, "antialias-taa.frag");
+    glGenVertexArrays(1, &emptyVao);
+}
+
+void Antialias::DeleteTargets()
+{
+    msaaTarget.DeleteFBO();
+    if (!taaFbo) return;
+    glDeleteFramebuffers(1, &taaFbo);
+    glDeleteTextures(1, &taaTexture);
+    glDeleteTextures(1, &taaDepth);
+    glDeleteFramebuffers(2, historyFbo);
+    glDeleteTextures(2, historyTexture);
+    taaFbo = taaTexture = taaDepth = 0;
+    for (int h=0;  h<2;  h++)
+        historyFbo[h] = historyTexture[h] = 0;
+}
+
+// Only the active mode's targets are kept.
+void Antialias::CreateTargets(const int w, const int h)
+{
+    DeleteTargets();
+    width = w;
+    height = h;
+    historyValid = false;
+
+    if (active == MSAA) {
+        int maxSamples;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        samples = std::max(2, std::min(samples, maxSamples));
+        msaaRequested = samples;
+        msaaTarget.CreateMultisampleFBO(w, h, GL_RGBA16F, samples); }
+
+    else if (active == TAA) {
+        taaTexture = CreateTexture(w, h, GL_RGBA16F, GL_RGBA, GL_NEAREST);
+        taaDepth = CreateTexture(w, h, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_NEAREST);
+        glGenFramebuffers(1, &taaFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, taaFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, taaTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, taaDepth, 0);
+        CheckTarget("TAA");
+
+        // The history is read between texels, so filtered
+        for (int i=0;  i<2;  i++) {
+            historyTexture[i] = CreateTexture(w, h, GL_RGBA16F, GL_RGBA, GL_LINEAR);
+            glGenFramebuffers(1, &historyFbo[i]);
+            glBindFramebuffer(GL_FRAMEBUFFER, historyFbo[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                                   historyTexture[i], 0);
+            CheckTarget("TAA history"); }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+}
+
+////////////////////////////////////////////////////////////////////////
+// The framebuffer the lighting pass should draw into:  the scene's
+// output itself if there is nothing to do.
+unsigned int Antialias::Target(Scene& scene)
+{
+    int previous = active;
+    active = mode;
+    if (active == MSAA && scene.renderPath == Scene::DEFERRED)
+        active = NONE;
+
+    if (active == NONE) {
+        historyValid = false;
+        return scene.outputFbo; }
+
+    if (active != previous || scene.width != width || scene.height != height
+        || (active == MSAA && samples != msaaRequested))
+        CreateTargets(scene.width, scene.height);
+    frame++;
+    return active == MSAA ? msaaTarget.fbo : taaFbo;
+}
+
+// Element i (from 1) of the Halton sequence in the given base
+static float Halton(int i, const int base)
+{
+    float f = 1.0f, r = 0.0f;
+    for (;  i > 0;  i /= base) {
+        f /= base;
+        r += f*(i % base); }
+    return r;
+}
+
+// This frame's offset of the image, in normalized device coordinates
+// (two units across the viewport).
+void Antialias::Jitter(float& jx, float& jy) const
+{
+    int i = frame % TAA_PHASES + 1;
+    jx = (2.0f*Halton(i, 2) - 1.0f)/width;
+    jy = (2.0f*Halton(i, 3) - 1.0f)/height;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Resolves the frame drawn into Target into the scene's output.  The
+// scene's WorldProj is the unjittered one again.
+void Antialias::Resolve(Scene& scene)
+{
+    if (active == NONE) return;
+
+    timer.Begin();
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(emptyVao);
+    glViewport(0, 0, width, height);
+
+    if (active == MSAA) {
+        glBindFramebuffer(GL_FRAMEBUFFER, scene.outputFbo);
+        msaaShader.Use();
+        int program = msaaShader.program;
+        glActiveTexture(GL_TEXTURE0+SOURCE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msaaTarget.texture);
+        int loc = glGetUniformLocation(program, "source");
+        glUniform1i(loc, SOURCE_UNIT);
+        loc = glGetUniformLocation(program, "samples");
+        glUniform1i(loc, msaaTarget.samples);
+        loc = glGetUniformLocation(program, "hdr");
+        glUniform1i(loc, scene.post.enabled);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        msaaShader.Unuse();
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0); }
+
+    else {
+        // The deferred path's depth is in its G-buffer.
+        unsigned int depth = scene.renderPath == Scene::DEFERRED
+            ? scene.deferred.depthTexture : taaDepth;
+        MAT4 ViewProj = scene.WorldProj*scene.WorldView;
+        MAT4 Reproject = previousViewProj*ViewProj.inverse();
+
+        int next = 1 - currentHistory;
+        glBindFramebuffer(GL_FRAMEBUFFER, historyFbo[next]);
+        taaShader.Use();
+        int program = taaShader.program;
+        glActiveTexture(GL_TEXTURE0+SOURCE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, taaTexture);
+        glActiveTexture(GL_TEXTURE0+HISTORY_UNIT);
+        glBindTexture(GL_TEXTURE_2D, historyTexture[currentHistory]);
+        glActiveTexture(GL_TEXTURE0+DEPTH_UNIT);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        int loc = glGetUniformLocation(program, "current");
+        glUniform1i(loc, SOURCE_UNIT);
+        loc = glGetUniformLocation(program, "history");
+        glUniform1i(loc, HISTORY_UNIT);
+        loc = glGetUniformLocation(program, "depth");
+        glUniform1i(loc, DEPTH_UNIT);
+        loc = glGetUniformLocation(program, "reproject");
+        glUniformMatrix4fv(loc, 1, GL_TRUE, Reproject.Pntr());
+        loc = glGetUniformLocation(program, "texel");
+        glUniform2f(loc, 1.0f/width, 1.0f/height);
+        loc = glGetUniformLocation(program, "feedback");
+        glUniform1f(loc, feedback);
+        loc = glGetUniformLocation(program, "hasHistory");
+        glUniform1i(loc, historyValid);
+        loc = glGetUniformLocation(program, "hdr");
+        glUniform1i(loc, scene.post.enabled);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        taaShader.Unuse();
+
+        for (int unit=SOURCE_UNIT;  unit<=DEPTH_UNIT;  unit++) {
+            glActiveTexture(GL_TEXTURE0+unit);
+            glBindTexture(GL_TEXTURE_2D, 0); }
+
+        // The new history is the frame
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, historyFbo[next]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scene.outputFbo);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, scene.outputFbo);
+
+        currentHistory = next;
+        previousViewProj = ViewProj;
+        historyValid = true; }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    timer.End();
+}
@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////
+// Anti-aliasing of the lighting pass, by one of:
+//
+//   MSAA:  the pass draws into a multisampled target (an FBO of
+//          samples samples per pixel, see fbo.h), so triangle edges
+//          are covered at the higher rate while each pixel is still
+//          shaded once.  The resolve averages each pixel's samples,
+//          weighted by 1/(1+luminance) when the frame is HDR, so a
+//          sample of the sun does not swamp the edge it lies on.
+//          Shading aliasing (the ground texture, highlights) is not
+//          touched.  The deferred path shades pixels, not samples, so
+//          gains nothing from it and draws without it.
+//
+//   TAA:   the projection (see Perspective) is offset each frame by a
+//          sub-pixel jitter (the Halton (2,3) sequence, over
+//          TAA_PHASES frames), and each frame blended into a history
+//          of the ones before:  supersampling spread over time,
+//          edges and shading alike.  The history is reprojected
+//          through the depth buffer (the velocity of each pixel is
+//          the difference of the last frame's WorldProj*WorldView and
+//          this one's), and sampled with a Catmull-Rom filter to stay
+//          sharp.  What the history shows that is no longer there
+//          (moving objects, disocclusions) is clamped to the range of
+//          the new frame's 3x3 neighborhood, in YCoCg.
+//
+// Target gives the framebuffer the lighting pass should draw into,
+// and Resolve brings it back to the scene's output (in place of
+// post-processing's HDR target, see post.h, when that is on).  The
+// resolve is timed;  the cost of drawing the samples shows in the
+// lighting pass's own timers.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _ANTIALIAS_
+#define _ANTIALIAS_
+
+#include "transform.h"
+#include "shader.h"
+#include "fbo.h"
+#include "gputimer.h"
+
+#define TAA_PHASES 8
+
+class Scene;
+
+class Antialias
+{
+public:
+    enum { NONE=0, MSAA=1, TAA=2 };
+    int mode;
+    int samples;            // Per pixel, for MSAA
+    float feedback;         // For TAA:  the weight of the new frame
+
+    int active;             // The mode in use this frame
+    int frame;              // Counts the jittered frames
+
+    FBO msaaTarget;         // Its samples may be more than asked for
+    int msaaRequested;      // The samples it was made for
+    unsigned int taaFbo, taaTexture, taaDepth;  // The jittered frame
+    unsigned int historyFbo[2], historyTexture[2];
+    int currentHistory;     // The one written last
+    bool historyValid;
+    MAT4 previousViewProj;  // Unjittered
+    int width, height;
+
+    ShaderProgram msaaShader, taaShader;
+    unsigned int emptyVao;
+
+    GpuTimer timer;
+
+    Antialias();
+    void Initialize();
+    unsigned int Target(Scene& scene);
+    bool Jittered() const { return active == TAA; }
+    void Jitter(float& jx, float& jy) const;
+    void Resolve(Scene& scene);
+
+private:
+    void CreateTargets(const int w, const int h);
+    void DeleteTargets();
+};
+
+#endif
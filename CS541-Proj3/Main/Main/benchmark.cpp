@@ -0,0 +1,684 @@
+///////////////////////////////////////////////////////////////////////
+// A headless benchmark of the renderer.  Builds with "make benchmark"
+// into benchmark.exe, linked with everything but framework.cpp.
+//
+// A scene is generated deterministically from a few scale
+// parameters, then rendered (offscreen, in a hidden window) along
+// fixed camera paths.  Animation is tied to the frame number rather
+// than the clock, so every run draws exactly the same frames, and
+// results are comparable from one commit to the next.  For each path
+// the report gives the CPU time to submit a frame, the whole frame
+// time (to glFinish), the GPU time of the frame and of each pass,
+// the draw calls, triangles, heap allocations and percentage of
+// objects occluded per frame (and the memory in use after startup,
+// by subsystem), as JSON:
+//
+//   benchmark.exe [options] -o results.json
+//
+//   -scale small|medium|large   Preset for all of the below
+//   -instances N     Copies of the teapot scattered over the ground
+//   -lights M        Point lights
+//   -textures K      Generated textures, spread over the instances
+//   -tess L          Tessellation multiplier for the teapot, sphere
+//                    and terrain grid
+//   -path orbit|flyby|top|all|none
+//   -frames F        Frames measured per path (after a warm up)
+//   -render forward|clustered|deferred
+//   -multidraw on|off  Draw with one multi-draw per material (see
+//                    megabuffer.h), where supported
+//   -occlusion on|off|software  Hi-Z occlusion culling (see
+//                    occlusion.h), from GPU depth or the software
+//                    rasterizer (softocclusion.h)
+//   -surface flat|normal|parallax  The ground's surface detail (see
+//                    surface.glsl)
+//   -post on|off     HDR bloom, exposure and tone mapping (see post.h)
+//   -aa none|msaa|taa  Anti-aliasing (see antialias.h)
+//   -samples S       Per pixel, for -aa msaa
+//   -budget MS       Scale the resolution to this GPU time per frame
+//                    (see dynamicresolution.h);  0, the default, is off
+//   -ao off|low|medium|high  Ambient occlusion quality (see ssao.h)
+//   -prepass on|off  Depth prepass before the forward lighting pass
+//                    (see depthprepass.h)
+//   -size WxH        Output resolution
+//   -o FILE          Write the JSON to FILE rather than stdout
+//   -scaling T       Also time the CPU frame preparation (transform
+//                    updates, culling, light binning) with 1 to T job
+//                    threads;  use -path none for this alone
+//   -model FILE.ply  Use this as the central model, rather than the
+//                    teapot (its meshlet culling is reported, see
+//                    meshlet.h)
+//   -meshes A.ply,B.ply  Also report the mesh codec's (see
+//                    meshcodec.h) size and speed on these models
+//
+// Progress and shader messages also go to stdout, so use -o when the
+// results are to be parsed.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "shadermanager.h"
+#include "jobs.h"
+#include "allocation.h"
+#include "meshcodec.h"
+
+// Stamped by the Makefile with the source revision
+#ifndef BENCHMARK_COMMIT
+#define BENCHMARK_COMMIT "unknown"
+#endif
+
+#define WARMUP_FRAMES 10
+
+Scene scene;
+extern float atime;
+static FILE* out = stdout;
+vec3 HSV2RGB(const float h, const float s, const float v);
+
+struct Config
+{
+    std::string scale;
+    int instances, lights, textures, tess;
+    std::string path, render;
+    int frames, width, height;
+    std::string output;
+    int scaling;
+    bool multiDraw, post, prepass;
+    std::string occlusion;
+    std::string surface;
+    std::string antialias;
+    int samples;
+    float budget;
+    std::string ao;
+    std::string model;
+    std::vector<std::string> meshes;
+};
+
+// A camera path:  tilt, spin and zoom at t in 0..1
+struct CameraPath
+{
+    const char* name;
+    float tilt0, tilt1, spin0, spin1, zoom0, zoom1;
+};
+
+static const CameraPath paths[] = {
+    {"orbit", -25.0f, -25.0f,   0.0f, 360.0f,  80.0f,  80.0f},
+    {"flyby", -70.0f, -10.0f,   0.0f, 120.0f, 150.0f,  20.0f},
+    {"top",   -90.0f, -90.0f,   0.0f,   0.0f, 150.0f, 150.0f},
+};
+
+// Statistics of one measurement over a path's frames
+struct Series
+{
+    std::vector<double> values;
+
+    double Mean() const
+    {
+        double sum = 0.0;
+        for (unsigned int i=0;  i<values.size();  i++)
+            sum += values[i];
+        return values.size() ? sum/values.size() : 0.0;
+    }
+
+    double Percentile(const double p) const
+    {
+        if (values.empty()) return 0.0;
+        std::vector<double> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[std::min(sorted.size()-1, size_t(p*sorted.size()))];
+    }
+};
+
+static float Random(unsigned int& seed)
+{
+    seed = seed*1664525u + 1013904223u;
+    return (seed>>8)/16777216.0f;
+}
+
+static void Usage()
+{
+    fprintf(stderr, "usage: benchmark.exe [-scale small|medium|large] [-instances N] [-lights M]\n"
+            "         [-textures K] [-tess L] [-path orbit|flyby|top|all] [-frames F]\n"
+            "         [-render forward|clustered|deferred] [-multidraw on|off] [-occlusion on|off|software]\n"
+            "         [-surface flat|normal|parallax] [-post on|off] [-aa none|msaa|taa] [-samples S] [-budget MS]\n"
+            "         [-ao off|low|medium|high] [-prepass on|off] [-size WxH] [-o FILE] [-scaling T] [-model FILE.ply] [-meshes A.ply,B.ply,...]\n");
+    exit(-1);
+}
+
+static void Preset(Config& c, const std::string& scale)
+{
+    c.scale = scale;
+    if (scale == "small") {
+        c.instances = 32;    c.lights = 16;    c.textures = 4;   c.tess = 1; }
+    else if (scale == "medium") {
+        c.instances = 256;   c.lights = 256;   c.textures = 8;   c.tess = 1; }
+    else if (scale == "large") {
+        c.instances = 2048;  c.lights = 2048;  c.textures = 32;  c.tess = 2; }
+    else
+        Usage();
+}
+
+static void ParseArguments(int argc, char** argv, Config& c)
+{
+    // The preset first, so that the other options override it
+    Preset(c, "medium");
+    for (int i=1;  i+1<argc;  i++)
+        if (std::string(argv[i]) == "-scale")
+            Preset(c, argv[i+1]);
+
+    c.path = "all";
+    c.render = "forward";
+    c.frames = 120;
+    c.width = 1280;
+    c.height = 720;
+    c.scaling = 0;
+    c.multiDraw = false;
+    c.occlusion = "on";
+    c.surface = "normal";
+    c.post = true;
+    c.antialias = "none";
+    c.samples = 4;
+    c.budget = 0.0f;
+    c.ao = "medium";
+    c.prepass = false;
+
+    for (int i=1;  i<argc;  i++) {
+        std::string a = argv[i];
+        if (i+1 >= argc) Usage();
+        const char* v = argv[++i];
+        if (a == "-scale")           continue;
+        else if (a == "-instances")  c.instances = atoi(v);
+        else if (a == "-lights")     c.lights = atoi(v);
+        else if (a == "-textures")   c.textures = atoi(v);
+        else if (a == "-tess")       c.tess = std::max(1, atoi(v));
+        else if (a == "-path")       c.path = v;
+        else if (a == "-frames")     c.frames = std::max(1, atoi(v));
+        else if (a == "-render")     c.render = v;
+        else if (a == "-o")          c.output = v;
+        else if (a == "-scaling")    c.scaling = atoi(v);
+        else if (a == "-multidraw")  c.multiDraw = std::string(v) == "on";
+        else if (a == "-occlusion")  c.occlusion = v;
+        else if (a == "-surface")    c.surface = v;
+        else if (a == "-post")       c.post = std::string(v) == "on";
+        else if (a == "-aa")         c.antialias = v;
+        else if (a == "-samples")    c.samples = atoi(v);
+        else if (a == "-budget")     c.budget = float(atof(v));
+        else if (a == "-ao")         c.ao = v;
+        else if (a == "-prepass")    c.prepass = std::string(v) == "on";
+        else if (a == "-model")      c.model = v;
+        else if (a == "-meshes") {
+            std::string list(v);
+            for (size_t start=0, comma;  start<=list.size();  start=comma+1) {
+                comma = list.find(',', start);
+                if (comma == std::string::npos) comma = list.size();
+                if (comma > start) c.meshes.push_back(list.substr(start, comma-start)); } }
+        else if (a == "-size") {
+            if (sscanf(v, "%dx%d", &c.width, &c.height) != 2) Usage(); }
+        else
+            Usage(); }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Replaces the scene's models with ones of the requested
+// tessellation, and adds the instances, textures and lights.
+static void GenerateScene(const Config& c)
+{
+    // (The central models are cached by the scene;  these are not.)
+    MemoryScope scope(MEM_SCENE);
+    delete scene.spherePolygons;
+    delete scene.terrain;
+    scene.spherePolygons = new Sphere(32*c.tess);
+    scene.terrain = new Terrain(64*c.tess);
+
+    Model* teapot = new Teapot(12*c.tess);
+    float s = 3.0f/teapot->size;
+    scene.centralPolygons = teapot;
+    scene.centralTr = Scale(s,s,s)*Translate(-teapot->center);
+    if (!c.model.empty()) {
+        // Stood up and sized as Scene::SetCentralModel does the PLY models
+        Model* model = new Ply(c.model.c_str());
+        float m = 3.0f/model->size;
+        scene.centralPolygons = model;
+        scene.centralTr = Rotate(2, 180.0f)*Rotate(0, 90.0f)*Scale(m,m,m)*Translate(-model->center); }
+
+    scene.instanceTextures.resize(c.textures);
+    for (int i=0;  i<c.textures;  i++)
+        scene.instanceTextures[i].Generate(256, i+1);
+
+    // Rebuild the scene graph around the new models, then add the
+    // instances as children of the ground (which stand on the
+    // terrain).  The graph's draw lists group them by texture.
+    scene.BuildGraph();
+    scene.graph.Reserve(scene.graph.count + c.instances);
+    int plain = scene.graph.AddMaterial(ShaderVariants::LIT, NULL);
+    std::vector<int> textured(c.textures);
+    for (int i=0;  i<c.textures;  i++)
+        textured[i] = scene.graph.AddMaterial(ShaderVariants::TEXTURED, &scene.instanceTextures[i]);
+
+    unsigned int seed = 54321u;
+    for (int i=0;  i<c.instances;  i++) {
+        float x = 45.0f*(2.0f*Random(seed) - 1.0f);
+        float y = 45.0f*(2.0f*Random(seed) - 1.0f);
+        float size = 0.5f + Random(seed);
+        float angle = 360.0f*Random(seed);
+        MAT4 tr = Translate(x, y, scene.terrain->Height(x, y) + 0.5f*size)*Rotate(2, angle)
+            *Scale(size*s, size*s, size*s)*Translate(-teapot->center);
+        vec3 color = HSV2RGB(Random(seed), 0.6f, 0.8f);
+        scene.graph.Add(scene.groundNode, tr, teapot, c.textures ? textured[i%c.textures] : plain,
+                        color); }
+
+    scene.pointLights.Generate(c.lights);
+
+    if (c.render == "clustered")      scene.renderPath = Scene::CLUSTERED;
+    else if (c.render == "deferred")  scene.renderPath = Scene::DEFERRED;
+    else if (c.render == "forward")   scene.renderPath = Scene::FORWARD;
+    else Usage();
+
+    scene.multiDraw = c.multiDraw && scene.megaBuffer.supported;
+    if (c.occlusion == "on" || c.occlusion == "software") {
+        scene.occlusion.enabled = true;
+        scene.occlusion.method = c.occlusion == "on" ? Occlusion::GPU : Occlusion::SOFTWARE; }
+    else if (c.occlusion == "off")
+        scene.occlusion.enabled = false;
+    else Usage();
+
+    if (c.surface == "flat")          scene.surfaceDetail = Scene::FLAT;
+    else if (c.surface == "normal")   scene.surfaceDetail = Scene::NORMAL_MAPPED;
+    else if (c.surface == "parallax") scene.surfaceDetail = Scene::PARALLAX;
+    else Usage();
+
+    scene.post.enabled = c.post;
+
+    if (c.antialias == "none")      scene.antialias.mode = Antialias::NONE;
+    else if (c.antialias == "msaa") scene.antialias.mode = Antialias::MSAA;
+    else if (c.antialias == "taa")  scene.antialias.mode = Antialias::TAA;
+    else Usage();
+    scene.antialias.samples = c.samples;
+
+    scene.dynamicResolution.enabled = c.budget > 0.0f;
+    scene.dynamicResolution.targetMs = c.budget;
+
+    scene.ssao.enabled = c.ao != "off";
+    if (c.ao == "low")              scene.ssao.quality = SSAO::LOW;
+    else if (c.ao == "medium")      scene.ssao.quality = SSAO::MEDIUM;
+    else if (c.ao == "high")        scene.ssao.quality = SSAO::HIGH;
+    else if (c.ao != "off") Usage();
+
+    scene.depthPrepass.enabled = c.prepass;
+}
+
+// Places the camera at t (0..1) along a path.
+static void SetCamera(const CameraPath& p, const float t)
+{
+    scene.tilt = p.tilt0 + t*(p.tilt1 - p.tilt0);
+    scene.spin = p.spin0 + t*(p.spin1 - p.spin0);
+    scene.zoom = p.zoom0 + t*(p.zoom1 - p.zoom0);
+
+    float rx = (scene.width*scene.ry)/scene.height;
+    scene.WorldView = Translate(scene.tx, scene.ty, -1*scene.zoom)
+        *Rotate(0, scene.tilt - 90)*Rotate(2, scene.spin);
+    scene.WorldProj = Perspective(rx, scene.ry, scene.front, scene.back);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Renders frame f (of n) of a path, returning the CPU submit time and
+// the whole frame time, in milliseconds.
+static void RenderFrame(const CameraPath& p, const int f, const int n,
+                        double& cpuMs, double& frameMs)
+{
+    SetCamera(p, n > 1 ? float(f)/(n-1) : 0.0f);
+    atime = 3.0f*f/60.0f;       // The framework's rate, at 60 frames a second
+
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+    scene.DrawScene();
+    std::chrono::high_resolution_clock::time_point submitted =
+        std::chrono::high_resolution_clock::now();
+    glFinish();
+    std::chrono::high_resolution_clock::time_point finished =
+        std::chrono::high_resolution_clock::now();
+
+    cpuMs = std::chrono::duration<double, std::milli>(submitted - start).count();
+    frameMs = std::chrono::duration<double, std::milli>(finished - start).count();
+}
+
+static void ResetTimers()
+{
+    GpuTimer* timers[] = {&scene.forwardTimer, &scene.deferred.gbufferTimer,
+                          &scene.deferred.shadeTimer, &scene.deferred.lightTimer,
+                          &scene.probe.timer, &scene.prefilter.timer, &scene.shLighting.timer,
+                          &scene.post.timer, &scene.post.bloomTimer, &scene.post.exposureTimer,
+                          &scene.post.toneTimer, &scene.antialias.timer,
+                          &scene.dynamicResolution.upscaleTimer, &scene.ssao.timer,
+                          &scene.ssao.prepassTimer, &scene.depthPrepass.timer};
+    for (unsigned int i=0;  i<sizeof(timers)/sizeof(timers[0]);  i++)
+        timers[i]->averageMs = 0.0;
+    scene.depthPrepass.fragmentsPerPixel = 0.0f;
+}
+
+static void PrintSeries(const char* name, const Series& s, const bool last=false)
+{
+    fprintf(out, "        \"%s\": {\"mean\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"max\": %.4f}%s\n",
+            name, s.Mean(), s.Percentile(0.5), s.Percentile(0.95), s.Percentile(1.0),
+            last ? "" : ",");
+}
+
+// The allocation counters after startup (see allocation.h).
+static void PrintMemory()
+{
+    memoryStats.Sample();
+    fprintf(out, "  \"memory\": {\"startup_allocations\": %d, \"frame_arena_peak\": %d, "
+            "\"mesh_pool_reused\": %d, \"mesh_pool_allocated\": %d,\n",
+            memoryStats.totalAllocations, frameArena.peak, meshPool.reused, meshPool.allocated);
+    fprintf(out, "    \"live_kb\": {");
+    for (int t=0;  t<MEM_TAG_COUNT;  t++)
+        fprintf(out, "\"%s\": %d%s", MemoryStats::names[t], memoryStats.kilobytes[t],
+                t+1 < MEM_TAG_COUNT ? ", " : "},\n");
+    fprintf(out, "    \"peak_kb\": {");
+    for (int t=0;  t<MEM_TAG_COUNT;  t++)
+        fprintf(out, "\"%s\": %d%s", MemoryStats::names[t], memoryStats.peakKilobytes[t],
+                t+1 < MEM_TAG_COUNT ? ", " : "}},\n");
+}
+
+// Renders one path, and prints its JSON object.
+static void RunPath(const CameraPath& p, const Config& c, GpuTimer& frameTimer, const bool last)
+{
+    fprintf(stderr, "Path %s\n", p.name);
+    double cpuMs, frameMs;
+    for (int f=0;  f<WARMUP_FRAMES;  f++)
+        RenderFrame(p, 0, c.frames, cpuMs, frameMs);
+    ResetTimers();
+
+    // (Reserved, so that only the renderer's allocations are counted.)
+    Series cpu, frame, gpu, draws, triangles, occluded, culled, softTris, softMs;
+    Series clusters, visibleClusters, meshletTris, visibleTris, terrainTexels, scale;
+    Series* series[15] = {&cpu, &frame, &gpu, &draws, &triangles, &occluded, &culled,
+                          &softTris, &softMs, &clusters, &visibleClusters, &meshletTris,
+                          &visibleTris, &terrainTexels, &scale};
+    for (int s=0;  s<15;  s++)
+        series[s]->values.reserve(c.frames);
+    int stalls = scene.stream.stalls;
+    memoryStats.Sample();
+    int allocations = memoryStats.totalAllocations;
+    for (int f=0;  f<c.frames;  f++) {
+        DrawStats before = drawStats;
+        frameTimer.Begin();
+        RenderFrame(p, f, c.frames, cpuMs, frameMs);
+        frameTimer.End();
+
+        cpu.values.push_back(cpuMs);
+        frame.values.push_back(frameMs);
+        gpu.values.push_back(frameTimer.Wait());
+        draws.values.push_back(double(drawStats.drawCalls - before.drawCalls));
+        triangles.values.push_back(double(drawStats.triangles - before.triangles));
+        occluded.values.push_back(scene.occlusion.percent);
+        culled.values.push_back(double(scene.occlusion.occluded + scene.occlusion.faceOccluded));
+        softTris.values.push_back(double(scene.occlusion.software.triangles));
+        softMs.values.push_back(scene.occlusion.software.ms);
+        clusters.values.push_back(double(scene.meshletCuller.clusters));
+        visibleClusters.values.push_back(double(scene.meshletCuller.visibleClusters));
+        meshletTris.values.push_back(double(scene.meshletCuller.triangles));
+        visibleTris.values.push_back(double(scene.meshletCuller.visibleTriangles));
+        terrainTexels.values.push_back(double(scene.terrain->texelsUpdated));
+        scale.values.push_back(scene.dynamicResolution.scale); }
+    memoryStats.Sample();
+    allocations = memoryStats.totalAllocations - allocations;
+
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"path\": \"%s\",\n", p.name);
+    fprintf(out, "      \"frames\": %d,\n", c.frames);
+    fprintf(out, "      \"ms\": {\n");
+    PrintSeries("cpu", cpu);
+    PrintSeries("frame", frame);
+    PrintSeries("gpu", gpu, true);
+    fprintf(out, "      },\n");
+    fprintf(out, "      \"gpu_pass_ms\": {\"forward\": %.4f, \"gbuffer\": %.4f, \"shade\": %.4f, "
+            "\"lights\": %.4f, \"probe\": %.4f, \"prefilter\": %.4f, \"sh\": %.4f, "
+            "\"post\": %.4f, \"bloom\": %.4f, \"exposure\": %.4f, \"tonemap\": %.4f, "
+            "\"antialias\": %.4f, \"upscale\": %.4f, \"ssao\": %.4f, \"ssao_prepass\": %.4f, "
+            "\"depth_prepass\": %.4f},\n",
+            scene.forwardTimer.averageMs, scene.deferred.gbufferTimer.averageMs,
+            scene.deferred.shadeTimer.averageMs, scene.deferred.lightTimer.averageMs,
+            scene.probe.timer.averageMs, scene.prefilter.timer.averageMs,
+            scene.shLighting.timer.averageMs, scene.post.timer.averageMs,
+            scene.post.bloomTimer.averageMs, scene.post.exposureTimer.averageMs,
+            scene.post.toneTimer.averageMs, scene.antialias.timer.averageMs,
+            scene.dynamicResolution.upscaleTimer.averageMs, scene.ssao.timer.averageMs,
+            scene.ssao.prepassTimer.averageMs, scene.depthPrepass.timer.averageMs);
+    fprintf(out, "      \"fragments_per_pixel\": %.3f,\n", scene.depthPrepass.fragmentsPerPixel);
+    fprintf(out, "      \"depth_prepass_copied\": %s,\n", scene.depthPrepass.copied ? "true" : "false");
+    fprintf(out, "      \"cluster_binning_ms\": %.4f,\n", scene.clusters.binMs);
+    fprintf(out, "      \"stream_stalls\": %d,\n", scene.stream.stalls - stalls);
+    fprintf(out, "      \"allocations_per_frame\": %.1f,\n", double(allocations)/c.frames);
+    fprintf(out, "      \"draw_calls\": %.1f,\n", draws.Mean());
+    fprintf(out, "      \"triangles\": %.0f,\n", triangles.Mean());
+    fprintf(out, "      \"occluded_pct\": %.1f,\n", occluded.Mean());
+    fprintf(out, "      \"occluded_draws\": %.1f,\n", culled.Mean());
+    fprintf(out, "      \"software_occlusion\": {\"triangles\": %.0f, \"ms\": %.4f, "
+            "\"triangles_per_ms\": %.0f},\n", softTris.Mean(), softMs.Mean(),
+            softMs.Mean() > 0.0 ? softTris.Mean()/softMs.Mean() : 0.0);
+    fprintf(out, "      \"meshlets\": {\"clusters\": %.0f, \"visible_clusters\": %.1f, "
+            "\"triangles\": %.0f, \"visible_triangles\": %.1f},\n", clusters.Mean(),
+            visibleClusters.Mean(), meshletTris.Mean(), visibleTris.Mean());
+    fprintf(out, "      \"terrain\": {\"triangles\": %d, \"texels_updated\": %.1f},\n",
+            scene.terrain->triangles, terrainTexels.Mean());
+    fprintf(out, "      \"render_scale\": {\"mean\": %.3f, \"min\": %.3f, \"max\": %.3f}\n",
+            scale.Mean(), scale.Percentile(0.0), scale.Percentile(1.0));
+    fprintf(out, "    }%s\n", last ? "" : ",");
+}
+
+static double Since(const std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+}
+
+////////////////////////////////////////////////////////////////////////
+// For each of c.meshes, loads the PLY file (bypassing its cache),
+// encodes it as the cache would, times decoding it, and checks the
+// decoded arrays against the originals.  Prints the "meshes" JSON
+// array.  Decode speed is in GB/s of decoded arrays (float positions,
+// normals and indices) written.
+static void RunMeshes(const Config& c)
+{
+    const int runs = 20;
+    std::vector<std::string> found;
+    for (unsigned int i=0;  i<c.meshes.size();  i++)
+        if (FILE* f = fopen(c.meshes[i].c_str(), "rb")) {
+            fclose(f);
+            found.push_back(c.meshes[i]); }
+        else
+            fprintf(stderr, "Can't open %s\n", c.meshes[i].c_str());
+
+    fprintf(stderr, "Meshes\n");
+    fprintf(out, "  \"meshes\": [\n");
+    for (unsigned int i=0;  i<found.size();  i++) {
+        const char* name = found[i].c_str();
+        std::vector<unsigned char> file;
+        ReadMeshFile(name, file);
+
+        Ply::useCache = false;
+        std::chrono::high_resolution_clock::time_point start =
+            std::chrono::high_resolution_clock::now();
+        Ply* ply = new Ply(name);
+        double parseMs = Since(start);
+        Ply::useCache = true;
+
+        std::vector<unsigned char> data;
+        start = std::chrono::high_resolution_clock::now();
+        EncodeMesh(*ply, MESH_NORMALS, data);
+        double encodeMs = Since(start);
+
+        Model decoded;
+        Series decode;
+        for (int r=0;  r<runs;  r++) {
+            start = std::chrono::high_resolution_clock::now();
+            DecodeMesh(&data[0], data.size(), decoded);
+            decode.values.push_back(Since(start)); }
+
+        // Compared corner by corner, as the vertices are renumbered
+        int nv = ply->Pnt.size(), nt = ply->Tri.size();
+        vec3 extent = ply->maxP - ply->minP;
+        float positionError = 0.0f, normalError = 0.0f;
+        for (int t=0;  t<nt;  t++)
+            for (int k=0;  k<3;  k++) {
+                int a = ply->Tri[t][k], b = decoded.Tri[t][k];
+                for (int j=0;  j<3;  j++)
+                    positionError = std::max(positionError,
+                                             fabsf(ply->Pnt[a][j] - decoded.Pnt[b][j])/extent[j]);
+                float angle = atan2f(length(cross(ply->Nrm[a], decoded.Nrm[b])),
+                                     dot(ply->Nrm[a], decoded.Nrm[b]));
+                normalError = std::max(normalError, angle*180.0f/3.14159265f); }
+
+        double floatBytes = (16.0 + 12.0 + 8.0 + 12.0)*nv + 12.0*nt;
+        double decodedBytes = (16.0 + 12.0)*nv + 12.0*nt;
+        double decodeMs = decode.Percentile(0.5);
+        fprintf(out, "    {\"mesh\": \"%s\", \"vertices\": %d, \"triangles\": %d, "
+                "\"ply_bytes\": %d, \"float_bytes\": %.0f, \"encoded_bytes\": %d,\n",
+                name, nv, nt, int(file.size()), floatBytes, int(data.size()));
+        fprintf(out, "     \"bytes_per_triangle\": {\"ply\": %.2f, \"float\": %.2f, \"encoded\": %.2f},\n",
+                double(file.size())/nt, floatBytes/nt, double(data.size())/nt);
+        fprintf(out, "     \"ply_load_ms\": %.3f, \"encode_ms\": %.3f, \"decode_ms\": %.3f, "
+                "\"decode_gbps\": %.3f,\n",
+                parseMs, encodeMs, decodeMs, decodedBytes/(decodeMs*1.0e6));
+        fprintf(out, "     \"max_position_error\": %.3g, \"max_normal_error_deg\": %.4f}%s\n",
+                positionError, normalError, i+1 < found.size() ? "," : "");
+        delete ply; }
+    fprintf(out, "  ]%s\n", c.scaling > 0 ? "," : "");
+}
+
+////////////////////////////////////////////////////////////////////////
+// Times the CPU side of frame preparation with 1 to c.scaling job
+// threads, and prints the "scaling" JSON array.  Each repetition
+// dirties the ground (so every instance, its child, is recomputed),
+// updates the graph, culls it for the view and six views around it
+// (as for a cube probe), and bins the lights.  No OpenGL is involved,
+// so this measures the job system alone.
+static void RunScaling(const Config& c)
+{
+    const int warmup = 3, runs = 20;
+    SetCamera(paths[0], 0.0f);
+
+    Frustum frustum[7];
+    frustum[0].FromMatrix(scene.WorldProj*scene.WorldView);
+    MAT4 FaceProj = Perspective(1.0f, 1.0f, scene.front, scene.back);
+    for (int f=0;  f<6;  f++) {
+        MAT4 FaceView = f < 4 ? Rotate(0, -90.0f)*Rotate(2, 90.0f*f) : Rotate(0, f == 4 ? 0.0f : 180.0f);
+        frustum[f+1].FromMatrix(FaceProj*FaceView); }
+    SceneGraph::DrawList lists[7];
+
+    fprintf(stderr, "Scaling\n");
+    fprintf(out, "  \"scaling\": [\n");
+    double single = 0.0;
+    for (int threads=1;  threads<=c.scaling;  threads++) {
+        jobs.Initialize(threads);
+        Series update, cull, bin, total;
+        for (int r=0;  r<warmup+runs;  r++) {
+            std::chrono::high_resolution_clock::time_point start =
+                std::chrono::high_resolution_clock::now();
+            scene.graph.SetLocal(scene.groundNode, MAT4());
+            scene.graph.Update();
+            double u = Since(start);
+
+            std::chrono::high_resolution_clock::time_point t0 =
+                std::chrono::high_resolution_clock::now();
+            jobs.ParallelFor(7, 1, [&](int v0, int v1)
+            {
+                for (int v=v0;  v<v1;  v++)
+                    scene.graph.Cull(&frustum[v], SceneGraph::ENVIRONMENT, lists[v]);
+            });
+            double k = Since(t0);
+
+            scene.clusters.Bin(scene.pointLights, scene.WorldView, scene.WorldProj,
+                               scene.front, scene.back);
+            double all = Since(start);
+
+            if (r < warmup) continue;
+            update.values.push_back(u);
+            cull.values.push_back(k);
+            bin.values.push_back(scene.clusters.binMs);
+            total.values.push_back(all); }
+
+        if (threads == 1) single = total.Percentile(0.5);
+        fprintf(out, "    {\"threads\": %d, \"update_ms\": %.4f, \"cull_ms\": %.4f, "
+                "\"bin_ms\": %.4f, \"total_ms\": %.4f, \"speedup\": %.3f}%s\n",
+                threads, update.Percentile(0.5), cull.Percentile(0.5), bin.Percentile(0.5),
+                total.Percentile(0.5), single/total.Percentile(0.5),
+                threads < c.scaling ? "," : ""); }
+    fprintf(out, "  ]\n");
+    jobs.Initialize();
+}
+
+int main(int argc, char** argv)
+{
+    glutInit(&argc, argv);
+    Config c;
+    ParseArguments(argc, argv, c);
+
+    // A window is needed for the GL context, but is never shown:
+    // everything is drawn into an offscreen framebuffer.
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+    glutInitContextVersion(3, 3);
+    glutInitContextProfile(GLUT_COMPATIBILITY_PROFILE);
+    glutInitWindowSize(64, 64);
+    glutCreateWindow("Benchmark");
+    glutHideWindow();
+    glload::LoadFunctions();
+
+    FBO output;
+    output.CreateFBO(c.width, c.height, GL_RGBA8);
+
+    scene.width = c.width;
+    scene.height = c.height;
+    scene.InitializeScene();
+    scene.outputFbo = output.fbo;
+    GenerateScene(c);
+
+    GpuTimer frameTimer;
+    std::vector<const CameraPath*> run;
+    for (unsigned int i=0;  i<sizeof(paths)/sizeof(paths[0]);  i++)
+        if (c.path == "all" || c.path == paths[i].name)
+            run.push_back(&paths[i]);
+    if (run.empty() && c.path != "none") Usage();
+
+    if (!c.output.empty() && !(out = fopen(c.output.c_str(), "w"))) {
+        printf("Can't open %s\n", c.output.c_str());
+        exit(-1); }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": 1,\n");
+    fprintf(out, "  \"commit\": \"%s\",\n", BENCHMARK_COMMIT);
+    fprintf(out, "  \"renderer\": \"%s\",\n", glGetString(GL_RENDERER));
+    fprintf(out, "  \"config\": {\"scale\": \"%s\", \"instances\": %d, \"lights\": %d, \"textures\": %d, "
+            "\"tess\": %d, \"render\": \"%s\", \"multidraw\": %s, \"occlusion\": \"%s\", "
+            "\"surface\": \"%s\", \"post\": %s, \"antialias\": \"%s\", \"samples\": %d, "
+            "\"budget_ms\": %.2f, \"ao\": \"%s\", \"prepass\": %s, \"model\": \"%s\", \"width\": %d, \"height\": %d, \"nodes\": %d},\n",
+            c.scale.c_str(), c.instances, c.lights, c.textures, c.tess, c.render.c_str(),
+            scene.multiDraw ? "true" : "false", c.occlusion.c_str(),
+            c.surface.c_str(), c.post ? "true" : "false", c.antialias.c_str(),
+            scene.antialias.samples, c.budget, c.ao.c_str(),
+            c.prepass ? "true" : "false", c.model.empty() ? "teapot" : c.model.c_str(),
+            c.width, c.height, scene.graph.count);
+    PrintMemory();
+    fprintf(out, "  \"paths\": [\n");
+    for (unsigned int i=0;  i<run.size();  i++)
+        RunPath(*run[i], c, frameTimer, i+1 == run.size());
+    fprintf(out, "  ]%s\n", c.scaling > 0 || c.meshes.size() ? "," : "");
+    if (c.meshes.size())
+        RunMeshes(c);
+    if (c.scaling > 0)
+        RunScaling(c);
+    fprintf(out, "}\n");
+    if (out != stdout) fclose(out);
+    return 0;
+}
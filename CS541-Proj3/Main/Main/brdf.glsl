@@ -0,0 +1,26 @@
+/////////////////////////////////////////////////////////////////////////
+// The BRDF shared by the lighting shaders:  Schlick's Fresnel, a
+// normalized Phong distribution (the exponent mapped from shininess
+// in 0..1 to 1..8192), and the approximation G/(LN*VN) = 1/(LH*LH).
+//
+// #include "brdf.glsl"
+////////////////////////////////////////////////////////////////////////
+
+const float PI = 3.14159;
+
+vec3 BRDF(vec3 eye, vec3 normal, vec3 light, vec3 dif, vec3 spec, float shiny)
+{
+    float alpha = pow(8192, shiny);
+
+    vec3 V = normalize(eye);
+    vec3 N = normalize(normal);
+    vec3 L = normalize(light);
+    vec3 H = normalize(L+V);
+
+    float HN = max(dot(H,N), 0.0);
+    float LH = max(dot(L,H), 0.0);
+
+    vec3 F = spec + (1.0-spec)*pow(1.0-LH, 5.0);
+    float D = ((alpha+2.0)/(2.0*PI))*pow(HN, alpha);
+    return (F*D)/(4.0*LH*LH) + dif/PI;
+}
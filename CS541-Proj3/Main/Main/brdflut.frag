@@ -0,0 +1,59 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the split-sum BRDF lookup table.  For N.V (u) and
+// perceptual roughness (v), integrates the GGX/Smith specular BRDF
+// over the hemisphere, writing the scale (x) and bias (y) to apply
+// to the Fresnel reflectance F0.  Run once at startup.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+in vec2 uv;
+
+const float PI = 3.14159265;
+const int SAMPLES = 512;
+
+vec2 Hammersley(int i, int n)
+{
+    uint b = uint(i);
+    b = (b << 16u) | (b >> 16u);
+    b = ((b & 0x55555555u) << 1u) | ((b & 0xAAAAAAAAu) >> 1u);
+    b = ((b & 0x33333333u) << 2u) | ((b & 0xCCCCCCCCu) >> 2u);
+    b = ((b & 0x0F0F0F0Fu) << 4u) | ((b & 0xF0F0F0F0u) >> 4u);
+    b = ((b & 0x00FF00FFu) << 8u) | ((b & 0xFF00FF00u) >> 8u);
+    return vec2(float(i)/float(n), float(b)*2.3283064365386963e-10);
+}
+
+// Smith shadowing/masking for one direction, with k chosen for IBL
+float G1(float NX, float k)
+{
+    return NX/(NX*(1.0 - k) + k);
+}
+
+void main()
+{
+    float NV = max(uv.x, 0.001);
+    float a = uv.y*uv.y;
+    float k = a/2.0;
+
+    // Work in tangent space with N = +Z.
+    vec3 V = vec3(sqrt(1.0 - NV*NV), 0.0, NV);
+
+    vec2 result = vec2(0.0);
+    for (int i=0;  i<SAMPLES;  i++) {
+        vec2 xi = Hammersley(i, SAMPLES);
+        float phi = 2.0*PI*xi.x;
+        float cosTheta = sqrt((1.0 - xi.y)/(1.0 + (a*a - 1.0)*xi.y));
+        float sinTheta = sqrt(1.0 - cosTheta*cosTheta);
+        vec3 H = vec3(sinTheta*cos(phi), sinTheta*sin(phi), cosTheta);
+        vec3 L = 2.0*dot(V, H)*H - V;
+
+        float NL = max(L.z, 0.0);
+        float NH = max(H.z, 0.0);
+        float VH = max(dot(V, H), 0.0);
+        if (NL > 0.0) {
+            float G = G1(NV, k)*G1(NL, k);
+            float Gvis = G*VH/(NH*NV);
+            float Fc = pow(1.0 - VH, 5.0);
+            result += vec2((1.0 - Fc)*Gvis, Fc*Gvis); } }
+
+    gl_FragColor = vec4(result/float(SAMPLES), 0.0, 1.0);
+}
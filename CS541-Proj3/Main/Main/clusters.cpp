@@ -0,0 +1,296 @@
+///////////////////////////////////////////////////////////////////////
+// Clustered light culling on the CPU.  See clusters.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <math.h>
+#include <chrono>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "clusters.h"
+#include "jobs.h"
+
+// Texture units holding the cluster buffers (see lighting.frag)
+#define GRID_UNIT  13
+#define INDEX_UNIT 14
+
+// Lights per job when finding their ranges
+#define LIGHT_GRAIN 128
+
+Clusters::Clusters()
+    :dimX(16), dimY(16), dimZ(32), gridBuffer(0), gridTexture(0),
+     indexBuffer(0), indexTexture(0), offsetAlignment(0), front(0.1f), back(1000.0f), binMs(0.0),
+     maxPerCluster(0)
+{
+}
+
+void Clusters::Initialize()
+{
+    // Texture buffer ranges must start at a multiple of this.
+    offsetAlignment = 0;
+    if (glext_ARB_texture_buffer_range)
+        glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+
+    glGenBuffers(1, &gridBuffer);
+    glGenTextures(1, &gridTexture);
+    glGenBuffers(1, &indexBuffer);
+    glGenTextures(1, &indexTexture);
+}
+
+// The depth slice holding a point at the given distance in front of
+// the eye:  slices are spaced exponentially from front to back.
+int Clusters::Slice(const float depth)
+{
+    int z = int(floor(log(depth/front)/log(back/front)*dimZ));
+    return z < 0 ? 0 : (z >= dimZ ? dimZ-1 : z);
+}
+
+// Converts a range of normalized device coordinates to a range of
+// tiles, returning false if it is off screen.
+static bool TileRange(const float ndcMin, const float ndcMax, const int dim,
+                      short& t0, short& t1)
+{
+    if (ndcMax < -1.0f || ndcMin > 1.0f) return false;
+    int a = int(floor(0.5f*(ndcMin + 1.0f)*dim));
+    int b = int(floor(0.5f*(ndcMax + 1.0f)*dim));
+    t0 = a < 0 ? 0 : a;
+    t1 = b >= dim ? dim-1 : b;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Phase one:  the cluster ranges of lights first..last-1.  Each light's
+// sphere is bounded by a view space box, whose projection bounds the
+// tiles;  a sphere reaching in front of the front plane covers all
+// tiles.
+void Clusters::FindRanges(PointLights& lights, MAT4& View, MAT4& Proj,
+                          const int first, const int last)
+{
+    for (int i=first;  i<last;  i++) {
+        vec4 pr = lights.lights[i].positionRadius;
+        float r = pr.w;
+        vec3 v;
+        for (int k=0;  k<3;  k++)
+            v[k] = View[k][0]*pr.x + View[k][1]*pr.y + View[k][2]*pr.z + View[k][3];
+
+        ClusterRange& c = ranges[i];
+        c.z0 = 1;  c.z1 = 0;            // Empty
+        float nearest = -v.z - r, farthest = -v.z + r;
+        if (farthest < front || nearest > back) continue;
+
+        if (nearest <= front) {
+            c.x0 = c.y0 = 0;
+            c.x1 = dimX-1;
+            c.y1 = dimY-1; }
+        else {
+            // Dividing by the extreme depths bounds the projection.
+            float x0 = v.x - r, x1 = v.x + r, y0 = v.y - r, y1 = v.y + r;
+            float ndcX0 = Proj[0][0]*(x0 >= 0.0f ? x0/farthest : x0/nearest);
+            float ndcX1 = Proj[0][0]*(x1 >= 0.0f ? x1/nearest : x1/farthest);
+            float ndcY0 = Proj[1][1]*(y0 >= 0.0f ? y0/farthest : y0/nearest);
+            float ndcY1 = Proj[1][1]*(y1 >= 0.0f ? y1/nearest : y1/farthest);
+            if (!TileRange(ndcX0, ndcX1, dimX, c.x0, c.x1)) continue;
+            if (!TileRange(ndcY0, ndcY1, dimY, c.y0, c.y1)) continue; }
+
+        c.z0 = Slice(nearest > front ? nearest : front);
+        c.z1 = Slice(farthest < back ? farthest : back); }
+}
+
+// Phase two:  count the lights in each cluster of slices z0..z1-1.
+void Clusters::CountSlices(const int z0, const int z1)
+{
+    for (unsigned int i=0;  i<ranges.size();  i++) {
+        const ClusterRange& c = ranges[i];
+        int za = c.z0 > z0 ? c.z0 : z0;
+        int zb = c.z1 < z1-1 ? c.z1 : z1-1;
+        for (int z=za;  z<=zb;  z++)
+            for (int y=c.y0;  y<=c.y1;  y++)
+                for (int x=c.x0;  x<=c.x1;  x++)
+                    counts[(z*dimY + y)*dimX + x]++; }
+}
+
+// Phase three:  write the light indices of the clusters of slices
+// z0..z1-1, at the offsets found by the prefix sum.  The grid's
+// counts were reset to zero, and count back up as indices are added.
+void Clusters::FillSlices(const int z0, const int z1)
+{
+    for (unsigned int i=0;  i<ranges.size();  i++) {
+        const ClusterRange& c = ranges[i];
+        int za = c.z0 > z0 ? c.z0 : z0;
+        int zb = c.z1 < z1-1 ? c.z1 : z1-1;
+        for (int z=za;  z<=zb;  z++)
+            for (int y=c.y0;  y<=c.y1;  y++)
+                for (int x=c.x0;  x<=c.x1;  x++) {
+                    unsigned int* cell = &grid[2*((z*dimY + y)*dimX + x)];
+                    indices[cell[0] + cell[1]++] = i; } }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Bins the lights for the given view, and uploads the results.
+void Clusters::Build(PointLights& lights, MAT4& View, MAT4& Proj,
+                     const float f, const float b, StreamBuffer& stream)
+{
+    Bin(lights, View, Proj, f, b);
+    Upload(stream);
+}
+
+// The CPU part of Build, which makes no OpenGL calls, so may run as a
+// job (see Scene::DrawScene).  Each phase is spread over the job
+// system:  the lights in groups, and the slices one per job.
+void Clusters::Bin(PointLights& lights, MAT4& View, MAT4& Proj,
+                   const float f, const float b)
+{
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+
+    front = f;
+    back = b;
+    int clusterCount = dimX*dimY*dimZ;
+    int lightCount = lights.count;
+    ranges.resize(lightCount);
+    counts.assign(clusterCount, 0);
+    grid.resize(2*clusterCount);
+
+    jobs.ParallelFor(lightCount, LIGHT_GRAIN, [&](int first, int last)
+                     { FindRanges(lights, View, Proj, first, last); });
+    jobs.ParallelFor(dimZ, 1, [&](int z0, int z1) { CountSlices(z0, z1); });
+
+    unsigned int total = 0;
+    maxPerCluster = 0;
+    for (int c=0;  c<clusterCount;  c++) {
+        grid[2*c] = total;
+        grid[2*c+1] = 0;
+        total += counts[c];
+        if (int(counts[c]) > maxPerCluster) maxPerCluster = counts[c]; }
+    indices.resize(total ? total : 1);
+
+    jobs.ParallelFor(dimZ, 1, [&](int z0, int z1) { FillSlices(z0, z1); });
+
+    binMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Sends the most recent binning to the texture buffers:  through the
+// stream buffer (see streambuffer.h), with no synchronization, when
+// texture buffers can be pointed at part of a buffer, or otherwise
+// (or if the stream is full) by respecifying buffers of their own.
+void Clusters::Upload(StreamBuffer& stream)
+{
+    if (offsetAlignment > 0) {
+        int gridBytes = grid.size()*sizeof(unsigned int);
+        int indexBytes = indices.size()*sizeof(unsigned int);
+        int gridOffset = stream.Write(&grid[0], gridBytes, offsetAlignment);
+        int indexOffset = gridOffset < 0 ? -1 : stream.Write(&indices[0], indexBytes, offsetAlignment);
+        if (indexOffset >= 0) {
+            glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+            glTexBufferRange(GL_TEXTURE_BUFFER, GL_RG32UI, stream.buffer, gridOffset, gridBytes);
+            glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+            glTexBufferRange(GL_TEXTURE_BUFFER, GL_R32UI, stream.buffer, indexOffset, indexBytes);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            return; } }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, grid.size()*sizeof(unsigned int), &grid[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, indices.size()*sizeof(unsigned int), &indices[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, gridBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// Makes the clusters available to the lighting shader, which then
+// loops over a cluster's lights instead of all of them.
+void Clusters::Bind(const int program)
+{
+    glActiveTexture(GL_TEXTURE0+GRID_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+    glActiveTexture(GL_TEXTURE0+INDEX_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    SetUnits(program);
+    int loc = glGetUniformLocation(program, "clustered");
+    glUniform1i(loc, 1);
+    loc = glGetUniformLocation(program, "clusterDims");
+    glUniform3i(loc, dimX, dimY, dimZ);
+    loc = glGetUniformLocation(program, "clusterFront");
+    glUniform1f(loc, front);
+    loc = glGetUniformLocation(program, "clusterLogRatio");
+    glUniform1f(loc, log(back/front));
+}
+
+// As EnvProbe::SetUnits, done for every pass to keep the (unsigned
+// integer) buffer samplers off unit 0.
+void Clusters::SetUnits(const int program)
+{
+    int loc = glGetUniformLocation(program, "clusterGrid");
+    glUniform1i(loc, GRID_UNIT);
+    loc = glGetUniformLocation(program, "clusterIndices");
+    glUniform1i(loc, INDEX_UNIT);
+    loc = glGetUniformLocation(program, "clustered");
+    glUniform1i(loc, 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Measures the cost of each lighting path as the number of lights
+// grows from 1 to 10,000, printing the GPU time of each path (and the
+// CPU binning time of the clustered path).  The brute force forward
+// path is skipped for large counts, where it takes seconds per frame.
+void Clusters::Benchmark(Scene& scene)
+{
+    const int counts[5] = { 1, 10, 100, 1000, 10000 };
+    const int warmup = 3, runs = 10;
+    const int maxForward = 1000;
+    int savedCount = scene.pointLights.count;
+    int savedPath = scene.renderPath;
+
+    printf("\nLight scaling benchmark, %dx%d, %dx%dx%d clusters, %d threads\n",
+           scene.width, scene.height, dimX, dimY, dimZ, jobs.threadCount);
+    printf("%7s %11s %11s %11s %11s %9s\n",
+           "lights", "forward ms", "forward+ ms", "bin CPU ms", "deferred ms", "max/clus");
+
+    for (int n=0;  n<5;  n++) {
+        scene.pointLights.Generate(counts[n]);
+        double ms[3] = { -1.0, 0.0, 0.0 };
+        double bin = 0.0;
+
+        for (int path=Scene::FORWARD;  path<=Scene::DEFERRED;  path++) {
+            if (path == Scene::FORWARD && counts[n] > maxForward) continue;
+            scene.renderPath = path;
+            ms[path] = 0.0;
+
+            GpuTimer bench;
+            for (int r=0;  r<warmup+runs;  r++) {
+                scene.stream.BeginFrame();
+                if (path == Scene::CLUSTERED)
+                    Build(scene.pointLights, scene.WorldView, scene.WorldProj,
+                          scene.front, scene.back, scene.stream);
+                bench.Begin();
+                if (path == Scene::DEFERRED) scene.deferred.Draw(scene);
+                else scene.DrawForward();
+                bench.End();
+                scene.stream.EndFrame();
+                double t = bench.Wait();
+                if (r >= warmup) {
+                    ms[path] += t/runs;
+                    if (path == Scene::CLUSTERED) bin += binMs/runs; } } }
+
+        if (ms[Scene::FORWARD] < 0.0)
+            printf("%7d %11s", counts[n], "-");
+        else
+            printf("%7d %11.3f", counts[n], ms[Scene::FORWARD]);
+        printf(" %11.3f %11.3f %11.3f %9d\n", ms[Scene::CLUSTERED], bin,
+               ms[Scene::DEFERRED], maxPerCluster); }
+
+    fflush(stdout);
+    scene.pointLights.Generate(savedCount);
+    scene.renderPath = savedPath;
+}
@@ -0,0 +1,37 @@
+/////////////////////////////////////////////////////////////////////////
+// The sum of the point lights reaching a surface:  all of them, or
+// when clustered, just those binned into the fragment's cluster (see
+// clusters.h).
+//
+// #include "clusters.glsl"
+////////////////////////////////////////////////////////////////////////
+
+#include "pointlights.glsl"
+
+uniform bool clustered;
+uniform usamplerBuffer clusterGrid;     // Per cluster:  offset, count
+uniform usamplerBuffer clusterIndices;
+uniform ivec3 clusterDims;
+uniform float clusterFront, clusterLogRatio;
+uniform int WIDTH, HEIGHT;
+uniform mat4 ViewMatrix;
+
+vec3 PointLighting(vec3 P, vec3 N, vec3 V, vec3 dif, vec3 spec, float shiny)
+{
+    vec3 sum = vec3(0.0);
+    if (!clustered) {
+        for (int i=0;  i<pointLightCount;  i++)
+            sum += PointLight(i, P, N, V, dif, spec, shiny);
+        return sum; }
+
+    float depth = -(ViewMatrix*vec4(P, 1.0)).z;
+    int z = int(floor(log(depth/clusterFront)/clusterLogRatio*float(clusterDims.z)));
+    ivec3 c = clamp(ivec3(int(gl_FragCoord.x)*clusterDims.x/WIDTH,
+                          int(gl_FragCoord.y)*clusterDims.y/HEIGHT, z),
+                    ivec3(0), clusterDims - 1);
+    uvec2 list = texelFetch(clusterGrid, (c.z*clusterDims.y + c.y)*clusterDims.x + c.x).xy;
+    for (uint k=0u;  k<list.y;  k++)
+        sum += PointLight(int(texelFetch(clusterIndices, int(list.x + k)).x),
+                          P, N, V, dif, spec, shiny);
+    return sum;
+}
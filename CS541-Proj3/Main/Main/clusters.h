@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////
+// Clustered light culling for forward rendering ("forward+").  The
+// view frustum is divided into a grid of clusters:  dimX by dimY
+// screen tiles, and dimZ depth slices spaced exponentially between
+// the front and back clipping planes.  Each frame, the point lights
+// are binned into the clusters their spheres overlap, on the CPU
+// and spread across several threads.  The result is two compact
+// arrays, sent to the lighting shader in texture buffers:
+//
+//    grid:     per cluster, the offset and count of its lights
+//              in the index list (RG32UI)
+//    indices:  the light indices of all clusters, back to back (R32UI)
+//
+// so that a fragment loops over only the lights of its own cluster.
+//
+// Binning is done in three phases, each split into jobs (see jobs.h):
+// finding each light's range of clusters (split by lights), counting
+// the lights in each cluster (split by depth slices, so no two
+// threads touch the same cluster), and after a prefix sum of the
+// counts, writing the indices (again split by slices).  Bin does
+// only this CPU work, so it can overlap other drawing;  Upload then
+// sends the results to OpenGL (through the stream buffer, see
+// streambuffer.h, where possible).
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _CLUSTERS_
+#define _CLUSTERS_
+
+#include <vector>
+
+#include "transform.h"
+#include "gputimer.h"
+
+class Scene;
+class PointLights;
+class StreamBuffer;
+
+// The clusters overlapped by one light, as inclusive ranges;  an
+// empty range (z0 > z1) for lights outside the frustum.
+struct ClusterRange
+{
+    short x0, x1, y0, y1, z0, z1;
+};
+
+class Clusters
+{
+public:
+    int dimX, dimY, dimZ;
+
+    // Binning results (see above)
+    std::vector<ClusterRange> ranges;
+    std::vector<unsigned int> grid;     // offset, count pairs
+    std::vector<unsigned int> counts;   // per cluster, for the prefix sum
+    std::vector<unsigned int> indices;
+
+    unsigned int gridBuffer, gridTexture, indexBuffer, indexTexture;
+    int offsetAlignment;    // For texture buffer ranges;  0 if unsupported
+    float front, back;      // Depth range of the slices
+
+    // Statistics
+    double binMs;           // CPU time of the most recent Build
+    int maxPerCluster;
+
+    Clusters();
+    void Initialize();
+    void Build(PointLights& lights, MAT4& View, MAT4& Proj,
+               const float front, const float back, StreamBuffer& stream);
+    void Bin(PointLights& lights, MAT4& View, MAT4& Proj,
+             const float front, const float back);
+    void Upload(StreamBuffer& stream);
+    void Bind(const int program);
+    void SetUnits(const int program);
+    void Benchmark(Scene& scene);
+
+    // Used by the binning jobs
+    void FindRanges(PointLights& lights, MAT4& View, MAT4& Proj,
+                    const int first, const int last);
+    void CountSlices(const int z0, const int z1);
+    void FillSlices(const int z0, const int z1);
+
+private:
+    int Slice(const float depth);
+};
+
+#endif
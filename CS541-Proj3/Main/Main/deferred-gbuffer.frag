@@ -0,0 +1,50 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the G-buffer pass of the deferred path (see
+// deferred.h).  Writes the surface attributes which the lighting
+// passes need, to three render targets:
+//
+//   0:  world space normal, shininess
+//   1:  diffuse color, surface kind (see below)
+//   2:  specular color
+//
+// The surface kind selects the same shading as lighting.frag's
+// variants:  0 lit, 1 direct color, 2 textured ground, 3 central
+// (reflective) model.  The ground's normal is bent by its normal map
+// (see surface.glsl).  Depth goes to the depth attachment.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+#include "material.glsl"
+#include "surface.glsl"
+uniform sampler2D groundTexture;
+
+in vec3 normalVec, lightVec;
+in vec3 eyeVec;
+in vec2 texCoord;
+in vec4 tangent;
+
+layout(location=0) out vec4 gNormal;
+layout(location=1) out vec4 gAlbedo;
+layout(location=2) out vec4 gSpecular;
+
+void main()
+{
+    vec3 N = normalize(normalVec);
+
+#if defined(DIRECT)
+    gAlbedo = vec4(diffuse, 1.0);
+#elif defined(TEXTURED)
+    vec2 uv = 2.0*texCoord.st;
+    vec3 flatN = N;
+    N = SurfaceDetail(uv, N, tangent, normalize(eyeVec));
+    float relief = Relief(flatN, N, normalize(lightVec));
+    gAlbedo = vec4(relief*texture(groundTexture, uv).xyz, 2.0);
+#elif defined(REFLECTIVE)
+    gAlbedo = vec4(diffuse, 3.0);
+#else
+    gAlbedo = vec4(diffuse, 0.0);
+#endif
+
+    gNormal = vec4(N, shininess);
+    gSpecular = vec4(specular, 0.0);
+}
@@ -0,0 +1,42 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the point light pass of the deferred path (see
+// deferred.h).  For each pixel covered by a light's volume, adds
+// that light's contribution to the surface stored in the G-buffer.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+#include "pointlights.glsl"
+
+uniform int WIDTH, HEIGHT;
+uniform mat4 ViewInverse;
+uniform mat4 ViewProjectionInverse;
+
+// G-buffer
+uniform sampler2D gNormal, gAlbedo, gSpecular, gDepth;
+
+flat in int light;
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy/vec2(WIDTH, HEIGHT);
+    float depth = texture(gDepth, uv).x;
+    vec4 albedoKind = texture(gAlbedo, uv);
+    if (depth == 1.0 || int(albedoKind.w + 0.5) == 1) discard;
+
+    vec4 P = ViewProjectionInverse*vec4(2.0*vec3(uv, depth) - 1.0, 1.0);
+    P /= P.w;
+
+    // Skip the G-buffer reads where the light can't reach.
+    vec4 pr = texelFetch(pointLights, 2*light);
+    vec3 L = pr.xyz - P.xyz;
+    if (dot(L, L) >= pr.w*pr.w) discard;
+
+    vec4 normalShininess = texture(gNormal, uv);
+    vec3 N = normalize(normalShininess.xyz);
+    vec3 eye = (ViewInverse*vec4(0,0,0,1)).xyz;
+    vec3 V = normalize(eye - P.xyz);
+    vec3 specular = texture(gSpecular, uv).xyz;
+
+    gl_FragColor = vec4(PointLight(light, P.xyz, N, V, albedoKind.xyz, specular,
+                                   normalShininess.w), 1.0);
+}
@@ -0,0 +1,23 @@
+/////////////////////////////////////////////////////////////////////////
+// Vertex shader for the point light pass of the deferred path (see
+// deferred.h).  Draws one instance of a low resolution unit sphere
+// per light, scaled to enclose the light's radius of influence.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform mat4 ViewMatrix;
+uniform mat4 ProjectionMatrix;
+uniform samplerBuffer pointLights;
+uniform float volumeScale;      // Makes the polygonal sphere enclose the true one
+
+in vec4 vertex;
+
+flat out int light;
+
+void main()
+{
+    light = gl_InstanceID;
+    vec4 pr = texelFetch(pointLights, 2*light);
+    vec3 P = pr.xyz + volumeScale*pr.w*vertex.xyz;
+    gl_Position = ProjectionMatrix*ViewMatrix*vec4(P, 1.0);
+}
@@ -0,0 +1,83 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the full screen pass of the deferred path (see
+// deferred.h).  Reconstructs each pixel's surface from the G-buffer
+// and applies everything except the point lights:  the main light,
+// the SH ambient light (darkened by the ambient occlusion, see
+// ssao.h), and the environment reflection on the central model.
+// Matches the forward shading in lighting.frag.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+#include "brdf.glsl"
+#include "environment.glsl"
+#include "shlighting.glsl"
+#include "ssao.glsl"
+
+uniform mat4 ViewInverse;
+uniform mat4 ViewProjectionInverse;
+
+uniform vec3 lightPos;
+uniform vec3 lightValue;
+
+// G-buffer
+uniform sampler2D gNormal, gAlbedo, gSpecular, gDepth;
+
+// Prefiltered specular (see prefilter.h)
+uniform bool prefiltered;
+uniform samplerCube specularCube;
+uniform sampler2D brdfLUT;
+uniform float specularLevels;
+
+in vec2 uv;
+
+void main()
+{
+    float depth = texture(gDepth, uv).x;
+    if (depth == 1.0) discard;      // Background:  keep the clear color
+
+    vec4 normalShininess = texture(gNormal, uv);
+    vec4 albedoKind = texture(gAlbedo, uv);
+    vec3 specular = texture(gSpecular, uv).xyz;
+    vec3 diffuse = albedoKind.xyz;
+    float shininess = normalShininess.w;
+    int kind = int(albedoKind.w + 0.5);
+
+    if (kind == 1) {
+        gl_FragColor = vec4(diffuse, 1.0);
+        return; }
+
+    vec4 P = ViewProjectionInverse*vec4(2.0*vec3(uv, depth) - 1.0, 1.0);
+    float ao = AmbientOcclusion(1.0/P.w);
+    P /= P.w;
+    vec3 eye = (ViewInverse*vec4(0,0,0,1)).xyz;
+
+    vec3 N = normalize(normalShininess.xyz);
+    vec3 V = normalize(eye - P.xyz);
+    vec3 L = normalize(lightPos - P.xyz);
+    float LN = max(dot(L,N), 0.0);
+
+    // The textured ground is shaded by its BRDF alone, as in the
+    // forward path.
+    if (kind == 2) {
+        gl_FragColor = vec4(ao*BRDF(V, N, L, diffuse, specular, shininess), 1.0);
+        return; }
+
+    vec3 lit = BRDF(V, N, L, diffuse, specular, shininess)*LN*lightValue;
+    if (shEnabled)
+        lit += ao*shStrength*(diffuse/PI)*SHIrradiance(N);
+
+    if (kind == 3) {
+        vec3 R = normalize(2.0*dot(V,N)*N - V);
+        float VN = max(dot(V,N), 0.0);
+        if (prefiltered) {
+            float alpha = pow(8192, shininess);
+            float roughness = sqrt(sqrt(2.0/(alpha+2.0)));
+            vec3 env = textureLod(specularCube, R, roughness*(specularLevels-1.0)).xyz;
+            vec2 ab = texture(brdfLUT, vec2(VN, roughness)).xy;
+            lit += env*(specular*ab.x + ab.y); }
+        else {
+            vec3 F = specular + (1.0-specular)*pow(1.0-VN, 5.0);
+            lit += F*SampleEnvironment(R, 0.0); } }
+
+    gl_FragColor = vec4(lit, 1.0);
+}
@@ -0,0 +1,231 @@
+///////////////////////////////////////////////////////////////////////
+// Deferred shading path.  See deferred.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <math.h>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "deferred.h"
+
+// Texture units used for the G-buffer (see deferred-shade.frag)
+#define NORMAL_UNIT   2
+#define ALBEDO_UNIT   3
+#define SPECULAR_UNIT 4
+#define DEPTH_UNIT    5
+
+// Divisions of the light volume sphere
+#define VOLUME_DIVISIONS 8
+
+Deferred::Deferred()
+    :fbo(0), normalTexture(0), albedoTexture(0), specularTexture(0),
+     depthTexture(0), width(0), height(0), volume(NULL), emptyVao(0)
+{
+}
+
+static void CreateDeferredShader(ShaderProgram& shader, const char* vert, const char* frag)
+{
+    shader.CreateProgram();
+    shader.CreateShader(vert, GL_VERTEX_SHADER);
+    shader.CreateShader(frag, GL_FRAGMENT_SHADER);
+
+    BindAttributeLocations(shader.program);
+
+    shader.LinkProgram();
+}
+
+void Deferred::Initialize()
+{
+    gbufferShader.Create("lighting.vert", "deferred-gbuffer.frag");
+    CreateDeferredShader(shadeShader, "fullscreen.vert", "deferred-shade.frag");
+    CreateDeferredShader(lightShader, "deferred-light.vert", "deferred-light.frag");
+
+    volume = new Sphere(VOLUME_DIVISIONS);
+    glGenVertexArrays(1, &emptyVao);
+}
+
+static unsigned int CreateTexture(const int w, const int h, const unsigned int format,
+                                  const unsigned int components, const unsigned int type)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, components, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+void Deferred::DeleteTargets()
+{
+    if (!fbo) return;
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &normalTexture);
+    glDeleteTextures(1, &albedoTexture);
+    glDeleteTextures(1, &specularTexture);
+    glDeleteTextures(1, &depthTexture);
+    fbo = normalTexture = albedoTexture = specularTexture = depthTexture = 0;
+}
+
+// The G-buffer follows the size of the window.
+void Deferred::CreateTargets(const int w, const int h)
+{
+    DeleteTargets();
+    width = w;
+    height = h;
+
+    normalTexture = CreateTexture(w, h, GL_RGBA16F, GL_RGBA, GL_FLOAT);
+    albedoTexture = CreateTexture(w, h, GL_RGBA16F, GL_RGBA, GL_FLOAT);
+    specularTexture = CreateTexture(w, h, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    depthTexture = CreateTexture(w, h, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normalTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, albedoTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, specularTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+    unsigned int buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, buffers);
+
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("G-buffer FBO Error: %d\n", status);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Deferred::BindTargets(const int program)
+{
+    glActiveTexture(GL_TEXTURE0+NORMAL_UNIT);
+    glBindTexture(GL_TEXTURE_2D, normalTexture);
+    glActiveTexture(GL_TEXTURE0+ALBEDO_UNIT);
+    glBindTexture(GL_TEXTURE_2D, albedoTexture);
+    glActiveTexture(GL_TEXTURE0+SPECULAR_UNIT);
+    glBindTexture(GL_TEXTURE_2D, specularTexture);
+    glActiveTexture(GL_TEXTURE0+DEPTH_UNIT);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    int loc = glGetUniformLocation(program, "gNormal");
+    glUniform1i(loc, NORMAL_UNIT);
+    loc = glGetUniformLocation(program, "gAlbedo");
+    glUniform1i(loc, ALBEDO_UNIT);
+    loc = glGetUniformLocation(program, "gSpecular");
+    glUniform1i(loc, SPECULAR_UNIT);
+    loc = glGetUniformLocation(program, "gDepth");
+    glUniform1i(loc, DEPTH_UNIT);
+}
+
+void Deferred::UnbindTargets()
+{
+    for (int unit=NORMAL_UNIT;  unit<=DEPTH_UNIT;  unit++) {
+        glActiveTexture(GL_TEXTURE0+unit);
+        glBindTexture(GL_TEXTURE_2D, 0); }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Draws the frame (replacing the forward lighting pass).  The probe
+// has already been rendered.
+void Deferred::Draw(Scene& scene)
+{
+    if (scene.width != width || scene.height != height)
+        CreateTargets(scene.width, scene.height);
+
+    MAT4 ViewProjInverse = (scene.WorldProj*scene.WorldView).inverse();
+
+    ///////////////////////////////////////////////////////////////////
+    // G-buffer pass
+    gbufferTimer.Begin();
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    scene.SetupVariants(gbufferShader, scene.WorldView, scene.WorldProj);
+    scene.DrawEnvironment(gbufferShader, NULL, scene.CameraHiZ());
+    scene.DrawCentralModel(gbufferShader);
+    gbufferShader.Unuse();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, scene.outputFbo);
+    gbufferTimer.End();
+
+    // Ambient occlusion, from the G-buffer's depth and normals
+    scene.ssao.Compute(scene, depthTexture, normalTexture);
+    glBindFramebuffer(GL_FRAMEBUFFER, scene.outputFbo);
+
+    ///////////////////////////////////////////////////////////////////
+    // Shade pass:  everything but the point lights
+    shadeTimer.Begin();
+    glViewport(0, 0, width, height);
+    glClearColor(0.5, 0.5, 0.5, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+
+    shadeShader.Use();
+    int program = shadeShader.program;
+    scene.SetupProgram(program, scene.WorldView, scene.WorldProj);
+    int loc = glGetUniformLocation(program, "ViewProjectionInverse");
+    glUniformMatrix4fv(loc, 1, GL_TRUE, ViewProjInverse.Pntr());
+    scene.probe.Bind(program);
+    scene.prefilter.Bind(program);
+    scene.ssao.Bind(program);
+    BindTargets(program);
+
+    glBindVertexArray(emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    scene.ssao.Unbind();
+    scene.prefilter.Unbind();
+    scene.probe.Unbind();
+    shadeShader.Unuse();
+    shadeTimer.End();
+
+    ///////////////////////////////////////////////////////////////////
+    // Light pass:  one volume per point light, added in.  Drawing
+    // only the back faces (without depth testing) covers each pixel
+    // once per light, whether or not the eye is inside the volume.
+    lightTimer.Begin();
+    if (scene.pointLights.count > 0) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+
+        lightShader.Use();
+        program = lightShader.program;
+        scene.SetupProgram(program, scene.WorldView, scene.WorldProj);
+        loc = glGetUniformLocation(program, "ViewProjectionInverse");
+        glUniformMatrix4fv(loc, 1, GL_TRUE, ViewProjInverse.Pntr());
+        // The polygonal sphere's faces lie inside the unit sphere.
+        loc = glGetUniformLocation(program, "volumeScale");
+        glUniform1f(loc, 1.0f/(cos(3.14159f/(2*VOLUME_DIVISIONS))*cos(3.14159f/VOLUME_DIVISIONS)));
+        scene.pointLights.Bind(program);
+        BindTargets(program);
+
+        glBindVertexArray(volume->vao);
+        glDrawElementsInstanced(GL_QUADS, volume->shape*volume->count, GL_UNSIGNED_INT,
+                                0, scene.pointLights.count);
+        drawStats.drawCalls++;
+        drawStats.triangles += 2LL*volume->count*scene.pointLights.count;
+        glBindVertexArray(0);
+
+        lightShader.Unuse();
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND); }
+    lightTimer.End();
+
+    UnbindTargets();
+    glEnable(GL_DEPTH_TEST);
+}
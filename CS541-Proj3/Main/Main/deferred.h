@@ -0,0 +1,54 @@
+///////////////////////////////////////////////////////////////////////
+// Deferred shading path, as an alternative to the forward lighting
+// pass (which evaluates every light for every fragment drawn).  The
+// frame is drawn in three passes:
+//
+//   G-buffer:   the scene is drawn once, storing each pixel's normal,
+//               material and depth into a multiple render target FBO
+//               (see deferred-gbuffer.frag).
+//   Shade:      one full screen pass applies the main light, ambient
+//               light and reflections (deferred-shade.frag).
+//   Lights:     each point light draws an instanced sphere enclosing
+//               its radius, adding its contribution to just the
+//               pixels it covers (deferred-light.vert/frag).
+//
+// Each pass is timed separately, for comparison against the forward
+// path's single pass as the number of lights grows.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _DEFERRED_
+#define _DEFERRED_
+
+#include "shader.h"
+#include "gputimer.h"
+
+class Scene;
+class Model;
+
+class Deferred
+{
+public:
+    // G-buffer targets (see deferred-gbuffer.frag) and depth
+    unsigned int fbo;
+    unsigned int normalTexture, albedoTexture, specularTexture, depthTexture;
+    int width, height;
+
+    ShaderVariants gbufferShader;
+    ShaderProgram shadeShader, lightShader;
+    Model* volume;          // Unit sphere drawn around each light
+    unsigned int emptyVao;
+
+    GpuTimer gbufferTimer, shadeTimer, lightTimer;
+
+    Deferred();
+    void Initialize();
+    void Draw(Scene& scene);
+
+private:
+    void CreateTargets(const int w, const int h);
+    void DeleteTargets();
+    void BindTargets(const int program);
+    void UnbindTargets();
+};
+
+#endif
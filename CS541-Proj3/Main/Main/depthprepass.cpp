@@ -0,0 +1,222 @@
+///////////////////////////////////////////////////////////////////////
+// Depth prepass for the forward lighting pass.  See depthprepass.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "depthprepass.h"
+
+DepthPrepass::DepthPrepass()
+    :enabled(false), showOverdraw(false), maxCount(6.0f), fragmentsPerPixel(0.0f), copied(false),
+     countFbo(0), countTexture(0), countDepth(0), width(0), height(0), emptyVao(0),
+     current(0), prepassed(false)
+{
+    queries[0] = 0;
+}
+
+void DepthPrepass::Initialize()
+{
+    int terrain = 1<<ShaderVariants::TERRAIN;
+    depthShader.Create("occluder.vert", "occluder.frag", terrain);
+    overdrawShader.Create("occluder.vert", "overdraw.frag", terrain);
+    showShader.CreateProgram();
+    showShader.CreateShader("fullscreen.vert", GL_VERTEX_SHADER);
+    showShader.CreateShader("overdraw-show.frag", GL_FRAGMENT_SHADER);
+    showShader.LinkProgram();
+    glGenVertexArrays(1, &emptyVao);
+}
+
+// The overdraw view's count target, with its own depth.
+void DepthPrepass::CreateTarget(const int w, const int h)
+{
+    if (countFbo) {
+        glDeleteFramebuffers(1, &countFbo);
+        glDeleteTextures(1, &countTexture);
+        glDeleteRenderbuffers(1, &countDepth); }
+    width = w;
+    height = h;
+
+    glGenTextures(1, &countTexture);
+    glBindTexture(GL_TEXTURE_2D, countTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, w, h, 0, GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &countDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, countDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &countFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, countFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, countTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, countDepth);
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("Overdraw FBO Error: %d\n", status);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// The lighting pass's nodes, depth only, into the bound framebuffer.
+void DepthPrepass::DrawDepth(Scene& scene)
+{
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    scene.SetupVariants(depthShader, scene.WorldView, scene.WorldProj);
+    scene.DrawEnvironment(depthShader, NULL, scene.CameraHiZ());
+    scene.DrawCentralModel(depthShader);
+    depthShader.Unuse();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// Whether this frame's SSAO prepass depth can be copied into the
+// bound framebuffer:  a blit of depth needs both single sampled, and
+// of the same format (the SSAO prepass's is 24 bits, no stencil).
+// The window's depth buffer may report those and still differ, so is
+// never copied into.
+bool DepthPrepass::CanCopyDepth(Scene& scene)
+{
+    if (!scene.ssao.prepassDrawn || scene.ssao.width != scene.width
+        || scene.ssao.height != scene.height || scene.outputFbo == 0)
+        return false;
+
+    int sampleBuffers, depthBits, stencilBits;
+    glGetIntegerv(GL_SAMPLE_BUFFERS, &sampleBuffers);
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                          GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                          GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+    return sampleBuffers == 0 && depthBits == 24 && stencilBits == 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+// The prepass, into the lighting pass's framebuffer (bound, and
+// cleared, by DrawForward):  copied from the SSAO prepass where
+// possible, else drawn.
+void DepthPrepass::Draw(Scene& scene)
+{
+    prepassed = enabled;
+    copied = false;
+    if (!enabled) return;
+
+    timer.Begin();
+    if (CanCopyDepth(scene)) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, scene.ssao.prepassFbo);
+        glBlitFramebuffer(0, 0, scene.width, scene.height, 0, 0, scene.width, scene.height,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, scene.outputFbo);
+        copied = true; }
+    else
+        DrawDepth(scene);
+    timer.End();
+}
+
+// Reads one query's result, if it has arrived, into fragmentsPerPixel
+// (or waits for it, if its slot is about to be reused).
+void DepthPrepass::Collect(const int slot)
+{
+    if (!pending[slot]) return;
+
+    if (slot != current) {
+        int available = 0;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return; }
+
+    GLuint64 samples;
+    glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &samples);
+    pending[slot] = false;
+
+    float f = float(samples)/pixels[slot];
+    fragmentsPerPixel = fragmentsPerPixel==0.0f ? f : 0.9f*fragmentsPerPixel + 0.1f*f;
+}
+
+// Around the lighting pass's draws:  the depth test against the
+// prepass, and the count of fragments shaded.
+void DepthPrepass::BeginLighting()
+{
+    // Lazily create the queries on first use.
+    if (queries[0] == 0) {
+        glGenQueries(PREPASS_LATENCY, queries);
+        for (int i=0;  i<PREPASS_LATENCY;  i++)
+            pending[i] = false; }
+
+    Collect(current);
+    glBeginQuery(GL_SAMPLES_PASSED, queries[current]);
+
+    if (prepassed) {
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE); }
+}
+
+void DepthPrepass::EndLighting(Scene& scene)
+{
+    glEndQuery(GL_SAMPLES_PASSED);
+    int samples = scene.antialias.active == Antialias::MSAA ? scene.antialias.msaaTarget.samples : 1;
+    pixels[current] = float(scene.width)*scene.height*samples;
+    pending[current] = true;
+    current = (current+1)%PREPASS_LATENCY;
+    for (int i=0;  i<PREPASS_LATENCY;  i++)
+        if (i != current) Collect(i);
+
+    if (prepassed) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE); }
+    prepassed = false;
+}
+
+////////////////////////////////////////////////////////////////////////
+// The overdraw view, over the output:  the lighting pass's draws
+// repeated, each fragment adding one to its pixel's count, which is
+// then shown as a heat map.
+void DepthPrepass::DrawOverdraw(Scene& scene)
+{
+    if (!showOverdraw || scene.renderPath == Scene::DEFERRED)
+        return;
+    if (scene.width != width || scene.height != height)
+        CreateTarget(scene.width, scene.height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, countFbo);
+    glViewport(0, 0, width, height);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (enabled) {
+        DrawDepth(scene);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE); }
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    scene.SetupVariants(overdrawShader, scene.WorldView, scene.WorldProj);
+    scene.DrawEnvironment(overdrawShader, NULL, scene.CameraHiZ());
+    scene.DrawCentralModel(overdrawShader);
+    overdrawShader.Unuse();
+    glDisable(GL_BLEND);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+
+    // The heat map
+    glBindFramebuffer(GL_FRAMEBUFFER, scene.outputFbo);
+    glViewport(0, 0, scene.width, scene.height);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(emptyVao);
+    showShader.Use();
+    int program = showShader.program;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, countTexture);
+    int loc = glGetUniformLocation(program, "counts");
+    glUniform1i(loc, 0);
+    loc = glGetUniformLocation(program, "maxCount");
+    glUniform1f(loc, maxCount);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    showShader.Unuse();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
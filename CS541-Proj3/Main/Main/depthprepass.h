@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////
+// Depth prepass for the forward lighting pass:  the lighting shader's
+// BRDF is costly, and where the central model, the ring of spheres and
+// the ground overlap, fragments which are later hidden are shaded
+// anyway.  With the prepass on, the same nodes are first drawn depth
+// only (occluder.vert/frag:  positions only, no color), and the
+// lighting pass then tests GL_EQUAL against that depth without writing
+// it, so each pixel is shaded once.  Both vertex shaders declare
+// gl_Position invariant, so their depths are equal to the bit.
+//
+// With the ambient occlusion on, its prepass (see ssao.h) has already
+// drawn the same depth, so that is copied into the lighting pass's
+// target instead of being drawn a third time.  A copy needs matching
+// depth buffers:  the HDR, TAA and dynamic resolution targets match
+// the SSAO one, while into the window's own framebuffer (whose depth
+// format is the window system's) and the MSAA target the depth is
+// drawn as without SSAO.
+//
+// The lighting pass's shaded fragments are counted with a samples
+// passed query (read a few frames late, so never stalling), giving
+// fragmentsPerPixel:  near 1 with the prepass, the overdraw without.
+// With MSAA the count is of samples, so is divided by the samples per
+// pixel.
+//
+// showOverdraw draws, over the frame, the count at each pixel as a
+// heat map:  the lighting pass's nodes drawn again, just as the
+// lighting pass draws them (with or without the prepass), into a
+// count target with additive blending.
+//
+// The deferred path shades each pixel once already (its G-buffer pass
+// is cheap), so the prepass is for the forward paths only.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _DEPTHPREPASS_
+#define _DEPTHPREPASS_
+
+#include "shader.h"
+#include "gputimer.h"
+
+#define PREPASS_LATENCY 4
+
+class Scene;
+
+class DepthPrepass
+{
+public:
+    // User controllable parameters
+    bool enabled;
+    bool showOverdraw;
+    float maxCount;         // Red in the overdraw view
+
+    float fragmentsPerPixel;    // Smoothed, as GpuTimer's averageMs
+    bool copied;            // This frame's depth was the SSAO prepass's
+
+    ShaderVariants depthShader, overdrawShader;
+    ShaderProgram showShader;
+    unsigned int countFbo, countTexture, countDepth;
+    int width, height;      // Of the count target
+    unsigned int emptyVao;
+
+    GpuTimer timer;
+
+    DepthPrepass();
+    void Initialize();
+    void Draw(Scene& scene);
+    void BeginLighting();
+    void EndLighting(Scene& scene);
+    void DrawOverdraw(Scene& scene);
+
+private:
+    unsigned int queries[PREPASS_LATENCY];
+    bool pending[PREPASS_LATENCY];
+    float pixels[PREPASS_LATENCY];      // Counted by each query
+    int current;
+    bool prepassed;         // This frame's lighting pass tests GL_EQUAL
+
+    void DrawDepth(Scene& scene);
+    bool CanCopyDepth(Scene& scene);
+    void Collect(const int slot);
+    void CreateTarget(const int w, const int h);
+};
+
+#endif
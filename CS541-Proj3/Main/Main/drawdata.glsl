@@ -0,0 +1,42 @@
+/////////////////////////////////////////////////////////////////////////
+// The per-object values of a draw, for the vertex shaders.  Normally
+// uniforms, set before each object is drawn.  In the INDIRECT
+// variants (the multi-draw path, see megabuffer.h) they are fetched
+// instead from the drawData texture buffer, at the record chosen by
+// the drawID attribute, and the material is passed on to the pixel
+// shader (see material.glsl).  Call FetchDrawData first thing in
+// main.
+//
+// #include "drawdata.glsl"
+////////////////////////////////////////////////////////////////////////
+
+#ifdef INDIRECT
+
+uniform samplerBuffer drawData;
+in uint drawID;
+
+mat4 ModelMatrix, NormalMatrix;
+flat out vec3 diffuse, specular;
+flat out float shininess;
+
+void FetchDrawData()
+{
+    int r = 8*int(drawID);
+    ModelMatrix = transpose(mat4(texelFetch(drawData, r), texelFetch(drawData, r+1),
+                                 texelFetch(drawData, r+2), vec4(0, 0, 0, 1)));
+    NormalMatrix = mat4(texelFetch(drawData, r+3), texelFetch(drawData, r+4),
+                        texelFetch(drawData, r+5), vec4(0, 0, 0, 1));
+    vec4 d = texelFetch(drawData, r+6);
+    diffuse = d.rgb;
+    shininess = d.a;
+    specular = texelFetch(drawData, r+7).rgb;
+}
+
+#else
+
+uniform mat4 ModelMatrix;
+uniform mat4 NormalMatrix;
+
+void FetchDrawData() {}
+
+#endif
@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////
+// Dynamic resolution scaling.  See dynamicresolution.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <algorithm>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "dynamicresolution.h"
+
+// The fraction of the way to the wanted scale moved each frame
+#define SCALE_GAIN 0.1f
+
+DynamicResolution::DynamicResolution()
+    :enabled(false), targetMs(16.7f), minScale(0.5f), maxScale(1.0f), sharpness(0.5f),
+     probeQuality(2), desired(1.0f), scale(1.0f), width(0), height(0), fbo(0), texture(0),
+     depthBuffer(0), targetWidth(0), targetHeight(0), emptyVao(0)
+{
+}
+
+void DynamicResolution::Initialize(Scene& scene)
+{
+    upscaleShader.CreateProgram();
+    upscaleShader.CreateShader("fullscreen.vert", GL_VERTEX_SHADER);
+    upscaleShader.CreateShader("upscale.frag", GL_FRAGMENT_SHADER);
+    upscaleShader.LinkProgram();
+    glGenVertexArrays(1, &emptyVao);
+    probeQuality = scene.probe.quality;
+}
+
+// The offscreen target, with its depth (for the lighting pass, when
+// it is drawn into directly).
+void DynamicResolution::CreateTarget(const int w, const int h)
+{
+    if (fbo) {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &texture);
+        glDeleteRenderbuffers(1, &depthBuffer); }
+    targetWidth = w;
+    targetHeight = h;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("Dynamic resolution FBO Error: %d\n", status);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Chooses this frame's scale (and probe quality) from the frames
+// timed so far, and starts timing this one.
+void DynamicResolution::BeginFrame(Scene& scene)
+{
+    if (enabled && frameTimer.ms > 0.0) {
+        float wanted = scale*sqrtf(targetMs/float(frameTimer.ms));
+        wanted = std::max(minScale, std::min(wanted, maxScale));
+        desired += SCALE_GAIN*(wanted - desired);
+        if (fabsf(desired - scale) > 0.75f/SCALE_STEPS)
+            scale = floorf(desired*SCALE_STEPS + 0.5f)/SCALE_STEPS; }
+    else if (!enabled)
+        desired = scale = 1.0f;
+    scale = std::max(minScale, std::min(scale, std::min(maxScale, 1.0f)));
+
+    int drop = scale < 10.0f/SCALE_STEPS ? 2 : scale < 13.0f/SCALE_STEPS ? 1 : 0;
+    scene.probe.SetQuality(std::max(0, probeQuality - drop));
+
+    width = std::max(1, int(scene.width*scale + 0.5f));
+    height = std::max(1, int(scene.height*scale + 0.5f));
+    frameTimer.Begin();
+}
+
+// The framebuffer the frame is drawn into, at width by height, when
+// Scaled.
+unsigned int DynamicResolution::Target()
+{
+    if (width != targetWidth || height != targetHeight)
+        CreateTarget(width, height);
+    return fbo;
+}
+
+// Upscales the frame into the scene's output (at the scene's size),
+// sharpening as it goes.
+void DynamicResolution::Upscale(Scene& scene)
+{
+    if (!Scaled()) return;
+
+    upscaleTimer.Begin();
+    glBindFramebuffer(GL_FRAMEBUFFER, scene.outputFbo);
+    glViewport(0, 0, scene.width, scene.height);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(emptyVao);
+
+    upscaleShader.Use();
+    int program = upscaleShader.program;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    int loc = glGetUniformLocation(program, "source");
+    glUniform1i(loc, 0);
+    loc = glGetUniformLocation(program, "sourceTexel");
+    glUniform2f(loc, 1.0f/targetWidth, 1.0f/targetHeight);
+    loc = glGetUniformLocation(program, "sharpness");
+    glUniform1f(loc, sharpness);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    upscaleShader.Unuse();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    upscaleTimer.End();
+}
+
+void DynamicResolution::EndFrame()
+{
+    frameTimer.End();
+}
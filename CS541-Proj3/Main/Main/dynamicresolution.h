@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////
+// Dynamic resolution:  the frame is drawn at scale times the window's
+// width and height, into an offscreen target, and upscaled into the
+// output with a sharpening filter (a contrast adaptive one, after
+// AMD's CAS, which sharpens less where the neighborhood already has
+// contrast, so edges do not ring).
+//
+// The scale is chosen by a controller from the GPU time of the whole
+// frame (a timestamp query, see gputimer.h) against targetMs.  Since
+// the time of the pixel work goes with the square of the scale, the
+// scale wanted is the current one times sqrt(targetMs/ms);  the
+// controller moves towards it by a fraction each frame, to ride out
+// the timer's latency and noise.  The scale drawn at is that, rounded
+// to steps of 1/SCALE_STEPS, changing only when it is most of a step
+// away:  each change reallocates the size dependent targets (the
+// G-buffer, the HDR and anti-aliasing targets, ...), so it should
+// happen when the load changes, not every frame.
+//
+// The same controller sets the reflection probe's quality (see
+// envprobe.h):  probeQuality at full scale, one level less below
+// 13/16, two below 5/8.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _DYNAMICRESOLUTION_
+#define _DYNAMICRESOLUTION_
+
+#include "shader.h"
+#include "gputimer.h"
+
+#define SCALE_STEPS 16
+
+class Scene;
+
+class DynamicResolution
+{
+public:
+    // User controllable parameters
+    bool enabled;
+    float targetMs;         // GPU time per frame aimed for
+    float minScale, maxScale;
+    float sharpness;        // Of the upscale, 0..1
+    int probeQuality;       // The probe's, at full scale
+
+    float desired;          // The controller's scale, unrounded
+    float scale;            // Drawn at this frame
+    int width, height;      // Drawn at this frame
+
+    unsigned int fbo, texture, depthBuffer;
+    int targetWidth, targetHeight;
+    ShaderProgram upscaleShader;
+    unsigned int emptyVao;
+
+    GpuTimer frameTimer, upscaleTimer;
+
+    DynamicResolution();
+    void Initialize(Scene& scene);
+    void BeginFrame(Scene& scene);
+    bool Scaled() const { return scale < 1.0f; }
+    unsigned int Target();
+    void Upscale(Scene& scene);
+    void EndFrame();
+
+private:
+    void CreateTarget(const int w, const int h);
+};
+
+#endif
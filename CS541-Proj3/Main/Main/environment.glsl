@@ -0,0 +1,36 @@
+/////////////////////////////////////////////////////////////////////////
+// Lookups into the environment probe (see envprobe.h), in whichever
+// representation it currently holds.
+//
+// #include "environment.glsl"
+////////////////////////////////////////////////////////////////////////
+
+uniform int probeType;          // 0: paraboloid, 1: cube, 2: octahedral
+uniform sampler2D topReflectionTexture;
+uniform sampler2D bottomReflectionTexture;
+uniform samplerCube envCube;
+uniform sampler2D envOcta;
+
+// Octahedral mapping of a direction to texture coordinates (the
+// inverse of OctDecode in envprobe-octa.frag).
+vec2 OctEncode(vec3 d)
+{
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    vec2 e = d.xy;
+    if (d.z < 0.0)
+        e = (1.0 - abs(d.yx))*vec2(d.x>=0.0 ? 1.0 : -1.0, d.y>=0.0 ? 1.0 : -1.0);
+    return 0.5*e + 0.5;
+}
+
+// The environment in direction R (normalized), from MIP level lod.
+vec3 SampleEnvironment(vec3 R, float lod)
+{
+    if (probeType == 1)
+        return textureLod(envCube, R, lod).xyz;
+    else if (probeType == 2)
+        return textureLod(envOcta, OctEncode(R), lod).xyz;
+    else if (R.z >= 0.0)
+        return textureLod(topReflectionTexture, 0.5*(R.xy/(1.0+R.z)) + 0.5, lod).xyz;
+    else
+        return textureLod(bottomReflectionTexture, 0.5*(R.xy/(1.0-R.z)) + 0.5, lod).xyz;
+}
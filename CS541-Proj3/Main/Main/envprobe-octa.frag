@@ -0,0 +1,24 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for resampling the probe's cube map into an
+// octahedral map.  OctDecode must be the inverse of OctEncode in
+// environment.glsl, which reads the map.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform samplerCube envCube;
+
+in vec2 uv;
+
+vec3 OctDecode(vec2 t)
+{
+    vec2 e = 2.0*t - 1.0;
+    vec3 d = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (d.z < 0.0)
+        d.xy = (1.0 - abs(d.yx))*vec2(d.x>=0.0 ? 1.0 : -1.0, d.y>=0.0 ? 1.0 : -1.0);
+    return normalize(d);
+}
+
+void main()
+{
+    gl_FragColor = textureLod(envCube, OctDecode(uv), 0.0);
+}
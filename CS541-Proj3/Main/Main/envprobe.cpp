@@ -0,0 +1,505 @@
+///////////////////////////////////////////////////////////////////////
+// An environment probe capturing the scene around the center of
+// reflection as paraboloid, cube or octahedral maps.  See envprobe.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <vector>
+#include <math.h>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "envprobe.h"
+#include "jobs.h"
+
+// Texture units used by the probe (see lighting.frag)
+#define TOP_UNIT    6
+#define BOTTOM_UNIT 7
+#define CUBE_UNIT   8
+#define OCTA_UNIT   9
+
+const float PI = 3.14159f;
+
+// Viewing direction and up vector for the six cube faces, in the
+// order (and orientation) OpenGL expects them.
+static const vec3 faceDir[6] = { vec3( 1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0),
+                                 vec3( 0,-1, 0), vec3( 0, 0, 1), vec3(0, 0,-1) };
+static const vec3 faceUp[6]  = { vec3( 0,-1, 0), vec3( 0,-1, 0), vec3(0, 0, 1),
+                                 vec3( 0, 0,-1), vec3( 0,-1, 0), vec3(0,-1, 0) };
+
+EnvProbe::EnvProbe()
+    :type(PARABOLOID), quality(2), faceCulling(true), updateInterval(1),
+     center(0.0f, 0.0f, 0.0f), cubeFbo(0), cubeTexture(0), cubeDepth(0),
+     cubeSize(0), emptyVao(0), updated(false), mipmapped(false), frame(0), drawCount(0)
+{
+}
+
+// A paraboloid map of size PxP is the reference;  the quality levels
+// correspond to P = 256, 512 and 1024.
+int EnvProbe::TexelBudget(const int q)
+{
+    int p = 256<<q;
+    return 2*p*p;
+}
+
+// The edge length of one map (or cube face) of type t which fits in
+// the texel budget of quality q.
+int EnvProbe::MapSize(const int t, const int q)
+{
+    int budget = TexelBudget(q);
+    if (t==PARABOLOID) return int(sqrt(budget/2.0) + 0.5);
+    else if (t==CUBE)  return int(sqrt(budget/6.0) + 0.5);
+    else               return int(sqrt(float(budget)) + 0.5);
+}
+
+static void CreateProbeShader(ShaderProgram& shader, const char* vert, const char* frag)
+{
+    shader.CreateProgram();
+    shader.CreateShader(vert, GL_VERTEX_SHADER);
+    shader.CreateShader(frag, GL_FRAGMENT_SHADER);
+
+    BindAttributeLocations(shader.program);
+
+    shader.LinkProgram();
+}
+
+// Creates the shaders and the render targets for the current type.
+void EnvProbe::Initialize()
+{
+    // Nothing in the probe reflects, so no REFLECTIVE variants.
+    const int variants = (1<<ShaderVariants::TEXTURED) | (1<<ShaderVariants::DIRECT)
+                         | (1<<ShaderVariants::TERRAIN);
+    topShader.Create("lighting-pass1-topReflection.vert",
+                     "lighting-pass1-topReflection.frag", variants);
+    bottomShader.Create("lighting-pass1-bottomReflection.vert",
+                        "lighting-pass1-bottomReflection.frag", variants);
+    CreateProbeShader(octaShader, "fullscreen.vert", "envprobe-octa.frag");
+
+    // A fullscreen triangle is generated from gl_VertexID, but a core
+    // profile still requires some VAO to be bound.
+    glGenVertexArrays(1, &emptyVao);
+
+    CreateTargets();
+}
+
+void EnvProbe::SetType(const int t)
+{
+    if (t == type) return;
+    type = t;
+    CreateTargets();
+}
+
+void EnvProbe::SetQuality(const int q)
+{
+    if (q == quality) return;
+    quality = q;
+    CreateTargets();
+}
+
+void EnvProbe::DeleteTargets()
+{
+    topTarget.DeleteFBO();
+    bottomTarget.DeleteFBO();
+    octaTarget.DeleteFBO();
+
+    if (cubeFbo) {
+        glDeleteFramebuffers(1, &cubeFbo);
+        glDeleteRenderbuffers(1, &cubeDepth);
+        glDeleteTextures(1, &cubeTexture);
+        cubeFbo = cubeDepth = cubeTexture = 0; }
+}
+
+// Only the targets needed by the current type are kept, so that the
+// memory in use is that of one representation (for the octahedral
+// map, with its source cube map).  All use RGBA16F.
+void EnvProbe::CreateTargets()
+{
+    DeleteTargets();
+    int size = MapSize(type, quality);
+
+    if (type == PARABOLOID) {
+        topTarget.CreateFBO(size, size, GL_RGBA16F);
+        bottomTarget.CreateFBO(size, size, GL_RGBA16F);
+        return; }
+
+    // The octahedral map is resampled from a cube map of matching
+    // angular resolution.
+    cubeSize = MapSize(CUBE, quality);
+
+    glGenTextures(1, &cubeTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+    for (int f=0;  f<6;  f++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+f, 0, GL_RGBA16F,
+                     cubeSize, cubeSize, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    glGenRenderbuffers(1, &cubeDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, cubeDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, cubeSize, cubeSize);
+
+    glGenFramebuffers(1, &cubeFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, cubeFbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, cubeDepth);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_CUBE_MAP_POSITIVE_X, cubeTexture, 0);
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("Cube FBO Error: %d\n", status);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (type == OCTAHEDRAL)
+        octaTarget.CreateFBO(size, size, GL_RGBA16F);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Paraboloid pass:  the vertex shader does the projection, so the
+// whole environment is drawn without culling.
+void EnvProbe::RenderParaboloid(Scene& scene, ShaderVariants& shader, FBO& target)
+{
+    target.Bind();
+    glViewport(0, 0, target.width, target.height);
+    glClearColor(0.5, 0.5, 0.5, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    scene.SetupVariants(shader, scene.WorldView, scene.WorldProj);
+    drawCount += scene.DrawEnvironment(shader, NULL);
+    shader.Unuse();
+
+    target.Unbind();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Cube pass:  six 90 degree views from the center, each drawing only
+// the objects which intersect that face's frustum.  The six faces
+// are culled together, across the job system, and then drawn.
+void EnvProbe::RenderCube(Scene& scene)
+{
+    MAT4 FaceProj = Perspective(1.0f, 1.0f, scene.front, scene.back);
+    MAT4 FaceView[6];
+    Frustum frustum[6];
+    for (int f=0;  f<6;  f++) {
+        FaceView[f] = LookAt(center, center+faceDir[f], faceUp[f]);
+        frustum[f].FromMatrix(FaceProj*FaceView[f]); }
+
+    // Each face's occluders (the central model is not drawn in the
+    // faces, so is not one), see occlusion.h
+    Occlusion& occlusion = scene.occlusion;
+    if (occlusion.enabled)
+        for (int f=0;  f<6;  f++)
+            occlusion.Build(scene, occlusion.faces[f], FaceView[f], FaceProj,
+                            cubeSize, cubeSize, SceneGraph::ENVIRONMENT);
+
+    jobs.ParallelFor(6, 1, [&](int f0, int f1)
+    {
+        for (int f=f0;  f<f1;  f++)
+            scene.graph.Cull(faceCulling ? &frustum[f] : NULL, SceneGraph::ENVIRONMENT,
+                             faceLists[f], occlusion.enabled ? &occlusion.faces[f] : NULL);
+    });
+    for (int f=0;  f<6;  f++) {
+        occlusion.faceOccluded += faceLists[f].occluded;
+        occlusion.faceTested += faceLists[f].nodes.size() + faceLists[f].occluded; }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, cubeFbo);
+    glViewport(0, 0, cubeSize, cubeSize);
+    glClearColor(0.5, 0.5, 0.5, 1.0);
+
+    for (int f=0;  f<6;  f++) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_CUBE_MAP_POSITIVE_X+f, cubeTexture, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        scene.SetupVariants(scene.lightingShader, FaceView[f], FaceProj);
+        drawCount += scene.DrawNodes(scene.lightingShader, faceLists[f].nodes); }
+    scene.lightingShader.Unuse();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Octahedral pass:  render the cube map, then resample it into the
+// octahedral layout with a single fullscreen triangle.
+void EnvProbe::RenderOctahedral(Scene& scene)
+{
+    RenderCube(scene);
+    Resample();
+}
+
+void EnvProbe::Resample()
+{
+    octaTarget.Bind();
+    glViewport(0, 0, octaTarget.width, octaTarget.height);
+    glDisable(GL_DEPTH_TEST);
+
+    octaShader.Use();
+    glActiveTexture(GL_TEXTURE0+CUBE_UNIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+    int loc = glGetUniformLocation(octaShader.program, "envCube");
+    glUniform1i(loc, CUBE_UNIT);
+
+    glBindVertexArray(emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    octaShader.Unuse();
+
+    glEnable(GL_DEPTH_TEST);
+    octaTarget.Unbind();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Called once per frame, before the lighting pass.  The probe is
+// re-rendered only every updateInterval frames.
+void EnvProbe::Render(Scene& scene)
+{
+    if (updateInterval < 1) updateInterval = 1;
+    updated = frame++ % updateInterval == 0;
+    if (!updated) return;
+    mipmapped = false;
+
+    // Make sure none of the probe's own textures are bound while
+    // rendering into them.
+    Unbind();
+
+    timer.Begin();
+    drawCount = 0;
+    if (type == PARABOLOID) {
+        RenderParaboloid(scene, topShader, topTarget);
+        RenderParaboloid(scene, bottomShader, bottomTarget); }
+    else if (type == CUBE)
+        RenderCube(scene);
+    else
+        RenderOctahedral(scene);
+    timer.End();
+}
+
+// Makes the probe's textures available to the lighting shader.
+void EnvProbe::Bind(const int program)
+{
+    glActiveTexture(GL_TEXTURE0+TOP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, topTarget.texture);
+    glActiveTexture(GL_TEXTURE0+BOTTOM_UNIT);
+    glBindTexture(GL_TEXTURE_2D, bottomTarget.texture);
+    glActiveTexture(GL_TEXTURE0+CUBE_UNIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+    glActiveTexture(GL_TEXTURE0+OCTA_UNIT);
+    glBindTexture(GL_TEXTURE_2D, octaTarget.texture);
+
+    SetUnits(program);
+}
+
+// Tells a shader which texture units hold the probe's textures.
+// Since the cube map sampler is of a different type than the 2D
+// samplers, it must never be left on the default unit 0;  so this is
+// done for every pass, whether or not the probe's textures are bound.
+void EnvProbe::SetUnits(const int program)
+{
+    int loc = glGetUniformLocation(program, "probeType");
+    glUniform1i(loc, type);
+    loc = glGetUniformLocation(program, "topReflectionTexture");
+    glUniform1i(loc, TOP_UNIT);
+    loc = glGetUniformLocation(program, "bottomReflectionTexture");
+    glUniform1i(loc, BOTTOM_UNIT);
+    loc = glGetUniformLocation(program, "envCube");
+    glUniform1i(loc, CUBE_UNIT);
+    loc = glGetUniformLocation(program, "envOcta");
+    glUniform1i(loc, OCTA_UNIT);
+}
+
+void EnvProbe::Unbind()
+{
+    glActiveTexture(GL_TEXTURE0+TOP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0+BOTTOM_UNIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0+CUBE_UNIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glActiveTexture(GL_TEXTURE0+OCTA_UNIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// Builds MIP chains for the current type's textures, so that they may
+// be sampled at a lower resolution (see prefilter.frag).  The lighting
+// shader always reads level 0.  Done at most once per update, however
+// many passes ask for it.
+static void MipmapTexture(const unsigned int target, const unsigned int texture)
+{
+    glBindTexture(target, texture);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, 1000);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glGenerateMipmap(target);
+    glBindTexture(target, 0);
+}
+
+void EnvProbe::GenerateMipmaps()
+{
+    if (mipmapped) return;
+    mipmapped = true;
+    if (type == PARABOLOID) {
+        MipmapTexture(GL_TEXTURE_2D, topTarget.texture);
+        MipmapTexture(GL_TEXTURE_2D, bottomTarget.texture); }
+    else if (type == CUBE)
+        MipmapTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+    else
+        MipmapTexture(GL_TEXTURE_2D, octaTarget.texture);
+}
+
+// The average solid angle of one sampled texel at level 0.
+float EnvProbe::SourceTexelAngle()
+{
+    int n = MapSize(type, quality);
+    float texels;
+    if (type == PARABOLOID) texels = 2.0f*(PI/4.0f)*n*n;
+    else if (type == CUBE)  texels = 6.0f*n*n;
+    else                    texels = float(n)*n;
+    return 4.0f*PI/texels;
+}
+
+// The memory held by the current type's targets at level 0:  RGBA16F
+// color and a 24 bit depth buffer for each.  The octahedral map's
+// count includes its source cube map.
+int EnvProbe::AllocatedBytes()
+{
+    const int texel = 8 + 4;
+    int bytes = 0;
+    if (type == PARABOLOID)
+        bytes += (topTarget.width*topTarget.height + bottomTarget.width*bottomTarget.height)*texel;
+    else
+        bytes += 6*cubeSize*cubeSize*8 + cubeSize*cubeSize*4;
+    if (type == OCTAHEDRAL)
+        bytes += octaTarget.width*octaTarget.height*texel;
+    return bytes;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Benchmark support:  the inverse mappings from texture coordinates
+// (u,v in 0..1) to directions, as used by the shaders.  Returns false
+// for points which the shaders never sample (though d is still set,
+// so texel corners just outside the paraboloid's disk are usable).
+static bool TexelDirection(const int t, const float u, const float v, vec3& d)
+{
+    float x = 2.0f*u - 1.0f;
+    float y = 2.0f*v - 1.0f;
+
+    if (t == EnvProbe::PARABOLOID) {  // One (top) hemisphere
+        float r2 = x*x + y*y;
+        d = vec3(2.0f*x, 2.0f*y, 1.0f-r2)/(1.0f+r2);
+        return r2 <= 1.0f; }
+
+    else if (t == EnvProbe::CUBE) {   // One (+Z) face
+        d = normalize(vec3(x, y, 1.0f));
+        return true; }
+
+    else {                            // The whole octahedral map
+        d = vec3(x, y, 1.0f - fabs(x) - fabs(y));
+        if (d.z < 0.0f) {
+            float ox = d.x;
+            d.x = (1.0f - fabs(d.y))*(ox  >= 0.0f ? 1.0f : -1.0f);
+            d.y = (1.0f - fabs(ox ))*(d.y >= 0.0f ? 1.0f : -1.0f); }
+        d = normalize(d);
+        return true; }
+}
+
+// Computes, for one map of type t and size n, the number of texels
+// which map to a direction, the solid angle they cover, and the
+// smallest and largest solid angle of a single texel.
+static void TexelStats(const int t, const int n, double& used, double& omega,
+                       double& minOmega, double& maxOmega)
+{
+    used = omega = maxOmega = 0.0;
+    minOmega = 1e30;
+    for (int j=0;  j<n;  j++)
+        for (int i=0;  i<n;  i++) {
+            vec3 c, d00, d10, d01, d11;
+            if (!TexelDirection(t, (i+0.5f)/n, (j+0.5f)/n, c)) continue;
+            TexelDirection(t, float(i  )/n, float(j  )/n, d00);
+            TexelDirection(t, float(i+1)/n, float(j  )/n, d10);
+            TexelDirection(t, float(i  )/n, float(j+1)/n, d01);
+            TexelDirection(t, float(i+1)/n, float(j+1)/n, d11);
+
+            // Area of the (nearly planar) quad on the unit sphere.
+            double w = 0.5*length(cross(d10-d00, d01-d00))
+                     + 0.5*length(cross(d10-d11, d01-d11));
+            used += 1.0;
+            omega += w;
+            minOmega = w < minOmega ? w : minOmega;
+            maxOmega = w > maxOmega ? w : maxOmega; }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Renders the probe repeatedly with each representation at the
+// current quality level (and so at equal sampled resolution) and
+// prints the memory and GPU cost alongside texel efficiency figures:
+//
+//   MB:        memory held by the targets (color and depth)
+//   render:    GPU time drawing the scene into the maps (for the
+//              octahedral map, into its source cube map)
+//   resample:  GPU time resampling the cube map into the octahedral map
+//   used:      fraction of the sampled map's texels which are sampled
+//   uniform:   ratio of largest to smallest texel solid angle
+//              (1.0 would be a perfectly even distribution)
+//   tex/sr:    average sampled texels per steradian
+void EnvProbe::Benchmark(Scene& scene)
+{
+    const char* names[3] = { "paraboloid", "cube", "octahedral" };
+    const int warmup = 5, runs = 30;
+    int savedType = type;
+
+    printf("\nEnvironment probe benchmark, %d texels sampled per probe\n",
+           TexelBudget(quality));
+    printf("%-11s %6s %6s %7s %8s %9s %8s %8s %6s\n",
+           "type", "size", "MB", "used", "uniform", "tex/sr", "render", "resample", "draws");
+
+    for (int t=PARABOLOID;  t<=OCTAHEDRAL;  t++) {
+        SetType(t);
+        Unbind();
+
+        GpuTimer bench, resample;
+        double total = 0.0, resampleTotal = 0.0;
+        for (int r=0;  r<warmup+runs;  r++) {
+            drawCount = 0;
+            bench.Begin();
+            if (t == PARABOLOID) {
+                RenderParaboloid(scene, topShader, topTarget);
+                RenderParaboloid(scene, bottomShader, bottomTarget); }
+            else
+                RenderCube(scene);
+            bench.End();
+            double ms = bench.Wait();
+            if (r >= warmup) total += ms;
+
+            if (t == OCTAHEDRAL) {
+                resample.Begin();
+                Resample();
+                resample.End();
+                ms = resample.Wait();
+                if (r >= warmup) resampleTotal += ms; } }
+
+        // Paraboloid and cube statistics are for one map (or face)
+        // and scale to the whole probe.
+        int n = MapSize(t, quality);
+        int maps = t==PARABOLOID ? 2 : (t==CUBE ? 6 : 1);
+        double used, omega, minOmega, maxOmega;
+        TexelStats(t, n, used, omega, minOmega, maxOmega);
+        used *= maps;
+        omega *= maps;
+
+        printf("%-11s %6d %6.1f %6.1f%% %8.2f %9.0f %8.3f %8.3f %6d\n",
+               names[t], n, AllocatedBytes()/(1024.0*1024.0), 100.0*used/(double(maps)*n*n),
+               maxOmega/minOmega, used/omega, total/runs, resampleTotal/runs, drawCount); }
+
+    fflush(stdout);
+    SetType(savedType);
+}
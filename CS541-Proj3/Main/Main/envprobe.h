@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////
+// An environment probe:  captures the scene surrounding a point (the
+// center of reflection) into a texture which the lighting pass
+// samples to produce reflections on the central model.  Three
+// parameterizations of the sphere of directions are supported:
+//
+//   PARABOLOID:  Two paraboloid maps (top and bottom hemispheres),
+//                projected in the vertex shader.  Cheap, but only
+//                pi/4 of each map is used and large triangles bend
+//                badly near the seam.
+//   CUBE:        A cube map rendered as six 90 degree views, with
+//                objects culled against each face's frustum (all six
+//                culled in parallel before any is drawn).
+//   OCTAHEDRAL:  The cube map resampled into a single 2D texture by
+//                the octahedral mapping, which uses every texel.
+//
+// All three are read in lighting.frag through SampleEnvironment().
+// The quality setting chooses a texel budget which is shared
+// equally by the three representations' sampled maps, so they can be
+// compared at equal resolution (see Benchmark).  The octahedral map
+// also keeps the cube map it is resampled from, so holds about twice
+// the memory of the others;  AllocatedBytes reports each one's.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _ENVPROBE_
+#define _ENVPROBE_
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "shader.h"
+#include "fbo.h"
+#include "gputimer.h"
+#include "scenegraph.h"
+
+class Scene;
+
+class EnvProbe
+{
+public:
+    enum { PARABOLOID=0, CUBE=1, OCTAHEDRAL=2 };
+
+    // User controllable parameters
+    int type;           // One of the above;  change with SetType
+    int quality;        // 0..2;  change with SetQuality
+    bool faceCulling;   // Cull objects against each cube face
+    int updateInterval; // Re-render the probe every N frames
+
+    vec3 center;        // Center of reflection (world space)
+
+    // Paraboloid maps, looking up (+Z) and down (-Z)
+    FBO topTarget, bottomTarget;
+    ShaderVariants topShader, bottomShader;
+
+    // Cube map (also the source for the octahedral map)
+    unsigned int cubeFbo, cubeTexture, cubeDepth;
+    int cubeSize;
+    SceneGraph::DrawList faceLists[6];  // Each face's visible objects
+
+    // Octahedral map, resampled from the cube map
+    FBO octaTarget;
+    ShaderProgram octaShader;
+    unsigned int emptyVao;
+
+    bool updated;       // Set when the most recent Render re-rendered
+    bool mipmapped;     // MIP chains are up to date with the contents
+
+    // Statistics
+    int frame;
+    int drawCount;      // Objects drawn by the most recent Render
+    GpuTimer timer;
+
+    EnvProbe();
+    void Initialize();
+    void SetType(const int t);
+    void SetQuality(const int q);
+    void Render(Scene& scene);
+    void Bind(const int program);
+    void SetUnits(const int program);
+    void Unbind();
+    void GenerateMipmaps();
+    float SourceTexelAngle();
+    int AllocatedBytes();
+    void Benchmark(Scene& scene);
+
+    // Texels available to each representation at a quality level.
+    static int TexelBudget(const int q);
+    static int MapSize(const int t, const int q);
+
+private:
+    void CreateTargets();
+    void DeleteTargets();
+    void RenderParaboloid(Scene& scene, ShaderVariants& shader, FBO& target);
+    void RenderCube(Scene& scene);
+    void RenderOctahedral(Scene& scene);
+    void Resample();
+};
+
+#endif
@@ -22,6 +22,13 @@
 #include "scene.h"
 
 void FBO::CreateFBO(const int w, const int h)
+{
+    CreateFBO(w, h, GL_RGBA32F_ARB);
+}
+
+// As above, but with the texture's internal format (e.g. GL_RGBA16F)
+// specified by the caller.
+void FBO::CreateFBO(const int w, const int h, const unsigned int format)
 {
     width = w;
     height = h;
@@ -30,7 +37,6 @@ void FBO::CreateFBO(const int w, const int h)
     glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
 
     // Create a render buffer, and attach it to FBO's depth attachment
-    unsigned int depthBuffer;
     glGenRenderbuffersEXT(1, &depthBuffer);
     glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, depthBuffer);
     glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT,
@@ -41,7 +47,7 @@ void FBO::CreateFBO(const int w, const int h)
     // Create texture and attach FBO's color 0 attachment
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, width, height,
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height,
                  0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
 
@@ -63,6 +69,55 @@ void FBO::CreateFBO(const int w, const int h)
     glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
 }
 
+// As above, but multisampled, with s samples per pixel:  the texture
+// is a GL_TEXTURE_2D_MULTISAMPLE (so it must be resolved, or read
+// sample by sample with texelFetch), and the depth buffer
+// multisampled to match.
+void FBO::CreateMultisampleFBO(const int w, const int h, const unsigned int format,
+                               const int s)
+{
+    width = w;
+    height = h;
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    // The driver may round the count requested up, so the count the
+    // texture actually has is kept, and used for the depth too.
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+    glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, s, format,
+                            width, height, GL_TRUE);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D_MULTISAMPLE, 0, GL_TEXTURE_SAMPLES, &samples);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D_MULTISAMPLE, texture, 0);
+
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24,
+                                     width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, depthBuffer);
+
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("Multisample FBO Error: %d\n", status);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Releases the FBO and its attachments (so it may be created again
+// at a different size).
+void FBO::DeleteFBO()
+{
+    if (!fbo) return;
+    glDeleteTextures(1, &texture);
+    glDeleteRenderbuffersEXT(1, &depthBuffer);
+    glDeleteFramebuffersEXT(1, &fbo);
+    fbo = texture = depthBuffer = 0;
+    samples = 0;
+}
 
 void FBO::Bind() { glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo); }
 void FBO::Unbind() { glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0); }
@@ -14,9 +14,17 @@ public:
     unsigned int fbo;
 
     unsigned int texture;
+    unsigned int depthBuffer;
     int width, height;  // Size of the texture.
+    int samples;        // Per pixel, if multisampled (else 0), as allocated
+
+    FBO() :fbo(0), texture(0), depthBuffer(0), width(0), height(0), samples(0) {}
 
     void CreateFBO(const int w, const int h);
+    void CreateFBO(const int w, const int h, const unsigned int format);
+    void CreateMultisampleFBO(const int w, const int h, const unsigned int format,
+                              const int s);
+    void DeleteFBO();
     void Bind();
     void Unbind();
 };
@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////
+// Main loop timing:  fixed step simulation, frame pacing, and frame
+// time statistics.  See frameloop.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <thread>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "frameloop.h"
+
+// The swap interval extensions all take a single int:
+// wglSwapIntervalEXT, glXSwapIntervalMESA and glXSwapIntervalSGI.
+typedef int (CODEGEN_FUNCPTR *SwapIntervalProc)(int interval);
+static SwapIntervalProc swapIntervalProc = NULL;
+
+// Sleeping is only accurate to a millisecond or two, so the last of
+// the wait is spent spinning.
+#define SPIN_MS 2.0
+
+FrameLoop::FrameLoop()
+    :pacing(VSYNC), targetFps(60), step(1.0/120.0), maxFrameTime(0.25),
+     swapControl(false), frameMs(0.0), averageMs(0.0), medianMs(0.0), p99Ms(0.0),
+     steps(0), accumulator(0.0), swapInterval(-1)
+{
+    ResetHistogram();
+}
+
+// Called once a GL context exists.
+void FrameLoop::Initialize()
+{
+#ifdef _WIN32
+    swapIntervalProc = (SwapIntervalProc)glutGetProcAddress("wglSwapIntervalEXT");
+#else
+    swapIntervalProc = (SwapIntervalProc)glutGetProcAddress("glXSwapIntervalMESA");
+    if (!swapIntervalProc)
+        swapIntervalProc = (SwapIntervalProc)glutGetProcAddress("glXSwapIntervalSGI");
+#endif
+    swapControl = swapIntervalProc != NULL;
+    SetPacing(pacing);
+
+    last = deadline = Clock::now();
+    printf("Frame pacing: %s swap control, %.0f Hz simulation\n",
+           swapControl ? "with" : "without", 1.0/step);
+}
+
+void FrameLoop::SetSwapInterval(const int i)
+{
+    if (!swapIntervalProc || i == swapInterval) return;
+    swapIntervalProc(i);
+    swapInterval = i;
+}
+
+// Without swap control, VSYNC falls back to capping at targetFps.
+void FrameLoop::SetPacing(const int p)
+{
+    pacing = p;
+    SetSwapInterval(pacing == VSYNC ? 1 : 0);
+}
+
+// Measures the frame just ended, and returns the number of simulation
+// steps to run before drawing the next.
+int FrameLoop::BeginFrame()
+{
+    Clock::time_point now = Clock::now();
+    double seconds = std::chrono::duration<double>(now - last).count();
+    last = now;
+
+    frameMs = 1000.0*seconds;
+    averageMs = averageMs==0.0 ? frameMs : 0.95*averageMs + 0.05*frameMs;
+    int bucket = int(frameMs/FRAMELOOP_BUCKET_MS);
+    histogram[bucket < FRAMELOOP_BUCKETS ? bucket : FRAMELOOP_BUCKETS-1]++;
+    frames++;
+    if (frames % 30 == 0) {
+        medianMs = Percentile(0.5);
+        p99Ms = Percentile(0.99); }
+
+    // After a stall (a breakpoint, a window drag, a benchmark) don't
+    // try to simulate all the lost time.
+    if (seconds > maxFrameTime)
+        seconds = maxFrameTime;
+    accumulator += seconds;
+
+    steps = 0;
+    while (accumulator >= step) {
+        accumulator -= step;
+        steps++; }
+    return steps;
+}
+
+// How far between the last two simulation steps this frame falls,
+// 0..1.
+double FrameLoop::Alpha()
+{
+    return accumulator/step;
+}
+
+// Called after the swap.
+void FrameLoop::EndFrame()
+{
+    if (pacing == UNCAPPED || (pacing == VSYNC && swapControl)) {
+        deadline = Clock::now();
+        return; }
+
+    // Aim each frame at 1/targetFps after the previous deadline, so
+    // that the error of one sleep doesn't accumulate;  but if a frame
+    // ran long, restart from now rather than rushing to catch up.
+    Clock::time_point now = Clock::now();
+    deadline += std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0/targetFps));
+    if (deadline < now) {
+        deadline = now;
+        return; }
+
+    Clock::duration spin = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(SPIN_MS));
+    if (deadline - now > spin)
+        std::this_thread::sleep_for(deadline - now - spin);
+    while (Clock::now() < deadline)
+        ;
+}
+
+void FrameLoop::ResetHistogram()
+{
+    for (int i=0;  i<FRAMELOOP_BUCKETS;  i++)
+        histogram[i] = 0;
+    frames = 0;
+    medianMs = p99Ms = 0.0;
+}
+
+// The frame time below which fraction p of the frames fall, to the
+// middle of its bucket.
+double FrameLoop::Percentile(const double p)
+{
+    long long target = (long long)(p*frames);
+    long long sum = 0;
+    for (int i=0;  i<FRAMELOOP_BUCKETS;  i++) {
+        sum += histogram[i];
+        if (sum > target)
+            return (i + 0.5)*FRAMELOOP_BUCKET_MS; }
+    return FRAMELOOP_BUCKETS*FRAMELOOP_BUCKET_MS;
+}
+
+void FrameLoop::PrintHistogram()
+{
+    if (frames == 0) return;
+    long long most = 0;
+    for (int i=0;  i<FRAMELOOP_BUCKETS;  i++)
+        if (histogram[i] > most) most = histogram[i];
+
+    printf("Frame times over %lld frames:  median %.1f ms, 99%% %.1f ms\n",
+           frames, Percentile(0.5), Percentile(0.99));
+    for (int i=0;  i<FRAMELOOP_BUCKETS;  i++) {
+        if (histogram[i] == 0) continue;
+        int bar = int(50*histogram[i]/most);
+        if (i < FRAMELOOP_BUCKETS-1)
+            printf("%5.1f-%5.1f ms %7lld ", i*FRAMELOOP_BUCKET_MS, (i+1)*FRAMELOOP_BUCKET_MS, histogram[i]);
+        else
+            printf("  over %5.1f ms %7lld ", i*FRAMELOOP_BUCKET_MS, histogram[i]);
+        for (int j=0;  j<bar;  j++)
+            printf("#");
+        printf("\n"); }
+    fflush(stdout);
+}
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////
+// The main loop's timing:  a fixed step simulation decoupled from the
+// rendering rate, frame pacing, and frame time statistics.
+//
+// Each frame, BeginFrame() measures the time since the last frame
+// (with a high resolution clock) and returns how many fixed steps of
+// "step" seconds the simulation should advance to catch up.  The time
+// left over, as a fraction of a step, is Alpha():  rendering blends
+// the last two simulated states by it, so motion is smooth whatever
+// the ratio of frame rate to step rate.  After the swap, EndFrame()
+// paces the loop:
+//
+//   VSYNC     the swap waits for the display (swap interval 1)
+//   CAPPED    sleeps until 1/targetFps after the previous frame
+//   UNCAPPED  runs flat out, for benchmarking
+//
+// Frame times go into a histogram of FRAMELOOP_BUCKET_MS wide buckets, from
+// which the median and 99th percentile are read.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _FRAMELOOP_
+#define _FRAMELOOP_
+
+#include <chrono>
+
+#define FRAMELOOP_BUCKETS 128
+#define FRAMELOOP_BUCKET_MS 0.5
+
+class FrameLoop
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Pacing {VSYNC, CAPPED, UNCAPPED};
+    int pacing;
+    int targetFps;          // For CAPPED, or VSYNC without swap control
+    double step;            // Simulation step, in seconds
+    double maxFrameTime;    // Longer frames are simulated as this long
+    bool swapControl;       // The swap interval can be set
+
+    // Statistics
+    double frameMs;         // Most recent frame time
+    double averageMs;       // Exponentially smoothed frame time
+    double medianMs, p99Ms; // From the histogram
+    int steps;              // Simulation steps run this frame
+    long long frames;
+    long long histogram[FRAMELOOP_BUCKETS];   // The last is the overflow
+
+    FrameLoop();
+    void Initialize();
+    void SetPacing(const int p);
+    int BeginFrame();
+    double Alpha();
+    void EndFrame();
+    void ResetHistogram();
+    void PrintHistogram();
+
+private:
+    Clock::time_point last, deadline;
+    double accumulator;     // Time not yet simulated, in seconds
+    int swapInterval;
+
+    void SetSwapInterval(const int i);
+    double Percentile(const double p);
+};
+
+#endif
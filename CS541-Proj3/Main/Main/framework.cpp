@@ -25,6 +25,10 @@
 using namespace glm;
 
 #include "scene.h"
+#include "shadermanager.h"
+#include "frameloop.h"
+#include "jobs.h"
+#include "allocation.h"
 #include "AntTweakBar.h"
 
 Scene scene;
@@ -36,48 +40,64 @@ bool leftDown = false;
 bool middleDown = false;
 bool rightDown = false;
 bool shifted;
-float x = scene.eyePos.x;
-float y = scene.eyePos.y;
-float z = scene.eyePos.z;
-float speed = scene.speed;
+FrameLoop frameLoop;
+extern float atime;
+
+// The state advanced by the simulation:  the environment's rotation,
+// and the eye's position when walking.  Drawing blends the last two
+// states.
+struct SimState
+{
+    double atime;
+    float x, y;
+};
+SimState previous = {0.0, scene.eyePos.x, scene.eyePos.y}, current = previous;
+
+////////////////////////////////////////////////////////////////////////
+// Advances the simulation by one fixed step of dt seconds.
+void Simulate(const double dt)
+{
+    previous = current;
+
+    // One turn every two minutes
+    current.atime += 360.0*dt/120.0;
+
+    if (scene.canMove) {
+        float d = scene.speed*dt;
+        float s = sin(scene.spin*rad), c = cos(scene.spin*rad);
+        if (scene.wDown) {
+            current.x -= d*s;
+            current.y -= d*c; }
+        if (scene.aDown) {
+            current.x += d*c;
+            current.y -= d*s; }
+        if (scene.sDown) {
+            current.x += d*s;
+            current.y += d*c; }
+        if (scene.dDown) {
+            current.x -= d*c;
+            current.y += d*s; } }
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Called by GLUT when the scene needs to be redrawn.
 void ReDraw()
 {
+	// Catch the simulation up to the present, then draw the state
+	// between its last two steps.
+	int steps = frameLoop.BeginFrame();
+	for (int i=0;  i<steps;  i++)
+		Simulate(frameLoop.step);
+	float alpha = frameLoop.Alpha();
+	atime = fmod(previous.atime + alpha*(current.atime - previous.atime), 360.0);
+	float x = previous.x + alpha*(current.x - previous.x);
+	float y = previous.y + alpha*(current.y - previous.y);
+
 	float rx =  (scene.width * scene.ry) / (scene.height);
 
 	if (scene.canMove)
 	{
 
-		//vec3 temp = (scene.eyePos);
-
-			if (scene.wDown)
-			{//Stare at these for a little bit, THIS CLOSE
-				//scene.eyePos += scene.speed*vec3(sin((scene.spin)*PI / 180), cos(scene.spin*PI / 180), 0);
-				x -= speed*sin((scene.spin)*PI / 180);
-				y -= speed *cos((scene.spin)*PI / 180);
-			}
-
-			if (scene.aDown)
-			{
-				//scene.eyePos -= scene.speed*vec3(cos((scene.spin)*PI / 180), -1 * sin((scene.spin)*PI / 180), 0.0);
-
-				x +=speed*  cos(scene.spin*PI / 180);
-				y += speed*-1*sin(scene.spin*PI / 180);
-			}
-			if (scene.sDown)
-			{
-				//scene.eyePos = scene.eyePos - scene.speed*vec3(sin((scene.spin)*PI / 180), cos(scene.spin*PI / 180), 0);
-				x += speed*sin(scene.spin*PI / 180);
-				y += speed*cos(scene.spin*PI / 180);
-			}
-			if (scene.dDown)
-			{
-				//scene.eyePos = scene.eyePos + scene.speed*vec3(( cos(scene.spin*PI / 180)), -1*sin((scene.spin)*PI / 180), 0);
-				x -= speed * cos(scene.spin*PI / 180);
-				y -= speed*-1*sin(scene.spin*PI / 180);
-			}
-
 			//Translate(-1 * scene.eyePos.x, -1 * scene.eyePos.y, -1 * scene.eyePos.z);
 
 			//scene.WorldView = MAT4();
@@ -118,6 +138,10 @@ void ReDraw()
     scene.DrawScene();
     TwDraw();
     glutSwapBuffers();
+
+    // Pace, and go straight on to the next frame.
+    frameLoop.EndFrame();
+    glutPostRedisplay();
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -140,11 +164,6 @@ void KeyboardDown(unsigned char key, int x, int y)
 {
 	if (TwEventKeyboardGLUT(key, x, y)) return;
 
-	scene.prevTime = scene.currTime;
-	scene.currTime = time(&scene.currTime);
-	scene.diff = difftime(scene.currTime, scene.prevTime);
-	scene.speed = scene.speed*.9*scene.diff;
-
 
 
 
@@ -172,6 +191,7 @@ void KeyboardDown(unsigned char key, int x, int y)
 
 	case 27:                    // Escape key
 	case 'q':
+		frameLoop.PrintHistogram();
 		exit(0);
 
 
@@ -290,6 +310,20 @@ void MouseButton(int button, int state, int x, int y)
 
 	}
 
+	else if (button == GLUT_MIDDLE_BUTTON && state == GLUT_DOWN)
+	{
+		// Report the scene graph node under the mouse
+		int node = scene.Pick(x, y);
+		if (node < 0)
+			printf("Picked nothing\n");
+		else
+			printf("Picked node %d (%s)\n", node,
+				node == scene.centralNode ? "central model" :
+				node == scene.terrainNode ? "ground" :
+				node == scene.sunNode ? "sun" :
+				scene.graph.parent[node] == scene.ringNode ? "sphere" : "instance");
+	}
+
 	else if (button == 3 || button == 4)
 	{
 		if (button == 3)
@@ -430,6 +464,7 @@ void MouseMotion(int x, int y)
 // Functions called by AntTweakBar
 void Quit(void *clientData)
 {
+    frameLoop.PrintHistogram();
     TwTerminate();
     glutLeaveMainLoop();
 }
@@ -455,6 +490,79 @@ void TW_CALL GetModel(void *value, void *clientData)
     *(int*)value = scene.centralModel;
 }
 
+void TW_CALL SetProbeType(const void *value, void *clientData)
+{
+    scene.probe.SetType(*(int*)value);
+}
+
+void TW_CALL GetProbeType(void *value, void *clientData)
+{
+    *(int*)value = scene.probe.type;
+}
+
+void TW_CALL SetProbeQuality(const void *value, void *clientData)
+{
+    scene.dynamicResolution.probeQuality = *(int*)value;
+    scene.probe.SetQuality(*(int*)value);
+}
+
+void TW_CALL GetProbeQuality(void *value, void *clientData)
+{
+    *(int*)value = scene.probe.quality;
+}
+
+void BenchmarkProbe(void *clientData)
+{
+    scene.probe.Benchmark(scene);
+}
+
+void BenchmarkLights(void *clientData)
+{
+    scene.clusters.Benchmark(scene);
+}
+
+void TW_CALL SetPacing(const void *value, void *clientData)
+{
+    frameLoop.SetPacing(*(int*)value);
+}
+
+void TW_CALL GetPacing(void *value, void *clientData)
+{
+    *(int*)value = frameLoop.pacing;
+}
+
+void PrintFrameHistogram(void *clientData)
+{
+    frameLoop.PrintHistogram();
+}
+
+void ResetFrameHistogram(void *clientData)
+{
+    frameLoop.ResetHistogram();
+}
+
+// Changes to the point lights regenerate them.
+void TW_CALL SetLightCount(const void *value, void *clientData)
+{
+    scene.pointLights.Generate(*(int*)value);
+}
+
+void TW_CALL GetLightCount(void *value, void *clientData)
+{
+    *(int*)value = scene.pointLights.count;
+}
+
+void TW_CALL SetLightRadius(const void *value, void *clientData)
+{
+    scene.pointLights.radius = *(float*)value;
+    scene.pointLights.Generate(scene.pointLights.count);
+}
+
+void TW_CALL GetLightRadius(void *value, void *clientData)
+{
+    *(float*)value = scene.pointLights.radius;
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Do the OpenGL/GLut setup and then enter the interactive loop.
 int main(int argc, char** argv)
@@ -490,17 +598,280 @@ int main(int argc, char** argv)
     TwInit(TW_OPENGL, NULL);
     TwGLUTModifiersFunc((int(TW_CALL*)())glutGetModifiers);
     TwBar *bar = TwNewBar("Tweaks");
-    TwDefine(" Tweaks size='200 300' ");
+    TwDefine(" Tweaks size='240 400' ");
     TwAddButton(bar, "quit", (TwButtonCallback)Quit, NULL, " label='Quit' key=q ");
 
+    // Main loop pacing and frame times
+    TwAddVarCB(bar, "pacing", TwDefineEnum("Pacing", NULL, 0),
+               SetPacing, GetPacing, NULL,
+               " label='Pacing' group='Frame' enum='0 {Vsync}, 1 {Capped}, 2 {Uncapped}' ");
+    TwAddVarRW(bar, "targetFps", TW_TYPE_INT32, &frameLoop.targetFps,
+               " label='Cap fps' group='Frame' min=10 max=500 ");
+    TwAddVarRO(bar, "frameMs", TW_TYPE_DOUBLE, &frameLoop.averageMs,
+               " label='Frame ms' group='Frame' precision=2 ");
+    TwAddVarRO(bar, "medianMs", TW_TYPE_DOUBLE, &frameLoop.medianMs,
+               " label='Median ms' group='Frame' precision=1 ");
+    TwAddVarRO(bar, "p99Ms", TW_TYPE_DOUBLE, &frameLoop.p99Ms,
+               " label='99% ms' group='Frame' precision=1 ");
+    TwAddVarRO(bar, "simSteps", TW_TYPE_INT32, &frameLoop.steps,
+               " label='Steps per frame' group='Frame' ");
+    TwAddButton(bar, "printHistogram", (TwButtonCallback)PrintFrameHistogram, NULL,
+                " label='Print histogram' group='Frame' ");
+    TwAddButton(bar, "resetHistogram", (TwButtonCallback)ResetFrameHistogram, NULL,
+                " label='Reset histogram' group='Frame' ");
+    TwAddVarRO(bar, "jobThreads", TW_TYPE_INT32, &jobs.threadCount,
+               " label='Job threads' group='Frame' ");
+    TwAddVarRO(bar, "graphUpdated", TW_TYPE_INT32, &scene.graph.updated,
+               " label='Nodes updated' group='Frame' ");
+    TwAddVarRO(bar, "streamStalls", TW_TYPE_INT32, &scene.stream.stalls,
+               " label='Stream stalls' group='Frame' ");
+    TwAddVarRO(bar, "streamPeak", TW_TYPE_INT32, &scene.stream.peakBytes,
+               " label='Stream peak bytes' group='Frame' ");
+    if (scene.megaBuffer.supported)
+        TwAddVarRW(bar, "multiDraw", TW_TYPE_BOOLCPP, &scene.multiDraw,
+                   " label='Multi-draw' group='Frame' ");
+
+    // Live and peak kilobytes per allocation tag (see allocation.h)
+    TwAddVarRO(bar, "frameAllocs", TW_TYPE_INT32, &memoryStats.frameAllocations,
+               " label='Allocs/frame' group='Memory' ");
+    for (int t=0;  t<MEM_TAG_COUNT;  t++) {
+        char name[32], def[96];
+        sprintf(name, "memLive%d", t);
+        sprintf(def, " label='%s KB' group='Memory' ", MemoryStats::names[t]);
+        TwAddVarRO(bar, name, TW_TYPE_INT32, &memoryStats.kilobytes[t], def);
+        sprintf(name, "memPeak%d", t);
+        sprintf(def, " label='%s peak KB' group='Memory' ", MemoryStats::names[t]);
+        TwAddVarRO(bar, name, TW_TYPE_INT32, &memoryStats.peakKilobytes[t], def); }
+    TwAddVarRO(bar, "arenaPeak", TW_TYPE_INT32, &frameArena.peak,
+               " label='Frame arena peak' group='Memory' ");
+    TwDefine(" Tweaks/Memory opened=false ");
+
+    // Hi-Z occlusion culling (see occlusion.h);  mode 9 shows it
+    TwAddVarRW(bar, "occlusion", TW_TYPE_BOOLCPP, &scene.occlusion.enabled,
+               " label='Enabled' group='Occlusion' ");
+    TwAddVarRW(bar, "occlusionMethod", TwDefineEnum("OcclusionMethod", NULL, 0),
+               &scene.occlusion.method,
+               " label='Method' group='Occlusion' enum='0 {GPU depth}, 1 {Software}' ");
+    TwAddVarRO(bar, "occludedPct", TW_TYPE_FLOAT, &scene.occlusion.percent,
+               " label='Occluded %' group='Occlusion' precision=1 ");
+    TwAddVarRO(bar, "occluded", TW_TYPE_INT32, &scene.occlusion.occluded,
+               " label='Occluded' group='Occlusion' ");
+    TwAddVarRO(bar, "faceOccluded", TW_TYPE_INT32, &scene.occlusion.faceOccluded,
+               " label='Probe occluded' group='Occlusion' ");
+    TwAddVarRO(bar, "occlusionStalls", TW_TYPE_INT32, &scene.occlusion.stalls,
+               " label='Read back stalls' group='Occlusion' ");
+    TwAddVarRO(bar, "softTriangles", TW_TYPE_INT32, &scene.occlusion.software.triangles,
+               " label='Software tris' group='Occlusion' ");
+    TwAddVarRO(bar, "softMs", TW_TYPE_DOUBLE, &scene.occlusion.software.ms,
+               " label='Software ms' group='Occlusion' precision=3 ");
+    TwAddVarRO(bar, "softRate", TW_TYPE_DOUBLE, &scene.occlusion.software.trianglesPerMs,
+               " label='Software tris/ms' group='Occlusion' precision=0 ");
+
+    // Meshlet culling of large meshes (see meshlet.h)
+    TwAddVarRW(bar, "meshlets", TW_TYPE_BOOLCPP, &scene.meshletCuller.enabled,
+               " label='Enabled' group='Meshlets' ");
+    TwAddVarRO(bar, "meshletClusters", TW_TYPE_INT32, &scene.meshletCuller.clusters,
+               " label='Clusters' group='Meshlets' ");
+    TwAddVarRO(bar, "meshletVisible", TW_TYPE_INT32, &scene.meshletCuller.visibleClusters,
+               " label='Visible clusters' group='Meshlets' ");
+    TwAddVarRO(bar, "meshletTris", TW_TYPE_INT32, &scene.meshletCuller.triangles,
+               " label='Triangles' group='Meshlets' ");
+    TwAddVarRO(bar, "meshletVisibleTris", TW_TYPE_INT32, &scene.meshletCuller.visibleTriangles,
+               " label='Visible triangles' group='Meshlets' ");
+
+    // The ground's normal and height maps (see surface.glsl)
+    TwAddVarRW(bar, "surfaceDetail", TwDefineEnum("SurfaceDetail", NULL, 0),
+               &scene.surfaceDetail,
+               " label='Detail' group='Surface' enum='0 {Flat}, 1 {Normal map}, 2 {Parallax occlusion}' ");
+    TwAddVarRW(bar, "parallaxScale", TW_TYPE_FLOAT, &scene.parallaxScale,
+               " label='Parallax depth' group='Surface' min=0 max=0.1 step=0.002 ");
+    TwAddVarRW(bar, "parallaxMin", TW_TYPE_INT32, &scene.parallaxMinSteps,
+               " label='Min steps' group='Surface' min=1 max=64 ");
+    TwAddVarRW(bar, "parallaxMax", TW_TYPE_INT32, &scene.parallaxMaxSteps,
+               " label='Max steps' group='Surface' min=1 max=128 ");
+
+    // The clipmap terrain (see terrain.h)
+    TwAddVarRO(bar, "terrainLevels", TW_TYPE_INT32, &scene.terrain->levels,
+               " label='Levels' group='Terrain' ");
+    TwAddVarRO(bar, "terrainTris", TW_TYPE_INT32, &scene.terrain->triangles,
+               " label='Triangles' group='Terrain' ");
+    TwAddVarRO(bar, "terrainTexels", TW_TYPE_INT32, &scene.terrain->texelsUpdated,
+               " label='Texels updated' group='Terrain' ");
+
     TwAddVarCB(bar, "centralModel", TwDefineEnum("CentralModel", NULL, 0),
                SetModel, GetModel, NULL,
                " enum='0 {Teapot}, 1 {Bunny}, 2 {Dragon}, 3 {Sphere}' ");
     TwAddButton(bar, "Spheres", (TwButtonCallback)ToggleSpheres, NULL, " label='Spheres' ");
     TwAddButton(bar, "Ground", (TwButtonCallback)ToggleGround, NULL, " label='Ground' ");
 
+    // Environment probe (reflection) controls
+    TwAddVarCB(bar, "probeType", TwDefineEnum("ProbeType", NULL, 0),
+               SetProbeType, GetProbeType, NULL,
+               " label='Type' group='Reflection' enum='0 {Paraboloid}, 1 {Cube map}, 2 {Octahedral}' ");
+    TwAddVarCB(bar, "probeQuality", TwDefineEnum("ProbeQuality", NULL, 0),
+               SetProbeQuality, GetProbeQuality, NULL,
+               " label='Quality' group='Reflection' enum='0 {Low}, 1 {Medium}, 2 {High}' ");
+    TwAddVarRW(bar, "probeCulling", TW_TYPE_BOOLCPP, &scene.probe.faceCulling,
+               " label='Face culling' group='Reflection' ");
+    TwAddVarRW(bar, "probeInterval", TW_TYPE_INT32, &scene.probe.updateInterval,
+               " label='Update every' group='Reflection' min=1 max=16 ");
+    TwAddVarRO(bar, "probeMs", TW_TYPE_DOUBLE, &scene.probe.timer.averageMs,
+               " label='GPU ms' group='Reflection' precision=3 ");
+    TwAddVarRO(bar, "probeDraws", TW_TYPE_INT32, &scene.probe.drawCount,
+               " label='Draws' group='Reflection' ");
+    TwAddButton(bar, "probeBenchmark", (TwButtonCallback)BenchmarkProbe, NULL,
+                " label='Benchmark' group='Reflection' ");
+    TwAddVarRW(bar, "prefilter", TW_TYPE_BOOLCPP, &scene.prefilter.enabled,
+               " label='Prefilter' group='Reflection' ");
+    TwAddVarRW(bar, "prefilterSamples", TW_TYPE_INT32, &scene.prefilter.sampleCount,
+               " label='Samples' group='Reflection' min=16 max=1024 step=16 ");
+    TwAddVarRO(bar, "prefilterMs", TW_TYPE_DOUBLE, &scene.prefilter.timer.averageMs,
+               " label='Prefilter ms' group='Reflection' precision=3 ");
+
+    // Spherical harmonic ambient light controls
+    TwAddVarRW(bar, "shEnabled", TW_TYPE_BOOLCPP, &scene.shLighting.enabled,
+               " label='SH ambient' group='Ambient' ");
+    TwAddVarRW(bar, "shStrength", TW_TYPE_FLOAT, &scene.shLighting.strength,
+               " label='Strength' group='Ambient' min=0 max=4 step=0.05 ");
+    TwAddVarRW(bar, "shGrid", TW_TYPE_INT32, &scene.shLighting.gridSize,
+               " label='Grid size' group='Ambient' min=4 max=128 ");
+    TwAddVarRO(bar, "shMs", TW_TYPE_DOUBLE, &scene.shLighting.timer.averageMs,
+               " label='GPU ms' group='Ambient' precision=3 ");
+
+    // Point lights and the forward/deferred choice, with the GPU time
+    // of each path's passes
+    TwAddVarRW(bar, "renderPath", TwDefineEnum("RenderPath", NULL, 0),
+               &scene.renderPath,
+               " label='Path' group='Lights' enum='0 {Forward}, 1 {Forward+ (clustered)}, 2 {Deferred}' ");
+    TwAddVarCB(bar, "lightCount", TW_TYPE_INT32, SetLightCount, GetLightCount, NULL,
+               " label='Point lights' group='Lights' min=0 max=10000 step=16 ");
+    TwAddVarCB(bar, "lightRadius", TW_TYPE_FLOAT, SetLightRadius, GetLightRadius, NULL,
+               " label='Radius' group='Lights' min=0.5 max=50 step=0.5 ");
+    TwAddVarRO(bar, "forwardMs", TW_TYPE_DOUBLE, &scene.forwardTimer.averageMs,
+               " label='Forward ms' group='Lights' precision=3 ");
+    TwAddVarRO(bar, "binMs", TW_TYPE_DOUBLE, &scene.clusters.binMs,
+               " label='Binning CPU ms' group='Lights' precision=3 ");
+    TwAddVarRO(bar, "maxPerCluster", TW_TYPE_INT32, &scene.clusters.maxPerCluster,
+               " label='Max per cluster' group='Lights' ");
+    TwAddVarRO(bar, "gbufferMs", TW_TYPE_DOUBLE, &scene.deferred.gbufferTimer.averageMs,
+               " label='G-buffer ms' group='Lights' precision=3 ");
+    TwAddVarRO(bar, "shadeMs", TW_TYPE_DOUBLE, &scene.deferred.shadeTimer.averageMs,
+               " label='Shade ms' group='Lights' precision=3 ");
+    TwAddVarRO(bar, "lightMs", TW_TYPE_DOUBLE, &scene.deferred.lightTimer.averageMs,
+               " label='Lights ms' group='Lights' precision=3 ");
+    TwAddButton(bar, "lightBenchmark", (TwButtonCallback)BenchmarkLights, NULL,
+                " label='Benchmark' group='Lights' ");
+
+    // HDR post-processing (see post.h)
+    TwAddVarRW(bar, "post", TW_TYPE_BOOLCPP, &scene.post.enabled,
+               " label='Enabled' group='Post' ");
+    TwAddVarRW(bar, "autoExposure", TW_TYPE_BOOLCPP, &scene.post.autoExposure,
+               " label='Auto exposure' group='Post' ");
+    TwAddVarRW(bar, "compensation", TW_TYPE_FLOAT, &scene.post.compensation,
+               " label='Exposure EV' group='Post' min=-8 max=8 step=0.25 ");
+    TwAddVarRW(bar, "exposureKey", TW_TYPE_FLOAT, &scene.post.key,
+               " label='Key' group='Post' min=0.01 max=1 step=0.01 ");
+    TwAddVarRW(bar, "adaptation", TW_TYPE_FLOAT, &scene.post.adaptation,
+               " label='Adaptation s' group='Post' min=0 max=10 step=0.1 ");
+    TwAddVarRW(bar, "bloomStrength", TW_TYPE_FLOAT, &scene.post.bloomStrength,
+               " label='Bloom' group='Post' min=0 max=1 step=0.01 ");
+    TwAddVarRW(bar, "bloomThreshold", TW_TYPE_FLOAT, &scene.post.bloomThreshold,
+               " label='Bloom threshold' group='Post' min=0 max=20 step=0.1 ");
+    TwAddVarRW(bar, "bloomLevels", TW_TYPE_INT32, &scene.post.bloomLevels,
+               " label='Bloom levels' group='Post' min=1 max=8 ");
+    TwAddVarRO(bar, "postMs", TW_TYPE_DOUBLE, &scene.post.timer.averageMs,
+               " label='Post ms' group='Post' precision=3 ");
+    TwAddVarRO(bar, "bloomMs", TW_TYPE_DOUBLE, &scene.post.bloomTimer.averageMs,
+               " label='Bloom ms' group='Post' precision=3 ");
+    TwAddVarRO(bar, "exposureMs", TW_TYPE_DOUBLE, &scene.post.exposureTimer.averageMs,
+               " label='Exposure ms' group='Post' precision=3 ");
+    TwAddVarRO(bar, "toneMs", TW_TYPE_DOUBLE, &scene.post.toneTimer.averageMs,
+               " label='Tone map ms' group='Post' precision=3 ");
+
+    // Anti-aliasing (see antialias.h)
+    TwAddVarRW(bar, "antialias", TwDefineEnum("Antialias", NULL, 0),
+               &scene.antialias.mode,
+               " label='Mode' group='Antialiasing' enum='0 {None}, 1 {MSAA}, 2 {TAA}' ");
+    TwAddVarRW(bar, "msaaSamples", TwDefineEnum("MSAASamples", NULL, 0),
+               &scene.antialias.samples,
+               " label='MSAA samples' group='Antialiasing' enum='2 {2}, 4 {4}, 8 {8}' ");
+    TwAddVarRW(bar, "taaFeedback", TW_TYPE_FLOAT, &scene.antialias.feedback,
+               " label='TAA new frame' group='Antialiasing' min=0.02 max=1 step=0.01 ");
+    TwAddVarRO(bar, "resolveMs", TW_TYPE_DOUBLE, &scene.antialias.timer.averageMs,
+               " label='Resolve ms' group='Antialiasing' precision=3 ");
+
+    // Dynamic resolution (see dynamicresolution.h)
+    TwAddVarRW(bar, "dynamicResolution", TW_TYPE_BOOLCPP, &scene.dynamicResolution.enabled,
+               " label='Enabled' group='Resolution' ");
+    TwAddVarRW(bar, "targetMs", TW_TYPE_FLOAT, &scene.dynamicResolution.targetMs,
+               " label='Target GPU ms' group='Resolution' min=1 max=100 step=0.5 ");
+    TwAddVarRW(bar, "minScale", TW_TYPE_FLOAT, &scene.dynamicResolution.minScale,
+               " label='Min scale' group='Resolution' min=0.25 max=1 step=0.0625 ");
+    TwAddVarRW(bar, "maxScale", TW_TYPE_FLOAT, &scene.dynamicResolution.maxScale,
+               " label='Max scale' group='Resolution' min=0.25 max=1 step=0.0625 ");
+    TwAddVarRW(bar, "sharpness", TW_TYPE_FLOAT, &scene.dynamicResolution.sharpness,
+               " label='Sharpness' group='Resolution' min=0 max=1 step=0.05 ");
+    TwAddVarRO(bar, "renderScale", TW_TYPE_FLOAT, &scene.dynamicResolution.scale,
+               " label='Scale' group='Resolution' precision=3 ");
+    TwAddVarRO(bar, "frameGpuMs", TW_TYPE_DOUBLE, &scene.dynamicResolution.frameTimer.averageMs,
+               " label='Frame GPU ms' group='Resolution' precision=2 ");
+    TwAddVarRO(bar, "upscaleMs", TW_TYPE_DOUBLE, &scene.dynamicResolution.upscaleTimer.averageMs,
+               " label='Upscale ms' group='Resolution' precision=3 ");
+
+    // Ambient occlusion (see ssao.h)
+    TwAddVarRW(bar, "ssao", TW_TYPE_BOOLCPP, &scene.ssao.enabled,
+               " label='Enabled' group='SSAO' ");
+    TwAddVarRW(bar, "ssaoQuality", TwDefineEnum("SSAOQuality", NULL, 0),
+               &scene.ssao.quality,
+               " label='Quality' group='SSAO' enum='0 {Low}, 1 {Medium}, 2 {High}' ");
+    TwAddVarRW(bar, "ssaoRadius", TW_TYPE_FLOAT, &scene.ssao.radius,
+               " label='Radius' group='SSAO' min=0.25 max=10 step=0.25 ");
+    TwAddVarRW(bar, "ssaoIntensity", TW_TYPE_FLOAT, &scene.ssao.intensity,
+               " label='Intensity' group='SSAO' min=0 max=4 step=0.1 ");
+    TwAddVarRW(bar, "ssaoBudget", TW_TYPE_FLOAT, &scene.ssao.budgetMs,
+               " label='Budget ms' group='SSAO' min=0.1 max=10 step=0.1 ");
+    TwAddVarRO(bar, "ssaoLevel", TW_TYPE_INT32, &scene.ssao.level,
+               " label='Preset in use' group='SSAO' ");
+    TwAddVarRO(bar, "ssaoMs", TW_TYPE_DOUBLE, &scene.ssao.timer.averageMs,
+               " label='Occlusion ms' group='SSAO' precision=3 ");
+    TwAddVarRO(bar, "ssaoPrepassMs", TW_TYPE_DOUBLE, &scene.ssao.prepassTimer.averageMs,
+               " label='Prepass ms' group='SSAO' precision=3 ");
+
+    // Depth prepass for the forward paths (see depthprepass.h)
+    TwAddVarRW(bar, "depthPrepass", TW_TYPE_BOOLCPP, &scene.depthPrepass.enabled,
+               " label='Enabled' group='Depth prepass' ");
+    TwAddVarRW(bar, "showOverdraw", TW_TYPE_BOOLCPP, &scene.depthPrepass.showOverdraw,
+               " label='Show overdraw' group='Depth prepass' ");
+    TwAddVarRW(bar, "overdrawMax", TW_TYPE_FLOAT, &scene.depthPrepass.maxCount,
+               " label='Overdraw for red' group='Depth prepass' min=2 max=32 step=1 ");
+    TwAddVarRO(bar, "fragmentsPerPixel", TW_TYPE_FLOAT, &scene.depthPrepass.fragmentsPerPixel,
+               " label='Shaded per pixel' group='Depth prepass' precision=2 ");
+    TwAddVarRO(bar, "depthCopied", TW_TYPE_BOOLCPP, &scene.depthPrepass.copied,
+               " label='From SSAO depth' group='Depth prepass' ");
+    TwAddVarRO(bar, "depthPrepassMs", TW_TYPE_DOUBLE, &scene.depthPrepass.timer.averageMs,
+               " label='Prepass ms' group='Depth prepass' precision=3 ");
+
+    // Shader hot reload and cache statistics
+    TwAddVarRO(bar, "shaderParallel", TW_TYPE_BOOLCPP, &shaderManager.parallelCompile,
+               " label='Parallel compile' group='Shaders' ");
+    TwAddVarRO(bar, "shaderVariants", TW_TYPE_INT32, &shaderManager.variants,
+               " label='Variants' group='Shaders' ");
+    TwAddVarRO(bar, "shaderVariantMs", TW_TYPE_DOUBLE, &shaderManager.variantMs,
+               " label='Variant build ms' group='Shaders' precision=0 ");
+    TwAddVarRO(bar, "shaderHits", TW_TYPE_INT32, &shaderManager.cacheHits,
+               " label='Cache hits' group='Shaders' ");
+    TwAddVarRO(bar, "shaderMisses", TW_TYPE_INT32, &shaderManager.cacheMisses,
+               " label='Cache misses' group='Shaders' ");
+    TwAddVarRO(bar, "shaderReloads", TW_TYPE_INT32, &shaderManager.reloads,
+               " label='Reloads' group='Shaders' ");
+    TwAddVarRO(bar, "shaderFailures", TW_TYPE_INT32, &shaderManager.failures,
+               " label='Failed reloads' group='Shaders' ");
+    TwAddVarRO(bar, "shaderReloadMs", TW_TYPE_DOUBLE, &shaderManager.lastReloadMs,
+               " label='Last reload ms' group='Shaders' precision=0 ");
+
     // Initialize our scene
     scene.InitializeScene();
+    frameLoop.Initialize();
 
     // Enter the event loop.
     glutMainLoop();
@@ -0,0 +1,16 @@
+/////////////////////////////////////////////////////////////////////////
+// Vertex shader for fullscreen passes (octahedral resampling,
+// prefiltering, ...).  Draws a single triangle covering the whole
+// viewport, generated from gl_VertexID (no vertex attributes), and
+// passes on texture coordinates running 0..1 across the viewport.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+out vec2 uv;
+
+void main()
+{
+    vec2 p = vec2((gl_VertexID<<1)&2, gl_VertexID&2);
+    uv = p;
+    gl_Position = vec4(2.0*p - 1.0, 0.0, 1.0);
+}
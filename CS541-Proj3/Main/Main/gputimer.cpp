@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////
+// A small GPU stopwatch built on OpenGL timestamp queries.  See
+// gputimer.h for usage.
+////////////////////////////////////////////////////////////////////////
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+
+#include "gputimer.h"
+
+// Reads the result of one slot (if available, or unconditionally if
+// block is set) and folds it into ms and averageMs.
+void GpuTimer::Collect(const int slot, const bool block)
+{
+    if (!pending[slot]) return;
+
+    if (!block) {
+        int available = 0;
+        glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return; }
+
+    GLuint64 t0, t1;
+    glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &t0);
+    glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &t1);
+    pending[slot] = false;
+
+    ms = (t1 - t0)/1.0e6;
+    averageMs = averageMs==0.0 ? ms : 0.9*averageMs + 0.1*ms;
+}
+
+void GpuTimer::Begin()
+{
+    // Lazily create the query objects on first use.
+    if (queries[0][0] == 0) {
+        glGenQueries(2*GPUTIMER_LATENCY, &queries[0][0]);
+        for (int i=0;  i<GPUTIMER_LATENCY;  i++)
+            pending[i] = false; }
+
+    // The slot about to be reused was issued GPUTIMER_LATENCY frames
+    // ago, so this rarely waits.
+    Collect(current, true);
+    glQueryCounter(queries[current][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::End()
+{
+    glQueryCounter(queries[current][1], GL_TIMESTAMP);
+    pending[current] = true;
+    current = (current+1)%GPUTIMER_LATENCY;
+
+    // Pick up any results which have arrived in the meantime.
+    for (int i=0;  i<GPUTIMER_LATENCY;  i++)
+        if (i != current) Collect(i, false);
+}
+
+double GpuTimer::Wait()
+{
+    Collect((current+GPUTIMER_LATENCY-1)%GPUTIMER_LATENCY, true);
+    return ms;
+}
@@ -0,0 +1,33 @@
+///////////////////////////////////////////////////////////////////////
+// A small GPU stopwatch built on OpenGL timestamp queries.  Call
+// Begin() before and End() after the commands to be measured.  The
+// queries are kept in a short ring so that reading a result never
+// stalls the pipeline;  the value in "ms" is therefore a few frames
+// old.  Since timestamps (rather than GL_TIME_ELAPSED) are used,
+// timers may be freely nested.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _GPUTIMER_
+#define _GPUTIMER_
+
+#define GPUTIMER_LATENCY 4
+
+class GpuTimer
+{
+public:
+    unsigned int queries[GPUTIMER_LATENCY][2];
+    bool pending[GPUTIMER_LATENCY];
+    int current;
+    double ms;          // Most recent available result, in milliseconds
+    double averageMs;   // Exponentially smoothed result, in milliseconds
+
+    GpuTimer() :current(0), ms(0.0), averageMs(0.0) { queries[0][0] = 0; }
+    void Begin();
+    void End();
+    double Wait();      // Blocks until the last End() is available.
+
+private:
+    void Collect(const int slot, const bool block);
+};
+
+#endif
@@ -0,0 +1,24 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader building one level of the Hi-Z pyramid (see
+// occlusion.h) from the level above:  each texel is the farthest of
+// the 2x2 source texels it covers.  Where the source has an odd
+// width (or height), the last column (row) also takes in the extra
+// source texel, so that every source texel is covered.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D source;       // Its base level is the level read
+uniform ivec2 sourceSize;
+
+void main()
+{
+    ivec2 p = 2*ivec2(gl_FragCoord.xy);
+    ivec2 last = sourceSize - 1;
+    ivec2 end = min(p + 1 + ivec2(equal(p + 2, last)), last);
+
+    float d = 0.0;
+    for (int y=p.y;  y<=end.y;  y++)
+        for (int x=p.x;  x<=end.x;  x++)
+            d = max(d, texelFetch(source, ivec2(x, y), 0).r);
+    gl_FragColor = vec4(d);
+}
@@ -0,0 +1,19 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the occlusion debug view (see occlusion.h):  shows
+// one level of the Hi-Z pyramid, as linear depth (near is bright).
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D pyramid;
+uniform float level;
+uniform float front, back;
+
+in vec2 uv;
+
+void main()
+{
+    float d = 2.0*textureLod(pyramid, uv, level).r - 1.0;
+    float z = 2.0*front*back/(back + front - d*(back - front));
+    float shade = d >= 1.0 ? 0.0 : 1.0 - clamp(z/(0.25*back), 0.0, 0.9);
+    gl_FragColor = vec4(shade, shade, shade, 1.0);
+}
@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////
+// The work-stealing job system.  See jobs.h.
+////////////////////////////////////////////////////////////////////////
+
+#include "jobs.h"
+
+JobSystem jobs;
+
+// Which queue belongs to the calling thread:  0 for the main thread
+// (and any thread which is not a worker).
+static thread_local int threadIndex = 0;
+
+// Sleeping workers, so that Push only signals when one might be waiting
+static std::atomic<int> sleeping(0);
+
+JobSystem::JobSystem()
+    :threadCount(1), executed(0), stolen(0), quit(false), queued(0)
+{
+    queues.push_back(new Queue);
+}
+
+JobSystem::~JobSystem()
+{
+    Shutdown();
+    delete queues[0];
+}
+
+void JobSystem::Initialize(const int threads)
+{
+    Shutdown();
+    threadCount = threads > 0 ? threads : std::thread::hardware_concurrency();
+    if (threadCount < 1) threadCount = 1;
+
+    quit = false;
+    for (int t=1;  t<threadCount;  t++)
+        queues.push_back(new Queue);
+    for (int t=1;  t<threadCount;  t++)
+        workers.push_back(std::thread(&JobSystem::WorkerLoop, this, t));
+}
+
+// Stops the workers (after they finish their current job);  the main
+// thread then runs everything itself.
+void JobSystem::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> l(sleepLock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (unsigned int t=0;  t<workers.size();  t++)
+        workers[t].join();
+    workers.clear();
+
+    for (unsigned int t=1;  t<queues.size();  t++)
+        delete queues[t];
+    queues.resize(1);
+    threadCount = 1;
+}
+
+void JobSystem::ResetStatistics()
+{
+    executed = 0;
+    stolen = 0;
+}
+
+void JobSystem::Push(JobCounter& counter, void (*function)(void*, int, int),
+                     void* data, const int first, const int last)
+{
+    Job job = {function, data, first, last, &counter};
+    counter.pending++;
+
+    Queue& q = *queues[threadIndex];
+    {
+        std::lock_guard<std::mutex> l(q.lock);
+        q.jobs.push_back(job);
+    }
+    queued++;
+
+    if (sleeping > 0) {
+        { std::lock_guard<std::mutex> l(sleepLock); }
+        wake.notify_one(); }
+}
+
+// Takes the newest job from the thread's own queue.
+bool JobSystem::Pop(const int self, Job& job)
+{
+    Queue& q = *queues[self];
+    std::lock_guard<std::mutex> l(q.lock);
+    if (q.jobs.empty()) return false;
+    job = q.jobs.back();
+    q.jobs.pop_back();
+    queued--;
+    return true;
+}
+
+// Takes the oldest job from some other thread's queue, trying each in
+// turn starting from the next thread.
+bool JobSystem::Steal(const int self, Job& job)
+{
+    int n = queues.size();
+    for (int k=1;  k<n;  k++) {
+        Queue& q = *queues[(self+k)%n];
+        std::lock_guard<std::mutex> l(q.lock);
+        if (q.jobs.empty()) continue;
+        job = q.jobs.front();
+        q.jobs.pop_front();
+        queued--;
+        stolen++;
+        return true; }
+    return false;
+}
+
+bool JobSystem::RunOne(const int self)
+{
+    Job job;
+    if (!Pop(self, job) && !Steal(self, job))
+        return false;
+    Execute(job);
+    return true;
+}
+
+void JobSystem::Execute(const Job& job)
+{
+    job.function(job.data, job.first, job.last);
+    executed++;
+    job.counter->pending--;
+}
+
+// Runs jobs until the counter's are all done.  Rather than block,
+// the waiting thread works on whatever it can find.
+void JobSystem::Wait(JobCounter& counter)
+{
+    while (counter.pending > 0)
+        if (!RunOne(threadIndex))
+            std::this_thread::yield();
+}
+
+void JobSystem::WorkerLoop(const int self)
+{
+    threadIndex = self;
+    while (!quit) {
+        // Spin briefly (jobs tend to come in bursts) before sleeping
+        bool found = false;
+        for (int spin=0;  spin<64 && !found && !quit;  spin++) {
+            found = RunOne(self);
+            if (!found) std::this_thread::yield(); }
+        if (found) continue;
+
+        std::unique_lock<std::mutex> l(sleepLock);
+        sleeping++;
+        wake.wait(l, [this] { return quit || queued > 0; });
+        sleeping--; }
+}
@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////
+// A small work-stealing job system for the per-frame CPU work (scene
+// graph updates, culling, light binning), so that it spreads over
+// all cores while the main thread keeps all of the OpenGL calls.
+//
+// Each thread (the main thread and threadCount-1 workers) owns a
+// deque of jobs.  A thread pushes new jobs onto the back of its own
+// deque and takes work from the back too (most recent first, while
+// its data is still in cache);  an idle thread steals from the front
+// of another's deque (the oldest, and usually largest, work).  Idle
+// workers sleep until jobs are pushed.
+//
+// A job is a plain function pointer, an argument and a range, so
+// pushing one allocates nothing.  Jobs are grouped by a JobCounter,
+// which Wait spins on, running (or stealing) jobs meanwhile, so a job
+// may itself start and wait for other jobs.  Jobs must not make
+// OpenGL calls.
+//
+//   jobs.ParallelFor(n, grain, [&](int first, int last) { ... });
+//
+// splits 0..n-1 into ranges of about grain, runs them across the
+// threads, and returns when all are done.  Run and Wait start work
+// which overlaps with the main thread's drawing:
+//
+//   JobCounter done;
+//   jobs.Run(done, [&] { ... });
+//   ... draw ...
+//   jobs.Wait(done);
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _JOBS_
+#define _JOBS_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobCounter
+{
+    std::atomic<int> pending;
+    JobCounter() :pending(0) {}
+};
+
+struct Job
+{
+    void (*function)(void* data, int first, int last);
+    void* data;
+    int first, last;
+    JobCounter* counter;
+};
+
+class JobSystem
+{
+public:
+    int threadCount;        // Including the main thread
+
+    // Statistics, since the last ResetStatistics
+    std::atomic<int> executed, stolen;
+
+    JobSystem();
+    ~JobSystem();
+    void Initialize(const int threads=0);  // 0 for one per core
+    void Shutdown();
+    void ResetStatistics();
+
+    void Push(JobCounter& counter, void (*function)(void*, int, int),
+              void* data, const int first, const int last);
+    void Wait(JobCounter& counter);
+
+    // A lambda run as one job.  It must outlive the Wait.
+    template <class F> void Run(JobCounter& counter, F& f)
+    {
+        Push(counter, &CallTask<F>, &f, 0, 0);
+    }
+
+    // Calls f(first, last) for ranges covering 0..n-1, in parallel.
+    template <class F> void ParallelFor(const int n, const int grain, F f)
+    {
+        int size = grain < 1 ? 1 : grain;
+        if (n <= size || threadCount == 1) {
+            if (n > 0) f(0, n);
+            return; }
+
+        JobCounter counter;
+        for (int first=0;  first<n;  first+=size)
+            Push(counter, &CallRange<F>, &f, first, first+size < n ? first+size : n);
+        Wait(counter);
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Job> jobs;
+    };
+    std::vector<Queue*> queues;         // One per thread, main thread first
+    std::vector<std::thread> workers;
+    std::atomic<bool> quit;
+    std::atomic<int> queued;            // Jobs in all queues
+
+    std::mutex sleepLock;               // Idle workers wait here
+    std::condition_variable wake;
+
+    bool Pop(const int self, Job& job);
+    bool Steal(const int self, Job& job);
+    bool RunOne(const int self);
+    void Execute(const Job& job);
+    void WorkerLoop(const int self);
+
+    template <class F> static void CallRange(void* f, int first, int last)
+    {
+        (*(F*)f)(first, last);
+    }
+    template <class F> static void CallTask(void* f, int, int)
+    {
+        (*(F*)f)();
+    }
+};
+
+extern JobSystem jobs;
+
+#endif
@@ -5,10 +5,11 @@
 ////////////////////////////////////////////////////////////////////////
 #version 330
 
-uniform mat4 ModelMatrix;
+#include "drawdata.glsl"
+#include "terrain.glsl"
+
 uniform mat4 ViewMatrix, ViewInverse;
 uniform mat4 ProjectionMatrix;
-uniform mat4 NormalMatrix;
 
 uniform vec3 lightPos;
 
@@ -30,6 +31,7 @@ out float depth;
 
 void main()
 {      
+    FetchDrawData();
     tangent = vertexTangent;
     texCoord = vertexTexture;
 
@@ -38,6 +40,11 @@ void main()
 
     normalVec = normalize(mat3(NormalMatrix)*vertexNormal);    
     worldPos = (ModelMatrix*vertex).xyz;
+#ifdef TERRAIN
+    vec4 terrainTangent;
+    TerrainVertex(vertex.xy, worldPos, normalVec, texCoord, terrainTangent);
+    tangent = terrainTangent.xyz;
+#endif
     //vec3 worldVertex = vec3(ModelMatrix * vertex);
     eyeVec = (ViewInverse*vec4(0,0,0,1)).xyz - worldPos;
     lightVec = lightPos - worldPos;
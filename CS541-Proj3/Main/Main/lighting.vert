@@ -5,10 +5,11 @@
 ////////////////////////////////////////////////////////////////////////
 #version 330
 
-uniform mat4 ModelMatrix;
+#include "drawdata.glsl"
+#include "terrain.glsl"
+
 uniform mat4 ViewMatrix, ViewInverse;
 uniform mat4 ProjectionMatrix;
-uniform mat4 NormalMatrix;
 
 uniform vec3 lightPos;
 
@@ -18,13 +19,16 @@ uniform vec3 lightPos;
 in vec4 vertex;
 in vec3 vertexNormal;
 in vec2 vertexTexture;
-in vec3 vertexTangent;
+in vec4 vertexTangent;
 
-out vec3 tangent;
+out vec4 tangent;           // World space, w the handedness
 out vec2 texCoord;
 out vec3 worldPos;
 out vec3 normalVec, lightVec, eyeVec;
 
+// Matching occluder.vert's, for the depth prepass (see depthprepass.h)
+invariant gl_Position;
+
 
 
 //out vec2 earthBaseTextureCoord;
@@ -33,7 +37,11 @@ out vec3 normalVec, lightVec, eyeVec;
 //out vec2 redEarthTextureCoord;
 void main()
 {      
-    tangent = vertexTangent;
+    FetchDrawData();
+#ifdef TERRAIN
+    TerrainVertex(vertex.xy, worldPos, normalVec, texCoord, tangent);
+#else
+    tangent = vec4(mat3(ModelMatrix)*vertexTangent.xyz, vertexTangent.w);
     texCoord = vertexTexture;
 
 
@@ -42,9 +50,14 @@ void main()
 
     normalVec = normalize(mat3(NormalMatrix)*vertexNormal);    
     worldPos = (ModelMatrix*vertex).xyz;
+#endif
     
     eyeVec = (ViewInverse*vec4(0,0,0,1)).xyz - worldPos;
     lightVec = lightPos - worldPos;
 	
+#ifdef TERRAIN
+    gl_Position = ProjectionMatrix*ViewMatrix*vec4(worldPos, 1.0);
+#else
     gl_Position = ProjectionMatrix*ViewMatrix*ModelMatrix*vertex;
+#endif
 }
@@ -0,0 +1,22 @@
+/////////////////////////////////////////////////////////////////////////
+// The per-object material, for the pixel shaders:  uniforms, or in
+// the INDIRECT variants, passed on from the vertex shader's draw
+// record (see drawdata.glsl).
+//
+// The TERRAIN variant is shaded as TEXTURED.
+//
+// #include "material.glsl"
+////////////////////////////////////////////////////////////////////////
+
+#ifdef TERRAIN
+#define TEXTURED
+#endif
+
+#ifdef INDIRECT
+flat in vec3 diffuse, specular;
+flat in float shininess;
+#else
+uniform vec3 diffuse;
+uniform vec3 specular;
+uniform float shininess;
+#endif
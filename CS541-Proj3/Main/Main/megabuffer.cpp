@@ -0,0 +1,257 @@
+///////////////////////////////////////////////////////////////////////
+// The multi-draw path's shared geometry, draw records and indirect
+// commands.  See megabuffer.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+
+#include "models.h"
+#include "scenegraph.h"
+#include "streambuffer.h"
+#include "megabuffer.h"
+#include "jobs.h"
+#include "allocation.h"
+
+#define DRAW_UNIT 15
+
+// Nodes per job in WriteDrawData
+#define RECORD_GRAIN 1024
+
+MegaBuffer::MegaBuffer()
+    :supported(false), vao(0), indexBuffer(0), idBuffer(0), idCount(0),
+     drawBuffer(0), drawTexture(0), commandBuffer(0), offsetAlignment(16),
+     generation(0), modelCount(0), vertexCount(0), indexCount(0), commandOffset(0)
+{
+    for (int a=0;  a<4;  a++)
+        vertexBuffers[a] = 0;
+}
+
+bool MegaBuffer::Supported()
+{
+    return glext_ARB_multi_draw_indirect && glext_ARB_base_instance
+        && glext_ARB_texture_buffer_range;
+}
+
+void MegaBuffer::Initialize()
+{
+    supported = Supported();
+    if (!supported) {
+        printf("Multi-draw unavailable:  drawing object by object\n");
+        return; }
+
+    glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(4, vertexBuffers);
+    glGenBuffers(1, &indexBuffer);
+    glGenBuffers(1, &idBuffer);
+    glGenBuffers(1, &drawBuffer);
+    glGenBuffers(1, &commandBuffer);
+    glGenTextures(1, &drawTexture);
+
+    // The attributes' formats never change, only the buffers' contents
+    const int sizes[4] = {4, 3, 2, 4};
+    glBindVertexArray(vao);
+    for (int a=0;  a<4;  a++) {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[a]);
+        glEnableVertexAttribArray(a);
+        glVertexAttribPointer(a, sizes[a], GL_FLOAT, GL_FALSE, 0, 0); }
+    glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+    glEnableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+    glVertexAttribIPointer(DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0, 0);
+    glVertexAttribDivisor(DRAW_ID_ATTRIBUTE, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBindVertexArray(0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Concatenates every model in the graph into the shared buffers.
+// Models without texture coordinates or tangents get zeros.
+void MegaBuffer::Pack(SceneGraph& graph)
+{
+    generation++;
+    std::vector<vec4> Pnt;
+    std::vector<vec3> Nrm;
+    std::vector<vec2> Tex;
+    std::vector<vec4> Tan;
+    std::vector<unsigned int> Index;
+    modelCount = 0;
+
+    for (int i=0;  i<graph.count;  i++) {
+        Model* m = graph.model[i];
+        if (!m || m->packed == generation) continue;
+        m->packed = generation;
+        m->firstIndex = Index.size();
+        m->baseVertex = Pnt.size();
+        modelCount++;
+
+        Pnt.insert(Pnt.end(), m->Pnt.begin(), m->Pnt.end());
+        Nrm.insert(Nrm.end(), m->Nrm.begin(), m->Nrm.end());
+        Nrm.resize(Pnt.size(), vec3(0.0f));
+        Tex.insert(Tex.end(), m->Tex.begin(), m->Tex.end());
+        Tex.resize(Pnt.size(), vec2(0.0f));
+        Tan.insert(Tan.end(), m->Tan.begin(), m->Tan.end());
+        Tan.resize(Pnt.size(), vec4(0.0f));
+
+        // Each quad as two triangles, with the same winding, split
+        // on the diagonal the driver chooses for GL_QUADS (so the
+        // two paths' images match)
+        for (unsigned int q=0;  q<m->Quad.size();  q++) {
+            const ivec4& Q = m->Quad[q];
+            unsigned int t[6] = {(unsigned int)Q[0], (unsigned int)Q[1], (unsigned int)Q[3],
+                                  (unsigned int)Q[1], (unsigned int)Q[2], (unsigned int)Q[3]};
+            Index.insert(Index.end(), t, t+6); }
+        for (unsigned int k=0;  k<m->Tri.size();  k++)
+            for (int c=0;  c<3;  c++)
+                Index.push_back(m->Tri[k][c]);
+        m->indexCount = Index.size() - m->firstIndex; }
+
+    vertexCount = Pnt.size();
+    indexCount = Index.size();
+    const void* data[4] = {Pnt.size() ? &Pnt[0] : NULL, Nrm.size() ? &Nrm[0] : NULL,
+                           Tex.size() ? &Tex[0] : NULL, Tan.size() ? &Tan[0] : NULL};
+    const int bytes[4] = {16, 12, 8, 16};
+    for (int a=0;  a<4;  a++) {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffers[a]);
+        glBufferData(GL_ARRAY_BUFFER, bytes[a]*vertexCount, data[a], GL_STATIC_DRAW); }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(vao);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indexCount,
+                 Index.size() ? &Index[0] : NULL, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    printf("Multi-draw buffers:  %d models, %d vertices, %d indices\n",
+           modelCount, vertexCount, indexCount);
+}
+
+// The draw records of all nodes (see megabuffer.h), into r.
+void MegaBuffer::FillRecords(const SceneGraph& graph, float* r)
+{
+    jobs.ParallelFor(graph.count, RECORD_GRAIN, [&](int first, int last)
+    {
+        for (int i=first;  i<last;  i++) {
+            float* p = r + 4*DRAW_RECORD*i;
+            const MAT4& W = graph.world[i];
+            const MAT4& N = graph.normal[i];
+            for (int row=0;  row<3;  row++)
+                for (int c=0;  c<4;  c++) {
+                    p[4*row + c] = W[row][c];
+                    p[12 + 4*row + c] = N[row][c]; }
+
+            Model* m = graph.model[i];
+            vec3 specular = m ? m->specularColor : vec3(0.0f);
+            p[24] = graph.color[i][0];
+            p[25] = graph.color[i][1];
+            p[26] = graph.color[i][2];
+            p[27] = m ? m->shininess : 0.0f;
+            p[28] = specular[0];
+            p[29] = specular[1];
+            p[30] = specular[2];
+            p[31] = 0.0f; }
+    });
+}
+
+////////////////////////////////////////////////////////////////////////
+// Once a frame, after the graph's Update:  repacks the geometry if
+// the graph holds a new model, and writes every node's draw record.
+void MegaBuffer::WriteDrawData(SceneGraph& graph, StreamBuffer& stream)
+{
+    for (int i=0;  i<graph.count;  i++)
+        if (graph.model[i] && graph.model[i]->packed != generation) {
+            Pack(graph);
+            break; }
+
+    // The drawID attribute's values:  one per node
+    if (idCount < graph.count) {
+        idCount = graph.count + graph.count/2;
+        std::vector<unsigned int> ids(idCount);
+        for (int i=0;  i<idCount;  i++)
+            ids[i] = i;
+        glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(unsigned int)*idCount, &ids[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0); }
+
+    int bytes = graph.count*DRAW_RECORD*4*sizeof(float);
+    if (bytes == 0) return;
+    int offset;
+    float* r = (float*)stream.Allocate(bytes, offsetAlignment, offset);
+    glBindTexture(GL_TEXTURE_BUFFER, drawTexture);
+    if (r) {
+        FillRecords(graph, r);
+        stream.Commit();
+        glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F, stream.buffer, offset, bytes); }
+    else {
+        r = frameArena.New<float>(bytes/sizeof(float));
+        FillRecords(graph, r);
+        glBindBuffer(GL_TEXTURE_BUFFER, drawBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, r, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawBuffer); }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE0+DRAW_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, drawTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Writes a command for each node of a culled list, binds them for
+// Draw, and binds the shared VAO.
+void MegaBuffer::WriteCommands(const SceneGraph& graph, const std::vector<int>& list,
+                               StreamBuffer& stream)
+{
+    int n = list.size();
+    int bytes = n*sizeof(DrawCommand);
+    DrawCommand* c = n ? (DrawCommand*)stream.Allocate(bytes, 4, commandOffset) : NULL;
+    bool streamed = c != NULL;
+    if (!streamed)
+        c = frameArena.New<DrawCommand>(n);
+
+    long long triangles = 0;
+    for (int k=0;  k<n;  k++) {
+        int i = list[k];
+        const Model* m = graph.model[i];
+        DrawCommand command = {m->indexCount, 1, m->firstIndex, m->baseVertex, (unsigned int)i};
+        c[k] = command;
+        triangles += m->indexCount/3; }
+    drawStats.triangles += triangles;
+
+    if (streamed) {
+        stream.Commit();
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.buffer); }
+    else {
+        commandOffset = 0;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, bytes, c, GL_STREAM_DRAW); }
+    glBindVertexArray(vao);
+}
+
+// Draws commands first..first+count-1 of the current list.
+void MegaBuffer::Draw(const int first, const int count)
+{
+    drawStats.drawCalls++;
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                (void*)(intptr_t)(commandOffset + first*sizeof(DrawCommand)),
+                                count, 0);
+}
+
+// Done with the current list.
+void MegaBuffer::Finish()
+{
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+// As EnvProbe::SetUnits, done for every pass to keep the buffer
+// sampler off unit 0.
+void MegaBuffer::SetUnits(const int program)
+{
+    int loc = glGetUniformLocation(program, "drawData");
+    glUniform1i(loc, DRAW_UNIT);
+}
@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////////////////////////
+// The multi-draw path:  all of the scene's geometry in one set of
+// buffers under a single VAO, drawn with one
+// glMultiDrawElementsIndirect per material rather than a
+// glDrawElements (and its VAO bind and uniforms) per object.
+//
+// Pack concatenates every model in the scene graph into shared
+// position, normal, texture coordinate, tangent and index buffers
+// (quads split into triangles, so one primitive type serves all),
+// recording each model's range in Model::firstIndex, indexCount and
+// baseVertex.  It is redone whenever the graph holds a model not yet
+// packed (a new central model, say).
+//
+// The per-object values live in a texture buffer of draw records
+// (RGBA32F, DRAW_RECORD texels per node), written once a frame into
+// the stream buffer (see streambuffer.h) by WriteDrawData:
+//
+//    texelFetch(drawData, 8*i+0..2):  ModelMatrix rows 0..2
+//    texelFetch(drawData, 8*i+3..5):  NormalMatrix rows 0..2
+//    texelFetch(drawData, 8*i+6):     diffuse.rgb, shininess
+//    texelFetch(drawData, 8*i+7):     specular.rgb, unused
+//
+// Each pass's culled list becomes an array of indirect commands
+// (WriteCommands), one per node, whose baseInstance is the node's
+// index.  An instanced attribute ("drawID", location 4, holding
+// 0,1,2,...) then gives the vertex shader that index, which it uses
+// to fetch the record (see drawdata.glsl):  the shaders' INDIRECT
+// variants (see ShaderVariants) do this.
+//
+// When the stream buffer is full, the records and commands are built
+// in the frame arena (see allocation.h) and uploaded with
+// glBufferData instead.
+//
+// Needs GL 4.3's multi-draw indirect and texture buffer ranges (and
+// 4.2's base instance);  without them, supported is false and the
+// scene draws object by object.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MEGABUFFER_
+#define _MEGABUFFER_
+
+#include <vector>
+
+#define DRAW_RECORD 8       // Texels (vec4) per node
+#define DRAW_ID_ATTRIBUTE 4 // The drawID attribute (see drawdata.glsl)
+
+class Model;
+class SceneGraph;
+class StreamBuffer;
+
+// The layout glMultiDrawElementsIndirect reads
+struct DrawCommand
+{
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+class MegaBuffer
+{
+public:
+    bool supported;
+    unsigned int vao;
+    unsigned int vertexBuffers[4];  // Position, normal, texture coordinate, tangent
+    unsigned int indexBuffer;
+    unsigned int idBuffer;          // 0,1,2,... for the drawID attribute
+    int idCount;
+    unsigned int drawBuffer, drawTexture;   // Draw records, when not streamed
+    unsigned int commandBuffer;             // Commands, when not streamed
+    int offsetAlignment;
+
+    // Packed geometry;  a packed model's Model::packed is generation.
+    int generation;
+    int modelCount, vertexCount, indexCount;
+
+    // The commands of the current list, in the buffer bound to
+    // GL_DRAW_INDIRECT_BUFFER
+    int commandOffset;
+
+    MegaBuffer();
+    static bool Supported();
+    void Initialize();
+    void WriteDrawData(SceneGraph& graph, StreamBuffer& stream);
+    void WriteCommands(const SceneGraph& graph, const std::vector<int>& list,
+                       StreamBuffer& stream);
+    void Draw(const int first, const int count);
+    void Finish();
+    void SetUnits(const int program);
+
+private:
+    void Pack(SceneGraph& graph);
+    void FillRecords(const SceneGraph& graph, float* r);
+};
+
+#endif
@@ -0,0 +1,292 @@
+///////////////////////////////////////////////////////////////////////
+// The mesh encoder and decoder.  See meshcodec.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "models.h"
+#include "meshcodec.h"
+
+////////////////////////////////////////////////////////////////////////
+// Octahedral encoding:  the unit sphere projected onto the octahedron
+// |x|+|y|+|z| = 1, whose lower half is folded over the upper, and
+// flattened onto the square [-1,1]^2.
+static void OctEncode(const vec3& n, short* out)
+{
+    vec3 v = n/(fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]));
+    float x = v[0], y = v[1];
+    if (v[2] < 0.0f) {
+        x = (1.0f - fabsf(v[1]))*(v[0] >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - fabsf(v[0]))*(v[1] >= 0.0f ? 1.0f : -1.0f); }
+    out[0] = (short)floorf(x*32767.0f + 0.5f);
+    out[1] = (short)floorf(y*32767.0f + 0.5f);
+}
+
+static inline vec3 OctDecode(const short* in)
+{
+    float x = in[0]*(1.0f/32767.0f);
+    float y = in[1]*(1.0f/32767.0f);
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    if (z < 0.0f) {
+        float fx = (1.0f - fabsf(y))*(x >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - fabsf(x))*(y >= 0.0f ? 1.0f : -1.0f);
+        x = fx; }
+    float s = 1.0f/sqrtf(x*x + y*y + z*z);
+    return vec3(x*s, y*s, z*s);
+}
+
+// Quantizes v in [lo,hi] to 0..65535.
+static unsigned short Quantize(const float v, const float lo, const float hi)
+{
+    if (hi <= lo) return 0;
+    float t = (v - lo)/(hi - lo);
+    t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+    return (unsigned short)floorf(t*65535.0f + 0.5f);
+}
+
+static void PutVarint(std::vector<unsigned char>& out, unsigned int v)
+{
+    while (v >= 0x80) {
+        out.push_back((unsigned char)(v | 0x80));
+        v >>= 7; }
+    out.push_back((unsigned char)v);
+}
+
+template <class T> static void Append(std::vector<unsigned char>& out, const T* p, const int n)
+{
+    const unsigned char* b = (const unsigned char*)p;
+    out.insert(out.end(), b, b + n*sizeof(T));
+}
+
+////////////////////////////////////////////////////////////////////////
+// Encodes model's arrays, and those of streams which it has, into out.
+void EncodeMesh(const Model& model, const int streams, std::vector<unsigned char>& out,
+                const long long sourceBytes, const int sourceFlags,
+                const unsigned long long sourceHash, const long long sourceTime)
+{
+    int nv = model.Pnt.size();
+    MeshHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "QMSH", 4);
+    h.version = MESH_VERSION;
+    h.streams = streams;
+    if (model.Nrm.size() != (size_t)nv) h.streams &= ~MESH_NORMALS;
+    if (model.Tex.size() != (size_t)nv) h.streams &= ~MESH_TEXCOORDS;
+    if (model.Tan.size() != (size_t)nv) h.streams &= ~MESH_TANGENTS;
+    h.vertexCount = nv;
+    h.quadCount = model.Quad.size();
+    h.triCount = model.Tri.size();
+    h.sourceBytes = sourceBytes;
+    h.sourceTime = sourceTime;
+    h.sourceFlags = sourceFlags;
+    h.sourceHash = sourceHash;
+
+    // Renumber the vertices in order of first use (unused ones last)
+    std::vector<int> remap(nv, -1);
+    std::vector<int> order;
+    order.reserve(nv);
+    std::vector<int> indices;
+    indices.reserve(4*h.quadCount + 3*h.triCount);
+    for (int q=0;  q<h.quadCount;  q++)
+        for (int c=0;  c<4;  c++)
+            indices.push_back(model.Quad[q][c]);
+    for (int t=0;  t<h.triCount;  t++)
+        for (int c=0;  c<3;  c++)
+            indices.push_back(model.Tri[t][c]);
+    for (unsigned int k=0;  k<indices.size();  k++)
+        if (remap[indices[k]] < 0) {
+            remap[indices[k]] = order.size();
+            order.push_back(indices[k]); }
+    for (int i=0;  i<nv;  i++)
+        if (remap[i] < 0) {
+            remap[i] = order.size();
+            order.push_back(i); }
+
+    // The index stream:  each index below the next unused number
+    std::vector<unsigned char> index;
+    index.reserve(2*indices.size());
+    unsigned int next = 0;
+    for (unsigned int k=0;  k<indices.size();  k++) {
+        unsigned int v = remap[indices[k]];
+        PutVarint(index, next - v);
+        if (v == next) next++; }
+    h.indexBytes = index.size();
+
+    // Ranges
+    for (int c=0;  c<3;  c++) {
+        h.minP[c] = nv ? model.Pnt[0][c] : 0.0f;
+        h.maxP[c] = h.minP[c]; }
+    for (int i=0;  i<nv;  i++)
+        for (int c=0;  c<3;  c++) {
+            h.minP[c] = fminf(h.minP[c], model.Pnt[i][c]);
+            h.maxP[c] = fmaxf(h.maxP[c], model.Pnt[i][c]); }
+    if (h.streams & MESH_TEXCOORDS) {
+        for (int c=0;  c<2;  c++)
+            h.minT[c] = h.maxT[c] = model.Tex[0][c];
+        for (int i=0;  i<nv;  i++)
+            for (int c=0;  c<2;  c++) {
+                h.minT[c] = fminf(h.minT[c], model.Tex[i][c]);
+                h.maxT[c] = fmaxf(h.maxT[c], model.Tex[i][c]); } }
+
+    out.clear();
+    Append(out, &h, 1);
+
+    std::vector<unsigned short> P(3*nv);
+    for (int i=0;  i<nv;  i++)
+        for (int c=0;  c<3;  c++)
+            P[3*i + c] = Quantize(model.Pnt[order[i]][c], h.minP[c], h.maxP[c]);
+    if (nv) Append(out, &P[0], 3*nv);
+
+    std::vector<short> S(2*nv);
+    if (h.streams & MESH_NORMALS) {
+        for (int i=0;  i<nv;  i++)
+            OctEncode(model.Nrm[order[i]], &S[2*i]);
+        Append(out, &S[0], 2*nv); }
+
+    if (h.streams & MESH_TEXCOORDS) {
+        std::vector<unsigned short> T(2*nv);
+        for (int i=0;  i<nv;  i++)
+            for (int c=0;  c<2;  c++)
+                T[2*i + c] = Quantize(model.Tex[order[i]][c], h.minT[c], h.maxT[c]);
+        Append(out, &T[0], 2*nv); }
+
+    if (h.streams & MESH_TANGENTS) {
+        for (int i=0;  i<nv;  i++) {
+            const vec4& T = model.Tan[order[i]];
+            OctEncode(vec3(T), &S[2*i]);
+            S[2*i+1] = T[3] < 0.0f ? (S[2*i+1] | 1) : (S[2*i+1] & ~1); }
+        Append(out, &S[0], 2*nv); }
+
+    if (index.size()) Append(out, &index[0], index.size());
+}
+
+////////////////////////////////////////////////////////////////////////
+// The header of encoded data, or NULL if it is not that.
+const MeshHeader* MeshDataHeader(const unsigned char* data, const size_t size)
+{
+    if (size < sizeof(MeshHeader)) return NULL;
+    const MeshHeader* h = (const MeshHeader*)data;
+    if (memcmp(h->magic, "QMSH", 4) || h->version != MESH_VERSION) return NULL;
+    if (h->vertexCount < 0 || h->quadCount < 0 || h->triCount < 0 || h->indexBytes < 0)
+        return NULL;
+    return h;
+}
+
+// Decodes n indices from p (advancing it), checking each against
+// the bounds of the stream and the vertex numbering.
+static bool DecodeIndices(const unsigned char*& p, const unsigned char* end,
+                          unsigned int& next, int* out, const int n)
+{
+    for (int k=0;  k<n;  k++) {
+        unsigned int v = 0;
+        int shift = 0;
+        while (p < end && (*p & 0x80)) {
+            v |= (*p++ & 0x7fu) << shift;
+            shift += 7; }
+        if (p >= end || shift > 28) return false;
+        v |= (unsigned int)*p++ << shift;
+        if (v > next) return false;
+        out[k] = next - v;
+        if (v == 0) next++; }
+    return true;
+}
+
+// Replaces model's arrays with the decoded ones.  Returns false if
+// data is not a valid encoding (found out part way, perhaps, leaving
+// the arrays partly replaced).
+bool DecodeMesh(const unsigned char* data, const size_t size, Model& model)
+{
+    const MeshHeader* h = MeshDataHeader(data, size);
+    if (!h) return false;
+    int nv = h->vertexCount;
+    size_t vertexBytes = 6;
+    if (h->streams & MESH_NORMALS) vertexBytes += 4;
+    if (h->streams & MESH_TEXCOORDS) vertexBytes += 4;
+    if (h->streams & MESH_TANGENTS) vertexBytes += 4;
+    if (size != sizeof(MeshHeader) + vertexBytes*nv + h->indexBytes) return false;
+
+    const unsigned char* p = data + sizeof(MeshHeader);
+    MemoryScope scope(MEM_MODELS);
+
+    vec3 lo(h->minP[0], h->minP[1], h->minP[2]);
+    vec3 step((h->maxP[0]-h->minP[0])/65535.0f, (h->maxP[1]-h->minP[1])/65535.0f,
+              (h->maxP[2]-h->minP[2])/65535.0f);
+    model.Pnt.resize(nv);
+    const unsigned short* P = (const unsigned short*)p;
+    for (int i=0;  i<nv;  i++, P+=3)
+        model.Pnt[i] = vec4(lo[0] + P[0]*step[0], lo[1] + P[1]*step[1], lo[2] + P[2]*step[2], 1.0f);
+    p += 6*nv;
+
+    model.Nrm.clear();
+    if (h->streams & MESH_NORMALS) {
+        model.Nrm.resize(nv);
+        const short* S = (const short*)p;
+        for (int i=0;  i<nv;  i++)
+            model.Nrm[i] = OctDecode(S + 2*i);
+        p += 4*nv; }
+
+    model.Tex.clear();
+    if (h->streams & MESH_TEXCOORDS) {
+        model.Tex.resize(nv);
+        const unsigned short* T = (const unsigned short*)p;
+        vec2 tlo(h->minT[0], h->minT[1]);
+        vec2 tstep((h->maxT[0]-h->minT[0])/65535.0f, (h->maxT[1]-h->minT[1])/65535.0f);
+        for (int i=0;  i<nv;  i++)
+            model.Tex[i] = vec2(tlo[0] + T[2*i]*tstep[0], tlo[1] + T[2*i+1]*tstep[1]);
+        p += 4*nv; }
+
+    model.Tan.clear();
+    if (h->streams & MESH_TANGENTS) {
+        model.Tan.resize(nv);
+        const short* S = (const short*)p;
+        for (int i=0;  i<nv;  i++)
+            model.Tan[i] = vec4(OctDecode(S + 2*i), (S[2*i+1] & 1) ? -1.0f : 1.0f);
+        p += 4*nv; }
+
+    // The index stream, straight into the quads and triangles
+    const unsigned char* end = p + h->indexBytes;
+    unsigned int next = 0;
+    model.Quad.resize(h->quadCount);
+    model.Tri.resize(h->triCount);
+    if (!DecodeIndices(p, end, next, h->quadCount ? &model.Quad[0][0] : NULL, 4*h->quadCount)
+        || !DecodeIndices(p, end, next, h->triCount ? &model.Tri[0][0] : NULL, 3*h->triCount)
+        || next > (unsigned int)nv)
+        return false;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////
+// 64 bit FNV-1a of a cache's source file, so that an edit which
+// keeps the file's size still invalidates the cache.
+unsigned long long MeshSourceHash(const std::vector<unsigned char>& data)
+{
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i=0;  i<data.size();  i++) {
+        h ^= data[i];
+        h *= 1099511628211ULL; }
+    return h;
+}
+
+bool ReadMeshFile(const char* name, std::vector<unsigned char>& data)
+{
+    FILE* f = fopen(name, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data.resize(size);
+    bool ok = size > 0 && fread(&data[0], 1, size, f) == (size_t)size;
+    fclose(f);
+    return ok;
+}
+
+bool WriteMeshFile(const char* name, const std::vector<unsigned char>& data)
+{
+    FILE* f = fopen(name, "wb");
+    if (!f) return false;
+    bool ok = fwrite(&data[0], 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
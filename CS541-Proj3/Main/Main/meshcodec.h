@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////
+// A compact encoding of a Model's arrays, for storing models on disk
+// (see Ply::Ply, which caches each PLY file's model in one) and
+// decoding them at load time far faster than parsing and
+// recomputing them.
+//
+// Positions are quantized to 16 bits per coordinate, relative to the
+// model's bounding box (an error of at most 1/131070 of its extent).
+// Normals and tangents are octahedrally encoded, as two 16-bit snorm
+// values (an error of at most about 0.01 degree;  a tangent's
+// handedness is the low bit of its second value), and texture
+// coordinates quantized to 16 bits over their range.  Streams which
+// the loader can cheaply rebuild (a PLY's texture coordinates and
+// tangents) may be left out;  the header's streams says which are
+// present.
+//
+// The encoder first renumbers the vertices in the order the quads
+// and then triangles first use them.  Each index is then stored as
+// the distance below the next unused vertex number -- 0 for a vertex
+// not used before, and usually small for one used recently -- as a
+// variable length integer (7 bits a byte, the top bit set on all but
+// the last).  Nothing is entropy coded, so decoding is a single pass
+// at close to memory speed.  The renumbering changes nothing about
+// what is drawn:  the primitives keep their order and winding.
+//
+//   std::vector<unsigned char> data;
+//   EncodeMesh(model, MESH_NORMALS, data);
+//   ...
+//   DecodeMesh(&data[0], data.size(), model);   // Fills the arrays
+//
+// All values are stored little-endian, as the machine holds them.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MESHCODEC_
+#define _MESHCODEC_
+
+#include <stddef.h>
+#include <vector>
+
+class Model;
+
+#define MESH_VERSION 4
+
+// Optional streams (positions and indices are always present)
+enum MeshStreams {MESH_NORMALS=1, MESH_TEXCOORDS=2, MESH_TANGENTS=4};
+
+struct MeshHeader
+{
+    char magic[4];              // "QMSH"
+    int version;                // MESH_VERSION
+    int streams;                // MeshStreams bits
+    int vertexCount, quadCount, triCount;
+    int indexBytes;             // Size of the index stream
+    float minP[3], maxP[3];     // Position range
+    float minT[2], maxT[2];     // Texture coordinate range
+    long long sourceBytes;      // For a cache:  the size of the file it was made from,
+    long long sourceTime;       //   its modification time,
+    int sourceFlags;            //   how it was loaded,
+    unsigned long long sourceHash;  // and MeshSourceHash of its contents
+};
+
+void EncodeMesh(const Model& model, const int streams, std::vector<unsigned char>& out,
+                const long long sourceBytes=0, const int sourceFlags=0,
+                const unsigned long long sourceHash=0, const long long sourceTime=0);
+bool DecodeMesh(const unsigned char* data, const size_t size, Model& model);
+const MeshHeader* MeshDataHeader(const unsigned char* data, const size_t size);
+
+unsigned long long MeshSourceHash(const std::vector<unsigned char>& data);
+
+bool ReadMeshFile(const char* name, std::vector<unsigned char>& data);
+bool WriteMeshFile(const char* name, const std::vector<unsigned char>& data);
+
+#endif
@@ -0,0 +1,199 @@
+///////////////////////////////////////////////////////////////////////
+// Meshlet building and culling.  See meshlet.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <algorithm>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+
+#include "models.h"
+#include "meshlet.h"
+#include "jobs.h"
+#include "allocation.h"
+
+// Meshlets per culling job
+#define CULL_MESHLETS 256
+
+////////////////////////////////////////////////////////////////////////
+// Splits model's triangles into meshlets, and reorders its Tri list
+// to match.  reverse flips the facing, as it does Ply's normals.
+void BuildMeshlets(Model& model, const bool reverse)
+{
+    MemoryScope scope(MEM_MODELS);
+    model.meshlets.clear();
+    int nt = model.Tri.size(), nv = model.Pnt.size();
+    if (nt == 0) return;
+
+    // The triangles using each vertex
+    std::vector<int> first(nv+1, 0), adjacent(3*nt);
+    for (int t=0;  t<nt;  t++)
+        for (int c=0;  c<3;  c++)
+            first[model.Tri[t][c]+1]++;
+    for (int v=0;  v<nv;  v++)
+        first[v+1] += first[v];
+    std::vector<int> fill(first.begin(), first.end()-1);
+    for (int t=0;  t<nt;  t++)
+        for (int c=0;  c<3;  c++)
+            adjacent[fill[model.Tri[t][c]]++] = t;
+
+    std::vector<unsigned char> used(nt, 0);
+    std::vector<int> mark(nv, -1);          // The meshlet a vertex is in
+    std::vector<int> order;
+    order.reserve(nt);
+    std::vector<int> candidates;
+    int seed = 0;
+
+    while (int(order.size()) < nt) {
+        while (used[seed]) seed++;
+        int m = model.meshlets.size();
+        int vertices = 0, tris = 0;
+        int start = order.size();
+        candidates.clear();
+
+        for (int t=seed;  t>=0; ) {
+            // Add t, and its neighbours as candidates
+            used[t] = 1;
+            order.push_back(t);
+            tris++;
+            for (int c=0;  c<3;  c++) {
+                int v = model.Tri[t][c];
+                if (mark[v] == m) continue;
+                mark[v] = m;
+                vertices++;
+                candidates.insert(candidates.end(), &adjacent[first[v]], &adjacent[first[v+1]]); }
+            if (tris == MESHLET_TRIANGLES) break;
+
+            // The candidate bringing in the fewest new vertices
+            int best = -1, bestNew = 4;
+            for (unsigned int k=0;  k<candidates.size();  k++) {
+                int u = candidates[k];
+                if (used[u]) continue;
+                int added = 0;
+                for (int c=0;  c<3;  c++)
+                    if (mark[model.Tri[u][c]] != m) added++;
+                if (vertices + added <= MESHLET_VERTICES && added < bestNew) {
+                    best = u;
+                    bestNew = added;
+                    if (added == 0) break; } }
+            t = best; }
+
+        // Bounds:  the box's center, and the cone about the average
+        // of the facet normals
+        Meshlet ml;
+        ml.firstTri = start;
+        ml.triCount = tris;
+        vec3 lo(1e30f), hi(-1e30f), sum(0.0f);
+        std::vector<vec3> normals(tris);
+        for (int k=0;  k<tris;  k++) {
+            const ivec3& tri = model.Tri[order[start+k]];
+            vec3 p[3];
+            for (int c=0;  c<3;  c++) {
+                p[c] = vec3(model.Pnt[tri[c]]);
+                lo = min(lo, p[c]);
+                hi = max(hi, p[c]); }
+            vec3 n = cross(p[1]-p[0], p[2]-p[0]);
+            float len = length(n);
+            normals[k] = len > 0.0f ? (reverse ? -n : n)/len : vec3(0.0f);
+            sum += normals[k]; }
+
+        ml.center = 0.5f*(lo + hi);
+        ml.radius = 0.0f;
+        for (int k=0;  k<tris;  k++) {
+            const ivec3& tri = model.Tri[order[start+k]];
+            for (int c=0;  c<3;  c++)
+                ml.radius = std::max(ml.radius, length(vec3(model.Pnt[tri[c]]) - ml.center)); }
+
+        float len = length(sum);
+        ml.axis = len > 0.0f ? sum/len : vec3(0.0f, 0.0f, 1.0f);
+        float least = len > 0.0f ? 1.0f : -1.0f;
+        for (int k=0;  k<tris && least > 0.0f;  k++)
+            least = std::min(least, normals[k] == vec3(0.0f) ? 1.0f : dot(ml.axis, normals[k]));
+        ml.cutoff = least > 0.0f ? sqrtf(1.0f - least*least) : 1.0f;
+        model.meshlets.push_back(ml); }
+
+    std::vector<ivec3> tri(nt);
+    for (int k=0;  k<nt;  k++)
+        tri[k] = model.Tri[order[k]];
+    for (int k=0;  k<nt;  k++)
+        model.Tri[k] = tri[k];
+}
+
+////////////////////////////////////////////////////////////////////////
+MeshletCuller::MeshletCuller()
+    :enabled(true), clusters(0), visibleClusters(0), triangles(0), visibleTriangles(0),
+     eye(0.0f)
+{
+}
+
+void MeshletCuller::BeginFrame()
+{
+    clusters = visibleClusters = triangles = visibleTriangles = 0;
+}
+
+// The view the following draws use (see Scene::SetupVariants).
+void MeshletCuller::SetView(const MAT4& View, const MAT4& Proj)
+{
+    frustum.FromMatrix(Proj*View);
+    MAT4 inverse = MAT4(View).inverse();
+    eye = vec3(inverse[0][3], inverse[1][3], inverse[2][3]);
+}
+
+// Draws the model's meshlets which may be seen, with world (and its
+// inverse) as its transform.
+void MeshletCuller::Draw(Model* model, const MAT4& world, const MAT4& inverse)
+{
+    int n = model->meshlets.size();
+    visible.resize(n);
+
+    // The eye in model coordinates, for the cones;  the world scale,
+    // for the spheres
+    vec3 e;
+    for (int r=0;  r<3;  r++)
+        e[r] = inverse[r][0]*eye[0] + inverse[r][1]*eye[1] + inverse[r][2]*eye[2] + inverse[r][3];
+    float scale = 0.0f;
+    for (int c=0;  c<3;  c++)
+        scale = std::max(scale, length(vec3(world[0][c], world[1][c], world[2][c])));
+
+    jobs.ParallelFor(n, CULL_MESHLETS, [&](int m0, int m1)
+    {
+        for (int m=m0;  m<m1;  m++) {
+            const Meshlet& ml = model->meshlets[m];
+            vec3 c;
+            for (int r=0;  r<3;  r++)
+                c[r] = world[r][0]*ml.center[0] + world[r][1]*ml.center[1]
+                       + world[r][2]*ml.center[2] + world[r][3];
+            vec3 d = ml.center - e;
+            visible[m] = frustum.SphereInside(c, ml.radius*scale)
+                         && dot(d, ml.axis) < ml.cutoff*length(d) + ml.radius; }
+    });
+
+    // Runs of survivors, each one range of the index buffer
+    counts.clear();
+    offsets.clear();
+    int drawn = 0, survivors = 0;
+    for (int m=0;  m<n;  m++) {
+        if (!visible[m]) continue;
+        const Meshlet& ml = model->meshlets[m];
+        survivors++;
+        drawn += ml.triCount;
+        const void* offset = (const void*)(sizeof(int)*3*size_t(ml.firstTri));
+        if (m > 0 && visible[m-1] && counts.size())
+            counts.back() += 3*ml.triCount;
+        else {
+            counts.push_back(3*ml.triCount);
+            offsets.push_back(offset); } }
+
+    clusters += n;
+    visibleClusters += survivors;
+    triangles += model->Tri.size();
+    visibleTriangles += drawn;
+    if (counts.empty()) return;
+
+    drawStats.drawCalls++;
+    drawStats.triangles += drawn;
+    glBindVertexArray(model->vao);
+    glMultiDrawElements(GL_TRIANGLES, &counts[0], GL_UNSIGNED_INT, &offsets[0], counts.size());
+    glBindVertexArray(0);
+}
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////
+// Meshlets:  a model's triangles split into small clusters (of at
+// most MESHLET_VERTICES vertices and MESHLET_TRIANGLES triangles),
+// each with a bounding sphere and a cone bounding its triangles'
+// normals, so that a large mesh (a scan such as dragon.ply) is drawn
+// without the clusters which are off screen or wholly back-facing.
+//
+// BuildMeshlets grows each cluster greedily from a seed triangle,
+// adding the neighbouring triangle which brings in the fewest new
+// vertices, so clusters are compact patches of the surface.  It then
+// reorders the model's Tri list cluster by cluster, so each cluster
+// is a contiguous range of the index buffer.  (Models made of quads
+// get none, and are drawn whole.)
+//
+// Each draw of a model with meshlets, MeshletCuller::Draw tests the
+// clusters -- split across the job system (see jobs.h) -- against the
+// view frustum (the sphere) and for facing away from the eye (the
+// cone), and then draws the survivors with one glMultiDrawElements,
+// adjacent survivors merged into one range.
+//
+// A cluster is back-facing when the eye is inside the cone's
+// "backface" region:  with c its center, r its radius, a the cone
+// axis and cutoff the sine of the cone's half angle,
+//
+//    dot(c - eye, a) >= cutoff*|c - eye| + r
+//
+// (a cone wider than a hemisphere has cutoff 1, and is never culled).
+// Both tests are conservative, so the image is unchanged except where
+// a back face would have shown (through a hole in an open mesh).
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MESHLET_
+#define _MESHLET_
+
+#include <vector>
+
+#include "transform.h"
+
+class Model;
+
+#define MESHLET_VERTICES  64
+#define MESHLET_TRIANGLES 124
+
+struct Meshlet
+{
+    vec3 center;            // Bounding sphere, in model coordinates
+    float radius;
+    vec3 axis;              // Normal cone
+    float cutoff;
+    int firstTri, triCount; // Range of the model's Tri list
+};
+
+void BuildMeshlets(Model& model, const bool reverse=false);
+
+class MeshletCuller
+{
+public:
+    bool enabled;
+
+    // Statistics of the current frame, summed over its draws
+    int clusters, visibleClusters;
+    int triangles, visibleTriangles;
+
+    MeshletCuller();
+    void BeginFrame();
+    void SetView(const MAT4& View, const MAT4& Proj);
+    void Draw(Model* model, const MAT4& world, const MAT4& inverse);
+
+private:
+    Frustum frustum;
+    vec3 eye;                               // World coordinates
+    std::vector<unsigned char> visible;     // Per meshlet, of the current draw
+    std::vector<int> counts;                // Ranges to draw
+    std::vector<const void*> offsets;
+};
+
+#endif
@@ -11,7 +11,7 @@
 // position,        vec4,   attribute #0
 // normal,          vec3,   attribute #1
 // texture coord,   vec3,   attribute #2
-// tangent,         vec3,   attribute #3
+// tangent,         vec4,   attribute #3 (w: handedness)
 //
 // An instance of any of these shapes is create with a single call:
 //    unsigned int obj = CreateSphere(divisions, &quadCount);
@@ -25,7 +25,9 @@
 
 #include <vector>
 #include <fstream>
+#include <string>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <glload/gl_3_3.h>
 #include <glload/gl_load.hpp>
 #include <glm/glm.hpp>
@@ -35,6 +37,7 @@
 #include "transform.h"
 #include "models.h"
 #include "rply.h"
+#include "meshcodec.h"
 
 const float PI = 3.14159f;
 const float rad = PI/180.0f;
@@ -47,11 +50,11 @@ mat4 Identity(1.0);
 // the vertex position, normal, texture coordinate, and tangent
 // vector.  This is the latest and most efficient way to get geometry
 // into the OpenGL graphics pipeline.
-unsigned int VaoFromQuads(std::vector<vec4> Pnt,
-                          std::vector<vec3> Nrm,
-                          std::vector<vec2> Tex,
-                          std::vector<vec3> Tan,
-                          std::vector<ivec4> Quad)
+unsigned int VaoFromQuads(const MeshArray<vec4>& Pnt,
+                          const MeshArray<vec3>& Nrm,
+                          const MeshArray<vec2>& Tex,
+                          const MeshArray<vec4>& Tan,
+                          const MeshArray<ivec4>& Quad)
 {
     unsigned int vao;
     glGenVertexArrays(1, &vao);
@@ -90,10 +93,10 @@ unsigned int VaoFromQuads(std::vector<vec4> Pnt,
         GLuint Dbuff;
         glGenBuffers(1, &Dbuff);
         glBindBuffer(GL_ARRAY_BUFFER, Dbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*Pnt.size(),
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*4*Pnt.size(),
                      &Tan[0][0], GL_STATIC_DRAW);
         glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, 0);
         glBindBuffer(GL_ARRAY_BUFFER, 0); }
 
     GLuint Ibuff;
@@ -107,11 +110,11 @@ unsigned int VaoFromQuads(std::vector<vec4> Pnt,
     return vao;
 }
 
-unsigned int VaoFromTris(std::vector<vec4> Pnt,
-                         std::vector<vec3> Nrm,
-                         std::vector<vec2> Tex,
-                         std::vector<vec3> Tan,
-                         std::vector<ivec3> Tri)
+unsigned int VaoFromTris(const MeshArray<vec4>& Pnt,
+                         const MeshArray<vec3>& Nrm,
+                         const MeshArray<vec2>& Tex,
+                         const MeshArray<vec4>& Tan,
+                         const MeshArray<ivec3>& Tri)
 {
     unsigned int vao;
     glGenVertexArrays(1, &vao);
@@ -150,10 +153,10 @@ unsigned int VaoFromTris(std::vector<vec4> Pnt,
         GLuint Dbuff;
         glGenBuffers(1, &Dbuff);
         glBindBuffer(GL_ARRAY_BUFFER, Dbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*Pnt.size(),
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*4*Pnt.size(),
                      &Tan[0][0], GL_STATIC_DRAW);
         glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, 0);
         glBindBuffer(GL_ARRAY_BUFFER, 0); }
 
     GLuint Ibuff;
@@ -167,12 +170,23 @@ unsigned int VaoFromTris(std::vector<vec4> Pnt,
     return vao;
 }
 
+// Sizes the data arrays exactly, before a constructor fills them.
+void Model::Reserve(const int vertices, const int quads, const int tris)
+{
+    Pnt.reserve(vertices);
+    Nrm.reserve(vertices);
+    Tex.reserve(vertices);
+    Tan.reserve(vertices);
+    Quad.reserve(quads);
+    Tri.reserve(tris);
+}
+
 void Model::ComputeSize()
 {
     // Compute min/max
     minP = swizzle<X,Y,Z>(Pnt[0]);
     maxP = swizzle<X,Y,Z>(Pnt[0]);
-    for (std::vector<vec4>::iterator p=Pnt.begin();  p<Pnt.end();  p++)
+    for (MeshArray<vec4>::iterator p=Pnt.begin();  p<Pnt.end();  p++)
         for (int c=0;  c<3;  c++) {
             minP[c] = min(minP[c], (*p)[c]);
             maxP[c] = max(maxP[c], (*p)[c]); }
@@ -182,10 +196,72 @@ void Model::ComputeSize()
     for (int c=0;  c<3;  c++)
         size = max(size, (maxP[c]-minP[c])/2.0f);
 
+    radius = 0.0;
+    for (MeshArray<vec4>::iterator p=Pnt.begin();  p<Pnt.end();  p++)
+        radius = max(radius, length(vec3((*p)[0], (*p)[1], (*p)[2]) - center));
+
     float s = 1.0/size;
     modelTr = Scale(s,s,s)*Translate(-center[0], -center[1], -center[2]);
 }
 
+// Tangents for normal mapping, made from the positions, normals and
+// texture coordinates as MikkTSpace makes them:  each triangle's
+// directions of increasing s and t are summed into its corners,
+// weighted by the corner's angle, and each vertex's sum of s
+// directions is made orthogonal to its normal.  Tan's w is +1 if the
+// sum of t directions is on the side of cross(N,T), and -1 if the
+// texture is mirrored there.  (MikkTSpace would split a vertex whose
+// triangles disagree;  here the larger sum decides.)  Quads are split
+// on the same diagonal as MegaBuffer::Pack splits them.  A vertex with
+// no usable direction (no texture coordinates, or a degenerate
+// mapping) gets any tangent orthogonal to its normal.
+void Model::ComputeTangents()
+{
+    MemoryScope scope(MEM_MODELS);
+    int nv = Pnt.size();
+    std::vector<vec3> sSum(nv, vec3(0.0f)), tSum(nv, vec3(0.0f));
+
+    auto triangle = [&](const int i0, const int i1, const int i2)
+    {
+        int v[3] = {i0, i1, i2};
+        vec3 p[3];
+        for (int c=0;  c<3;  c++)
+            p[c] = vec3(Pnt[v[c]]);
+        vec2 d1 = Tex[i1] - Tex[i0];
+        vec2 d2 = Tex[i2] - Tex[i0];
+        float r = d1[0]*d2[1] - d2[0]*d1[1];
+        vec3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+        if (fabsf(r) < 1e-12f || length(cross(e1, e2)) < 1e-12f) return;
+        vec3 sDir = normalize((e1*d2[1] - e2*d1[1])/r);
+        vec3 tDir = normalize((e2*d1[0] - e1*d2[0])/r);
+        for (int c=0;  c<3;  c++) {
+            vec3 a = p[(c+1)%3] - p[c], b = p[(c+2)%3] - p[c];
+            float la = length(a), lb = length(b);
+            if (la == 0.0f || lb == 0.0f) continue;
+            float angle = acosf(std::max(-1.0f, std::min(1.0f, dot(a, b)/(la*lb))));
+            sSum[v[c]] += angle*sDir;
+            tSum[v[c]] += angle*tDir; }
+    };
+
+    if (Tex.size() == (size_t)nv) {
+        for (unsigned int q=0;  q<Quad.size();  q++) {
+            triangle(Quad[q][0], Quad[q][1], Quad[q][3]);
+            triangle(Quad[q][1], Quad[q][2], Quad[q][3]); }
+        for (unsigned int t=0;  t<Tri.size();  t++)
+            triangle(Tri[t][0], Tri[t][1], Tri[t][2]); }
+
+    Tan.resize(nv);
+    for (int i=0;  i<nv;  i++) {
+        vec3 N = Nrm.size() == (size_t)nv && length(Nrm[i]) > 0.0f
+            ? normalize(Nrm[i]) : vec3(0.0f, 0.0f, 1.0f);
+        vec3 T = sSum[i] - N*dot(N, sSum[i]);
+        if (length(T) < 1e-6f)
+            T = cross(N, fabsf(N[0]) < 0.9f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f));
+        T = normalize(T);
+        float w = dot(cross(N, T), tSum[i]) < 0.0f ? -1.0f : 1.0f;
+        Tan[i] = vec4(T[0], T[1], T[2], w); }
+}
+
 void Model::MakeVAO()
 {
     if (Quad.size()) {
@@ -198,8 +274,13 @@ void Model::MakeVAO()
         shape = 3; }
 }
 
+DrawStats drawStats = {0, 0};
+
 void Model::DrawVAO()
 {
+    drawStats.drawCalls++;
+    drawStats.triangles += shape==4 ? 2*count : count;
+
     glBindVertexArray(vao);
     if (shape==4)
         glDrawElements(GL_QUADS, shape*count, GL_UNSIGNED_INT, 0);
@@ -208,6 +289,52 @@ void Model::DrawVAO()
     glBindVertexArray(0);
 }
 
+////////////////////////////////////////////////////////////////////////
+// The occluder proxy (see softocclusion.h) must lie inside the model,
+// or it would hide what is really visible.  A flat model (the ground)
+// is its own bounding box, so gets that, as two triangles;  no such
+// shape is known for the general model, which then gets none (and is
+// not an occluder for the software rasterizer).
+void Model::MakeProxy()
+{
+    proxyBuilt = true;
+    proxy.clear();
+    vec3 extent = maxP - minP;
+    int flat = extent[0] <= 1e-4f*size ? 0 : extent[1] <= 1e-4f*size ? 1 : extent[2] <= 1e-4f*size ? 2 : -1;
+    if (flat < 0) return;
+
+    int u = (flat+1)%3, v = (flat+2)%3;
+    vec3 c[4] = {minP, minP, minP, minP};
+    c[1][u] = c[2][u] = maxP[u];
+    c[2][v] = c[3][v] = maxP[v];
+    MemoryScope scope(MEM_MODELS);
+    proxy.push_back(c[0]);  proxy.push_back(c[1]);  proxy.push_back(c[2]);
+    proxy.push_back(c[0]);  proxy.push_back(c[2]);  proxy.push_back(c[3]);
+}
+
+// A sphere's proxy is the cube inscribed in the largest sphere inside
+// its facets:  all of its n by 2n quads are within PI/n of a vertex,
+// so that sphere's radius is at least cos(PI/n).
+void Sphere::MakeProxy()
+{
+    proxyBuilt = true;
+    proxy.clear();
+    int n = int(sqrtf(Quad.size()/2.0f) + 0.5f);
+    if (n < 3) return;
+
+    float h = radius*cosf(PI/n)/sqrtf(3.0f);
+    static const int faces[6][4] = {{0,2,3,1}, {4,5,7,6}, {0,1,5,4},
+                                    {2,6,7,3}, {0,4,6,2}, {1,3,7,5}};
+    MemoryScope scope(MEM_MODELS);
+    for (int f=0;  f<6;  f++) {
+        vec3 c[4];
+        for (int k=0;  k<4;  k++) {
+            int i = faces[f][k];
+            c[k] = center + vec3(i&1 ? h : -h, i&2 ? h : -h, i&4 ? h : -h); }
+        proxy.push_back(c[0]);  proxy.push_back(c[1]);  proxy.push_back(c[2]);
+        proxy.push_back(c[0]);  proxy.push_back(c[2]);  proxy.push_back(c[3]); }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Data for the Utah teapot.  It consists of a list of 306 control
 // points, and 32 Bezier patches, each defined by 16 control points
@@ -379,6 +506,8 @@ Teapot::Teapot(const int n)
     int npatches = sizeof(TeapotIndex)/sizeof(TeapotIndex[0]); // Should be 32 patches for the teapot
     const int nv = npatches*(n+1)*(n+1);
     int nq = npatches*n*n;
+    MemoryScope scope(MEM_MODELS);
+    Reserve(nv, nq, 0);
 
     for (int p=0;  p<npatches;  p++)    { // For each patch
         for (int i=0;  i<=n; i++) {       // Grid in u direction
@@ -441,8 +570,6 @@ Teapot::Teapot(const int n)
                     du0*v0*(*p10-*p00) + du0*v1*(*p11-*p01) + du0*v2*(*p12-*p02) + du0*v3*(*p13-*p03) +
                     du1*v0*(*p20-*p10) + du1*v1*(*p21-*p11) + du1*v2*(*p22-*p12) + du1*v3*(*p23-*p13) +
                     du2*v0*(*p30-*p20) + du2*v1*(*p31-*p21) + du2*v2*(*p32-*p22) + du2*v3*(*p33-*p23);
-                Tan.push_back(du);
-
                 // Evaluate the v-tangent of the Bezier patch at (u,v)
                 vec3 dv =
                     u0*dv0*(*p01-*p00) + u0*dv1*(*p02-*p01) + u0*dv2*(*p03-*p02) +
@@ -463,6 +590,7 @@ Teapot::Teapot(const int n)
                                           p*(n+1)*(n+1) + (i-1)*(n+1) + (j),
                                           p*(n+1)*(n+1) + (i  )*(n+1) + (j),
                                           p*(n+1)*(n+1) + (i  )*(n+1) + (j-1))); } } }
+    ComputeTangents();
     ComputeSize();
     MakeVAO();
 }
@@ -479,6 +607,9 @@ Sphere::Sphere(const int n)
 	specularColor = vec3(.3, .3, .3);
 	shininess = 0.3;
 
+    MemoryScope scope(MEM_MODELS);
+    Reserve((2*n+1)*(n+1), 2*n*n, 0);
+
     float d = 2.0f*PI/float(n*2);
     for (int i=0;  i<=n*2;  i++) {
         float s = i*2.0f*PI/float(n*2);
@@ -490,12 +621,12 @@ Sphere::Sphere(const int n)
             Pnt.push_back(vec4(x,y,z,1.0f));
             Nrm.push_back(vec3(x,y,z));
             Tex.push_back(vec2(s/(2*PI), t/PI));
-            Tan.push_back(vec3(-sin(s), cos(s), 0.0));
             if (i>0 && j>0) {
                 Quad.push_back(ivec4((i-1)*(n+1) + (j-1),
                                       (i-1)*(n+1) + (j),
                                       (i  )*(n+1) + (j),
                                       (i  )*(n+1) + (j-1))); } } }
+    ComputeTangents();
     ComputeSize();
     MakeVAO();
 }
@@ -515,27 +646,74 @@ Ply::Ply(const char* name, const bool reverse)
 	specularColor = vec3(0.3, 0.3, 0.3);
 	shininess = 0.8;
 
+    MemoryScope scope(MEM_MODELS);
+
+    // A compressed copy (see meshcodec.h) is kept beside the PLY
+    // file, made on the first load, and decoded on later ones in
+    // place of parsing the text and recomputing the normals.  It is
+    // made again whenever the PLY file's contents change.
+    //
+    // The PLY file's size and modification time (a stat, not a read)
+    // usually settle that;  only when the size matches but the time
+    // does not (a copy, a checkout, an edit) is the file read and
+    // hashed, and if its contents are unchanged the new time is
+    // recorded in the cache, so later loads skip the hash.
+    std::string cache(name);
+    size_t dot = cache.rfind('.');
+    cache = cache.substr(0, dot == std::string::npos ? cache.size() : dot) + ".qmesh";
+    long long sourceBytes = -1, sourceTime = 0;
+    struct stat info;
+    if (useCache && stat(name, &info) == 0) {
+        sourceBytes = info.st_size;
+        sourceTime = info.st_mtime; }
+
+    std::vector<unsigned char> data;
+    bool current = false;
+    if (useCache && ReadMeshFile(cache.c_str(), data)) {
+        MeshHeader* h = (MeshHeader*)MeshDataHeader(&data[0], data.size());
+        if (h && h->sourceBytes == sourceBytes && h->sourceFlags == int(reverse)) {
+            current = h->sourceTime == sourceTime;
+            std::vector<unsigned char> source;
+            if (!current && ReadMeshFile(name, source) && h->sourceHash == MeshSourceHash(source)) {
+                h->sourceTime = sourceTime;
+                current = true;
+                WriteMeshFile(cache.c_str(), data); } } }
+
+    if (current && DecodeMesh(&data[0], data.size(), *this)) {
+        Tex.reserve(Pnt.size());
+        for (unsigned int i=0;  i<Pnt.size();  i++)
+            Tex.push_back(vec2(Pnt[i][0], Pnt[i][1]));
+        ComputeTangents();
+        BuildMeshlets(*this, reverse);
+        ComputeSize();
+        MakeVAO();
+        return; }
+    Pnt.clear();  Nrm.clear();  Tex.clear();  Tan.clear();  Quad.clear();  Tri.clear();
+
     // Open PLY file and read header;  Exit on any failure.
     p_ply ply = ply_open(name, NULL, 0, NULL);
     if (!ply) { throw std::exception(); }
     if (!ply_read_header(ply)) { throw std::exception(); }
 
     // Setup callback for verticescs
-    ply_set_read_cb(ply, "vertex", "x", vertex_cb, this, 0);
+    long nv = ply_set_read_cb(ply, "vertex", "x", vertex_cb, this, 0);
     ply_set_read_cb(ply, "vertex", "y", vertex_cb, this, 1);
     ply_set_read_cb(ply, "vertex", "z", vertex_cb, this, 2);
 
     // Setup callback for faces
-    ply_set_read_cb(ply, "face", "vertex_indices", face_cb, this, 0);
+    long nf = ply_set_read_cb(ply, "face", "vertex_indices", face_cb, this, 0);
+
+    // The header gives the counts (exactly, for triangles)
+    Reserve(nv, 0, nf);
 
     // Read the PLY file filling the arrays via the callbacks.
     if (!ply_read(ply)) {printf("Failure in ply_read\n"); exit(-1); }
+    ply_close(ply);
 
 
     // Zero out the vertex normals
     for (int i=0;  i<Pnt.size();  i++) {
         Tex.push_back(vec2(Pnt[i][0], Pnt[i][1]));
-        Tan.push_back(vec3(1,0,0));
         Nrm.push_back(vec3(0,0,0)); }
 
     // Compute vertex normals: (For each face, compute a face
@@ -562,11 +740,31 @@ Ply::Ply(const char* name, const bool reverse)
     for (int i=0;  i<Pnt.size();  i++)
         Nrm[i] = normalize(Nrm[i]);
 
+    // Texture coordinates are projected onto the xy plane;  the
+    // tangents follow them.
+    ComputeTangents();
+
+    // The texture coordinates and tangents are made from the
+    // positions and normals, so are not worth storing.  (rply reads
+    // only from the file, so the hash is of a second read, made only
+    // here, when the cache is made.)
+    if (useCache) {
+        std::vector<unsigned char> source;
+        unsigned long long sourceHash = 0;
+        if (ReadMeshFile(name, source))
+            sourceHash = MeshSourceHash(source);
+        EncodeMesh(*this, MESH_NORMALS, data, sourceBytes, int(reverse), sourceHash, sourceTime);
+        if (!WriteMeshFile(cache.c_str(), data))
+            printf("Can't write %s\n", cache.c_str()); }
+
+    BuildMeshlets(*this, reverse);
     ComputeSize();
     MakeVAO();
 }
 
 
+bool Ply::useCache = true;
+
 vec4 staticPnt;
 vec3 staticNrm;
 vec2 staticTex;
@@ -615,12 +813,6 @@ int Ply::face_cb(p_ply_argument argument) {
 // sufficient, but that works poorly with the reflection map.
 Ground::Ground(const float r, const int n)
 {
-    std::vector<vec4> Pnt;
-    std::vector<vec3> Nrm;
-    std::vector<vec2> Tex;
-    std::vector<vec3> Tan;
-    std::vector<ivec4> Quad;
-
     //diffuseColor = vec3(0.3, 0.2, 0.1);
     //specularColor = vec3(1.0, 1.0, 1.0);
     //shininess = 120.0;
@@ -630,6 +822,9 @@ Ground::Ground(const float r, const int n)
 	specularColor = vec3(.03, .03, .03);
 	shininess = 0.1;
 
+    MemoryScope scope(MEM_MODELS);
+    Reserve((n+1)*(n+1), n*n, 0);
+
     for (int i=0;  i<=n;  i++) {
         float s = i/float(n);
         for (int j=0;  j<=n;  j++) {
@@ -637,14 +832,13 @@ Ground::Ground(const float r, const int n)
             Pnt.push_back(vec4(s*2.0*r-r, t*2.0*r-r, -3.0, 1.0));
             Nrm.push_back(vec3(0.0, 0.0, 1.0));
             Tex.push_back(vec2(s, t));
-            Tan.push_back(vec3(1.0, 0.0, 0.0));
             if (i>0 && j>0) {
                 Quad.push_back(ivec4((i-1)*(n+1) + (j-1),
                                       (i-1)*(n+1) + (j),
                                       (i  )*(n+1) + (j),
                                       (i  )*(n+1) + (j-1))); } } }
 
-    vao = VaoFromQuads(Pnt, Nrm, Tex, Tan, Quad);
-    count = Quad.size();
-    shape = 4;
+    ComputeTangents();
+    ComputeSize();
+    MakeVAO();
 }
@@ -28,6 +28,8 @@
 
 #include "transform.h"
 #include "rply.h"
+#include "allocation.h"
+#include "meshlet.h"
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -40,22 +42,22 @@ class Model
 {
 public:
 
-    Model() :animate(false) {}
+    Model() :animate(false), packed(-1), proxyBuilt(false) {}
     virtual ~Model() {}
 
-    // Data arrays
-    std::vector<vec4> Pnt;
-    std::vector<vec3> Nrm;
-    std::vector<vec2> Tex;
-    std::vector<vec3> Tan;
+    // Data arrays, from the mesh pool (see allocation.h)
+    MeshArray<vec4> Pnt;
+    MeshArray<vec3> Nrm;
+    MeshArray<vec2> Tex;
+    MeshArray<vec4> Tan;     // w:  handedness (see ComputeTangents)
 
     // Lighting information
     vec3 diffuseColor, specularColor;
     float shininess;
 
     // Geometry defined by indices into data arrays
-    std::vector<ivec4> Quad;
-    std::vector<ivec3> Tri;
+    MeshArray<ivec4> Quad;
+    MeshArray<ivec3> Tri;
     unsigned int count;
     unsigned int shape;
 
@@ -63,25 +65,56 @@ public:
     vec3 minP, maxP;
     vec3 center;
     float size;
+    float radius;       // Of a bounding sphere about center
     MAT4 modelTr;
     bool animate;
 
     // Defined by MakeVAO when/if sending to OpenGL
     unsigned int vao;
 
+    // Defined by MegaBuffer::Pack:  the model's triangles in the
+    // shared buffers (see megabuffer.h)
+    int packed;
+    unsigned int firstIndex, indexCount;
+    int baseVertex;
 
+    // Triangles (three corners each) entirely inside the model, for
+    // the software occlusion rasterizer (see softocclusion.h).  Built
+    // by MakeProxy the first time the model is an occluder;  empty if
+    // the model has none.
+    std::vector<vec3> proxy;
+    bool proxyBuilt;
 
+    // Clusters of the Tri list, for culling parts of a large mesh (see
+    // meshlet.h);  empty for most models
+    std::vector<Meshlet> meshlets;
 
 
+
+
+
+    void Reserve(const int vertices, const int quads, const int tris);
     virtual void ComputeSize();
+    void ComputeTangents();
     virtual void MakeVAO();
     virtual void DrawVAO();
+    virtual void MakeProxy();
 };
 
+// Running totals of what has been drawn (by DrawVAO, and the deferred
+// light volumes), for the benchmark (see benchmark.cpp).
+struct DrawStats
+{
+    long long drawCalls;
+    long long triangles;        // Quads count as two
+};
+extern DrawStats drawStats;
+
 class Sphere: public Model
 {
 public:
     Sphere(const int n);
+    virtual void MakeProxy();
 };
 
 class Teapot: public Model
@@ -99,6 +132,8 @@ public:
 class Ply: public Model
 {
 public:
+    static bool useCache;       // Load from, and make, a .qmesh (see meshcodec.h)
+
     Ply(const char* name, const bool reverse=false);
     virtual ~Ply() {printf("destruct Ply\n");};
     static int vertex_cb(p_ply_argument argument);
@@ -0,0 +1,8 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the occluder depth pass:  depth only.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+void main()
+{
+}
@@ -0,0 +1,32 @@
+/////////////////////////////////////////////////////////////////////////
+// Vertex shader for the depth only passes:  the occluders (see
+// occlusion.h) and the lighting pass's depth prepass (see
+// depthprepass.h).  Positions only, transformed exactly as in
+// lighting.vert (both invariant) so that the depths match those of the
+// lighting pass, to the bit for its GL_EQUAL test.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+#include "drawdata.glsl"
+#include "terrain.glsl"
+
+uniform mat4 ViewMatrix;
+uniform mat4 ProjectionMatrix;
+
+in vec4 vertex;
+
+invariant gl_Position;
+
+void main()
+{
+    FetchDrawData();
+#ifdef TERRAIN
+    vec3 worldPos, normal;
+    vec2 tex;
+    vec4 tangent;
+    TerrainVertex(vertex.xy, worldPos, normal, tex, tangent);
+    gl_Position = ProjectionMatrix*ViewMatrix*vec4(worldPos, 1.0);
+#else
+    gl_Position = ProjectionMatrix*ViewMatrix*ModelMatrix*vertex;
+#endif
+}
@@ -0,0 +1,398 @@
+///////////////////////////////////////////////////////////////////////
+// Hierarchical-Z occlusion culling.  See occlusion.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "occlusion.h"
+
+// Texture unit for the reduction's source and the debug view (a
+// scratch unit:  nothing else keeps a texture on it)
+#define HIZ_UNIT 0
+
+HiZ::HiZ()
+    :width(0), height(0), levels(0), fbo(0), depthTexture(0), pyramid(0),
+     valid(false), readWidth(HIZ_READ_WIDTH), firstLevel(0), current(0)
+{
+    for (int i=0;  i<HIZ_LATENCY;  i++) {
+        readBuffers[i] = 0;
+        fences[i] = NULL; }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Creates the depth target and the pyramid for a w by h view, to
+// read back from the first level no wider than read.
+void HiZ::Create(const int w, const int h, const int read)
+{
+    Delete();
+    width = w;
+    height = h;
+    readWidth = read;
+
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, w, h, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("Hi-Z FBO Error: %d\n", status);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Level 0 is half the view;  each level halves again (rounding
+    // down, but at least 1) until a single texel
+    levelWidth.clear();
+    levelHeight.clear();
+    int lw = std::max(1, w/2), lh = std::max(1, h/2);
+    while (true) {
+        levelWidth.push_back(lw);
+        levelHeight.push_back(lh);
+        if (lw == 1 && lh == 1) break;
+        lw = std::max(1, lw/2);
+        lh = std::max(1, lh/2); }
+    levels = levelWidth.size();
+
+    glGenTextures(1, &pyramid);
+    glBindTexture(GL_TEXTURE_2D, pyramid);
+    for (int l=0;  l<levels;  l++)
+        glTexImage2D(GL_TEXTURE_2D, l, GL_R32F, levelWidth[l], levelHeight[l], 0,
+                     GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels-1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The read back levels, packed one after another
+    firstLevel = 0;
+    while (firstLevel < levels-1
+           && std::max(levelWidth[firstLevel], levelHeight[firstLevel]) > readWidth)
+        firstLevel++;
+    offset.assign(levels, 0);
+    int total = 0;
+    for (int l=firstLevel;  l<levels;  l++) {
+        offset[l] = total;
+        total += levelWidth[l]*levelHeight[l]; }
+    texels.assign(total, 1.0f);
+    valid = false;
+
+    glGenBuffers(HIZ_LATENCY, readBuffers);
+    for (int i=0;  i<HIZ_LATENCY;  i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, total*sizeof(float), NULL, GL_STREAM_READ); }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    current = 0;
+}
+
+void HiZ::Delete()
+{
+    Discard();
+    if (fbo) glDeleteFramebuffers(1, &fbo);
+    if (depthTexture) glDeleteTextures(1, &depthTexture);
+    if (pyramid) glDeleteTextures(1, &pyramid);
+    if (readBuffers[0]) glDeleteBuffers(HIZ_LATENCY, readBuffers);
+    fbo = depthTexture = pyramid = 0;
+    for (int i=0;  i<HIZ_LATENCY;  i++)
+        readBuffers[i] = 0;
+    width = height = levels = 0;
+    valid = false;
+}
+
+// Forgets the read backs in flight.
+void HiZ::Discard()
+{
+    for (int i=0;  i<HIZ_LATENCY;  i++)
+        if (fences[i]) {
+            glDeleteSync((GLsync)fences[i]);
+            fences[i] = NULL; }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Takes the newest finished read back as texels (and its ViewProj),
+// oldest first.  One not yet finished is waited for only if it is in
+// the slot the next Build reuses;  returns whether that happened.
+bool HiZ::Collect()
+{
+    bool waited = false;
+    for (int i=0;  i<HIZ_LATENCY;  i++) {
+        int slot = (current+i)%HIZ_LATENCY;
+        GLsync fence = (GLsync)fences[slot];
+        if (!fence) continue;
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            // The GPU finishes in order, so no later one is done either
+            if (slot != current) break;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                ;
+            waited = true; }
+        glDeleteSync(fence);
+        fences[slot] = NULL;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readBuffers[slot]);
+        void* p = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, texels.size()*sizeof(float),
+                                   GL_MAP_READ_BIT);
+        if (p) {
+            memcpy(&texels[0], p, texels.size()*sizeof(float));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            ViewProj = readViewProj[slot];
+            valid = true; } }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return waited;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Is any of the box minP..maxP, in the world transform, possibly in
+// front of the occluders?  Thread safe (it only reads), so Cull's
+// jobs may call it at once.
+bool HiZ::Visible(const vec3& minP, const vec3& maxP, const MAT4& world) const
+{
+    if (!valid) return true;
+
+    MAT4 M = ViewProj*world;
+    float x0 = 1e30f, y0 = 1e30f, x1 = -1e30f, y1 = -1e30f, z0 = 1e30f;
+    for (int c=0;  c<8;  c++) {
+        vec3 p((c&1) ? maxP[0] : minP[0], (c&2) ? maxP[1] : minP[1], (c&4) ? maxP[2] : minP[2]);
+        float q[4];
+        for (int r=0;  r<4;  r++)
+            q[r] = M[r][0]*p[0] + M[r][1]*p[1] + M[r][2]*p[2] + M[r][3];
+
+        // A corner behind the eye:  the box's projection is unbounded
+        if (q[3] <= 1e-5f) return true;
+
+        float x = q[0]/q[3], y = q[1]/q[3], z = q[2]/q[3];
+        x0 = std::min(x0, x);  x1 = std::max(x1, x);
+        y0 = std::min(y0, y);  y1 = std::max(y1, y);
+        z0 = std::min(z0, z); }
+
+    // The screen rectangle, in pixels.  One entirely off screen is
+    // left to the frustum test.
+    float px0 = (0.5f*x0 + 0.5f)*width, px1 = (0.5f*x1 + 0.5f)*width;
+    float py0 = (0.5f*y0 + 0.5f)*height, py1 = (0.5f*y1 + 0.5f)*height;
+    if (px1 < 0.0f || py1 < 0.0f || px0 >= width || py0 >= height)
+        return true;
+    int ix0 = std::max(0, int(floorf(px0))), ix1 = std::min(width-1, int(floorf(px1)));
+    int iy0 = std::max(0, int(floorf(py0))), iy1 = std::min(height-1, int(floorf(py1)));
+    float nearest = 0.5f*z0 + 0.5f;
+
+    // The level whose texels (each 2^(level+1) pixels across) are at
+    // least as wide as the rectangle, so that it spans at most 2x2
+    int span = std::max(ix1 - ix0, iy1 - iy0) + 1;
+    int level = firstLevel;
+    while (level < levels-1 && (2<<level) < span)
+        level++;
+
+    int w = levelWidth[level], h = levelHeight[level];
+    const float* t = &texels[offset[level]];
+    int tx0 = std::min(ix0 >> (level+1), w-1), tx1 = std::min(ix1 >> (level+1), w-1);
+    int ty0 = std::min(iy0 >> (level+1), h-1), ty1 = std::min(iy1 >> (level+1), h-1);
+    float farthest = 0.0f;
+    for (int y=ty0;  y<=ty1;  y++)
+        for (int x=tx0;  x<=tx1;  x++)
+            farthest = std::max(farthest, t[y*w + x]);
+    return nearest <= farthest;
+}
+
+////////////////////////////////////////////////////////////////////////
+Occlusion::Occlusion()
+    :enabled(true), method(GPU), reduceFbo(0), emptyVao(0),
+     tested(0), occluded(0), faceTested(0), faceOccluded(0), stalls(0), percent(0.0f)
+{
+}
+
+static void CreateFullscreenShader(ShaderProgram& shader, const char* frag)
+{
+    shader.CreateProgram();
+    shader.CreateShader("fullscreen.vert", GL_VERTEX_SHADER);
+    shader.CreateShader(frag, GL_FRAGMENT_SHADER);
+    shader.LinkProgram();
+}
+
+void Occlusion::Initialize()
+{
+    occluderShader.Create("occluder.vert", "occluder.frag", 0);
+    CreateFullscreenShader(reduceShader, "hiz-reduce.frag");
+    CreateFullscreenShader(showShader, "hiz-show.frag");
+
+    glGenFramebuffers(1, &reduceFbo);
+    glGenVertexArrays(1, &emptyVao);
+}
+
+// Clears the statistics summed over a frame's views.
+void Occlusion::BeginFrame()
+{
+    faceTested = faceOccluded = stalls = 0;
+    software.BeginFrame();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Builds hiZ for a w by h view:  draws the occluders of layers (the
+// nodes with the OCCLUDER bit) with the View and Proj transforms,
+// reduces their depth into the pyramid, and starts the read back of
+// its coarse levels, after taking an earlier Build's as texels;  or
+// with method SOFTWARE, rasterizes them on the CPU.  Leaves
+// framebuffer 0 bound.
+void Occlusion::Build(Scene& scene, HiZ& hiZ, MAT4& View, MAT4& Proj,
+                      const int w, const int h, const int layers)
+{
+    int readWidth = method == SOFTWARE ? SOFT_WIDTH : HIZ_READ_WIDTH;
+    if (hiZ.width != w || hiZ.height != h || hiZ.readWidth != readWidth)
+        hiZ.Create(w, h, readWidth);
+
+    SceneGraph& graph = scene.graph;
+    occluders.clear();
+    for (int i=0;  i<graph.count;  i++)
+        if (graph.model[i] && !graph.hidden[i]
+            && (graph.mask[i] & SceneGraph::OCCLUDER) && (graph.mask[i] & layers))
+            occluders.push_back(i);
+
+    if (method == SOFTWARE) {
+        hiZ.Discard();
+        hiZ.ViewProj = Proj*View;
+        software.Render(scene, hiZ, occluders);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return; }
+
+    if (hiZ.Collect())
+        stalls++;
+
+    // The occluders' depth, at full resolution
+    glBindFramebuffer(GL_FRAMEBUFFER, hiZ.fbo);
+    glViewport(0, 0, w, h);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    scene.SetupVariants(occluderShader, View, Proj);
+    scene.DrawNodes(occluderShader, occluders);
+    occluderShader.Unuse();
+
+    // Each level the farthest of the one above
+    glDisable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, reduceFbo);
+    reduceShader.Use();
+    int program = reduceShader.program;
+    int loc = glGetUniformLocation(program, "source");
+    glUniform1i(loc, HIZ_UNIT);
+    glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+    glBindVertexArray(emptyVao);
+
+    // The coarse levels are copied into a read buffer as they are made
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, hiZ.readBuffers[hiZ.current]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    int sw = w, sh = h;
+    for (int l=0;  l<hiZ.levels;  l++) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               hiZ.pyramid, l);
+        glViewport(0, 0, hiZ.levelWidth[l], hiZ.levelHeight[l]);
+        if (l == 0)
+            glBindTexture(GL_TEXTURE_2D, hiZ.depthTexture);
+        else {
+            // Only the level above may be read while this one is drawn
+            glBindTexture(GL_TEXTURE_2D, hiZ.pyramid);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, l-1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, l-1); }
+        loc = glGetUniformLocation(program, "sourceSize");
+        glUniform2i(loc, sw, sh);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        if (l >= hiZ.firstLevel)
+            glReadPixels(0, 0, hiZ.levelWidth[l], hiZ.levelHeight[l], GL_RED, GL_FLOAT,
+                         (void*)(hiZ.offset[l]*sizeof(float)));
+        sw = hiZ.levelWidth[l];
+        sh = hiZ.levelHeight[l]; }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    hiZ.fences[hiZ.current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    hiZ.readViewProj[hiZ.current] = Proj*View;
+    hiZ.current = (hiZ.current+1)%HIZ_LATENCY;
+
+    glBindTexture(GL_TEXTURE_2D, hiZ.pyramid);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, hiZ.levels-1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindVertexArray(0);
+    reduceShader.Unuse();
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// The debug view (mode DEBUG_MODE), over the finished image:  the
+// objects the lighting pass skipped, as red wireframes, and the
+// camera's pyramid (its first read back level) in the lower left.
+void Occlusion::DrawDebug(Scene& scene)
+{
+    if (!enabled || scene.mode != DEBUG_MODE || !camera.valid)
+        return;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, scene.outputFbo);
+    glViewport(0, 0, scene.width, scene.height);
+    glDisable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+    // Drawn one at a time, so not with the multi-draw programs
+    ShaderVariants& shader = scene.lightingShader;
+    bool indirect = shader.indirect;
+    shader.indirect = false;
+    int program = shader.Use(ShaderVariants::DIRECT);
+    scene.SetupProgram(program, scene.WorldView, scene.WorldProj);
+    vec3 red(1.0f, 0.0f, 0.0f);
+
+    SceneGraph& graph = scene.graph;
+    for (int i=0;  i<graph.count;  i++) {
+        if (!graph.model[i] || graph.hidden[i] || !(graph.mask[i] & SceneGraph::ENVIRONMENT))
+            continue;
+        if (camera.Visible(graph.model[i]->minP, graph.model[i]->maxP, graph.world[i]))
+            continue;
+        int loc = glGetUniformLocation(program, "ModelMatrix");
+        glUniformMatrix4fv(loc, 1, GL_TRUE, graph.world[i].Pntr());
+        loc = glGetUniformLocation(program, "NormalMatrix");
+        glUniformMatrix4fv(loc, 1, GL_FALSE, graph.normal[i].Pntr());
+        loc = glGetUniformLocation(program, "diffuse");
+        glUniform3fv(loc, 1, &red[0]);
+        graph.model[i]->DrawVAO(); }
+    shader.Unuse();
+    shader.indirect = indirect;
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    // The pyramid (the software one is only on the CPU, so is sent
+    // first)
+    glViewport(0, 0, scene.width/4, scene.height/4);
+    showShader.Use();
+    program = showShader.program;
+    glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+    glBindTexture(GL_TEXTURE_2D, camera.pyramid);
+    if (method == SOFTWARE) {
+        int l = camera.firstLevel;
+        glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, camera.levelWidth[l], camera.levelHeight[l],
+                        GL_RED, GL_FLOAT, &camera.texels[camera.offset[l]]); }
+    int loc = glGetUniformLocation(program, "pyramid");
+    glUniform1i(loc, HIZ_UNIT);
+    loc = glGetUniformLocation(program, "level");
+    glUniform1f(loc, float(camera.firstLevel));
+    loc = glGetUniformLocation(program, "front");
+    glUniform1f(loc, scene.front);
+    loc = glGetUniformLocation(program, "back");
+    glUniform1f(loc, scene.back);
+    glBindVertexArray(emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    showShader.Unuse();
+
+    glViewport(0, 0, scene.width, scene.height);
+    glEnable(GL_DEPTH_TEST);
+}
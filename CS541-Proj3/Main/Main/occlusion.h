@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////
+// Hierarchical-Z occlusion culling:  objects hidden behind the
+// occluders (the central model, the ground and the ring of spheres)
+// are skipped in the lighting pass and the cube probe's faces.
+//
+// For each view, Build draws the occluders -- the graph's nodes with
+// the OCCLUDER bit in their mask -- into a depth texture at the
+// view's full resolution (occluder.vert/frag, depth only), and then
+// reduces it into a pyramid (hiz-reduce.frag) whose every texel holds
+// the farthest depth of the pixels it covers.  The coarse levels,
+// from the first no wider than HIZ_READ_WIDTH, are read back, and
+// SceneGraph::Cull then tests each object's box (its model's
+// minP..maxP, in its world transform) on the CPU:  the box is
+// projected to a screen rectangle and its nearest depth, and the
+// pyramid level at which the rectangle spans at most 2x2 texels is
+// compared.  If the box's nearest point is farther than all of them,
+// everything the object could draw is behind an occluder.
+//
+// The read back is not waited for.  Each Build copies the levels
+// (glReadPixels) into one of HIZ_LATENCY pixel buffers and fences
+// it;  a later Build of the same view takes the newest one whose
+// fence has passed, normally the previous frame's.  Waiting instead
+// would stall the CPU until the GPU had drawn and reduced the
+// occluders -- once for the camera and once for each of the cube
+// probe's six faces, every frame the probe updates.  Only if the GPU
+// is HIZ_LATENCY frames behind does Build wait (counted in stalls).
+//
+// The box test itself is conservative:  the pyramid is reduced from
+// the occluders' depth at full resolution, so against the view it
+// was built for it hides nothing which the pass would draw, and a
+// box crossing the near plane is always drawn.  Boxes are projected
+// with that view's transform (its ViewProj), at their current
+// positions.  But the pyramid is a frame (or more) old, so when the
+// camera or an occluder moves, an object coming out from behind an
+// occluder may be drawn a frame late.  The first frame after a view
+// is created culls nothing.
+//
+// With method SOFTWARE, the occluders are instead rasterized on the
+// CPU (see softocclusion.h), into the same levels, with the current
+// frame's transforms, so nothing lags and nothing waits on the GPU.
+//
+// The paraboloid probe projects in its vertex shader, so is not
+// culled.  The central model (inside the probe) is not drawn into
+// the probe's faces, so there the ground and spheres occlude alone.
+//
+// With mode (keys '0'-'9') set to DEBUG_MODE, occluded objects are
+// drawn anyway, as red wireframes over the image, and the camera's
+// pyramid is shown in the lower left corner.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _OCCLUSION_
+#define _OCCLUSION_
+
+#include <vector>
+
+#include "transform.h"
+#include "shader.h"
+#include "softocclusion.h"
+
+class Scene;
+
+#define HIZ_READ_WIDTH 128
+#define HIZ_LATENCY 3
+
+// One view's pyramid
+class HiZ
+{
+public:
+    int width, height;          // The view's (level 0 is half this)
+    int levels;
+    unsigned int fbo, depthTexture, pyramid;
+    MAT4 ViewProj;              // Of the view texels were built for
+    bool valid;
+
+    // The read back levels, firstLevel (the first no wider than
+    // readWidth) to levels-1
+    int readWidth, firstLevel;
+    std::vector<float> texels;
+    std::vector<int> offset, levelWidth, levelHeight;
+
+    // Read backs in flight:  texels, as copied by a Build, into
+    // readBuffers[slot], with the ViewProj it was built for
+    unsigned int readBuffers[HIZ_LATENCY];
+    void* fences[HIZ_LATENCY];          // GLsync objects, or NULL
+    MAT4 readViewProj[HIZ_LATENCY];
+    int current;                        // The slot the next Build uses
+
+    HiZ();
+    void Create(const int w, const int h, const int readWidth);
+    void Delete();
+    bool Collect();
+    void Discard();
+    bool Visible(const vec3& minP, const vec3& maxP, const MAT4& world) const;
+};
+
+class Occlusion
+{
+public:
+    enum { DEBUG_MODE=9 };
+    enum Method { GPU, SOFTWARE };
+
+    bool enabled;
+    int method;
+    HiZ camera;                 // For the lighting pass
+    HiZ faces[6];               // For the cube probe's faces
+
+    ShaderVariants occluderShader;
+    ShaderProgram reduceShader, showShader;
+    unsigned int reduceFbo, emptyVao;
+    std::vector<int> occluders; // Scratch:  the nodes drawn by Build
+    SoftRasterizer software;
+
+    // Statistics of the most recent frame
+    int tested, occluded;       // Lighting pass objects
+    int faceTested, faceOccluded;
+    int stalls;                 // Builds which waited for a read back
+    float percent;              // Of the lighting pass objects, occluded
+
+    Occlusion();
+    void Initialize();
+    void BeginFrame();
+    void Build(Scene& scene, HiZ& hiZ, MAT4& View, MAT4& Proj,
+               const int w, const int h, const int layers);
+    void DrawDebug(Scene& scene);
+};
+
+#endif
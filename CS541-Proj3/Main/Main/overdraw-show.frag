@@ -0,0 +1,25 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the overdraw view (see depthprepass.h):  shows the
+// fragments shaded per pixel as a heat map:  none black, one dark
+// blue, then through green and yellow to red at maxCount or more.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D counts;
+uniform float maxCount;
+
+in vec2 uv;
+
+void main()
+{
+    float n = texture(counts, uv).r;
+    if (n < 0.5) {
+        gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return; }
+
+    float t = 3.0*clamp((n - 1.0)/(maxCount - 1.0), 0.0, 1.0);
+    vec3 heat = t < 1.0 ? mix(vec3(0.0, 0.1, 0.6), vec3(0.0, 0.8, 0.0), t)
+              : t < 2.0 ? mix(vec3(0.0, 0.8, 0.0), vec3(1.0, 1.0, 0.0), t - 1.0)
+                        : mix(vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), t - 2.0);
+    gl_FragColor = vec4(heat, 1.0);
+}
@@ -0,0 +1,13 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the overdraw view (see depthprepass.h):  each
+// fragment the lighting pass would shade adds one to its pixel's
+// count (by additive blending).
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+layout(location=0) out vec4 countOut;
+
+void main()
+{
+    countOut = vec4(1.0, 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////
+// Point lights scattered over the ground.  See pointlights.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "pointlights.h"
+
+// Texture unit holding the light buffer (see lighting.frag)
+#define LIGHTS_UNIT 12
+
+// The ground is a square of this half-width, at this height.
+#define GROUND_RANGE 50.0f
+#define GROUND_Z    -3.0f
+
+vec3 HSV2RGB(const float h, const float s, const float v);
+
+// A small deterministic random number generator (0..1), so that
+// benchmarks see the same lights on every run and platform.
+static float Random(unsigned int& seed)
+{
+    seed = seed*1664525u + 1013904223u;
+    return (seed>>8)/16777216.0f;
+}
+
+PointLights::PointLights()
+    :count(0), radius(6.0f), intensity(3.0f), buffer(0), texture(0)
+{
+}
+
+void PointLights::Initialize()
+{
+    glGenBuffers(1, &buffer);
+    glGenTextures(1, &texture);
+    Generate(count);
+}
+
+// Scatters n lights just above the ground, with random hues.
+void PointLights::Generate(const int n)
+{
+    count = n;
+    lights.resize(n);
+    unsigned int seed = 12345u;
+    for (int i=0;  i<n;  i++) {
+        float x = GROUND_RANGE*(2.0f*Random(seed) - 1.0f);
+        float y = GROUND_RANGE*(2.0f*Random(seed) - 1.0f);
+        float z = GROUND_Z + 0.5f + 1.5f*Random(seed);
+        vec3 color = intensity*HSV2RGB(Random(seed), 0.8f, 1.0f);
+        lights[i].positionRadius = vec4(x, y, z, radius);
+        lights[i].color = vec4(color, 0.0f); }
+    Upload();
+}
+
+void PointLights::Upload()
+{
+    // A zero sized buffer is not allowed as a texture buffer's store.
+    int bytes = lights.size() ? lights.size()*sizeof(PointLight) : sizeof(PointLight);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, bytes, lights.size() ? &lights[0] : NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// Makes the lights available to a shader.
+void PointLights::Bind(const int program)
+{
+    glActiveTexture(GL_TEXTURE0+LIGHTS_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glActiveTexture(GL_TEXTURE0);
+
+    SetUnits(program);
+    int loc = glGetUniformLocation(program, "pointLightCount");
+    glUniform1i(loc, count);
+}
+
+// As EnvProbe::SetUnits, done for every pass to keep the buffer
+// sampler off unit 0.  No lights are used unless Bind is called.
+void PointLights::SetUnits(const int program)
+{
+    int loc = glGetUniformLocation(program, "pointLights");
+    glUniform1i(loc, LIGHTS_UNIT);
+    loc = glGetUniformLocation(program, "pointLightCount");
+    glUniform1i(loc, 0);
+}
@@ -0,0 +1,26 @@
+/////////////////////////////////////////////////////////////////////////
+// The contribution of one point light (see pointlights.h).
+//
+// #include "pointlights.glsl"
+////////////////////////////////////////////////////////////////////////
+
+#include "brdf.glsl"
+
+uniform samplerBuffer pointLights;
+uniform int pointLightCount;
+
+// Light from point light i reaching a surface at P.  Each light falls
+// off smoothly to zero at its radius.
+vec3 PointLight(int i, vec3 P, vec3 N, vec3 V, vec3 dif, vec3 spec, float shiny)
+{
+    vec4 pr = texelFetch(pointLights, 2*i);
+    vec3 L = pr.xyz - P;
+    float d2 = dot(L, L);
+    if (d2 >= pr.w*pr.w) return vec3(0.0);
+
+    float x = d2/(pr.w*pr.w);
+    float falloff = (1.0 - x*x)*(1.0 - x*x)/(d2 + 1.0);
+    float NL = max(dot(N, normalize(L)), 0.0);
+    vec3 color = texelFetch(pointLights, 2*i+1).xyz;
+    return BRDF(V, N, L, dif, spec, shiny)*NL*falloff*color;
+}
@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////
+// A set of point lights, in addition to the scene's single main
+// light.  Each light has a position, a radius beyond which it has no
+// effect, and a color.  The lights are sent to the shaders in a
+// texture buffer (RGBA32F, two texels per light):
+//
+//    texelFetch(pointLights, 2*i  ):  position.xyz, radius
+//    texelFetch(pointLights, 2*i+1):  color.rgb,    unused
+//
+// Generate() scatters lights over the ground plane with a fixed
+// seed, so a given count always produces the same scene.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _POINTLIGHTS_
+#define _POINTLIGHTS_
+
+#include <vector>
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+struct PointLight
+{
+    vec4 positionRadius;
+    vec4 color;
+};
+
+class PointLights
+{
+public:
+    // User controllable parameters;  changes to these take effect on
+    // the next call to Generate
+    int count;
+    float radius;
+    float intensity;
+
+    std::vector<PointLight> lights;
+    unsigned int buffer, texture;   // Texture buffer holding "lights"
+
+    PointLights();
+    void Initialize();
+    void Generate(const int n);
+    void Upload();
+    void Bind(const int program);
+    void SetUnits(const int program);
+};
+
+#endif
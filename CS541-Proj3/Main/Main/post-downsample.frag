@@ -0,0 +1,72 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader halving a level of the bloom pyramid (see post.h),
+// with the 13 tap filter of Jimenez (Call of Duty: Advanced Warfare):
+// five overlapping 2x2 boxes of bilinear taps, the central one
+// weighted 1/2 and the four corner ones 1/8.
+//
+// On the first level (from the HDR frame) each box is also weighted
+// by 1/(1+luminance), which keeps single very bright pixels from
+// flickering through the bloom (Karis), and the result is put through
+// a soft threshold.  Alpha gets the log2 luminance of the unthresholded
+// frame, for the exposure histogram;  below that it is filtered like
+// the color.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;
+uniform bool first;
+uniform float threshold, knee;
+
+in vec2 uv;
+
+float Luminance(vec3 c)
+{
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec4 Tap(float x, float y)
+{
+    return texture(source, uv + sourceTexel*vec2(x, y));
+}
+
+// The average of four taps, weighted against fireflies on the first
+// level.  w accumulates the weight.
+vec3 Box(vec4 a, vec4 b, vec4 c, vec4 d, float weight, inout float w)
+{
+    vec3 sum = (a.rgb + b.rgb + c.rgb + d.rgb)*0.25;
+    if (first)
+        weight /= 1.0 + Luminance(sum);
+    w += weight;
+    return weight*sum;
+}
+
+void main()
+{
+    vec4 a = Tap(-2.0, -2.0), b = Tap(0.0, -2.0), c = Tap(2.0, -2.0);
+    vec4 d = Tap(-1.0, -1.0), e = Tap(1.0, -1.0);
+    vec4 f = Tap(-2.0,  0.0), g = Tap(0.0,  0.0), h = Tap(2.0,  0.0);
+    vec4 i = Tap(-1.0,  1.0), j = Tap(1.0,  1.0);
+    vec4 k = Tap(-2.0,  2.0), l = Tap(0.0,  2.0), m = Tap(2.0,  2.0);
+
+    float w = 0.0;
+    vec3 color = Box(d, e, i, j, 0.5, w)
+        + Box(a, b, f, g, 0.125, w) + Box(b, c, g, h, 0.125, w)
+        + Box(f, g, k, l, 0.125, w) + Box(g, h, l, m, 0.125, w);
+    color /= w;
+
+    if (!first) {
+        float alpha = 0.5*(d.a + e.a + i.a + j.a)*0.25
+            + 0.125*(a.a + 2.0*b.a + c.a + 2.0*f.a + 4.0*g.a + 2.0*h.a + k.a + 2.0*l.a + m.a)*0.25;
+        gl_FragColor = vec4(color, alpha);
+        return; }
+
+    // Soft threshold:  a quadratic knee from threshold-knee to
+    // threshold+knee, then linear
+    float lum = Luminance(color);
+    float soft = clamp(lum - threshold + knee, 0.0, 2.0*knee);
+    soft = soft*soft/(4.0*knee + 1e-4);
+    float contribution = max(soft, lum - threshold)/max(lum, 1e-4);
+
+    gl_FragColor = vec4(color*contribution, log2(max(Luminance(g.rgb), 1e-4)));
+}
@@ -0,0 +1,47 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader computing the exposure (see post.h), into a 1x1
+// target.  The histogram's texels between lowPercent and highPercent
+// of the way through it are averaged (in log2 luminance), which
+// ignores both the darkest pixels and small bright ones such as the
+// sun.  The exposure mapping that average to key is approached from
+// the previous one by adapt, in stops.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+#define HISTOGRAM_BINS 64
+
+uniform sampler2D histogram, previous;
+uniform bool autoExposure;
+uniform float compensation, key;
+uniform float lowPercent, highPercent;
+uniform float logMin, logMax;
+uniform float adapt;
+
+void main()
+{
+    float manual = exp2(compensation);
+    if (!autoExposure) {
+        gl_FragColor = vec4(manual);
+        return; }
+
+    float total = 0.0;
+    for (int i=0;  i<HISTOGRAM_BINS;  i++)
+        total += texelFetch(histogram, ivec2(i, 0), 0).r;
+    float low = lowPercent*total, high = highPercent*total;
+
+    float sum = 0.0, count = 0.0, before = 0.0;
+    for (int i=0;  i<HISTOGRAM_BINS;  i++) {
+        float n = texelFetch(histogram, ivec2(i, 0), 0).r;
+        float inside = clamp(before + n, low, high) - clamp(before, low, high);
+        float logLum = logMin + (i + 0.5)*(logMax - logMin)/HISTOGRAM_BINS;
+        sum += inside*logLum;
+        count += inside;
+        before += n; }
+
+    float average = count > 0.0 ? sum/count : log2(key);
+    float target = log2(key) - average + compensation;
+
+    float last = texelFetch(previous, ivec2(0, 0), 0).r;
+    float exposure = last > 0.0 ? mix(log2(last), target, adapt) : target;
+    gl_FragColor = vec4(exp2(exposure));
+}
@@ -0,0 +1,10 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader building the exposure histogram:  each point counts
+// one (see post-histogram.vert).
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+void main()
+{
+    gl_FragColor = vec4(1.0);
+}
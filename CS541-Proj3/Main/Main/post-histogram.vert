@@ -0,0 +1,21 @@
+/////////////////////////////////////////////////////////////////////////
+// Vertex shader building the exposure histogram (see post.h):  drawn
+// as one point per texel of a level of the bloom pyramid, each point
+// lands in the bin of its texel's log2 luminance (kept in alpha).
+// With additive blending, each bin counts its texels.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+#define HISTOGRAM_BINS 64
+
+uniform sampler2D luminance;
+uniform int width;
+uniform float logMin, logMax;
+
+void main()
+{
+    ivec2 p = ivec2(gl_VertexID % width, gl_VertexID / width);
+    float t = clamp((texelFetch(luminance, p, 0).a - logMin)/(logMax - logMin), 0.0, 1.0);
+    float bin = min(floor(t*HISTOGRAM_BINS), HISTOGRAM_BINS - 1.0);
+    gl_Position = vec4(2.0*(bin + 0.5)/HISTOGRAM_BINS - 1.0, 0.0, 0.0, 1.0);
+}
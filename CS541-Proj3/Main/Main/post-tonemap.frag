@@ -0,0 +1,38 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the last pass of the post-processing chain (see
+// post.h):  adds the bloom (spread from the pyramid's first level by
+// a tent filter, as in post-upsample.frag) to the HDR frame, applies
+// the exposure, and tone maps with Narkowicz's fit of the ACES
+// filmic curve.  Like the lighting it follows, it writes the display
+// values directly.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D source, bloom, exposure;
+uniform float bloomStrength;
+uniform vec2 bloomTexel;
+
+in vec2 uv;
+
+vec3 Bloom(float x, float y)
+{
+    return texture(bloom, uv + bloomTexel*vec2(x, y)).rgb;
+}
+
+vec3 Filmic(vec3 x)
+{
+    return clamp((x*(2.51*x + 0.03))/(x*(2.43*x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main()
+{
+    vec3 color = texture(source, uv).rgb;
+    if (bloomStrength > 0.0) {
+        vec3 b = 4.0*Bloom(0.0, 0.0)
+            + 2.0*(Bloom(-1.0, 0.0) + Bloom(1.0, 0.0) + Bloom(0.0, -1.0) + Bloom(0.0, 1.0))
+            + Bloom(-1.0, -1.0) + Bloom(1.0, -1.0) + Bloom(-1.0, 1.0) + Bloom(1.0, 1.0);
+        color += bloomStrength*b/16.0; }
+
+    color *= texelFetch(exposure, ivec2(0, 0), 0).r;
+    gl_FragColor = vec4(Filmic(color), 1.0);
+}
@@ -0,0 +1,25 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader spreading a level of the bloom pyramid into the next
+// larger one (see post.h) with a 3x3 tent filter of bilinear taps.
+// Added into the larger level by blending, with alpha (that level's
+// log luminance) left alone.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;
+
+in vec2 uv;
+
+vec3 Tap(float x, float y)
+{
+    return texture(source, uv + sourceTexel*vec2(x, y)).rgb;
+}
+
+void main()
+{
+    vec3 sum = 4.0*Tap(0.0, 0.0)
+        + 2.0*(Tap(-1.0, 0.0) + Tap(1.0, 0.0) + Tap(0.0, -1.0) + Tap(0.0, 1.0))
+        + Tap(-1.0, -1.0) + Tap(1.0, -1.0) + Tap(-1.0, 1.0) + Tap(1.0, 1.0);
+    gl_FragColor = vec4(sum/16.0, 0.0);
+}
@@ -0,0 +1,310 @@
+///////////////////////////////////////////////////////////////////////
+// HDR post-processing:  bloom, auto-exposure and tone mapping.  See
+// post.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <algorithm>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "post.h"
+
+// Texture units used by the passes (each its own program, so these
+// only need to avoid each other)
+#define SOURCE_UNIT   0
+#define BLOOM_UNIT    1
+#define EXPOSURE_UNIT 2
+
+// The pyramid level the histogram is built from:  an eighth of the
+// frame's size
+#define HISTOGRAM_LEVEL 2
+
+Post::Post()
+    :enabled(true), autoExposure(true), compensation(0.0f), key(0.18f), adaptation(0.5f),
+     lowPercent(0.5f), highPercent(0.95f), logMin(-10.0f), logMax(6.0f),
+     bloomStrength(0.05f), bloomThreshold(1.0f), bloomKnee(0.5f), bloomLevels(6),
+     hdrFbo(0), hdrTexture(0), depthBuffer(0), levels(0), levelsWanted(0), histogramFbo(0),
+     histogramTexture(0), currentExposure(0), width(0), height(0), emptyVao(0),
+     lastTime(-1.0)
+{
+    for (int l=0;  l<MAX_BLOOM_LEVELS;  l++)
+        bloomFbo[l] = bloomTexture[l] = 0;
+}
+
+static void CreatePostShader(ShaderProgram& shader, const char* vert, const char* frag)
+{
+    shader.CreateProgram();
+    shader.CreateShader(vert, GL_VERTEX_SHADER);
+    shader.CreateShader(frag, GL_FRAGMENT_SHADER);
+    shader.LinkProgram();
+}
+
+// A texture, and a framebuffer drawing into it.
+static void CreateTarget(const int w, const int h, const unsigned int format,
+                         unsigned int& fbo, unsigned int& texture)
+{
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("Post FBO Error: %d\n", status);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Post::Initialize()
+{
+    CreatePostShader(downShader, "fullscreen.vert", "post-downsample.frag");
+    CreatePostShader(histogramShader, "post-histogram.vert", "post-histogram.frag");
+    CreatePostShader(exposureShader, "fullscreen.vert", "post-exposure.frag");
+    CreatePostShader(upShader, "fullscreen.vert", "post-upsample.frag");
+    CreatePostShader(toneShader, "fullscreen.vert", "post-tonemap.frag");
+    glGenVertexArrays(1, &emptyVao);
+
+    // The size independent targets
+    CreateTarget(HISTOGRAM_BINS, 1, GL_R32F, histogramFbo, histogramTexture);
+    for (int e=0;  e<2;  e++) {
+        CreateTarget(1, 1, GL_R32F, exposureFbo[e], exposureTexture[e]);
+        glBindFramebuffer(GL_FRAMEBUFFER, exposureFbo[e]);
+        glClearColor(0.0, 0.0, 0.0, 0.0);   // No exposure yet:  adapt at once
+        glClear(GL_COLOR_BUFFER_BIT); }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Post::DeleteTargets()
+{
+    if (!hdrFbo) return;
+    glDeleteFramebuffers(1, &hdrFbo);
+    glDeleteTextures(1, &hdrTexture);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(levels, bloomFbo);
+    glDeleteTextures(levels, bloomTexture);
+    hdrFbo = hdrTexture = depthBuffer = 0;
+    levels = 0;
+}
+
+// The HDR target and the pyramid follow the size of the window.
+void Post::CreateTargets(const int w, const int h)
+{
+    DeleteTargets();
+    width = w;
+    height = h;
+
+    CreateTarget(w, h, GL_RGBA16F, hdrFbo, hdrTexture);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, hdrFbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Halved until bloomLevels, or a level would be under 2 texels
+    // (so a small frame may have fewer than levelsWanted)
+    levelsWanted = std::min(bloomLevels, MAX_BLOOM_LEVELS);
+    int lw = w, lh = h;
+    for (levels=0;  levels<levelsWanted;  levels++) {
+        lw /= 2;
+        lh /= 2;
+        if (lw < 2 || lh < 2) break;
+        levelWidth[levels] = lw;
+        levelHeight[levels] = lh;
+        CreateTarget(lw, lh, GL_RGBA16F, bloomFbo[levels], bloomTexture[levels]); }
+}
+
+// The framebuffer the lighting pass should draw into, for a w by h
+// frame.
+unsigned int Post::Target(const int w, const int h)
+{
+    if (w != width || h != height || levelsWanted != std::min(bloomLevels, MAX_BLOOM_LEVELS))
+        CreateTargets(w, h);
+    return hdrFbo;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Runs the chain on the frame drawn into the HDR target, leaving the
+// result in the scene's output.
+void Post::Apply(Scene& scene)
+{
+    double now = glutGet(GLUT_ELAPSED_TIME)/1000.0;
+    float dt = lastTime < 0.0 ? 0.0f : float(std::min(now - lastTime, 0.1));
+    lastTime = now;
+
+    timer.Begin();
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(emptyVao);
+
+    // (Adding the bloom back up leaves the levels' luminance alone.)
+    bloomTimer.Begin();
+    Downsample();
+    Upsample();
+    bloomTimer.End();
+
+    exposureTimer.Begin();
+    Meter(dt);
+    exposureTimer.End();
+
+    ///////////////////////////////////////////////////////////////////
+    // Tone map, with the bloom and exposure, into the output
+    toneTimer.Begin();
+    glBindFramebuffer(GL_FRAMEBUFFER, scene.outputFbo);
+    glViewport(0, 0, width, height);
+    toneShader.Use();
+    int program = toneShader.program;
+    glActiveTexture(GL_TEXTURE0+SOURCE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, hdrTexture);
+    glActiveTexture(GL_TEXTURE0+BLOOM_UNIT);
+    glBindTexture(GL_TEXTURE_2D, levels ? bloomTexture[0] : 0);
+    glActiveTexture(GL_TEXTURE0+EXPOSURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, exposureTexture[currentExposure]);
+    int loc = glGetUniformLocation(program, "source");
+    glUniform1i(loc, SOURCE_UNIT);
+    loc = glGetUniformLocation(program, "bloom");
+    glUniform1i(loc, BLOOM_UNIT);
+    loc = glGetUniformLocation(program, "exposure");
+    glUniform1i(loc, EXPOSURE_UNIT);
+    loc = glGetUniformLocation(program, "bloomStrength");
+    glUniform1f(loc, levels ? bloomStrength : 0.0f);
+    loc = glGetUniformLocation(program, "bloomTexel");
+    glUniform2f(loc, levels ? 1.0f/levelWidth[0] : 0.0f, levels ? 1.0f/levelHeight[0] : 0.0f);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    toneShader.Unuse();
+    toneTimer.End();
+
+    for (int unit=SOURCE_UNIT;  unit<=EXPOSURE_UNIT;  unit++) {
+        glActiveTexture(GL_TEXTURE0+unit);
+        glBindTexture(GL_TEXTURE_2D, 0); }
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    timer.End();
+}
+
+// Halves the frame down the pyramid;  the first level also gets the
+// threshold and the log luminance (see post-downsample.frag).
+void Post::Downsample()
+{
+    downShader.Use();
+    int program = downShader.program;
+    int loc = glGetUniformLocation(program, "source");
+    glUniform1i(loc, SOURCE_UNIT);
+    loc = glGetUniformLocation(program, "threshold");
+    glUniform1f(loc, bloomThreshold);
+    loc = glGetUniformLocation(program, "knee");
+    glUniform1f(loc, bloomKnee);
+    glActiveTexture(GL_TEXTURE0+SOURCE_UNIT);
+
+    for (int l=0;  l<levels;  l++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, bloomFbo[l]);
+        glViewport(0, 0, levelWidth[l], levelHeight[l]);
+        glBindTexture(GL_TEXTURE_2D, l == 0 ? hdrTexture : bloomTexture[l-1]);
+        int sw = l == 0 ? width : levelWidth[l-1];
+        int sh = l == 0 ? height : levelHeight[l-1];
+        loc = glGetUniformLocation(program, "sourceTexel");
+        glUniform2f(loc, 1.0f/sw, 1.0f/sh);
+        loc = glGetUniformLocation(program, "first");
+        glUniform1i(loc, l == 0);
+        glDrawArrays(GL_TRIANGLES, 0, 3); }
+    downShader.Unuse();
+}
+
+// Builds the histogram, then the exposure from it (and the last).
+void Post::Meter(const float dt)
+{
+    if (autoExposure && levels) {
+        int l = std::min(HISTOGRAM_LEVEL, levels-1);
+        glBindFramebuffer(GL_FRAMEBUFFER, histogramFbo);
+        glViewport(0, 0, HISTOGRAM_BINS, 1);
+        glClearColor(0.0, 0.0, 0.0, 0.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        histogramShader.Use();
+        int program = histogramShader.program;
+        glActiveTexture(GL_TEXTURE0+SOURCE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, bloomTexture[l]);
+        int loc = glGetUniformLocation(program, "luminance");
+        glUniform1i(loc, SOURCE_UNIT);
+        loc = glGetUniformLocation(program, "width");
+        glUniform1i(loc, levelWidth[l]);
+        loc = glGetUniformLocation(program, "logMin");
+        glUniform1f(loc, logMin);
+        loc = glGetUniformLocation(program, "logMax");
+        glUniform1f(loc, logMax);
+        glDrawArrays(GL_POINTS, 0, levelWidth[l]*levelHeight[l]);
+        histogramShader.Unuse();
+        glDisable(GL_BLEND); }
+
+    // From the last exposure into the other
+    int next = 1 - currentExposure;
+    glBindFramebuffer(GL_FRAMEBUFFER, exposureFbo[next]);
+    glViewport(0, 0, 1, 1);
+    exposureShader.Use();
+    int program = exposureShader.program;
+    glActiveTexture(GL_TEXTURE0+SOURCE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, histogramTexture);
+    glActiveTexture(GL_TEXTURE0+EXPOSURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, exposureTexture[currentExposure]);
+    int loc = glGetUniformLocation(program, "histogram");
+    glUniform1i(loc, SOURCE_UNIT);
+    loc = glGetUniformLocation(program, "previous");
+    glUniform1i(loc, EXPOSURE_UNIT);
+    loc = glGetUniformLocation(program, "autoExposure");
+    glUniform1i(loc, autoExposure && levels);
+    loc = glGetUniformLocation(program, "compensation");
+    glUniform1f(loc, compensation);
+    loc = glGetUniformLocation(program, "key");
+    glUniform1f(loc, key);
+    loc = glGetUniformLocation(program, "lowPercent");
+    glUniform1f(loc, lowPercent);
+    loc = glGetUniformLocation(program, "highPercent");
+    glUniform1f(loc, std::max(lowPercent, highPercent));
+    loc = glGetUniformLocation(program, "logMin");
+    glUniform1f(loc, logMin);
+    loc = glGetUniformLocation(program, "logMax");
+    glUniform1f(loc, logMax);
+    // The fraction of the way to the new exposure this frame
+    loc = glGetUniformLocation(program, "adapt");
+    glUniform1f(loc, adaptation > 0.0f ? 1.0f - expf(-dt/adaptation) : 1.0f);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    exposureShader.Unuse();
+    currentExposure = next;
+}
+
+// Spreads each level into the one above, from the smallest up.
+void Post::Upsample()
+{
+    if (levels < 2) return;
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    upShader.Use();
+    int program = upShader.program;
+    int loc = glGetUniformLocation(program, "source");
+    glUniform1i(loc, SOURCE_UNIT);
+    glActiveTexture(GL_TEXTURE0+SOURCE_UNIT);
+
+    for (int l=levels-2;  l>=0;  l--) {
+        glBindFramebuffer(GL_FRAMEBUFFER, bloomFbo[l]);
+        glViewport(0, 0, levelWidth[l], levelHeight[l]);
+        glBindTexture(GL_TEXTURE_2D, bloomTexture[l+1]);
+        loc = glGetUniformLocation(program, "sourceTexel");
+        glUniform2f(loc, 1.0f/levelWidth[l+1], 1.0f/levelHeight[l+1]);
+        glDrawArrays(GL_TRIANGLES, 0, 3); }
+    upShader.Unuse();
+    glDisable(GL_BLEND);
+}
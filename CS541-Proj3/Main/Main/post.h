@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////
+// HDR post-processing.  The lighting pass (forward or deferred) draws
+// into a floating point (RGBA16F) target rather than the output, so
+// that the sun and highlights keep their values above 1.  The chain
+// then brings the frame back to the display's range:
+//
+//   Bloom down:  the frame is halved repeatedly into a pyramid of
+//                bloomLevels levels, by a 13 tap filter (Jimenez's,
+//                from Call of Duty: Advanced Warfare).  The first
+//                halving also applies the bloom's soft threshold,
+//                weights its taps against fireflies (Karis), and
+//                stores each pixel's log2 luminance in alpha.
+//   Bloom up:    from the smallest level back up, each level is
+//                spread with a tent filter and added into the one
+//                above (leaving alpha alone).
+//   Histogram:   each texel of one small level is drawn as a point
+//                into its bin of a HISTOGRAM_BINS by 1 target, with
+//                additive blending:  a histogram of log luminance
+//                over logMin..logMax, built without compute shaders
+//                or reading anything back.
+//   Exposure:    a single pixel pass reads the histogram, averages
+//                the luminance between its low and high percentiles,
+//                and moves the exposure towards the one mapping that
+//                to key, over adaptation seconds.  The exposure
+//                stays on the GPU, ping-ponged between two textures.
+//   Tone map:    one full screen pass, into the output:  the frame
+//                plus bloomStrength times the bloom, times the
+//                exposure, through a filmic curve (Narkowicz's fit
+//                of the ACES reference).
+//
+// The luminance is taken in the first bloom pass, and the bloom
+// composited in the tone mapping pass, so the chain never reads the
+// full size frame more than twice.  Each stage is timed.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _POST_
+#define _POST_
+
+#include "shader.h"
+#include "gputimer.h"
+
+#define HISTOGRAM_BINS 64
+#define MAX_BLOOM_LEVELS 8
+
+class Scene;
+
+class Post
+{
+public:
+    // User controllable parameters
+    bool enabled;
+    bool autoExposure;
+    float compensation;     // Exposure adjustment, in stops (EV)
+    float key;              // The tone average luminance maps to
+    float adaptation;       // Seconds to adapt (0 adapts at once)
+    float lowPercent, highPercent;  // Of the histogram averaged
+    float logMin, logMax;   // The histogram's range, in log2 luminance
+    float bloomStrength;
+    float bloomThreshold;   // Luminance where bloom begins
+    float bloomKnee;        // Width of the soft threshold
+    int bloomLevels;
+
+    // The HDR target (with its depth), and the bloom pyramid
+    unsigned int hdrFbo, hdrTexture, depthBuffer;
+    unsigned int bloomFbo[MAX_BLOOM_LEVELS], bloomTexture[MAX_BLOOM_LEVELS];
+    int levelWidth[MAX_BLOOM_LEVELS], levelHeight[MAX_BLOOM_LEVELS];
+    int levels;             // Of the pyramid, at the current size
+    int levelsWanted;       // The bloomLevels it was made for
+    unsigned int histogramFbo, histogramTexture;
+    unsigned int exposureFbo[2], exposureTexture[2];
+    int currentExposure;    // The one written last
+    int width, height;
+
+    ShaderProgram downShader, histogramShader, exposureShader, upShader, toneShader;
+    unsigned int emptyVao;
+
+    GpuTimer timer, bloomTimer, exposureTimer, toneTimer;
+
+    Post();
+    void Initialize();
+    unsigned int Target(const int w, const int h);
+    void Apply(Scene& scene);
+
+private:
+    double lastTime;        // Of the last Apply, in seconds
+
+    void CreateTargets(const int w, const int h);
+    void DeleteTargets();
+    void Downsample();
+    void Meter(const float dt);
+    void Upsample();
+};
+
+#endif
@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////
+// Prefiltered specular environment lighting (split-sum).  See
+// prefilter.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "envprobe.h"
+#include "prefilter.h"
+
+// Texture units used for the results (see lighting.frag)
+#define SPECULAR_UNIT 10
+#define LUT_UNIT      11
+
+Prefilter::Prefilter()
+    :enabled(true), sampleCount(64), cubeTexture(0), size(256), levels(7),
+     lutTexture(0), lutSize(128), fbo(0), emptyVao(0)
+{
+}
+
+static void CreateFullscreenShader(ShaderProgram& shader, const char* frag)
+{
+    shader.CreateProgram();
+    shader.CreateShader("fullscreen.vert", GL_VERTEX_SHADER);
+    shader.CreateShader(frag, GL_FRAGMENT_SHADER);
+    shader.LinkProgram();
+}
+
+// Creates the shaders, the prefiltered cube map (with all its MIP
+// levels) and the BRDF lookup table.
+void Prefilter::Initialize()
+{
+    CreateFullscreenShader(filterShader, "prefilter.frag");
+    CreateFullscreenShader(lutShader, "brdflut.frag");
+    glGenVertexArrays(1, &emptyVao);
+    glGenFramebuffers(1, &fbo);
+
+    glGenTextures(1, &cubeTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+    for (int level=0;  level<levels;  level++)
+        for (int f=0;  f<6;  f++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+f, level, GL_RGBA16F,
+                         size>>level, size>>level, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels-1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    glGenTextures(1, &lutTexture);
+    glBindTexture(GL_TEXTURE_2D, lutTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, lutSize, lutSize, 0, GL_RG, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    BuildLUT();
+}
+
+// The lookup table depends only on the BRDF, so is drawn just once.
+void Prefilter::BuildLUT()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, lutTexture, 0);
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("BRDF LUT FBO Error: %d\n", status);
+
+    glViewport(0, 0, lutSize, lutSize);
+    glDisable(GL_DEPTH_TEST);
+    lutShader.Use();
+    glBindVertexArray(emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    lutShader.Unuse();
+    glEnable(GL_DEPTH_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Called after the probe is rendered.  Each MIP level of the cube map
+// is filled with the probe convolved for that level's roughness;  the
+// probe's own MIP chain supplies the pre-blurred source samples.
+void Prefilter::Filter(EnvProbe& probe)
+{
+    if (!enabled || !probe.updated) return;
+
+    Unbind();
+    timer.Begin();
+    probe.GenerateMipmaps();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glDisable(GL_DEPTH_TEST);
+
+    filterShader.Use();
+    int program = filterShader.program;
+    probe.Bind(program);
+    int loc = glGetUniformLocation(program, "sampleCount");
+    glUniform1i(loc, sampleCount);
+    loc = glGetUniformLocation(program, "sourceTexelAngle");
+    glUniform1f(loc, probe.SourceTexelAngle());
+
+    glBindVertexArray(emptyVao);
+    for (int level=0;  level<levels;  level++) {
+        glViewport(0, 0, size>>level, size>>level);
+        loc = glGetUniformLocation(program, "roughness");
+        glUniform1f(loc, float(level)/float(levels-1));
+
+        for (int f=0;  f<6;  f++) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_CUBE_MAP_POSITIVE_X+f, cubeTexture, level);
+            loc = glGetUniformLocation(program, "face");
+            glUniform1i(loc, f);
+            glDrawArrays(GL_TRIANGLES, 0, 3); } }
+    glBindVertexArray(0);
+
+    probe.Unbind();
+    filterShader.Unuse();
+
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    timer.End();
+}
+
+// Makes the prefiltered cube map and lookup table available to the
+// lighting shader.
+void Prefilter::Bind(const int program)
+{
+    glActiveTexture(GL_TEXTURE0+SPECULAR_UNIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+    glActiveTexture(GL_TEXTURE0+LUT_UNIT);
+    glBindTexture(GL_TEXTURE_2D, lutTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    SetUnits(program);
+    int loc = glGetUniformLocation(program, "prefiltered");
+    glUniform1i(loc, enabled);
+}
+
+// As EnvProbe::SetUnits, done for every pass to keep the cube map
+// sampler off unit 0.
+void Prefilter::SetUnits(const int program)
+{
+    int loc = glGetUniformLocation(program, "specularCube");
+    glUniform1i(loc, SPECULAR_UNIT);
+    loc = glGetUniformLocation(program, "brdfLUT");
+    glUniform1i(loc, LUT_UNIT);
+    loc = glGetUniformLocation(program, "specularLevels");
+    glUniform1f(loc, float(levels));
+    loc = glGetUniformLocation(program, "prefiltered");
+    glUniform1i(loc, 0);
+}
+
+void Prefilter::Unbind()
+{
+    glActiveTexture(GL_TEXTURE0+SPECULAR_UNIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glActiveTexture(GL_TEXTURE0+LUT_UNIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
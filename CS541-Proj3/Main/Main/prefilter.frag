@@ -0,0 +1,92 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for prefiltering the environment probe:  convolves
+// the probe with the GGX lobe of the given roughness for one face
+// (and one MIP level) of the prefiltered cube map.  Uses filtered
+// importance sampling:  each sample reads a MIP level of the source
+// whose texel size matches the solid angle the sample represents,
+// so a modest sample count gives a smooth result.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform int face;               // Cube face being written, 0..5
+uniform float roughness;        // Perceptual roughness, 0..1
+uniform int sampleCount;
+uniform float sourceTexelAngle; // Solid angle of one source texel at MIP 0
+
+// The probe being filtered
+#include "environment.glsl"
+
+in vec2 uv;
+
+const float PI = 3.14159265;
+
+// The direction through texel uv of a cube face, following OpenGL's
+// cube map conventions.
+vec3 FaceDirection(int f, vec2 t)
+{
+    vec2 p = 2.0*t - 1.0;
+    if (f == 0) return normalize(vec3( 1.0, -p.y, -p.x));
+    if (f == 1) return normalize(vec3(-1.0, -p.y,  p.x));
+    if (f == 2) return normalize(vec3( p.x,  1.0,  p.y));
+    if (f == 3) return normalize(vec3( p.x, -1.0, -p.y));
+    if (f == 4) return normalize(vec3( p.x, -p.y,  1.0));
+    return normalize(vec3(-p.x, -p.y, -1.0));
+}
+
+// Low discrepancy sample points
+vec2 Hammersley(int i, int n)
+{
+    uint b = uint(i);
+    b = (b << 16u) | (b >> 16u);
+    b = ((b & 0x55555555u) << 1u) | ((b & 0xAAAAAAAAu) >> 1u);
+    b = ((b & 0x33333333u) << 2u) | ((b & 0xCCCCCCCCu) >> 2u);
+    b = ((b & 0x0F0F0F0Fu) << 4u) | ((b & 0xF0F0F0F0u) >> 4u);
+    b = ((b & 0x00FF00FFu) << 8u) | ((b & 0xFF00FF00u) >> 8u);
+    return vec2(float(i)/float(n), float(b)*2.3283064365386963e-10);
+}
+
+// A GGX distributed half vector around N
+vec3 ImportanceSampleGGX(vec2 xi, float a, vec3 N)
+{
+    float phi = 2.0*PI*xi.x;
+    float cosTheta = sqrt((1.0 - xi.y)/(1.0 + (a*a - 1.0)*xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta*cosTheta);
+    vec3 H = vec3(sinTheta*cos(phi), sinTheta*sin(phi), cosTheta);
+
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 T = normalize(cross(up, N));
+    vec3 B = cross(N, T);
+    return T*H.x + B*H.y + N*H.z;
+}
+
+void main()
+{
+    vec3 N = FaceDirection(face, uv);
+
+    // Roughness 0 is a mirror:  a copy of the probe.
+    if (roughness == 0.0) {
+        gl_FragColor = vec4(SampleEnvironment(N, 0.0), 1.0);
+        return; }
+
+    // As usual for the split-sum approximation, assume V = R = N.
+    float a = roughness*roughness;
+    vec3 sum = vec3(0.0);
+    float weight = 0.0;
+    for (int i=0;  i<sampleCount;  i++) {
+        vec3 H = ImportanceSampleGGX(Hammersley(i, sampleCount), a, N);
+        vec3 L = 2.0*dot(N, H)*H - N;
+        float NL = dot(N, L);
+        if (NL <= 0.0) continue;
+
+        // pdf of L is D(H)/4 (since N.H = V.H here)
+        float NH = max(dot(N, H), 0.0);
+        float d = NH*NH*(a*a - 1.0) + 1.0;
+        float D = a*a/(PI*d*d);
+        float sampleAngle = 1.0/(float(sampleCount)*D*0.25 + 0.0001);
+        float lod = max(0.5*log2(sampleAngle/sourceTexelAngle) + 1.0, 0.0);
+
+        sum += SampleEnvironment(L, lod)*NL;
+        weight += NL; }
+
+    gl_FragColor = vec4(sum/max(weight, 0.0001), 1.0);
+}
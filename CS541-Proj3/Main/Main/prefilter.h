@@ -0,0 +1,52 @@
+///////////////////////////////////////////////////////////////////////
+// Prefiltered specular environment lighting (the "split-sum"
+// approximation).  Each time the environment probe is re-rendered,
+// its contents are convolved with the GGX lobe for a range of
+// roughness values, one roughness per MIP level of a cube map.  A
+// 2D lookup table holding the scale and bias to apply to the
+// Fresnel reflectance (indexed by N.V and roughness) is built once.
+// The lighting shader then needs only one filtered cube map lookup
+// and one table lookup per fragment for glossy reflections:
+//
+//    specular = prefiltered(R, roughness) * (F0*lut.x + lut.y)
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _PREFILTER_
+#define _PREFILTER_
+
+#include "shader.h"
+#include "gputimer.h"
+
+class EnvProbe;
+
+class Prefilter
+{
+public:
+    // User controllable parameters
+    bool enabled;       // Off:  mirror reflections, straight from the probe
+    int sampleCount;    // GGX importance samples per texel
+
+    // Prefiltered cube map;  MIP level i holds roughness i/(levels-1)
+    unsigned int cubeTexture;
+    int size, levels;
+
+    // Split-sum BRDF lookup table (RG16F)
+    unsigned int lutTexture;
+    int lutSize;
+
+    ShaderProgram filterShader, lutShader;
+    unsigned int fbo, emptyVao;
+    GpuTimer timer;
+
+    Prefilter();
+    void Initialize();
+    void Filter(EnvProbe& probe);
+    void Bind(const int program);
+    void SetUnits(const int program);
+    void Unbind();
+
+private:
+    void BuildLUT();
+};
+
+#endif
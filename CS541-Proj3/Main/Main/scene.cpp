@@ -22,6 +22,8 @@
 #include <time.h>
 
 #include "scene.h"
+#include "shadermanager.h"
+#include "jobs.h"
 #include <math.h>
 #include <glimg/glimg.h>
 
@@ -29,6 +31,12 @@ static MAT4 Identity = MAT4();
 const float PI = 3.14159f;
 const float rad = PI/180.0f;
 
+////////////////////////////////////////////////////////////////////////
+// The rotation of the surrounding sphere environment, in degrees:
+// one turn every two minutes, advanced by the main loop's simulation
+// (see Simulate in framework.cpp).
+float atime = 0.0;
+
 ////////////////////////////////////////////////////////////////////////
 // This macro makes it easy to sprinkle checks for OpenGL errors
 // throught your code.  Most OpenGL calls can record errors, and a
@@ -67,17 +75,16 @@ vec3 HSV2RGB(const float h, const float s, const float v)
 void Scene::InitializeScene()
 {
     CHECKERROR;
+    MemoryScope scope(MEM_SCENE);
 
+    // Shaders are cached, and reloaded when edited (see shadermanager.h)
+    shaderManager.Initialize();
 
-	float rx = (width * ry) / (height);
+    // Per-frame CPU work is spread over all cores (see jobs.h)
+    jobs.Initialize();
 
 
-	//'texture' = texture buffer FBO's texture is put into, FBO.Bind() is to bind texture, FBO.Unbind is to unbind texture, FBO.CreateFBO() is to create texture?
-
-	topReflectionTarget.CreateFBO(1024, 1024);
-	
-	bottomReflectionTarget.CreateFBO(1024, 1024);
-
+	float rx = (width * ry) / (height);
 
 
 	//shadowTarget.CreateFBO(1024, 1024);
@@ -106,6 +113,14 @@ void Scene::InitializeScene()
     nSpheres = 16;
     drawSpheres = true;
     drawGround = true;
+    renderPath = FORWARD;
+    outputFbo = 0;
+    centralNode = -1;
+    multiDraw = false;
+    surfaceDetail = NORMAL_MAPPED;
+    parallaxScale = 0.02f;
+    parallaxMinSteps = 8;
+    parallaxMaxSteps = 32;
 
     // Scene transformation parameters
     // Fixme:  This is a good place to initialize your scene variables.
@@ -125,52 +140,31 @@ void Scene::InitializeScene()
     // built (in models.cpp) as Vertex Array Objects (VAO's) and sent
     // to the graphics card.
     spherePolygons = new Sphere(32);
-    groundPolygons = new Ground(50.0, 100);
+    terrain = new Terrain();
     SetCentralModel(0);         // Teapot, sphere, or some PLY model, or ...
 
     //////////////////////////////////////////////////////////////////////
     // Create a shader program  (See shader.h and shader.cpp.)
 
-    // Create the program
-    lightingShader.CreateProgram();
-
-    // Read and compile the source from two files.
-    lightingShader.CreateShader("lighting.vert", GL_VERTEX_SHADER);
-    lightingShader.CreateShader("lighting.frag", GL_FRAGMENT_SHADER);
-
-	glBindAttribLocation(lightingShader.program, 0, "vertex");
-	glBindAttribLocation(lightingShader.program, 1, "vertexNormal");
-	glBindAttribLocation(lightingShader.program, 2, "vertexTexture");
-	glBindAttribLocation(lightingShader.program, 3, "vertexTangent");
-
-
-	lightingShader.LinkProgram();
+    // Build the program's variants from two files.
+    lightingShader.Create("lighting.vert", "lighting.frag");
 
 		
-	reflectionShaderTop.CreateProgram();
-	reflectionShaderTop.CreateShader("lighting-pass1-topReflection.vert", GL_VERTEX_SHADER);
-	reflectionShaderTop.CreateShader("lighting-pass1-topReflection.frag", GL_FRAGMENT_SHADER);
-
-	glBindAttribLocation(lightingShader.program, 0, "vertex");
-	glBindAttribLocation(lightingShader.program, 1, "vertexNormal");
-	glBindAttribLocation(lightingShader.program, 2, "vertexTexture");
-	glBindAttribLocation(lightingShader.program, 3, "vertexTangent");
-
-
-	reflectionShaderTop.LinkProgram();
-
-	reflectionShaderBottom.CreateProgram();
-	reflectionShaderBottom.CreateShader("lighting-pass1-bottomReflection.vert", GL_VERTEX_SHADER);
-	reflectionShaderBottom.CreateShader("lighting-pass1-bottomReflection.frag", GL_FRAGMENT_SHADER);
-
-	glBindAttribLocation(lightingShader.program, 0, "vertex");
-	glBindAttribLocation(lightingShader.program, 1, "vertexNormal");
-	glBindAttribLocation(lightingShader.program, 2, "vertexTexture");
-	glBindAttribLocation(lightingShader.program, 3, "vertexTangent");
-
-
-
-	reflectionShaderBottom.LinkProgram();
+	// The environment probe builds its own shaders and render targets.
+	probe.Initialize();
+	prefilter.Initialize();
+	shLighting.Initialize();
+	pointLights.Initialize();
+	clusters.Initialize();
+	deferred.Initialize();
+	stream.Initialize(1<<20);
+	megaBuffer.Initialize();
+	occlusion.Initialize();
+	post.Initialize();
+	antialias.Initialize();
+	dynamicResolution.Initialize(*this);
+	ssao.Initialize();
+	depthPrepass.Initialize();
 	//shadowShader.CreateShader("", GL_VERTEX_SHADER);
 	//shadowShader.CreateShader("", GL_FRAGMENT_SHADER);
 
@@ -193,7 +187,11 @@ void Scene::InitializeScene()
 
 
     groundTexture.Read("images/6670-diffuse.jpg");
+    groundNormal.Read("images/6670-normal.jpg");
+    groundHeight.Read("images/6670-bump.jpg");
     CHECKERROR;
+
+    BuildGraph();
 //
 	//earthBaseTexture.Read("images/earth.png");
 //	CHECKERROR;
@@ -207,10 +205,14 @@ void Scene::InitializeScene()
 
 void Scene::SetCentralModel(const int i)
 {
-    delete centralPolygons;
-    centralPolygons = NULL;
     centralModel = i;
 
+    // Each model is built the first time it is chosen, then kept, so
+    // switching back and forth doesn't rebuild (or reload) it.
+    if (centralModel >= int(centralModels.size()))
+        centralModels.resize(centralModel+1, NULL);
+    Model*& cached = centralModels[centralModel];
+
     if (centralModel==0) {
         //SWAPPING TEAPOT FOR SPHERE HERE
 		//Arbitrarily setting the base Earth texture to 6, effects to 7 *****
@@ -218,7 +220,8 @@ void Scene::SetCentralModel(const int i)
 		//=Proj. 3 10/16/2015  Swapping back to teapot, can keep textures in the same places?
 
 		//centralPolygons = new Sphere(30);
-		centralPolygons =  new Teapot(12);
+		if (!cached) cached = new Teapot(12);
+		centralPolygons = cached;
 		//Identify this as the central model SH
 		isCentralModel = true;
         float s = 3.0/centralPolygons->size;
@@ -227,7 +230,8 @@ void Scene::SetCentralModel(const int i)
             Translate(-centralPolygons->center); }
 
     else if (centralModel==1) {
-        centralPolygons = new Ply("bunny.ply");
+        if (!cached) cached = new Ply("bunny.ply");
+        centralPolygons = cached;
         float s = 3.0/centralPolygons->size;
         centralTr =
             Rotate(2, 180.0f)
@@ -236,7 +240,8 @@ void Scene::SetCentralModel(const int i)
             *Translate(-centralPolygons->center); }
 
     else if (centralModel==2) {
-        centralPolygons = new Ply("dragon.ply");
+        if (!cached) cached = new Ply("dragon.ply");
+        centralPolygons = cached;
         float s = 3.0/centralPolygons->size;
         centralTr =
             Rotate(2, 180.0f)
@@ -245,235 +250,219 @@ void Scene::SetCentralModel(const int i)
             *Translate(-centralPolygons->center); }
 
     else {       // Fallback model
-        centralPolygons = new Sphere(32);
+        if (!cached) cached = new Sphere(32);
+        centralPolygons = cached;
         float s = 3.0/centralPolygons->size;
         centralTr = Scale(s,s,s); }
 
-
-
-
-
-}
-
-////////////////////////////////////////////////////////////////////////
-// A small helper function to draw a model after settings its lighting
-// and modeling parmaeters.
-void DrawModel(const int program, Model* m, MAT4& ModelTr)
-{
-    int loc = glGetUniformLocation(program, "ModelMatrix");
-    glUniformMatrix4fv(loc, 1, GL_TRUE, ModelTr.Pntr());
-
-    loc = glGetUniformLocation(program, "NormalMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, ModelTr.inverse().Pntr());
-
-    loc = glGetUniformLocation(program, "diffuse");
-    glUniform3fv(loc, 1, &m->diffuseColor[0]);
-
-    loc = glGetUniformLocation(program, "specular");
-    glUniform3fv(loc, 1, &m->specularColor[0]);
-
-    loc = glGetUniformLocation(program, "shininess");
-    glUniform1f(loc, m->shininess);
-
-    m->DrawVAO();
-
-
-
-
-
-
+    if (centralNode >= 0) {
+        graph.SetModel(centralNode, centralPolygons);
+        graph.SetLocal(centralNode, centralTr);
+        graph.color[centralNode] = centralPolygons->diffuseColor; }
 
 
 
 }
 
 ////////////////////////////////////////////////////////////////////////
-// A small helper function for DrawScene to draw all the environment
-// spheres.
-void Scene::DrawSpheres(unsigned int program, MAT4& ModelTr)
+// Builds the scene graph from the current models:  the sun, the ring
+// of spheres (children of one node which turns with atime), the
+// ground, and the central model.  Called again by anything which
+// replaces the models (see benchmark.cpp), which may then add nodes
+// of its own.
+void Scene::BuildGraph()
 {
+    graph.Clear();
+    int sunMaterial = graph.AddMaterial(ShaderVariants::DIRECT, NULL);
+    int litMaterial = graph.AddMaterial(ShaderVariants::LIT, NULL);
+    int groundMaterial = graph.AddMaterial(ShaderVariants::TERRAIN, &groundTexture,
+                                            &groundNormal, &groundHeight);
+    int centralMaterial = graph.AddMaterial(ShaderVariants::REFLECTIVE, NULL);
 
-	time(&currTime);
-    CHECKERROR;
-    float t = 1.0;
-    float s = 200.0;
-
-
-    int loc;
-
-    loc = glGetUniformLocation(program, "specular");
-    glUniform3fv(loc, 1, &spherePolygons->specularColor[0]);
-
-    loc = glGetUniformLocation(program, "shininess");
-    glUniform1f(loc, spherePolygons->shininess);
+    sunNode = graph.Add(-1, Translate(lightPos), spherePolygons, sunMaterial, vec3(100,1,1));
 
+    ringNode = graph.Add(-1, Rotate(2, atime));
     for (int i=0;  i<2*nSpheres;  i+=2) {
         float u = float(i)/(2*nSpheres);
-
         for (int j=2;  j<=nSpheres/2;  j+=2) {
             float v = float(j)/(nSpheres);
             vec3 color = HSV2RGB(u, 1.0f-2.0f*fabs(v-0.5f), 1.0f);
-
             float s = 3.0f* sin(v*3.14f);
-            MAT4 M = ModelTr*Rotate(2, 360.0f*u)*Rotate(1, 180.0f*v)
-                     *Translate(0.0f, 0.0f, 30.0f)*Scale(s,s,s) ;
-            loc = glGetUniformLocation(program, "ModelMatrix");
-            glUniformMatrix4fv(loc, 1, GL_TRUE, M.Pntr());
-
-            loc = glGetUniformLocation(program, "NormalMatrix");
-            glUniformMatrix4fv(loc, 1, GL_FALSE, M.inverse().Pntr());
-
-            loc = glGetUniformLocation(program, "diffuse");
-            glUniform3fv(loc, 1, &color[0]);
-            spherePolygons->DrawVAO(); } }
-
-    loc = glGetUniformLocation(program, "ModelMatrix");
-    glUniformMatrix4fv(loc, 1, GL_TRUE, Identity.Pntr());
-    loc = glGetUniformLocation(program, "NormalMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, Identity.Pntr());
-    CHECKERROR;
+            MAT4 M = Rotate(2, 360.0f*u)*Rotate(1, 180.0f*v)
+                     *Translate(0.0f, 0.0f, 30.0f)*Scale(s,s,s);
+            graph.Add(ringNode, M, spherePolygons, litMaterial, color,
+                      SceneGraph::ENVIRONMENT|SceneGraph::OCCLUDER); } }
+
+    // The ground's own node stays put (things placed on the ground are
+    // its children), while the terrain's box follows the eye.
+    groundNode = graph.Add(-1, Identity);
+    terrainNode = graph.Add(groundNode, terrain->Placement(), terrain, groundMaterial,
+                            terrain->diffuseColor,
+                            SceneGraph::ENVIRONMENT|SceneGraph::OCCLUDER);
+
+    centralNode = graph.Add(-1, centralTr, centralPolygons, centralMaterial,
+                            centralPolygons->diffuseColor,
+                            SceneGraph::CENTRAL|SceneGraph::OCCLUDER);
+    graph.Update();
 }
 
-void Scene::DrawGround(unsigned int program, MAT4& ModelTr)
+// Moves the nodes which change from frame to frame, and updates the
+// graph's transforms.
+void Scene::UpdateGraph()
 {
-    int loc = glGetUniformLocation(program, "diffuse");
-    glUniform3fv(loc, 1, &groundPolygons->diffuseColor[0]);
-
-    loc = glGetUniformLocation(program, "specular");
-    glUniform3fv(loc, 1, &groundPolygons->specularColor[0]);
-
-    loc = glGetUniformLocation(program, "shininess");
-    glUniform1f(loc, groundPolygons->shininess);
-
-    groundTexture.Bind(1);      // Choose texture unit 1
-    loc = glGetUniformLocation(program, "groundTexture");
-    glUniform1i(loc, 1);        // Tell the shader about unit 1
-
-
-
-
-
-
-
-
-
-    loc = glGetUniformLocation(program, "ModelMatrix");
-    glUniformMatrix4fv(loc, 1, GL_TRUE, ModelTr.Pntr());
-    loc = glGetUniformLocation(program, "NormalMatrix");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, ModelTr.inverse().Pntr());
+    graph.SetLocal(sunNode, Translate(lightPos));
+    graph.SetLocal(ringNode, Rotate(2, atime));
+    graph.SetHidden(ringNode, !drawSpheres);
+    graph.SetHidden(groundNode, !drawGround);
+
+    // The terrain's levels recentered about the eye
+    MAT4 inverse = WorldView.inverse();
+    terrain->Update(vec3(inverse[0][3], inverse[1][3], inverse[2][3]));
+    graph.SetLocal(terrainNode, terrain->Placement());
+    graph.Update();
+}
 
-    groundPolygons->DrawVAO();
+////////////////////////////////////////////////////////////////////////
+// Draws a list of nodes (from graph.Cull), switching the shader
+// variant and texture only where the node's material changes.  A
+// model with meshlets is drawn without its culled clusters (see
+// meshlet.h);  the multi-draw path draws whole models.  The terrain's
+// node draws its clipmap, where the shader has a TERRAIN variant
+// (elsewhere, its box's bottom face, as an occluder).  Returns the
+// number drawn.
+int Scene::DrawNodes(ShaderVariants& shader, const std::vector<int>& list)
+{
+    if (shader.indirect)
+        return DrawNodesIndirect(shader, list);
+
+    int current = -1;
+    int program = 0;
+    bool textured = false;
+    bool clipmap = false;
+    for (unsigned int k=0;  k<list.size();  k++) {
+        int i = list[k];
+        if (graph.material[i] != current) {
+            current = graph.material[i];
+            SceneGraph::Material& m = graph.materials[current];
+            program = shader.Use(m.variant);
+            BindMaterial(program, m);
+            clipmap = m.variant == ShaderVariants::TERRAIN && shader.built[m.variant];
+            if (m.texture) textured = true; }
+
+        Model* model = graph.model[i];
+        int loc = glGetUniformLocation(program, "ModelMatrix");
+        glUniformMatrix4fv(loc, 1, GL_TRUE, graph.world[i].Pntr());
+        loc = glGetUniformLocation(program, "NormalMatrix");
+        glUniformMatrix4fv(loc, 1, GL_FALSE, graph.normal[i].Pntr());
+        loc = glGetUniformLocation(program, "diffuse");
+        glUniform3fv(loc, 1, &graph.color[i][0]);
+        loc = glGetUniformLocation(program, "specular");
+        glUniform3fv(loc, 1, &model->specularColor[0]);
+        loc = glGetUniformLocation(program, "shininess");
+        glUniform1f(loc, model->shininess);
+
+        if (clipmap && model == terrain)
+            terrain->Draw(program);
+        else if (meshletCuller.enabled && model->meshlets.size())
+            meshletCuller.Draw(model, graph.world[i], graph.normal[i]);
+        else
+            model->DrawVAO(); }
+
+    if (textured) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE16);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE17);
+        glBindTexture(GL_TEXTURE_2D, 0); }
     CHECKERROR;
-
-    glActiveTexture(GL_TEXTURE1); // Choose texture unit 1
-    groundTexture.Unbind();
-
-
-
-
-
-
-
-
-
-
+    return list.size();
 }
 
-void Scene::DrawSun(unsigned int program, MAT4& ModelTr)
+// Binds a material's textures, for the program of its variant.  The
+// normal and height maps go to units 16 and 17 (see surface.glsl).
+void Scene::BindMaterial(const int program, const SceneGraph::Material& m)
 {
-    vec3 white(100,1,1);
-
-    int loc = glGetUniformLocation(program, "direct");
-    glUniform1i(loc, 1);
-
-    loc = glGetUniformLocation(program, "diffuse");
-    glUniform3fv(loc, 1, &white[0]);
-
-    loc = glGetUniformLocation(program, "ModelMatrix");
-    glUniformMatrix4fv(loc, 1, GL_TRUE, ModelTr.Pntr());
+    if (m.texture) {
+        m.texture->Bind(1);     // Choose texture unit 1
+        int loc = glGetUniformLocation(program, "groundTexture");
+        glUniform1i(loc, 1); }  // Tell the shader about unit 1
+
+    bool maps = m.normalMap && m.heightMap;
+    int loc = glGetUniformLocation(program, "surfaceMaps");
+    glUniform1i(loc, maps);
+    if (maps) {
+        m.normalMap->Bind(16);
+        loc = glGetUniformLocation(program, "normalMap");
+        glUniform1i(loc, 16);
+        m.heightMap->Bind(17);
+        loc = glGetUniformLocation(program, "heightMap");
+        glUniform1i(loc, 17); }
+}
 
-    spherePolygons->DrawVAO();
+// DrawNodes for the multi-draw path (see megabuffer.h):  the list's
+// commands are written in one go, then each run of one material is
+// a single glMultiDrawElementsIndirect.  The per-object values come
+// from the frame's draw records, so no uniforms are set per node.
+int Scene::DrawNodesIndirect(ShaderVariants& shader, const std::vector<int>& list)
+{
+    megaBuffer.WriteCommands(graph, list, stream);
+
+    bool textured = false;
+    unsigned int last;
+    for (unsigned int first=0;  first<list.size();  first=last) {
+        int current = graph.material[list[first]];
+        for (last=first+1;  last<list.size() && graph.material[list[last]] == current;  last++)
+            ;
+
+        SceneGraph::Material& m = graph.materials[current];
+        int program = shader.Use(m.variant);
+        BindMaterial(program, m);
+        if (m.texture) textured = true;
+        if (m.variant == ShaderVariants::TERRAIN && shader.built[m.variant]) {
+            // The clipmap is drawn on its own, with its node's record
+            for (unsigned int k=first;  k<last;  k++) {
+                glVertexAttribI4ui(DRAW_ID_ATTRIBUTE, list[k], 0, 0, 0);
+                terrain->Draw(program); }
+            glBindVertexArray(megaBuffer.vao); }
+        else
+            megaBuffer.Draw(first, last-first); }
+    megaBuffer.Finish();
+
+    if (textured) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE16);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE17);
+        glBindTexture(GL_TEXTURE_2D, 0); }
     CHECKERROR;
-
-    loc = glGetUniformLocation(program, "direct");
-    glUniform1i(loc, 0);
-
+    return list.size();
 }
 
 ////////////////////////////////////////////////////////////////////////
-// Called regularly to update the rotation of the surrounding sphere
-// environment.  Set to rotate once every two minutes.
-float atime = 0.0;
-void animate(int value)
+// Returns the graph node under pixel (x,y) of the window, or -1.
+int Scene::Pick(const int x, const int y)
 {
-    atime = 360.0f*glutGet(GLUT_ELAPSED_TIME)/120000.0f;
-    glutPostRedisplay();
+    MAT4 inverse = (WorldProj*WorldView).inverse();
+    vec3 ends[2];
+    for (int e=0;  e<2;  e++) {
+        float p[4] = {2.0f*x/width - 1.0f, 1.0f - 2.0f*y/height, e ? 1.0f : -1.0f, 1.0f};
+        float q[4];
+        for (int i=0;  i<4;  i++)
+            q[i] = inverse[i][0]*p[0] + inverse[i][1]*p[1] + inverse[i][2]*p[2] + inverse[i][3]*p[3];
+        ends[e] = vec3(q[0], q[1], q[2])/q[3]; }
+
+    return graph.Pick(ends[0], ends[1]-ends[0], SceneGraph::ALL);
 }
 
 ////////////////////////////////////////////////////////////////////////
-// Procedure DrawScene is called whenever the scene needs to be drawn.
-void Scene::DrawScene()
+// Sends the per-pass values (viewing and projection matrices,
+// lighting parameters, mode, ...) to a shader program.
+void Scene::SetupProgram(const int program, MAT4& View, MAT4& Proj)
 {
-    CHECKERROR;
-
     int loc;
 
-    // Calculate the light's position.
-    vec3 lPos = vec3(lightDist*cos(lightSpin*rad)*sin(lightTilt*rad),
-                     lightDist*sin(lightSpin*rad)*sin(lightTilt*rad),
-                     lightDist*cos(lightTilt*rad) );
-
-    // FIXME:  These hard-coded perspective and viewing matrices should be removed and replaced.
-   /* MAT4 WorldView, WorldProj;
-
-    WorldProj[0][0] =   -4.3301;
-    WorldProj[0][1] =    2.5000;
-    WorldProj[0][2] =    0.0000;
-    WorldProj[0][3] =    0.0000;
-    WorldProj[1][0] =   -1.2500;
-    WorldProj[1][1] =   -2.1651;
-    WorldProj[1][2] =    4.3301;
-    WorldProj[1][3] =   -5.0000;
-    WorldProj[2][0] =   -0.4330;
-    WorldProj[2][1] =   -0.7500;
-    WorldProj[2][2] =   -0.5000;
-    WorldProj[2][3] =  159.8032;
-    WorldProj[3][0] =   -0.4330;
-    WorldProj[3][1] =   -0.7500;
-    WorldProj[3][2] =   -0.5000;
-    WorldProj[3][3] =  160.0000;
-	*/
-	//prevTime = currTime;
-	//currTime = time(&currTime);
-	//diff = difftime(currTime, prevTime);
-
-    ///////////////////////////////////////////////////////////////////
-    // Lighting pass: Draw the scene with lighting being calculated in
-    // the lighting shader.
-    ///////////////////////////////////////////////////////////////////
-
-    // Set the viewport, and clear the screen
-    glViewport(0,0,width, height);
-    glClearColor(0.5,0.5, 0.5, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT| GL_DEPTH_BUFFER_BIT);
-
-
-	MAT4 SphereModelTr = Rotate(2, atime);
-	MAT4 SunModelTr = Translate(lPos);
-
-
-
-	/*
-
-    // Use lighting pass shader
-    lightingShader.Use();
-    int program = lightingShader.program;
-
-	//Send the central model indicator to the shader - SH
-	loc = glGetUniformLocation(program, "isCentralModel");
-	glUniform1i(loc, isCentralModel);
-
-
     // Send the screen height and width to the shader
     loc = glGetUniformLocation(program, "WIDTH");
     glUniform1i(loc, width);
@@ -482,11 +471,11 @@ void Scene::DrawScene()
 
     // Send the perspective and viewing matrices to the shader
     loc = glGetUniformLocation(program, "ProjectionMatrix");
-    glUniformMatrix4fv(loc, 1, GL_TRUE, WorldProj.Pntr());
+    glUniformMatrix4fv(loc, 1, GL_TRUE, Proj.Pntr());
     loc = glGetUniformLocation(program, "ViewMatrix");
-    glUniformMatrix4fv(loc, 1, GL_TRUE, WorldView.Pntr());
+    glUniformMatrix4fv(loc, 1, GL_TRUE, View.Pntr());
     loc = glGetUniformLocation(program, "ViewInverse");
-    glUniformMatrix4fv(loc, 1, GL_TRUE, WorldView.inverse().Pntr());
+    glUniformMatrix4fv(loc, 1, GL_TRUE, View.inverse().Pntr());
     CHECKERROR;
 
     // Send the initial model matrix and normal matrix to the shader
@@ -500,7 +489,7 @@ void Scene::DrawScene()
     loc = glGetUniformLocation(program, "lightAmbient");
     glUniform3fv(loc, 1, &ambientColor[0]);
     loc = glGetUniformLocation(program, "lightPos");
-    glUniform3fv(loc, 1, &lPos[0]);
+    glUniform3fv(loc, 1, &lightPos[0]);
     loc = glGetUniformLocation(program, "lightValue");
     glUniform3fv(loc, 1, &lightColor[0]);
 
@@ -509,263 +498,225 @@ void Scene::DrawScene()
     loc = glGetUniformLocation(program, "mode");
     glUniform1i(loc, mode);
 
+    // Surface detail (see surface.glsl)
+    loc = glGetUniformLocation(program, "surfaceDetail");
+    glUniform1i(loc, surfaceDetail);
+    loc = glGetUniformLocation(program, "parallaxScale");
+    glUniform1f(loc, parallaxScale);
+    loc = glGetUniformLocation(program, "parallaxMinSteps");
+    glUniform1i(loc, parallaxMinSteps);
+    loc = glGetUniformLocation(program, "parallaxMaxSteps");
+    glUniform1i(loc, parallaxMaxSteps);
+
+    probe.SetUnits(program);
+    prefilter.SetUnits(program);
+    shLighting.Bind(program, atime);
+    pointLights.SetUnits(program);
+    clusters.SetUnits(program);
+    megaBuffer.SetUnits(program);
+    ssao.SetUnits(program);
+}
 
+// SetupProgram for each of the shader's variants:  their INDIRECT
+// versions when drawing with multi-draw.
+void Scene::SetupVariants(ShaderVariants& shader, MAT4& View, MAT4& Proj)
+{
+    shader.indirect = multiDraw && megaBuffer.supported;
+    meshletCuller.SetView(View, Proj);
+    for (int v=0;  v<ShaderVariants::COUNT;  v++)
+        if (shader.built[v])
+            SetupProgram(shader.Use(v), View, Proj);
+}
 
-    // Draw the scene objects.
-    MAT4 SphereModelTr = Rotate(2, atime);
-    MAT4 SunModelTr = Translate(lPos);
-    DrawSun(program, SunModelTr);
-    if (drawSpheres) DrawSpheres(program, SphereModelTr);
-    if (drawGround) DrawGround(program, Identity);
-
-	lightingShader.Unuse();
-	*/
-	
-	//Use reflection shader - top pass SH
-	
-	reflectionShaderTop.Use();
-	//topReflectionTarget.Bind();
-	int prog1 = reflectionShaderTop.program;
-	//INSERT VARIABLES HERE
-
-
-	DrawSun(prog1, SunModelTr);
-	if (drawSpheres) DrawSpheres(prog1, SphereModelTr);
-	if (drawGround) DrawGround(prog1, Identity);
-
-
-	// Send the screen height and width to the shader
-	loc = glGetUniformLocation(prog1, "WIDTH");
-	glUniform1i(loc, width);
-	loc = glGetUniformLocation(prog1, "HEIGHT");
-	glUniform1i(loc, height);
-
-	// Send the perspective and viewing matrices to the shader
-	loc = glGetUniformLocation(prog1, "ProjectionMatrix");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, WorldProj.Pntr());
-	loc = glGetUniformLocation(prog1, "ViewMatrix");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, WorldView.Pntr());
-	loc = glGetUniformLocation(prog1, "ViewInverse");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, WorldView.inverse().Pntr());
-	CHECKERROR;
-
-	// Send the initial model matrix and normal matrix to the shader
-	loc = glGetUniformLocation(prog1, "ModelMatrix");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, Identity.Pntr());
-	loc = glGetUniformLocation(prog1, "NormalMatrix");
-	glUniformMatrix4fv(loc, 1, GL_FALSE, Identity.Pntr());
-	CHECKERROR;
-
-	// Send lighting parameters to the shader
-	loc = glGetUniformLocation(prog1, "lightAmbient");
-	glUniform3fv(loc, 1, &ambientColor[0]);
-	loc = glGetUniformLocation(prog1, "lightPos");
-	glUniform3fv(loc, 1, &lPos[0]);
-	loc = glGetUniformLocation(prog1, "lightValue");
-	glUniform3fv(loc, 1, &lightColor[0]);
-
-	// Send mode to the shader (used to choose alternate shading
-	// strategies in the shader)
-	loc = glGetUniformLocation(prog1, "mode");
-	glUniform1i(loc, mode);
-
-
-
-
-
-	//topReflectionTarget.Unbind();
-
-
-	reflectionShaderTop.Unuse();
-	CHECKERROR;
-	
-	
-
-	/*
-	
-	//Use reflection shader - bottom pass SH
-	bottomReflectionTarget.Bind();
-	reflectionShaderBottom.Use();
-	prog1 = reflectionShaderBottom.program;
-
-
-
-	//INSERT VARIABLES HERE
-	//Send the central model indicator to the shader - SH
-	loc = glGetUniformLocation(prog1, "isCentralModel");
-	glUniform1i(loc, isCentralModel);
-	// Send the screen height and width to the shader
-	loc = glGetUniformLocation(prog1, "WIDTH");
-	glUniform1i(loc, width);
-	loc = glGetUniformLocation(prog1, "HEIGHT");
-	glUniform1i(loc, height);
-
-	// Send the perspective and viewing matrices to the shader
-	loc = glGetUniformLocation(prog1, "ProjectionMatrix");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, WorldProj.Pntr());
-	loc = glGetUniformLocation(prog1, "ViewMatrix");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, WorldView.Pntr());
-	loc = glGetUniformLocation(prog1, "ViewInverse");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, WorldView.inverse().Pntr());
-	CHECKERROR;
-
-	// Send the initial model matrix and normal matrix to the shader
-	loc = glGetUniformLocation(prog1, "ModelMatrix");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, Identity.Pntr());
-	loc = glGetUniformLocation(prog1, "NormalMatrix");
-	glUniformMatrix4fv(loc, 1, GL_FALSE, Identity.Pntr());
-	CHECKERROR;
-
-	// Send lighting parameters to the shader
-	loc = glGetUniformLocation(prog1, "lightAmbient");
-	glUniform3fv(loc, 1, &ambientColor[0]);
-	loc = glGetUniformLocation(prog1, "lightPos");
-	glUniform3fv(loc, 1, &lPos[0]);
-	loc = glGetUniformLocation(prog1, "lightValue");
-	glUniform3fv(loc, 1, &lightColor[0]);
-
-	// Send mode to the shader (used to choose alternate shading
-	// strategies in the shader)
-	loc = glGetUniformLocation(prog1, "mode");
-	glUniform1i(loc, mode);
-
-
-
-
-	DrawSun(prog1, SunModelTr);
-	if (drawSpheres) DrawSpheres(prog1, SphereModelTr);
-	if (drawGround) DrawGround(prog1, Identity);
-
-
-
-
-
-
-	reflectionShaderBottom.Unuse();
-	bottomReflectionTarget.Unbind();
-
-
-
-	/*
-	You use the Texture object's identifier "textureId" and the FOB's texture id "texture" the same way when you want to access the texture in a shader.  The first of those is demonstrated in my code, the second should copy it.  The code that makes either texture available in a shader is:
-
-    glActiveTexture(GL_TEXTURE0+someUnit); // Texture unit ID, your choice: 1 through 15
-    glBindTexture(GL_TEXTURE_2D, someTextureId); // Texture or FBO object's texture id.
-
-    loc = glGetUniformLocation(program, "someSampler");  // Sampler2D name (as declared in shader),
-    glUniform1i(loc, someUnit);        // Tell the shader about the chosen unit.
-	
-	
-	
-	 int program = lightingShader.program;
-	lightingShader.Use();
-
-
-	//Send the central model indicator to the shader - SH
-	isCentralModel = 0;
-	loc = glGetUniformLocation(program, "isCentralModel");
-	glUniform1i(loc, isCentralModel);
-
-	glActiveTexture(GL_TEXTURE0 + 7);
-
-	glBindTexture(GL_TEXTURE_2D, bottomReflectionTarget.texture);
-
-	loc = glGetUniformLocation(program, "bottomReflectionTexture");
-	CHECKERROR;
-	glUniform1i(loc, 7);  //Tell shader about unit 7 -- THIS IS THE PROBLEM LINE, which implies that there's a similar issue with the other texture
-	
-	
-	
-	glActiveTexture(GL_TEXTURE0 + 6);
-	glBindTexture(GL_TEXTURE_2D, topReflectionTarget.texture);
-	loc = glGetUniformLocation(program, "topReflectionTexture");
-	glUniform1i(loc, 6);  //Tell shader about unit 6
-
-
-
-	
-						  // Send the screen height and width to the shader
-	loc = glGetUniformLocation(program, "WIDTH");
-	glUniform1i(loc, width);
-	loc = glGetUniformLocation(program, "HEIGHT");
-	glUniform1i(loc, height);
-
-	// Send the perspective and viewing matrices to the shader
-	loc = glGetUniformLocation(program, "ProjectionMatrix");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, WorldProj.Pntr());
-	loc = glGetUniformLocation(program, "ViewMatrix");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, WorldView.Pntr());
-	loc = glGetUniformLocation(program, "ViewInverse");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, WorldView.inverse().Pntr());
-	CHECKERROR;
-
-	// Send the initial model matrix and normal matrix to the shader
-	loc = glGetUniformLocation(program, "ModelMatrix");
-	glUniformMatrix4fv(loc, 1, GL_TRUE, Identity.Pntr());
-	loc = glGetUniformLocation(program, "NormalMatrix");
-	glUniformMatrix4fv(loc, 1, GL_FALSE, Identity.Pntr());
-	CHECKERROR;
-
-	// Send lighting parameters to the shader
-	loc = glGetUniformLocation(program, "lightAmbient");
-	glUniform3fv(loc, 1, &ambientColor[0]);
-	loc = glGetUniformLocation(program, "lightPos");
-	glUniform3fv(loc, 1, &lPos[0]);
-	loc = glGetUniformLocation(program, "lightValue");
-	glUniform3fv(loc, 1, &lightColor[0]);
-
-	// Send mode to the shader (used to choose alternate shading
-	// strategies in the shader)
-	loc = glGetUniformLocation(program, "mode");
-	glUniform1i(loc, mode);
-
-
-
-
-
-
-	DrawSun(program, SunModelTr);
-	if (drawSpheres) DrawSpheres(program, SphereModelTr);
-	if (drawGround) DrawGround(program, Identity);
-
-	isCentralModel = 1;
-	loc = glGetUniformLocation(program, "isCentralModel");
-	glUniform1i(loc, isCentralModel);
-
+////////////////////////////////////////////////////////////////////////
+// Draws everything surrounding the central model (the graph's
+// ENVIRONMENT layer: the sun, the ring of spheres, the ground, ...):
+// this is what the central model reflects.  If a frustum is given,
+// objects outside it are skipped, and if a Hi-Z pyramid is given (the
+// camera's, see CameraHiZ), objects behind its occluders.  Returns the
+// number of objects drawn.  Each object's material selects its
+// variant of the shader.
+int Scene::DrawEnvironment(ShaderVariants& shader, const Frustum* frustum,
+                           const HiZ* hiZ)
+{
+    graph.Cull(frustum, SceneGraph::ENVIRONMENT, drawList, hiZ);
+    if (hiZ) {
+        occlusion.occluded = drawList.occluded;
+        occlusion.tested = drawList.nodes.size() + drawList.occluded;
+        occlusion.percent = occlusion.tested ? 100.0f*occlusion.occluded/occlusion.tested : 0.0f; }
+    return DrawNodes(shader, drawList.nodes);
+}
 
+// The pyramid for culling the lighting pass, or NULL if occlusion
+// culling is off.
+const HiZ* Scene::CameraHiZ()
+{
+    return occlusion.enabled && occlusion.camera.valid ? &occlusion.camera : NULL;
+}
 
-	//APPLY TEXTURES TO CENTRAL MODEL HERE
+// Draws the central model, with the shader variant which gives it
+// its reflections.
+void Scene::DrawCentralModel(ShaderVariants& shader)
+{
+    graph.Cull(NULL, SceneGraph::CENTRAL, drawList);
+    DrawNodes(shader, drawList.nodes);
+}
 
-	///earthBaseTexture.Bind(6);  //Bind Earth base texture to pos 6
-	//loc = glGetUniformLocation(program, "earthBaseTexture");
-	//glUniform1i(loc, 6);  //Tell shader about unit 6
+////////////////////////////////////////////////////////////////////////
+// The forward lighting pass: Draw the scene with lighting being
+// calculated in the lighting shader.
+void Scene::DrawForward()
+{
+    forwardTimer.Begin();
 
-	//redEarthTexture.Bind(7);  //Bind Earth base texture to pos 7
-	//loc = glGetUniformLocation(program, "redEarthTexture");
-	//glUniform1i(loc, 7);  //Tell shader about unit 7
+    // Set the viewport, and clear the screen
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFbo);
+    glViewport(0,0,width, height);
+    glClearColor(0.5,0.5, 0.5, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT| GL_DEPTH_BUFFER_BIT);
 
-	//APPLY REFLECTION TO CENTRAL MODEL HERE
+    // Optionally lay down the depth first, so that only the visible
+    // fragments are shaded (see depthprepass.h)
+    depthPrepass.Draw(*this);
 
+    // Use lighting pass shader
+    SetupVariants(lightingShader, WorldView, WorldProj);
+    for (int v=0;  v<ShaderVariants::COUNT;  v++)
+        if (lightingShader.built[v]) {
+            int program = lightingShader.Use(v);
+            pointLights.Bind(program);
+            ssao.Bind(program);
+            if (renderPath == CLUSTERED)
+                clusters.Bind(program); }
 
-	
-    DrawModel(program, centralPolygons, centralTr);
+    // Draw the scene objects.
+    depthPrepass.BeginLighting();
+    DrawEnvironment(lightingShader, NULL, CameraHiZ());
+
+    // The central model reflects the environment captured above.
+    int program = lightingShader.Use(ShaderVariants::REFLECTIVE);
+    probe.Bind(program);
+    prefilter.Bind(program);
+    DrawCentralModel(lightingShader);
+    depthPrepass.EndLighting(*this);
+    prefilter.Unbind();
+    probe.Unbind();
+    ssao.Unbind();
+    CHECKERROR;
 
+    // Done with shader program
+    lightingShader.Unuse();
+    forwardTimer.End();
+    CHECKERROR;
+}
 
+////////////////////////////////////////////////////////////////////////
+// Procedure DrawScene is called whenever the scene needs to be drawn.
+void Scene::DrawScene()
+{
+    CHECKERROR;
 
+    // Count the previous frame's allocations (see allocation.h), and
+    // free its scratch memory
+    memoryStats.Sample();
+    frameArena.Reset();
 
-	isCentralModel = 0;
+    // Pick up any edited shaders
+    shaderManager.Update();
 
+    // Move on to a free region of the stream buffer
+    stream.BeginFrame();
 
+    // With dynamic resolution, the whole frame is drawn at a smaller
+    // size, into its own target, and upscaled into the output last.
+    dynamicResolution.BeginFrame(*this);
+    int fullWidth = width, fullHeight = height;
+    unsigned int windowFbo = outputFbo;
+    if (dynamicResolution.Scaled()) {
+        width = dynamicResolution.width;
+        height = dynamicResolution.height;
+        outputFbo = dynamicResolution.Target(); }
 
+    // Calculate the light's position.
+    lightPos = vec3(lightDist*cos(lightSpin*rad)*sin(lightTilt*rad),
+                    lightDist*sin(lightSpin*rad)*sin(lightTilt*rad),
+                    lightDist*cos(lightTilt*rad) );
+    UpdateGraph();
+    if (multiDraw && megaBuffer.supported)
+        megaBuffer.WriteDrawData(graph, stream);
+
+    // The camera's occluders, for culling the lighting pass (see
+    // occlusion.h)
+    occlusion.BeginFrame();
+    meshletCuller.BeginFrame();
+    if (occlusion.enabled)
+        occlusion.Build(*this, occlusion.camera, WorldView, WorldProj,
+                        width, height, SceneGraph::ALL);
+    else {
+        occlusion.tested = occlusion.occluded = 0;
+        occlusion.percent = 0.0f; }
+
+    // The clustered path's light binning is CPU work only, so start
+    // it now on the job system (see jobs.h), to overlap the probe's
+    // drawing.
+    JobCounter binning;
+    auto bin = [&] { clusters.Bin(pointLights, WorldView, WorldProj, front, back); };
+    if (renderPath == CLUSTERED)
+        jobs.Run(binning, bin);
 
+    ///////////////////////////////////////////////////////////////////
+    // Reflection pass: Capture the environment around the central
+    // model into the probe's texture(s).
+    ///////////////////////////////////////////////////////////////////
+    probe.Render(*this);
+    prefilter.Filter(probe);
+    shLighting.Project(probe, atime);
     CHECKERROR;
 
-    // Done with shader program
-    lightingShader.Unuse();
+    ///////////////////////////////////////////////////////////////////
+    // Lighting pass: Either forward (one pass, all lights in the
+    // lighting shader), forward with the lights binned into clusters
+    // (see clusters.h), or deferred (see deferred.h).
+    ///////////////////////////////////////////////////////////////////
+    jobs.Wait(binning);
+    if (renderPath == CLUSTERED)
+        clusters.Upload(stream);
+
+    // With post-processing, lit into the HDR target instead of the
+    // output, then tone mapped into it.  With anti-aliasing, lit into
+    // its own target (with TAA, through a jittered projection), then
+    // resolved into whichever of those is next.
+    unsigned int finalFbo = outputFbo;
+    if (post.enabled)
+        outputFbo = post.Target(width, height);
+    unsigned int litFbo = outputFbo;
+    outputFbo = antialias.Target(*this);
+    MAT4 Proj = WorldProj;
+    if (antialias.Jittered()) {
+        float jx, jy;
+        antialias.Jitter(jx, jy);
+        WorldProj = Perspective((width*ry)/height, ry, front, back, jx, jy); }
+
+    if (renderPath == DEFERRED)
+        deferred.Draw(*this);
+    else {
+        ssao.Draw(*this);
+        DrawForward(); }
+
+    WorldProj = Proj;
+    outputFbo = litFbo;
+    antialias.Resolve(*this);
+    outputFbo = finalFbo;
+    if (post.enabled)
+        post.Apply(*this);
+
+    width = fullWidth;
+    height = fullHeight;
+    outputFbo = windowFbo;
+    dynamicResolution.Upscale(*this);
+    occlusion.DrawDebug(*this);
+    depthPrepass.DrawOverdraw(*this);
+    dynamicResolution.EndFrame();
+    stream.EndFrame();
     CHECKERROR;
-	*/
-    // After all drawing, schedule a call to the animate procedure in 10 ms.
-    glutTimerFunc(10, animate, 1);
-	//getchar();
-
 }
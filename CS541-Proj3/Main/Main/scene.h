@@ -17,9 +17,26 @@
 using namespace glm;
 
 #include "models.h"
+#include "terrain.h"
 #include "shader.h"
 #include "texture.h"
 #include "fbo.h"
+#include "envprobe.h"
+#include "prefilter.h"
+#include "shlighting.h"
+#include "pointlights.h"
+#include "deferred.h"
+#include "clusters.h"
+#include "gputimer.h"
+#include "scenegraph.h"
+#include "streambuffer.h"
+#include "megabuffer.h"
+#include "occlusion.h"
+#include "post.h"
+#include "antialias.h"
+#include "dynamicresolution.h"
+#include "ssao.h"
+#include "depthprepass.h"
 
 class Scene
 {
@@ -45,6 +62,7 @@ public:
     float lightTilt;
     vec3 lightDir;
     float lightDist;
+    vec3 lightPos;      // Calculated from the above at the start of each frame
 
 
 
@@ -52,31 +70,105 @@ public:
     int width, height;
 
     // Shader programs
-    ShaderProgram lightingShader;
-	ShaderProgram reflectionShaderTop;
-	ShaderProgram reflectionShaderBottom;
+    ShaderVariants lightingShader;
     // The polygon models (VAOs - Vertex Array Objects)
     Model* centralPolygons;
+    std::vector<Model*> centralModels;  // Built so far, by centralModel
     Model* spherePolygons;
-    Model* groundPolygons;
+    Terrain* terrain;           // The ground (see terrain.h)
 
     // Texture
     Texture groundTexture;
+    Texture groundNormal, groundHeight;
+
+    // How much of the normal and height maps is used (see surface.glsl)
+    enum { FLAT=0, NORMAL_MAPPED=1, PARALLAX=2 };
+    int surfaceDetail;
+    float parallaxScale;
+    int parallaxMinSteps, parallaxMaxSteps;
+
+    // Textures for extra models added to the graph (by the benchmark,
+    // see benchmark.cpp)
+    std::vector<Texture> instanceTextures;
+
+    // Everything to be drawn, as a scene graph (see scenegraph.h)
+    // built from the models above by BuildGraph.  These nodes are
+    // the ones changed from frame to frame (or by the user).
+    SceneGraph graph;
+    int sunNode, ringNode, groundNode, terrainNode, centralNode;
+    SceneGraph::DrawList drawList;  // Filled by graph.Cull
+
+    // The final image is drawn into this framebuffer (0 for the window)
+    unsigned int outputFbo;
 
 	//Earth textures
 	//Texture earthBaseTexture;
 	//Texture redEarthTexture;
 
 
+    // Environment probe for the central model's reflections
+    EnvProbe probe;
+    Prefilter prefilter;    // Glossy (split-sum) version of the probe
+    SHLighting shLighting;  // Diffuse (ambient) lighting from the probe
+
+    // Contact shading for the ambient light (see ssao.h)
+    SSAO ssao;
+
+    // Many lights, and the choice of how to draw them
+    enum { FORWARD=0, CLUSTERED=1, DEFERRED=2 };
+    int renderPath;
+    PointLights pointLights;
+    Clusters clusters;      // Light lists for the CLUSTERED (forward+) path
+    Deferred deferred;
+    GpuTimer forwardTimer;
+    DepthPrepass depthPrepass;  // For the forward paths' lighting pass
+
+    // Per-frame data written by the CPU (see streambuffer.h)
+    StreamBuffer stream;
+
+    // All geometry in shared buffers, drawn with a multi-draw per
+    // material (see megabuffer.h), when multiDraw is set
+    MegaBuffer megaBuffer;
+    bool multiDraw;
+
+    // Objects hidden behind the occluders are skipped (see occlusion.h)
+    Occlusion occlusion;
+
+    // Off screen and back-facing parts of large meshes are skipped
+    // (see meshlet.h)
+    MeshletCuller meshletCuller;
+
+    // The frame is lit in HDR, then bloomed, exposed and tone mapped
+    // into the output (see post.h)
+    Post post;
+
+    // Edges (and, with TAA, shading) smoothed by MSAA or temporal
+    // anti-aliasing (see antialias.h)
+    Antialias antialias;
+
+    // The frame drawn smaller when the GPU is over budget, then
+    // upscaled (see dynamicresolution.h)
+    DynamicResolution dynamicResolution;
+
     // Main methods
     void InitializeScene();
     void DrawScene();
+    void DrawForward();
 
     // Helper methods
     void SetCentralModel( const int i);
-    void DrawSun(unsigned int program, MAT4& ModelTr);
-    void DrawSpheres(unsigned int program, MAT4& ModelTr);
-    void DrawGround(unsigned int program, MAT4& ModelTr);
+    void BuildGraph();
+    void UpdateGraph();
+    int Pick(const int x, const int y);
+    void SetupProgram(const int program, MAT4& View, MAT4& Proj);
+    void BindMaterial(const int program, const SceneGraph::Material& m);
+    void SetupVariants(ShaderVariants& shader, MAT4& View, MAT4& Proj);
+    int DrawNodes(ShaderVariants& shader, const std::vector<int>& list);
+    int DrawNodesIndirect(ShaderVariants& shader, const std::vector<int>& list);
+    int DrawEnvironment(ShaderVariants& shader, const Frustum* frustum,
+                        const HiZ* hiZ=NULL);
+    const HiZ* CameraHiZ();
+    void DrawCentralModel(ShaderVariants& shader);
 
 
 
@@ -87,9 +179,7 @@ public:
 	float tilt = -90, spin = 0, tx = 0, ty = 0, zoom = 150, ry = 0.2, front = 0.1, back = 1000;
 	//= 0.2;   //ry* (width / height);
 	bool canMove = false, wDown = false, sDown = false, aDown = false, dDown = false;
-	time_t prevTime, currTime;
-	float speed = 1;
-	float diff;
+	float speed = 100;      // Walking speed, units per second
 	vec3 eyePos =vec3(0, 240, 4);
 	float eyePosX=0.0, eyePosY=-250, eyePosZ=4;
 
@@ -103,9 +193,6 @@ public:
 	float curMouseX, curMouseY;
 
 
-	//unsigned int topReflection, bottomReflection;
-	FBO topReflectionTarget, bottomReflectionTarget;
-	Texture topReflection, bottomReflection;
 	int isCentralModel = 0;  //Keep track of when you're drawing the central model or not.  1 if drawing central model, 0 else
 	ShaderProgram shadowShader;
 	FBO shadowTarget;
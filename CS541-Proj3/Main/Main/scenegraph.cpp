@@ -0,0 +1,284 @@
+///////////////////////////////////////////////////////////////////////
+// The scene graph:  node creation, the dirty-driven transform update,
+// culling into draw lists, and picking.  See scenegraph.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "models.h"
+#include "scenegraph.h"
+#include "occlusion.h"
+#include "jobs.h"
+#include "allocation.h"
+
+enum { DIRTY=1, HIDDEN=2 };
+
+// Nodes per job in Update and Cull
+#define UPDATE_GRAIN 1024
+#define CULL_GRAIN 4096
+
+// Transforms a point by a (row-major) matrix.
+static vec3 TransformPoint(const MAT4& M, const vec3 p)
+{
+    vec3 r;
+    for (int i=0;  i<3;  i++)
+        r[i] = M[i][0]*p[0] + M[i][1]*p[1] + M[i][2]*p[2] + M[i][3];
+    return r;
+}
+
+SceneGraph::SceneGraph()
+    :count(0), dirtyFrom(0), version(0), updated(0)
+{
+}
+
+void SceneGraph::Clear()
+{
+    materials.clear();
+    parent.clear();  local.clear();  world.clear();  normal.clear();
+    center.clear();  radius.clear();  model.clear();  color.clear();
+    material.clear();  mask.clear();  flags.clear();  hidden.clear();
+    stamp.clear();  depth.clear();  levels.clear();
+    count = dirtyFrom = 0;
+}
+
+void SceneGraph::Reserve(const int n)
+{
+    MemoryScope scope(MEM_GRAPH);
+    parent.reserve(n);  local.reserve(n);  world.reserve(n);  normal.reserve(n);
+    center.reserve(n);  radius.reserve(n);  model.reserve(n);  color.reserve(n);
+    material.reserve(n);  mask.reserve(n);  flags.reserve(n);  hidden.reserve(n);
+    stamp.reserve(n);  depth.reserve(n);
+}
+
+int SceneGraph::AddMaterial(const int variant, Texture* texture,
+                            Texture* normalMap, Texture* heightMap)
+{
+    Material m = {variant, texture, normalMap, heightMap};
+    materials.push_back(m);
+    return materials.size() - 1;
+}
+
+// Appends a node, which is therefore after its parent.  Returns its
+// index.  The world values are filled in by the next Update.
+int SceneGraph::Add(const int p, const MAT4& tr, Model* m,
+                    const int mat, const vec3 c, const int layers)
+{
+    if (p >= count) {
+        printf("SceneGraph: parent %d of node %d does not exist\n", p, count);
+        exit(-1); }
+    MemoryScope scope(MEM_GRAPH);
+
+    parent.push_back(p);
+    local.push_back(tr);
+    world.push_back(tr);
+    normal.push_back(MAT4());
+    center.push_back(vec3(0.0f));
+    radius.push_back(0.0f);
+    model.push_back(m);
+    color.push_back(c);
+    material.push_back(mat);
+    mask.push_back(layers);
+    flags.push_back(0);
+    hidden.push_back(0);
+    stamp.push_back(0);
+
+    int d = p < 0 ? 0 : depth[p]+1;
+    depth.push_back(d);
+    if (d >= int(levels.size())) levels.resize(d+1);
+    levels[d].push_back(count);
+
+    MarkDirty(count);
+    return count++;
+}
+
+void SceneGraph::MarkDirty(const int i)
+{
+    flags[i] |= DIRTY;
+    if (i < dirtyFrom) dirtyFrom = i;
+}
+
+void SceneGraph::SetLocal(const int i, const MAT4& tr)
+{
+    local[i] = tr;
+    MarkDirty(i);
+}
+
+void SceneGraph::SetModel(const int i, Model* m)
+{
+    model[i] = m;
+    MarkDirty(i);           // For its bound
+}
+
+void SceneGraph::SetHidden(const int i, const bool hide)
+{
+    if (hide == ((flags[i] & HIDDEN) != 0)) return;
+    if (hide) flags[i] |= HIDDEN;
+    else      flags[i] &= ~HIDDEN;
+    MarkDirty(i);
+}
+
+// The model's bounding sphere, carried into the world:  its center
+// transformed, its radius scaled by the largest axis scale.
+void SceneGraph::ComputeBound(const int i)
+{
+    Model* m = model[i];
+    if (!m) {
+        center[i] = TransformPoint(world[i], vec3(0.0f));
+        radius[i] = 0.0f;
+        return; }
+
+    const MAT4& W = world[i];
+    float s = 0.0f;
+    for (int c=0;  c<3;  c++)
+        s = std::max(s, W[0][c]*W[0][c] + W[1][c]*W[1][c] + W[2][c]*W[2][c]);
+    center[i] = TransformPoint(W, m->center);
+    radius[i] = sqrt(s)*m->radius;
+}
+
+// Recomputes node i if it is dirty itself, or if its parent was
+// recomputed in this Update (its stamp is the current version).
+// Returns whether it was.
+bool SceneGraph::UpdateNode(const int i)
+{
+    int p = parent[i];
+    if (!(flags[i] & DIRTY) && (p < 0 || stamp[p] != version))
+        return false;
+
+    if (p < 0) {
+        world[i] = local[i];
+        hidden[i] = (flags[i] & HIDDEN) != 0; }
+    else {
+        world[i] = world[p]*local[i];
+        hidden[i] = (flags[i] & HIDDEN) || hidden[p]; }
+    normal[i] = world[i].inverse();
+    ComputeBound(i);
+
+    flags[i] &= ~DIRTY;
+    stamp[i] = version;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Updates the levels in turn, each across the job system, starting
+// in each at the first dirty index:  nothing before it can have
+// changed.
+void SceneGraph::Update()
+{
+    updated = 0;
+    if (dirtyFrom >= count) return;
+    version++;
+
+    std::atomic<int> total(0);
+    for (unsigned int d=0;  d<levels.size();  d++) {
+        const std::vector<int>& level = levels[d];
+        int start = std::lower_bound(level.begin(), level.end(), dirtyFrom) - level.begin();
+        jobs.ParallelFor(level.size()-start, UPDATE_GRAIN, [&](int first, int last)
+        {
+            int n = 0;
+            for (int k=start+first;  k<start+last;  k++)
+                if (UpdateNode(level[k])) n++;
+            total += n;
+        }); }
+
+    updated = total;
+    dirtyFrom = count;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Fills list with the drawable nodes of the given layers which are
+// not hidden and (if a frustum is given) inside the frustum.  The
+// list is grouped by material, in material order, and in node order
+// within each material, so that a draw loop switches programs and
+// textures as rarely as possible.
+//
+// This is a counting sort in three steps:  each chunk of nodes finds
+// its survivors;  a prefix sum over (material, chunk) gives each
+// chunk the position of its first node of each material;  and each
+// chunk scatters its survivors to those positions.
+void SceneGraph::Cull(const Frustum* frustum, const int layers, DrawList& list,
+                      const HiZ* hiZ) const
+{
+    MemoryScope scope(MEM_GRAPH);
+    int chunkCount = (count + CULL_GRAIN-1)/CULL_GRAIN;
+    int materialCount = materials.size();
+    list.chunks.resize(chunkCount);
+    list.offsets.assign(chunkCount*materialCount, 0);
+
+    std::atomic<int> culled(0), occluded(0);
+    jobs.ParallelFor(chunkCount, 1, [&](int c0, int c1)
+    {
+        MemoryScope scope(MEM_GRAPH);
+        for (int c=c0;  c<c1;  c++) {
+            std::vector<int>& chunk = list.chunks[c];
+            int* offsets = &list.offsets[c*materialCount];
+            chunk.clear();
+            int rejected = 0, hiddenBehind = 0;
+            int end = std::min(count, (c+1)*CULL_GRAIN);
+            for (int i=c*CULL_GRAIN;  i<end;  i++) {
+                if (!model[i] || hidden[i] || !(mask[i] & layers))
+                    continue;
+                if (frustum && !frustum->SphereInside(center[i], radius[i])) {
+                    rejected++;
+                    continue; }
+                if (hiZ && !hiZ->Visible(model[i]->minP, model[i]->maxP, world[i])) {
+                    hiddenBehind++;
+                    continue; }
+                chunk.push_back(i);
+                offsets[material[i]]++; }
+            culled += rejected;
+            occluded += hiddenBehind; }
+    });
+
+    // Turn the counts into starting positions, material-major
+    int total = 0;
+    for (int m=0;  m<materialCount;  m++)
+        for (int c=0;  c<chunkCount;  c++) {
+            int n = list.offsets[c*materialCount + m];
+            list.offsets[c*materialCount + m] = total;
+            total += n; }
+
+    list.nodes.resize(total);
+    jobs.ParallelFor(chunkCount, 1, [&](int c0, int c1)
+    {
+        for (int c=c0;  c<c1;  c++) {
+            int* offsets = &list.offsets[c*materialCount];
+            const std::vector<int>& chunk = list.chunks[c];
+            for (unsigned int k=0;  k<chunk.size();  k++)
+                list.nodes[offsets[material[chunk[k]]]++] = chunk[k]; }
+    });
+    list.culled = culled;
+    list.occluded = occluded;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Returns the nearest drawable node, of the given layers, whose
+// bounding sphere the ray (origin + t*direction, t >= 0) hits, or
+// -1 for none.  Bounding spheres make this approximate, but cheap
+// enough to run over every node.
+int SceneGraph::Pick(const vec3 origin, const vec3 direction, const int layers) const
+{
+    vec3 d = normalize(direction);
+    int nearest = -1;
+    float nearestT = 0.0f;
+    for (int i=0;  i<count;  i++) {
+        if (!model[i] || hidden[i] || !(mask[i] & layers))
+            continue;
+
+        // Solve |origin + t*d - center|^2 = radius^2 for the first t
+        vec3 oc = origin - center[i];
+        float b = dot(oc, d);
+        float c = dot(oc, oc) - radius[i]*radius[i];
+        float disc = b*b - c;
+        if (disc < 0.0f) continue;
+        float t = -b - sqrt(disc);
+        if (t < 0.0f) t = -b + sqrt(disc);      // Origin inside the sphere
+        if (t < 0.0f) continue;
+
+        if (nearest < 0 || t < nearestT) {
+            nearest = i;
+            nearestT = t; } }
+    return nearest;
+}
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////
+// A scene graph of transform nodes, stored as parallel arrays (one
+// entry per node in each) rather than as linked node objects.  A
+// node's parent always has a smaller index, so a single pass in
+// index order visits every parent before its children.
+//
+// Each node has a local transform, relative to its parent, and a
+// cached world transform, normal matrix (the world inverse, sent to
+// the shaders untransposed) and world bounding sphere.  Changing a
+// node's local transform (or hiding it) marks it dirty;  Update
+// then recomputes that node and its descendants, and nothing else.
+// The pass starts at the lowest dirty index, so a frame in which
+// only a few nodes (near the end) move costs little more than
+// those few nodes.
+//
+// Nodes may carry a model to draw, with a color, a material (a shader
+// variant and texture, see AddMaterial) and a layer mask.  Cull
+// gathers the visible nodes of some layers into a draw list, grouped
+// by material, rejecting those outside a frustum or, given a Hi-Z
+// pyramid, behind the occluders (see occlusion.h);  Pick finds the
+// node under a ray.
+//
+// Update and Cull spread their work over the job system (jobs.h).
+// Update goes a level (a depth in the tree) at a time, each level in
+// parallel:  a node's parent is always on the level before.  Cull
+// splits the nodes into chunks, and each chunk's survivors are then
+// scattered into place by material, also in parallel.  Neither makes
+// OpenGL calls, and Cull may run for several lists at once.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SCENEGRAPH_
+#define _SCENEGRAPH_
+
+#include <vector>
+
+#include "transform.h"
+
+class Model;
+class Texture;
+class HiZ;
+
+class SceneGraph
+{
+public:
+    // Layers, for the mask of Add and Cull.  OCCLUDER is not a layer:
+    // it marks nodes drawn into the occlusion pyramids.
+    enum { ENVIRONMENT=1, CENTRAL=2, ALL=3, OCCLUDER=4 };
+
+    struct Material
+    {
+        int variant;            // A ShaderVariants variant
+        Texture* texture;       // Bound to unit 1, or NULL
+        Texture* normalMap;     // Bound to units 16 and 17, or NULL
+        Texture* heightMap;     // (see surface.glsl)
+    };
+    std::vector<Material> materials;
+
+    // The result of Cull:  node indices grouped by material, and the
+    // working space used to build them.
+    struct DrawList
+    {
+        std::vector<int> nodes;
+        int culled;             // Nodes rejected by the frustum
+        int occluded;           // Nodes rejected by the pyramid
+
+        std::vector<std::vector<int> > chunks;  // Survivors of each chunk
+        std::vector<int> offsets;               // Per chunk and material
+        DrawList() :culled(0), occluded(0) {}
+    };
+
+    // Per node
+    std::vector<int> parent;            // -1 for a root
+    std::vector<MAT4> local;
+    std::vector<MAT4> world;
+    std::vector<MAT4> normal;           // world.inverse()
+    std::vector<vec3> center;           // World bounding sphere
+    std::vector<float> radius;
+    std::vector<Model*> model;          // NULL for a pure transform
+    std::vector<vec3> color;
+    std::vector<int> material;
+    std::vector<unsigned char> mask;
+    std::vector<unsigned char> flags;   // DIRTY and HIDDEN bits
+    std::vector<unsigned char> hidden;  // Hidden, or below a hidden node
+    std::vector<unsigned int> stamp;    // version of the last Update to change it
+    std::vector<int> depth;             // 0 for a root
+
+    // Node indices by depth, each in increasing order
+    std::vector<std::vector<int> > levels;
+
+    int count;
+    int dirtyFrom;          // Lowest dirty index (count if none)
+    unsigned int version;   // Incremented by each Update
+
+    // Statistics of the most recent Update
+    int updated;
+
+    SceneGraph();
+    void Clear();
+    void Reserve(const int n);
+
+    int AddMaterial(const int variant, Texture* texture,
+                    Texture* normalMap=NULL, Texture* heightMap=NULL);
+    int Add(const int parent, const MAT4& local, Model* model=NULL,
+            const int material=0, const vec3 color=vec3(1.0f),
+            const int mask=ENVIRONMENT);
+
+    void SetLocal(const int i, const MAT4& tr);
+    void SetModel(const int i, Model* m);
+    void SetHidden(const int i, const bool hide);
+
+    void Update();
+    void Cull(const Frustum* frustum, const int layers, DrawList& list,
+              const HiZ* hiZ=NULL) const;
+    int Pick(const vec3 origin, const vec3 direction, const int layers) const;
+
+private:
+    void MarkDirty(const int i);
+    void ComputeBound(const int i);
+    bool UpdateNode(const int i);
+};
+
+#endif
@@ -0,0 +1,69 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the first stage of the spherical harmonic
+// projection of the environment probe (see shlighting.h).  The
+// fragment in column i and row j sums, over slice j of a grid of
+// directions (gridSize^2 per cube face), the probe's radiance times
+// basis function i times the solid angle of the grid cell.  The
+// total solid angle is kept in w for normalization.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform int gridSize;
+uniform int slices;
+uniform float sourceTexelAngle;
+
+// The probe being projected
+#include "environment.glsl"
+
+// The nine real SH basis functions of bands 0..2
+float SHBasis(int i, vec3 d)
+{
+    if (i == 0) return 0.282095;
+    if (i == 1) return 0.488603*d.y;
+    if (i == 2) return 0.488603*d.z;
+    if (i == 3) return 0.488603*d.x;
+    if (i == 4) return 1.092548*d.x*d.y;
+    if (i == 5) return 1.092548*d.y*d.z;
+    if (i == 6) return 0.315392*(3.0*d.z*d.z - 1.0);
+    if (i == 7) return 1.092548*d.x*d.z;
+    return 0.546274*(d.x*d.x - d.y*d.y);
+}
+
+void main()
+{
+    int coefficient = int(gl_FragCoord.x);
+    int slice = int(gl_FragCoord.y);
+
+    int perFace = gridSize*gridSize;
+    int total = 6*perFace;
+    int first = (total*slice)/slices;
+    int last = (total*(slice+1))/slices;
+
+    // Sample at the probe MIP level matching the grid spacing
+    float cellAngle = 4.0*3.14159265/float(total);
+    float lod = max(0.5*log2(cellAngle/sourceTexelAngle), 0.0);
+
+    vec4 sum = vec4(0.0);
+    for (int k=first;  k<last;  k++) {
+        int f = k/perFace;
+        int cell = k - f*perFace;
+        vec2 p = 2.0*(vec2(cell%gridSize, cell/gridSize) + 0.5)/float(gridSize) - 1.0;
+
+        vec3 d;
+        if      (f == 0) d = vec3( 1.0, -p.y, -p.x);
+        else if (f == 1) d = vec3(-1.0, -p.y,  p.x);
+        else if (f == 2) d = vec3( p.x,  1.0,  p.y);
+        else if (f == 3) d = vec3( p.x, -1.0, -p.y);
+        else if (f == 4) d = vec3( p.x, -p.y,  1.0);
+        else             d = vec3(-p.x, -p.y, -1.0);
+
+        // Solid angle of a cube face cell is proportional to
+        // (1+s^2+t^2)^(-3/2).
+        float len2 = dot(d, d);
+        float w = 4.0/(float(perFace)*len2*sqrt(len2));
+        d = normalize(d);
+
+        sum += vec4(SampleEnvironment(d, lod)*SHBasis(coefficient, d)*w, w); }
+
+    gl_FragColor = sum;
+}
@@ -0,0 +1,26 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the second stage of the spherical harmonic
+// projection (see shlighting.h):  sums the partial sums of one
+// coefficient, normalizes by the total solid angle (exactly 4 pi in
+// theory), and convolves with the clamped cosine, turning radiance
+// coefficients into irradiance coefficients.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D partialSums;
+uniform int slices;
+
+void main()
+{
+    int coefficient = int(gl_FragCoord.x);
+
+    vec4 sum = vec4(0.0);
+    for (int j=0;  j<slices;  j++)
+        sum += texelFetch(partialSums, ivec2(coefficient, j), 0);
+
+    // Cosine lobe convolution per band:  pi, 2pi/3, pi/4
+    const float PI = 3.14159265;
+    float A = coefficient == 0 ? PI : (coefficient < 4 ? 2.0*PI/3.0 : PI/4.0);
+
+    gl_FragColor = vec4(A*sum.xyz*(4.0*PI/sum.w), 0.0);
+}
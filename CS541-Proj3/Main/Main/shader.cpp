@@ -11,28 +11,17 @@
 
 
 #include "shader.h"
+#include "shadermanager.h"
+#include "megabuffer.h"
+#include "allocation.h"
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
 #include <glload/gl_3_3.h>
 #include <glload/gl_load.hpp>
 #include <GL/freeglut.h>
 
-// Reads a specified file into a string and returns the string.
-char* ReadFile(const char* name)
-{
-    std::ifstream f;
-    f.open(name, std::ios_base::binary); // Open
-    f.seekg(0, std::ios_base::end);      // Position at end
-    int length = f.tellg();              //   to get the length
-
-    char* content = new char [length+1]; // Create buffer of needed length
-    f.seekg (0, std::ios_base::beg);     // Position at beginning
-    f.read (content, length);            //   to read complete file
-    f.close();                           // Close
-
-    content[length] = char(0);           // Finish with a NULL
-    return content;
-}
-
 // Asks OpenGL to create an empty shader program.
 void ShaderProgram::CreateProgram()
 { 
@@ -51,11 +40,19 @@ void ShaderProgram::Unuse()
     glUseProgram(0);
 }
 
-// Read, send to OpenGL, and compile a single file into a shader program.
+// Records a file to be compiled into the shader program.  The
+// compilation itself is done by LinkProgram, which may skip it
+// entirely if a cached binary of the program exists.
 void ShaderProgram::CreateShader(const char* fileName, int type)
 {
-    // Read the source from the named file
-    char* src = ReadFile(fileName);
+    fileNames.push_back(fileName);
+    types.push_back(type);
+}
+
+// Send to OpenGL, and compile a single shader's source, attaching it
+// to a program.  Returns false (after printing the log) on failure.
+bool CompileShader(const int program, const char* fileName, const char* src, const int type)
+{
     const char* psrc[1] = {src};
 
     // Create a shader and attach, hand it the source, and compile it.
@@ -63,7 +60,6 @@ void ShaderProgram::CreateShader(const char* fileName, int type)
     glAttachShader(program, shader);
     glShaderSource(shader, 1, psrc, NULL);
     glCompileShader(shader);
-    delete src;
 
     // Get the compilation status
     int status;
@@ -73,17 +69,18 @@ void ShaderProgram::CreateShader(const char* fileName, int type)
     if (status != 1) {
         int length;
         glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
-        char* buffer = new char[length];
-        glGetShaderInfoLog(shader, length, NULL, buffer);
-        printf("Compile log for %s:\n%s\n", fileName, buffer);
-        delete buffer;
-        exit(-1); }
+        std::vector<char> buffer(length+1);
+        glGetShaderInfoLog(shader, length, NULL, &buffer[0]);
+        printf("Compile log for %s:\n%s\n", fileName, &buffer[0]); }
+
+    // Once attached, the shader is deleted along with the program.
+    glDeleteShader(shader);
+    return status == 1;
 }
 
-void ShaderProgram::LinkProgram()
+// Checks a program's link status, printing the log on failure.
+bool CheckLink(const int program)
 {
-    // Link program and check the status
-    glLinkProgram(program);
     int status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
     
@@ -91,9 +88,206 @@ void ShaderProgram::LinkProgram()
     if (status != 1) {
         int length;
         glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
-        char* buffer = new char[length];
-        glGetProgramInfoLog(program, length, NULL, buffer);
-        printf("Link log:\n%s\n", buffer);
-        delete buffer;
-        exit(-1); }
+        std::vector<char> buffer(length+1);
+        glGetProgramInfoLog(program, length, NULL, &buffer[0]);
+        printf("Link log:\n%s\n", &buffer[0]);
+        return false; }
+    return true;
+}
+
+// Reads a whole file into text.  Returns false if it can't be opened.
+static bool ReadText(const std::string& name, std::string& text)
+{
+    std::ifstream f(name.c_str(), std::ios_base::binary);
+    if (!f.is_open()) return false;
+    text.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Appends text (source string number source) to out, expanding its
+// #include lines.  The defines follow the #version line.  included
+// lists the files already expanded into this shader;  dependencies,
+// those included by any shader of the program, numbered from 1.
+static void Expand(const std::string& text, const int source, const std::string& defines,
+                   std::vector<std::string>& included,
+                   std::vector<std::string>& dependencies, std::string& out)
+{
+    std::istringstream lines(text);
+    std::string line;
+    for (int number=1;  std::getline(lines, line);  number++) {
+        size_t start = line.find_first_not_of(" \t");
+        bool version = start != std::string::npos && line.compare(start, 8, "#version") == 0;
+        bool include = start != std::string::npos && line.compare(start, 8, "#include") == 0;
+        if (!version && !include) {
+            out += line + "\n";
+            continue; }
+
+        char resume[32];
+        sprintf(resume, "#line %d %d\n", number+1, source);
+        if (version) {
+            out += line + "\n" + defines + resume;
+            continue; }
+
+        size_t open = line.find('"', start);
+        size_t close = open == std::string::npos ? open : line.find('"', open+1);
+        if (close == std::string::npos) {
+            out += "#error malformed #include\n";
+            continue; }
+        std::string name = line.substr(open+1, close-open-1);
+
+        if (std::find(included.begin(), included.end(), name) == included.end()) {
+            included.push_back(name);
+            size_t n = std::find(dependencies.begin(), dependencies.end(), name)
+                - dependencies.begin();
+            if (n == dependencies.size())
+                dependencies.push_back(name);
+
+            std::string contents;
+            if (ReadText(name, contents)) {
+                char first[32];
+                sprintf(first, "#line 1 %d\n", int(n+1));
+                out += first;
+                Expand(contents, int(n+1), defines, included, dependencies, out); }
+            else
+                out += "#error cannot open " + name + "\n"; }
+        out += resume; }
+}
+
+// Reads and preprocesses the source of each of the program's files,
+// recording the files they include in dependencies.
+void ShaderProgram::ReadSources(std::vector<std::string>& sources)
+{
+    // NAME=VALUE becomes "#define NAME VALUE"
+    std::string defineLines;
+    std::istringstream words(defines);
+    std::string word;
+    while (words >> word) {
+        size_t equals = word.find('=');
+        if (equals == std::string::npos)
+            defineLines += "#define " + word + "\n";
+        else
+            defineLines += "#define " + word.substr(0, equals) + " " + word.substr(equals+1) + "\n"; }
+
+    sources.clear();
+    dependencies.clear();
+    for (unsigned int i=0;  i<fileNames.size();  i++) {
+        std::string text, source;
+        if (!ReadText(fileNames[i], text))
+            text = "#error cannot open " + fileNames[i] + "\n";
+        std::vector<std::string> included;
+        Expand(text, 0, defineLines, included, dependencies, source);
+        sources.push_back(source); }
+}
+
+void ShaderProgram::LinkProgram()
+{
+    MemoryScope scope(MEM_SHADERS);
+
+    // Read the (preprocessed) source from the named files
+    std::vector<std::string> sources;
+    ReadSources(sources);
+
+    // A cached binary of the same sources skips compilation.
+    if (!shaderManager.LoadBinary(*this, sources)) {
+        for (unsigned int i=0;  i<fileNames.size();  i++)
+            if (!CompileShader(program, fileNames[i].c_str(), sources[i].c_str(), types[i])) {
+                if (defines.size())
+                    printf("  (defines: %s)\n", defines.c_str());
+                for (unsigned int d=0;  d<dependencies.size();  d++)
+                    printf("  (source %d is %s)\n", d+1, dependencies[d].c_str());
+                exit(-1); }
+
+        // Link program and check the status
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        if (!CheckLink(program))
+            exit(-1);
+        shaderManager.SaveBinary(*this, sources); }
+
+    // Watch the source files for changes
+    shaderManager.Register(this);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Shader variants
+
+const char* ShaderVariants::names[ShaderVariants::COUNT] =
+    {"LIT", "TEXTURED", "REFLECTIVE", "DIRECT", "TERRAIN"};
+
+ShaderVariants::ShaderVariants() :indirectBuilt(false), indirect(false), count(0), compileMs(0.0)
+{
+    for (int v=0;  v<COUNT;  v++)
+        built[v] = false;
+}
+
+void BindAttributeLocations(const int program)
+{
+    glBindAttribLocation(program, 0, "vertex");
+    glBindAttribLocation(program, 1, "vertexNormal");
+    glBindAttribLocation(program, 2, "vertexTexture");
+    glBindAttribLocation(program, 3, "vertexTangent");
+    glBindAttribLocation(program, DRAW_ID_ATTRIBUTE, "drawID");
+}
+
+// Compiles and links one program from the two files.
+static void Build(ShaderProgram& s, const char* vertFile, const char* fragFile,
+                  const std::string& defines)
+{
+    s.defines = defines;
+    s.CreateProgram();
+    s.CreateShader(vertFile, GL_VERTEX_SHADER);
+    s.CreateShader(fragFile, GL_FRAGMENT_SHADER);
+
+    BindAttributeLocations(s.program);
+
+    s.LinkProgram();
+}
+
+// Builds the variants in mask (a bit per Variant;  LIT is always
+// built) of the program made from the two files, and their INDIRECT
+// versions if multi-draw is supported.
+void ShaderVariants::Create(const char* vertFile, const char* fragFile, const int mask)
+{
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+
+    count = 0;
+    indirectBuilt = MegaBuffer::Supported();
+    for (int v=0;  v<COUNT;  v++) {
+        built[v] = v == LIT || (mask & (1<<v));
+        if (!built[v]) continue;
+
+        std::string defines = v == LIT ? "" : names[v];
+        Build(variant[v], vertFile, fragFile, defines);
+        count++;
+        if (indirectBuilt) {
+            Build(indirectVariant[v], vertFile, fragFile, defines + " INDIRECT");
+            count++; } }
+
+    compileMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    shaderManager.variants += count;
+    shaderManager.variantMs += compileMs;
+    printf("%s: %d variants (%.0f ms)\n", fragFile, count, compileMs);
+}
+
+// The program of variant v, or of LIT if v wasn't built (the
+// INDIRECT one while indirect is set).
+int ShaderVariants::Program(const int v)
+{
+    int u = built[v] ? v : LIT;
+    return indirect && indirectBuilt ? indirectVariant[u].program : variant[u].program;
+}
+
+// Makes variant v the current program, and returns it.
+int ShaderVariants::Use(const int v)
+{
+    int program = Program(v);
+    glUseProgram(program);
+    return program;
+}
+
+void ShaderVariants::Unuse()
+{
+    glUseProgram(0);
 }
@@ -6,22 +6,90 @@
 // invoked for all geometry passing through the graphics pipeline.
 // When done, unload it with method "Unuse".
 //
+// Sources are run through a small preprocessor before compilation:
+// a line
+//     #include "file.glsl"
+// is replaced by that file's contents (each file at most once per
+// shader), and the program's defines are inserted after #version.
+// #line directives keep compiler messages pointing at the right
+// line;  source string 0 is the shader's own file, and string n is
+// dependencies[n-1].
+//
 // Copyright 2013 DigiPen Institute of Technology
 ////////////////////////////////////////////////////////////////////////
 
 #ifndef _SHADER_
 #define _SHADER_
 
+#include <string>
+#include <vector>
+
 class ShaderProgram
 {
 public:
     int program;
-    
+
+    // The source files, recorded so that the program can be rebuilt
+    // when one changes (see shadermanager.h)
+    std::vector<std::string> fileNames;
+    std::vector<int> types;
+
+    // Space separated NAME or NAME=VALUE macros, defined in every
+    // source;  and the files #included, found by ReadSources.
+    std::string defines;
+    std::vector<std::string> dependencies;
+
+    ShaderProgram() :program(0) {}
     void CreateProgram();
     void CreateShader(const char* fileName, const int type);
     void LinkProgram();
+    void ReadSources(std::vector<std::string>& sources);
     void Use();
     void Unuse();
 };
 
+// Binds the vertex attribute locations used throughout (see models.h
+// and megabuffer.h) in a program about to be linked.  Every program
+// drawing models calls it, at first build and at hot reload alike.
+void BindAttributeLocations(const int program);
+
+////////////////////////////////////////////////////////////////////////
+// The compile time specializations of one vertex/pixel shader pair.
+// Rather than have every fragment branch on uniforms to decide how it
+// is shaded, each variant is compiled with one #define and the draw
+// code chooses the variant for each object:
+//
+//   LIT         the plain lit surface (no define)
+//   TEXTURED    the textured ground
+//   REFLECTIVE  the central model, reflecting the environment probe
+//   DIRECT      unlit, in its diffuse color (the sun)
+//   TERRAIN     the clipmap terrain (see terrain.h), shaded as TEXTURED
+//
+// A variant not built falls back to LIT.
+//
+// Where the multi-draw path is supported (see megabuffer.h), each
+// variant is also built with INDIRECT defined, taking its per-object
+// values from draw records rather than uniforms;  Use and Program
+// choose those while indirect is set.
+class ShaderVariants
+{
+public:
+    enum Variant {LIT, TEXTURED, REFLECTIVE, DIRECT, TERRAIN, COUNT};
+    static const char* names[COUNT];
+
+    ShaderProgram variant[COUNT];
+    ShaderProgram indirectVariant[COUNT];
+    bool built[COUNT];
+    bool indirectBuilt;
+    bool indirect;          // Use the INDIRECT programs
+    int count;              // Number of variants built
+    double compileMs;       // Time spent building them
+
+    ShaderVariants();
+    void Create(const char* vertFile, const char* fragFile, const int mask=(1<<COUNT)-1);
+    int Program(const int v);
+    int Use(const int v);
+    void Unuse();
+};
+
 #endif
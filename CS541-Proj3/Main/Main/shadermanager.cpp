@@ -0,0 +1,326 @@
+///////////////////////////////////////////////////////////////////////
+// Shader hot reload and program binary cache.  See shadermanager.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <string.h>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "shadermanager.h"
+#include "allocation.h"
+
+// From GL_ARB_parallel_shader_compile, which glload predates
+#define GL_MAX_SHADER_COMPILER_THREADS_ARB 0x91B0
+#define GL_COMPLETION_STATUS_ARB           0x91B1
+typedef void (CODEGEN_FUNCPTR *MaxShaderCompilerThreadsProc)(GLuint count);
+
+#define CACHE_DIRECTORY "shadercache"
+
+// Without inotify, files are checked every this many frames.
+#define POLL_INTERVAL 30
+
+bool CompileShader(const int program, const char* fileName, const char* src, const int type);
+bool CheckLink(const int program);
+
+ShaderManager shaderManager;
+
+ShaderManager::ShaderManager()
+    :parallelCompile(false), useCache(true), cacheHits(0), cacheMisses(0),
+     reloads(0), failures(0), lastReloadMs(0.0), variants(0), variantMs(0.0),
+     watchFd(-1), frame(0)
+{
+}
+
+static bool HasExtension(const char* name)
+{
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i=0;  i<count;  i++)
+        if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name))
+            return true;
+    return false;
+}
+
+// Called once a GL context exists, before any program is linked.
+void ShaderManager::Initialize()
+{
+    driver = std::string((const char*)glGetString(GL_RENDERER))
+        + (const char*)glGetString(GL_VERSION);
+
+    // Let the driver compile on as many threads as it likes.
+    if (HasExtension("GL_ARB_parallel_shader_compile")) {
+        MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)
+            glutGetProcAddress("glMaxShaderCompilerThreadsARB");
+        if (maxThreads) {
+            maxThreads(0xFFFFFFFF);
+            parallelCompile = true; } }
+
+    // The program binary cache needs at least one binary format.
+    int formats = 0;
+    if (glext_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    useCache = formats > 0;
+#ifdef _WIN32
+    _mkdir(CACHE_DIRECTORY);
+#else
+    mkdir(CACHE_DIRECTORY, 0755);
+#endif
+
+#ifdef __linux__
+    // Editors either rewrite a file in place or write a new file and
+    // rename it over the old, so watch for both.
+    watchFd = inotify_init1(IN_NONBLOCK);
+    if (watchFd >= 0 && inotify_add_watch(watchFd, ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(watchFd);
+        watchFd = -1; }
+#endif
+
+    printf("Shaders: %s compile, binary cache %s, watching by %s\n",
+           parallelCompile ? "parallel" : "serial", useCache ? "on" : "off",
+           watchFd >= 0 ? "inotify" : "polling");
+}
+
+static long ModifiedTime(const std::string& name)
+{
+    struct stat info;
+    if (stat(name.c_str(), &info) != 0) return 0;
+    return long(info.st_mtime);
+}
+
+void ShaderManager::Register(ShaderProgram* p)
+{
+    for (unsigned int i=0;  i<programs.size();  i++)
+        if (programs[i] == p) return;
+    programs.push_back(p);
+    Watch(p);
+}
+
+// Starts watching p's files and includes, if not already watched.
+void ShaderManager::Watch(ShaderProgram* p)
+{
+    for (unsigned int i=0;  i<p->fileNames.size();  i++)
+        if (!modified.count(p->fileNames[i]))
+            modified[p->fileNames[i]] = ModifiedTime(p->fileNames[i]);
+    for (unsigned int i=0;  i<p->dependencies.size();  i++)
+        if (!modified.count(p->dependencies[i]))
+            modified[p->dependencies[i]] = ModifiedTime(p->dependencies[i]);
+}
+
+// Is file one of p's sources, or included by them?
+bool ShaderManager::Uses(ShaderProgram* p, const std::string& file)
+{
+    return std::find(p->fileNames.begin(), p->fileNames.end(), file) != p->fileNames.end()
+        || std::find(p->dependencies.begin(), p->dependencies.end(), file) != p->dependencies.end();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Binary cache
+
+// 64 bit FNV-1a
+static void Hash(unsigned long long& h, const char* data, const size_t length)
+{
+    for (size_t i=0;  i<length;  i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL; }
+}
+
+// The cache file for a program:  named by the hash of the driver, and
+// each shader's type and source.
+std::string ShaderManager::CachePath(ShaderProgram& p, const std::vector<std::string>& sources)
+{
+    unsigned long long h = 14695981039346656037ULL;
+    Hash(h, driver.c_str(), driver.size());
+    for (unsigned int i=0;  i<sources.size();  i++) {
+        Hash(h, (const char*)&p.types[i], sizeof(int));
+        Hash(h, sources[i].c_str(), sources[i].size()); }
+
+    char name[64];
+    sprintf(name, CACHE_DIRECTORY "/%016llx.bin", h);
+    return name;
+}
+
+// Loads a cached binary for these sources into p's program.  Returns
+// false if there is none, or the driver rejects it.
+bool ShaderManager::LoadBinary(ShaderProgram& p, const std::vector<std::string>& sources)
+{
+    if (!useCache) return false;
+
+    std::ifstream f(CachePath(p, sources).c_str(), std::ios_base::binary);
+    if (!f.is_open()) {
+        cacheMisses++;
+        return false; }
+
+    unsigned int format;
+    f.read((char*)&format, sizeof(format));
+    std::vector<char> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    f.close();
+
+    glProgramBinary(p.program, format, data.size() ? &data[0] : NULL, data.size());
+    int status;
+    glGetProgramiv(p.program, GL_LINK_STATUS, &status);
+    if (status != 1) {
+        cacheMisses++;
+        return false; }
+
+    cacheHits++;
+    return true;
+}
+
+void ShaderManager::SaveBinary(ShaderProgram& p, const std::vector<std::string>& sources)
+{
+    if (!useCache) return;
+
+    int length = 0;
+    glGetProgramiv(p.program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> data(length);
+    unsigned int format;
+    glGetProgramBinary(p.program, length, NULL, &format, &data[0]);
+
+    std::ofstream f(CachePath(p, sources).c_str(), std::ios_base::binary);
+    f.write((const char*)&format, sizeof(format));
+    f.write(&data[0], length);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Hot reload
+
+// Collects the names of the shader files changed since the last call.
+void ShaderManager::ChangedFiles(std::vector<std::string>& changed)
+{
+#ifdef __linux__
+    if (watchFd >= 0) {
+        char buffer[4096];
+        int n;
+        while ((n = read(watchFd, buffer, sizeof(buffer))) > 0)
+            for (int i=0;  i<n; ) {
+                struct inotify_event* e = (struct inotify_event*)&buffer[i];
+                if (e->len && modified.count(e->name)
+                    && std::find(changed.begin(), changed.end(), e->name) == changed.end())
+                    changed.push_back(e->name);
+                i += sizeof(struct inotify_event) + e->len; }
+        return; }
+#endif
+
+    if (frame % POLL_INTERVAL != 0) return;
+    for (std::map<std::string, long>::iterator i=modified.begin();  i!=modified.end();  i++) {
+        long t = ModifiedTime(i->first);
+        if (t != i->second) {
+            i->second = t;
+            changed.push_back(i->first); } }
+}
+
+// Starts rebuilding p into a new program object.  Nothing here waits
+// for the compiler, unless the driver lacks parallel compilation.
+void ShaderManager::StartBuild(ShaderProgram* p)
+{
+    // A newer edit supersedes a build still in progress.
+    for (unsigned int i=0;  i<builds.size();  i++)
+        if (builds[i].target == p) {
+            glDeleteProgram(builds[i].program);
+            builds.erase(builds.begin() + i);
+            break; }
+
+    Build b;
+    b.target = p;
+    b.program = glCreateProgram();
+    b.startTime = glutGet(GLUT_ELAPSED_TIME);
+
+    // An edit may have added includes, which are watched from now on.
+    p->ReadSources(b.sources);
+    Watch(p);
+
+    for (unsigned int i=0;  i<p->fileNames.size();  i++) {
+        const char* psrc[1] = { b.sources[i].c_str() };
+        unsigned int shader = glCreateShader(p->types[i]);
+        glShaderSource(shader, 1, psrc, NULL);
+        glCompileShader(shader);
+        glAttachShader(b.program, shader);
+        b.shaders.push_back(shader); }
+
+    BindAttributeLocations(b.program);
+
+    glProgramParameteri(b.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(b.program);
+    builds.push_back(b);
+}
+
+// Swaps in the programs whose builds have completed successfully.
+void ShaderManager::FinishBuilds()
+{
+    for (unsigned int i=0;  i<builds.size(); ) {
+        Build& b = builds[i];
+        if (parallelCompile) {
+            int done = 0;
+            glGetProgramiv(b.program, GL_COMPLETION_STATUS_ARB, &done);
+            if (!done) {
+                i++;
+                continue; } }
+
+        ShaderProgram* p = b.target;
+        std::string name = p->fileNames[0] + " + " + p->fileNames.back();
+        if (p->defines.size())
+            name += " [" + p->defines + "]";
+        bool ok = true;
+        for (unsigned int s=0;  s<b.shaders.size();  s++) {
+            int status;
+            glGetShaderiv(b.shaders[s], GL_COMPILE_STATUS, &status);
+            if (status != 1) {
+                int length;
+                glGetShaderiv(b.shaders[s], GL_INFO_LOG_LENGTH, &length);
+                std::vector<char> log(length+1);
+                glGetShaderInfoLog(b.shaders[s], length, NULL, &log[0]);
+                printf("Compile log for %s:\n%s\n", p->fileNames[s].c_str(), &log[0]);
+                ok = false; }
+            glDeleteShader(b.shaders[s]); }
+        if (ok) ok = CheckLink(b.program);
+
+        if (ok) {
+            // The swap:  every later use of the ShaderProgram gets the
+            // new program.
+            glDeleteProgram(p->program);
+            p->program = b.program;
+            SaveBinary(*p, b.sources);
+            reloads++;
+            lastReloadMs = glutGet(GLUT_ELAPSED_TIME) - b.startTime;
+            printf("Reloaded %s (%.0f ms)\n", name.c_str(), lastReloadMs); }
+        else {
+            glDeleteProgram(b.program);
+            failures++;
+            for (unsigned int d=0;  d<p->dependencies.size();  d++)
+                printf("  (source %d is %s)\n", d+1, p->dependencies[d].c_str());
+            printf("Keeping the previous %s\n", name.c_str()); }
+        fflush(stdout);
+        builds.erase(builds.begin() + i); }
+}
+
+// Called once per frame:  starts rebuilds for changed files, and
+// swaps in finished ones.
+void ShaderManager::Update()
+{
+    MemoryScope scope(MEM_SHADERS);
+    frame++;
+    std::vector<std::string> changed;
+    ChangedFiles(changed);
+
+    for (unsigned int c=0;  c<changed.size();  c++)
+        for (unsigned int i=0;  i<programs.size();  i++)
+            if (Uses(programs[i], changed[c]))
+                StartBuild(programs[i]);
+
+    FinishBuilds();
+}
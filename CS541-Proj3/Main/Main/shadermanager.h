@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////
+// Keeps the shader programs up to date with their source files, and
+// quick to build:
+//
+//   Hot reload:  The shader files are watched (with inotify on Linux,
+//       by polling modification times elsewhere).  When one changes,
+//       each program using it is rebuilt into a new program object
+//       in the background;  with GL_ARB_parallel_shader_compile the
+//       driver compiles on its own threads, and the frame loop only
+//       polls for completion.  A program which links is swapped in
+//       for the old one in a single step;  one which fails prints its
+//       log and leaves the old program running.
+//
+//   Includes:  A program is also rebuilt when a file it #includes
+//       changes (see ShaderProgram::ReadSources).
+//
+//   Binary cache:  Each linked program's glGetProgramBinary blob is
+//       written to shadercache/, named by a hash of its sources (and
+//       the driver), so that later startups load the binaries and
+//       skip compilation entirely.
+//
+// ShaderProgram::LinkProgram registers each program;  call Update()
+// once per frame.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SHADERMANAGER_
+#define _SHADERMANAGER_
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "shader.h"
+
+class ShaderManager
+{
+public:
+    bool parallelCompile;   // GL_ARB_parallel_shader_compile is in use
+    bool useCache;
+
+    // Statistics
+    int cacheHits, cacheMisses;
+    int reloads, failures;
+    double lastReloadMs;    // From noticing a change to swapping programs
+    int variants;           // Shader variants built (see ShaderVariants)
+    double variantMs;       //   and the time taken
+
+    ShaderManager();
+    void Initialize();
+    void Register(ShaderProgram* p);
+    void Update();
+
+    bool LoadBinary(ShaderProgram& p, const std::vector<std::string>& sources);
+    void SaveBinary(ShaderProgram& p, const std::vector<std::string>& sources);
+
+private:
+    // A program being rebuilt in the background
+    struct Build
+    {
+        ShaderProgram* target;
+        unsigned int program;
+        std::vector<unsigned int> shaders;
+        std::vector<std::string> sources;
+        int startTime;
+    };
+
+    std::vector<ShaderProgram*> programs;
+    std::vector<Build> builds;
+    std::string driver;     // Renderer and version, part of the cache key
+
+    int watchFd;            // inotify descriptor, or -1 to poll
+    std::map<std::string, long> modified;
+    int frame;
+
+    std::string CachePath(ShaderProgram& p, const std::vector<std::string>& sources);
+    void ChangedFiles(std::vector<std::string>& changed);
+    void Watch(ShaderProgram* p);
+    bool Uses(ShaderProgram* p, const std::string& file);
+    void StartBuild(ShaderProgram* p);
+    void FinishBuilds();
+};
+
+extern ShaderManager shaderManager;
+
+#endif
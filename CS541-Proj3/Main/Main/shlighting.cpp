@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////
+// Spherical harmonic ambient lighting.  See shlighting.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "envprobe.h"
+#include "shlighting.h"
+
+// Uniform buffer binding point for the coefficients
+#define SH_BINDING 0
+
+const float PI = 3.14159f;
+
+SHLighting::SHLighting()
+    :enabled(true), gridSize(32), strength(1.0f), projectedAngle(0.0f),
+     uniformBuffer(0), partialTexture(0), sumTexture(0), partialFbo(0),
+     sumFbo(0), emptyVao(0)
+{
+}
+
+static unsigned int CreateTarget(unsigned int& texture, const int w, const int h)
+{
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    unsigned int fbo;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, texture, 0);
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("SH FBO Error: %d\n", status);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return fbo;
+}
+
+static void CreateFullscreenShader(ShaderProgram& shader, const char* frag)
+{
+    shader.CreateProgram();
+    shader.CreateShader("fullscreen.vert", GL_VERTEX_SHADER);
+    shader.CreateShader(frag, GL_FRAGMENT_SHADER);
+    shader.LinkProgram();
+}
+
+void SHLighting::Initialize()
+{
+    CreateFullscreenShader(projectShader, "sh-project.frag");
+    CreateFullscreenShader(reduceShader, "sh-reduce.frag");
+    glGenVertexArrays(1, &emptyVao);
+
+    // Stage one writes one partial sum per coefficient (column) and
+    // slice of directions (row);  stage two sums the columns.
+    partialFbo = CreateTarget(partialTexture, SH_COEFFICIENTS, SH_SLICES);
+    sumFbo = CreateTarget(sumTexture, SH_COEFFICIENTS, 1);
+
+    // The 9x1 RGBA32F result has exactly the std140 layout of
+    // vec4[9], so it is copied straight into the uniform buffer.
+    float zeros[4*SH_COEFFICIENTS] = { 0.0f };
+    glGenBuffers(1, &uniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(zeros), zeros, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SH_BINDING, uniformBuffer);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Called after the probe is rendered.  Projects the probe onto SH
+// (only when its contents have changed), recording the rotation
+// angle of the environment at that moment.
+void SHLighting::Project(EnvProbe& probe, const float angle)
+{
+    if (!enabled || !probe.updated) return;
+
+    timer.Begin();
+    probe.GenerateMipmaps();
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(emptyVao);
+
+    // Stage one:  each fragment sums the projection of one slice of
+    // the directions onto one basis function.  The probe is read at
+    // the MIP level whose texels match the spacing of the directions.
+    glBindFramebuffer(GL_FRAMEBUFFER, partialFbo);
+    glViewport(0, 0, SH_COEFFICIENTS, SH_SLICES);
+    projectShader.Use();
+    int program = projectShader.program;
+    probe.Bind(program);
+    int loc = glGetUniformLocation(program, "gridSize");
+    glUniform1i(loc, gridSize);
+    loc = glGetUniformLocation(program, "slices");
+    glUniform1i(loc, SH_SLICES);
+    loc = glGetUniformLocation(program, "sourceTexelAngle");
+    glUniform1f(loc, probe.SourceTexelAngle());
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    probe.Unbind();
+    projectShader.Unuse();
+
+    // Stage two:  sum the slices, normalize, and apply the cosine
+    // lobe convolution.
+    glBindFramebuffer(GL_FRAMEBUFFER, sumFbo);
+    glViewport(0, 0, SH_COEFFICIENTS, 1);
+    reduceShader.Use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, partialTexture);
+    loc = glGetUniformLocation(reduceShader.program, "partialSums");
+    glUniform1i(loc, 0);
+    loc = glGetUniformLocation(reduceShader.program, "slices");
+    glUniform1i(loc, SH_SLICES);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    reduceShader.Unuse();
+
+    // Copy the result into the uniform buffer, entirely on the GPU.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, uniformBuffer);
+    glReadPixels(0, 0, SH_COEFFICIENTS, 1, GL_RGBA, GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glEnable(GL_DEPTH_TEST);
+    timer.End();
+
+    projectedAngle = angle;
+}
+
+// Connects a shader's SHLighting block to the coefficients, and
+// sends the rotation of the environment since they were projected.
+void SHLighting::Bind(const int program, const float angle)
+{
+    unsigned int block = glGetUniformBlockIndex(program, "SHLighting");
+    if (block != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, block, SH_BINDING);
+
+    int loc = glGetUniformLocation(program, "shEnabled");
+    glUniform1i(loc, enabled);
+    loc = glGetUniformLocation(program, "shStrength");
+    glUniform1f(loc, strength);
+    loc = glGetUniformLocation(program, "shRotation");
+    glUniform1f(loc, (angle - projectedAngle)*PI/180.0f);
+}
@@ -0,0 +1,31 @@
+/////////////////////////////////////////////////////////////////////////
+// Ambient light from the spherical harmonic projection of the
+// environment (see shlighting.h).
+//
+// #include "shlighting.glsl"
+////////////////////////////////////////////////////////////////////////
+
+layout(std140) uniform SHLighting { vec4 shCoefficients[9]; };
+uniform bool shEnabled;
+uniform float shStrength;
+uniform float shRotation;       // Environment rotation since projection
+
+// Diffuse irradiance arriving at a surface with normal n, from the
+// SH coefficients.  Rotating n back by shRotation (about Z) matches
+// the coefficients to the environment's current rotation.
+vec3 SHIrradiance(vec3 n)
+{
+    float c = cos(shRotation), s = sin(shRotation);
+    vec3 d = vec3(c*n.x + s*n.y, -s*n.x + c*n.y, n.z);
+
+    vec3 E = shCoefficients[0].xyz*0.282095
+           + shCoefficients[1].xyz*0.488603*d.y
+           + shCoefficients[2].xyz*0.488603*d.z
+           + shCoefficients[3].xyz*0.488603*d.x
+           + shCoefficients[4].xyz*1.092548*d.x*d.y
+           + shCoefficients[5].xyz*1.092548*d.y*d.z
+           + shCoefficients[6].xyz*0.315392*(3.0*d.z*d.z - 1.0)
+           + shCoefficients[7].xyz*1.092548*d.x*d.z
+           + shCoefficients[8].xyz*0.546274*(d.x*d.x - d.y*d.y);
+    return max(E, vec3(0.0));
+}
@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////
+// Image based diffuse (ambient) lighting from spherical harmonics.
+// Whatever the environment probe has captured (the ring of spheres,
+// the sky, the ground ...) is projected onto the 9 coefficients of
+// the first three SH bands by a two stage reduction on the GPU,
+// then convolved with the cosine lobe, so that the diffuse
+// irradiance in any direction N is a short polynomial in N:
+//
+//    E(N) = sum over i of shCoefficients[i] * Y_i(N)
+//
+// The coefficients are written by the GPU directly into a uniform
+// buffer (no read back to the CPU), which lighting.frag declares as
+//
+//    layout(std140) uniform SHLighting { vec4 shCoefficients[9]; };
+//
+// Between projections (when the probe is updated less often than
+// every frame) the environment keeps rotating with atime.  Rotating
+// the coefficients about Z is equivalent to rotating the lookup
+// direction the other way, which the shader does from the angle
+// passed by Bind, so the lighting follows the rotation smoothly.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SHLIGHTING_
+#define _SHLIGHTING_
+
+#include "shader.h"
+#include "gputimer.h"
+
+#define SH_COEFFICIENTS 9
+#define SH_SLICES 64        // Rows of partial sums in the first stage
+
+class EnvProbe;
+
+class SHLighting
+{
+public:
+    // User controllable parameters
+    bool enabled;
+    int gridSize;       // Directions per cube face edge (6*gridSize^2 in all)
+    float strength;     // Scale on the ambient contribution
+
+    float projectedAngle;   // atime at the most recent projection
+
+    unsigned int uniformBuffer;     // vec4 shCoefficients[9], std140
+    unsigned int partialTexture, sumTexture;
+    unsigned int partialFbo, sumFbo, emptyVao;
+    ShaderProgram projectShader, reduceShader;
+    GpuTimer timer;
+
+    SHLighting();
+    void Initialize();
+    void Project(EnvProbe& probe, const float angle);
+    void Bind(const int program, const float angle);
+};
+
+#endif
@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////
+// The software occlusion rasterizer.  See softocclusion.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFT_SSE 1
+#include <emmintrin.h>
+#endif
+
+#include "scene.h"
+#include "occlusion.h"
+#include "softocclusion.h"
+#include "jobs.h"
+#include "allocation.h"
+
+// Occluders per setup job
+#define SETUP_GRAIN 16
+
+SoftRasterizer::SoftRasterizer()
+    :triangles(0), ms(0.0), trianglesPerMs(0.0),
+     width(0), height(0), stride(0), tilesX(0), tilesY(0)
+{
+}
+
+void SoftRasterizer::BeginFrame()
+{
+    triangles = 0;
+    ms = 0.0;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Sets up a triangle given in texels (x, y) and window depth (z):
+// its edge equations, depth plane and covered texels.  Triangles
+// covering no whole texel are dropped.
+void SoftRasterizer::AddTriangle(const float v[3][3], std::vector<Triangle>& out) const
+{
+    float area = (v[1][0]-v[0][0])*(v[2][1]-v[0][1]) - (v[2][0]-v[0][0])*(v[1][1]-v[0][1]);
+    if (fabsf(area) < 1e-6f) return;
+    if (std::min(v[0][2], std::min(v[1][2], v[2][2])) >= 1.0f) return;   // Beyond the far plane
+
+    // Only texels with both corners inside the bounds can be covered
+    float x0 = std::min(v[0][0], std::min(v[1][0], v[2][0]));
+    float x1 = std::max(v[0][0], std::max(v[1][0], v[2][0]));
+    float y0 = std::min(v[0][1], std::min(v[1][1], v[2][1]));
+    float y1 = std::max(v[0][1], std::max(v[1][1], v[2][1]));
+    Triangle t;
+    t.x0 = std::max(0, int(ceilf(x0)));
+    t.y0 = std::max(0, int(ceilf(y0)));
+    t.x1 = std::min(width-1, int(floorf(x1)) - 1);
+    t.y1 = std::min(height-1, int(floorf(y1)) - 1);
+    if (t.x0 > t.x1 || t.y0 > t.y1) return;
+
+    // Edges, positive inside whatever the winding, each offset to its
+    // smallest value over a texel (and shrunk a little, for rounding)
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    for (int e=0;  e<3;  e++) {
+        const float* p = v[e];
+        const float* q = v[(e+1)%3];
+        float a = -(q[1] - p[1])*sign;
+        float b = (q[0] - p[0])*sign;
+        t.a[e] = a;
+        t.b[e] = b;
+        t.c[e] = -(a*p[0] + b*p[1]) + std::min(a, 0.0f) + std::min(b, 0.0f)
+                 - 1e-3f*(fabsf(a) + fabsf(b)); }
+
+    // The depth plane, offset to its largest value over a texel
+    float dz1 = v[1][2] - v[0][2], dz2 = v[2][2] - v[0][2];
+    t.za = (dz1*(v[2][1]-v[0][1]) - dz2*(v[1][1]-v[0][1]))/area;
+    t.zb = ((v[1][0]-v[0][0])*dz2 - (v[2][0]-v[0][0])*dz1)/area;
+    t.zc = v[0][2] - t.za*v[0][0] - t.zb*v[0][1]
+           + std::max(t.za, 0.0f) + std::max(t.zb, 0.0f) + 1e-6f;
+    out.push_back(t);
+}
+
+// Transforms an occluder's proxy triangles (sx, sy texels across the
+// view), clips them to the near plane, and sets them up into out.
+void SoftRasterizer::Setup(Scene& scene, const MAT4& ViewProj, const int occluder,
+                           const float sx, const float sy, std::vector<Triangle>& out) const
+{
+    const std::vector<vec3>& proxy = scene.graph.model[occluder]->proxy;
+    MAT4 M = ViewProj*scene.graph.world[occluder];
+
+    for (unsigned int k=0;  k+2<proxy.size();  k+=3) {
+        float clip[3][4];
+        for (int c=0;  c<3;  c++) {
+            const vec3& p = proxy[k+c];
+            for (int r=0;  r<4;  r++)
+                clip[c][r] = M[r][0]*p[0] + M[r][1]*p[1] + M[r][2]*p[2] + M[r][3]; }
+
+        // Clip to the near plane, z >= -w, making up to 4 corners
+        float poly[4][4];
+        int n = 0;
+        for (int c=0;  c<3;  c++) {
+            const float* p = clip[c];
+            const float* q = clip[(c+1)%3];
+            float dp = p[2] + p[3], dq = q[2] + q[3];
+            if (dp >= 0.0f)
+                for (int r=0;  r<4;  r++) poly[n][r] = p[r];
+            if (dp >= 0.0f) n++;
+            if ((dp >= 0.0f) != (dq >= 0.0f)) {
+                float s = dp/(dp - dq);
+                for (int r=0;  r<4;  r++) poly[n][r] = p[r] + s*(q[r] - p[r]);
+                n++; } }
+        if (n < 3) continue;
+
+        // To texels and window depth, then a fan of triangles
+        float v[4][3];
+        for (int c=0;  c<n;  c++) {
+            float w = std::max(poly[c][3], 1e-6f);
+            v[c][0] = (0.5f*poly[c][0]/w + 0.5f)*sx;
+            v[c][1] = (0.5f*poly[c][1]/w + 0.5f)*sy;
+            v[c][2] = 0.5f*poly[c][2]/w + 0.5f; }
+        for (int c=1;  c+1<n;  c++) {
+            float t[3][3];
+            for (int r=0;  r<3;  r++) {
+                t[0][r] = v[0][r];
+                t[1][r] = v[c][r];
+                t[2][r] = v[c+1][r]; }
+            AddTriangle(t, out); } }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Clears one tile, and draws its triangles into it.
+void SoftRasterizer::RasterizeTile(const int tile)
+{
+    int tx0 = (tile%tilesX)*TILE_WIDTH, ty0 = (tile/tilesX)*TILE_HEIGHT;
+    for (int y=ty0;  y<ty0+TILE_HEIGHT;  y++)
+        std::fill(&depth[y*stride + tx0], &depth[y*stride + tx0 + TILE_WIDTH], 1.0f);
+
+    const std::vector<const Triangle*>& bin = bins[tile];
+    for (unsigned int k=0;  k<bin.size();  k++) {
+        const Triangle& t = *bin[k];
+        // Rows of whole groups of 4, which never leave the tile
+        int x0 = std::max(t.x0, tx0) & ~3, x1 = std::min(t.x1, tx0 + TILE_WIDTH-1);
+        int y0 = std::max(t.y0, ty0), y1 = std::min(t.y1, ty0 + TILE_HEIGHT-1);
+        for (int y=y0;  y<=y1;  y++) {
+            float* row = &depth[y*stride];
+#if SOFT_SSE
+            __m128 step = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+            __m128 x = _mm_add_ps(_mm_set1_ps(float(x0)), step);
+            __m128 four = _mm_set1_ps(4.0f);
+            __m128 e[3], de[3];
+            for (int i=0;  i<3;  i++) {
+                e[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[i]), x),
+                                  _mm_set1_ps(t.b[i]*y + t.c[i]));
+                de[i] = _mm_set1_ps(4.0f*t.a[i]); }
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.za), x), _mm_set1_ps(t.zb*y + t.zc));
+            __m128 dz = _mm_mul_ps(_mm_set1_ps(t.za), four);
+            __m128 zero = _mm_setzero_ps();
+            for (int px=x0;  px<=x1;  px+=4) {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], zero),
+                                                      _mm_cmpge_ps(e[1], zero)),
+                                           _mm_cmpge_ps(e[2], zero));
+                __m128 d = _mm_loadu_ps(row + px);
+                __m128 nearer = _mm_min_ps(d, z);
+                _mm_storeu_ps(row + px, _mm_or_ps(_mm_and_ps(inside, nearer),
+                                                  _mm_andnot_ps(inside, d)));
+                for (int i=0;  i<3;  i++)
+                    e[i] = _mm_add_ps(e[i], de[i]);
+                z = _mm_add_ps(z, dz); }
+#else
+            for (int px=x0;  px<=x1;  px++) {
+                bool inside = true;
+                for (int i=0;  i<3;  i++)
+                    inside = inside && t.a[i]*px + t.b[i]*y + t.c[i] >= 0.0f;
+                float z = t.za*px + t.zb*y + t.zc;
+                if (inside && z < row[px]) row[px] = z; }
+#endif
+        } }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Fills hiZ (already laid out for this view, with its ViewProj set)
+// from the proxies of the occluder nodes.
+void SoftRasterizer::Render(Scene& scene, HiZ& hiZ, const std::vector<int>& occluders)
+{
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+    MemoryScope scope(MEM_SCENE);
+
+    // The buffer covers the whole view:  the level's texels, and
+    // the part texel beyond them where the view's size is odd
+    int level = hiZ.firstLevel;
+    float sx = float(hiZ.width)/float(2<<level), sy = float(hiZ.height)/float(2<<level);
+    width = int(ceilf(sx));
+    height = int(ceilf(sy));
+    tilesX = (width + TILE_WIDTH-1)/TILE_WIDTH;
+    tilesY = (height + TILE_HEIGHT-1)/TILE_HEIGHT;
+    stride = tilesX*TILE_WIDTH;
+    depth.resize(stride*tilesY*TILE_HEIGHT);
+
+    for (unsigned int k=0;  k<occluders.size();  k++) {
+        Model* model = scene.graph.model[occluders[k]];
+        if (!model->proxyBuilt) model->MakeProxy(); }
+
+    // Setup
+    int chunkCount = (occluders.size() + SETUP_GRAIN-1)/SETUP_GRAIN;
+    if (int(chunks.size()) < chunkCount) chunks.resize(chunkCount);
+    jobs.ParallelFor(chunkCount, 1, [&](int c0, int c1)
+    {
+        MemoryScope scope(MEM_SCENE);
+        for (int c=c0;  c<c1;  c++) {
+            chunks[c].clear();
+            int end = std::min(int(occluders.size()), (c+1)*SETUP_GRAIN);
+            for (int k=c*SETUP_GRAIN;  k<end;  k++)
+                Setup(scene, hiZ.ViewProj, occluders[k], sx, sy, chunks[c]); }
+    });
+
+    // Binning
+    bins.resize(tilesX*tilesY);
+    for (unsigned int b=0;  b<bins.size();  b++)
+        bins[b].clear();
+    int count = 0;
+    for (int c=0;  c<chunkCount;  c++)
+        for (unsigned int k=0;  k<chunks[c].size();  k++) {
+            const Triangle& t = chunks[c][k];
+            for (int y=t.y0/TILE_HEIGHT;  y<=t.y1/TILE_HEIGHT;  y++)
+                for (int x=t.x0/TILE_WIDTH;  x<=t.x1/TILE_WIDTH;  x++)
+                    bins[y*tilesX + x].push_back(&t);
+            count++; }
+
+    // Rasterizing
+    jobs.ParallelFor(tilesX*tilesY, 1, [&](int t0, int t1)
+    {
+        for (int t=t0;  t<t1;  t++)
+            RasterizeTile(t);
+    });
+
+    // The read back level, taking in the part texels, then the
+    // coarser levels
+    int w = hiZ.levelWidth[level], h = hiZ.levelHeight[level];
+    float* out = &hiZ.texels[hiZ.offset[level]];
+    for (int y=0;  y<h;  y++)
+        for (int x=0;  x<w;  x++) {
+            int xe = x == w-1 ? width-1 : x, ye = y == h-1 ? height-1 : y;
+            float d = 0.0f;
+            for (int yy=y;  yy<=ye;  yy++)
+                for (int xx=x;  xx<=xe;  xx++)
+                    d = std::max(d, depth[yy*stride + xx]);
+            out[y*w + x] = d; }
+
+    for (int l=level+1;  l<hiZ.levels;  l++) {
+        int sw = hiZ.levelWidth[l-1], sh = hiZ.levelHeight[l-1];
+        const float* src = &hiZ.texels[hiZ.offset[l-1]];
+        float* dst = &hiZ.texels[hiZ.offset[l]];
+        for (int y=0;  y<hiZ.levelHeight[l];  y++)
+            for (int x=0;  x<hiZ.levelWidth[l];  x++) {
+                // As hiz-reduce.frag:  an odd last column/row joins the one before
+                int px = 2*x, py = 2*y;
+                int xe = std::min(px + 1 + (px + 2 == sw-1 ? 1 : 0), sw-1);
+                int ye = std::min(py + 1 + (py + 2 == sh-1 ? 1 : 0), sh-1);
+                float d = 0.0f;
+                for (int yy=py;  yy<=ye;  yy++)
+                    for (int xx=px;  xx<=xe;  xx++)
+                        d = std::max(d, src[yy*sw + xx]);
+                dst[y*hiZ.levelWidth[l] + x] = d; } }
+    hiZ.valid = true;
+
+    triangles += count;
+    ms += std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    trianglesPerMs = ms > 0.0 ? triangles/ms : 0.0;
+}
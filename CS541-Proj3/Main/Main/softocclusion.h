@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////
+// A software occlusion rasterizer:  the CPU alternative to drawing
+// the occluders on the GPU and reading their depth back (see
+// occlusion.h), for where that wait is long (a software OpenGL, for
+// one).  It fills the same HiZ pyramid, so culling is unchanged.
+//
+// Each occluder is drawn as its model's proxy (Model::MakeProxy), a
+// few triangles inside the model:  the ground's own rectangle, a cube
+// inside each sphere.  The depth buffer is small -- the pyramid's
+// first read back level, no wider than SOFT_WIDTH -- and split into
+// TILE_WIDTH by TILE_HEIGHT tiles.  Render works in three phases:
+//
+//   * Setup, split by occluders across the job system (jobs.h):  the
+//     proxy triangles are transformed, clipped to the near plane, and
+//     turned into edge equations and a depth plane.
+//   * Binning, on the calling thread:  each triangle is listed in the
+//     tiles its bounding box overlaps.
+//   * Rasterizing, split by tiles (so no two threads write the same
+//     texel):  each tile's triangles are drawn four texels at a time
+//     with SSE where the compiler has it (scalar code otherwise).
+//
+// Coverage and depth are conservative:  a texel is written only if
+// the triangle covers all of it, with the triangle's farthest depth
+// over it, so the pyramid never hides something that the GPU would
+// draw.  The coarser levels are then reduced from it as on the GPU.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SOFTOCCLUSION_
+#define _SOFTOCCLUSION_
+
+#include <vector>
+
+#include "transform.h"
+
+class Scene;
+class HiZ;
+
+#define SOFT_WIDTH  256
+#define TILE_WIDTH  32          // A multiple of 4, for the SIMD rows
+#define TILE_HEIGHT 16
+
+class SoftRasterizer
+{
+public:
+    // Statistics of the current frame, summed over its views
+    int triangles;              // Set up (after clipping) and binned
+    double ms;                  // CPU time of Render
+    double trianglesPerMs;
+
+    SoftRasterizer();
+    void BeginFrame();
+    void Render(Scene& scene, HiZ& hiZ, const std::vector<int>& occluders);
+
+private:
+    // A triangle ready to rasterize, in texels of the depth buffer:
+    // edge equations a*x + b*y + c, offset so that >= 0 at a texel's
+    // lower left corner means the whole texel is inside, and a depth
+    // plane offset to give the farthest depth over the texel.
+    struct Triangle
+    {
+        float a[3], b[3], c[3];
+        float za, zb, zc;
+        int x0, y0, x1, y1;     // The texels it may cover
+    };
+
+    int width, height;          // Of the buffer:  the level, plus a partial texel
+    int stride, tilesX, tilesY;
+    std::vector<float> depth;
+    std::vector<std::vector<Triangle> > chunks;     // Setup's output, per job
+    std::vector<std::vector<const Triangle*> > bins;
+
+    void Setup(Scene& scene, const MAT4& ViewProj, const int occluder,
+               const float sx, const float sy, std::vector<Triangle>& out) const;
+    void AddTriangle(const float v[3][3], std::vector<Triangle>& out) const;
+    void RasterizeTile(const int tile);
+};
+
+#endif
@@ -0,0 +1,27 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader blurring the half size ambient occlusion (see ssao.h)
+// over a 4x4 block, so each pixel averages all 16 rotations of the
+// interleaved pattern.  Samples count less the further their view
+// depth is from the pixel's, so the blur stops at silhouettes.
+// Passes the view depth on, for the upsampling in ssao.glsl.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D occlusion;
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(occlusion, 0) - 1;
+    float z = texelFetch(occlusion, p, 0).g;
+
+    float sum = 0.0, total = 0.0;
+    for (int y=-2;  y<=1;  y++)
+        for (int x=-2;  x<=1;  x++) {
+            vec2 s = texelFetch(occlusion, clamp(p + ivec2(x, y), ivec2(0), last), 0).rg;
+            float w = max(1.0 - abs(s.g - z)/(0.05*z), 0.0);
+            sum += w*s.r;
+            total += w; }
+
+    gl_FragColor = vec4(total > 0.0 ? sum/total : 1.0, z, 0.0, 0.0);
+}
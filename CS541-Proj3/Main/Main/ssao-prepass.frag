@@ -0,0 +1,16 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader for the forward paths' prepass for the ambient
+// occlusion (see ssao.h):  just the world space normal (from the
+// geometry, without the ground's normal map);  depth goes to the
+// depth attachment.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+in vec3 normalVec;
+
+layout(location=0) out vec4 normalOut;
+
+void main()
+{
+    normalOut = vec4(normalize(normalVec), 0.0);
+}
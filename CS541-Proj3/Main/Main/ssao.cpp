@@ -0,0 +1,243 @@
+///////////////////////////////////////////////////////////////////////
+// Screen space ambient occlusion.  See ssao.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <GL/freeglut.h>
+
+#include "scene.h"
+#include "ssao.h"
+
+// The occlusion's unit in the lighting shaders (see ssao.glsl)
+#define AO_UNIT 19
+
+// Units of the SSAO passes themselves (each its own program)
+#define DEPTH_UNIT  0
+#define NORMAL_UNIT 1
+
+// Frames the budget is measured over before the preset changes again
+#define BUDGET_FRAMES 30
+
+// Directions and steps along each, per preset
+static const int presetDirections[SSAO::PRESETS] = {4, 6, 8};
+static const int presetSteps[SSAO::PRESETS] = {3, 4, 6};
+
+SSAO::SSAO()
+    :enabled(true), quality(MEDIUM), radius(3.0f), intensity(1.0f), budgetMs(1.0f),
+     level(MEDIUM), prepassFbo(0), normalTexture(0), depthTexture(0), prepassDrawn(false),
+     width(0), height(0),
+     emptyVao(0), prepassed(false), framesAtLevel(0)
+{
+    for (int i=0;  i<2;  i++)
+        aoFbo[i] = aoTexture[i] = 0;
+}
+
+static void CreateSSAOShader(ShaderProgram& shader, const char* frag)
+{
+    shader.CreateProgram();
+    shader.CreateShader("fullscreen.vert", GL_VERTEX_SHADER);
+    shader.CreateShader(frag, GL_FRAGMENT_SHADER);
+    shader.LinkProgram();
+}
+
+static unsigned int CreateTexture(const int w, const int h, const unsigned int format,
+                                  const unsigned int components)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, components, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+void SSAO::Initialize()
+{
+    prepassShader.Create("lighting.vert", "ssao-prepass.frag");
+    CreateSSAOShader(aoShader, "ssao.frag");
+    CreateSSAOShader(blurShader, "ssao-blur.frag");
+    glGenVertexArrays(1, &emptyVao);
+}
+
+void SSAO::DeleteTargets()
+{
+    if (!prepassFbo) return;
+    glDeleteFramebuffers(1, &prepassFbo);
+    glDeleteTextures(1, &normalTexture);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteFramebuffers(2, aoFbo);
+    glDeleteTextures(2, aoTexture);
+    prepassFbo = normalTexture = depthTexture = 0;
+    for (int i=0;  i<2;  i++)
+        aoFbo[i] = aoTexture[i] = 0;
+}
+
+// The prepass at the frame's size, the occlusion at half of it.
+void SSAO::CreateTargets(const int w, const int h)
+{
+    DeleteTargets();
+    width = w;
+    height = h;
+
+    normalTexture = CreateTexture(w, h, GL_RGBA16F, GL_RGBA);
+    depthTexture = CreateTexture(w, h, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT);
+    glGenFramebuffers(1, &prepassFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, prepassFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normalTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    int status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        printf("SSAO prepass FBO Error: %d\n", status);
+
+    for (int i=0;  i<2;  i++) {
+        aoTexture[i] = CreateTexture((w+1)/2, (h+1)/2, GL_RG16F, GL_RG);
+        glGenFramebuffers(1, &aoFbo[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, aoFbo[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, aoTexture[i], 0);
+        status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+            printf("SSAO FBO Error: %d\n", status); }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+// For the forward paths:  the depth and normal prepass, then the
+// occlusion from it.
+void SSAO::Draw(Scene& scene)
+{
+    prepassDrawn = false;
+    if (!enabled) return;
+    if (scene.width != width || scene.height != height)
+        CreateTargets(scene.width, scene.height);
+
+    prepassTimer.Begin();
+    glBindFramebuffer(GL_FRAMEBUFFER, prepassFbo);
+    glViewport(0, 0, width, height);
+    glClearColor(0.0, 0.0, 1.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    scene.SetupVariants(prepassShader, scene.WorldView, scene.WorldProj);
+    scene.DrawEnvironment(prepassShader, NULL, scene.CameraHiZ());
+    scene.DrawCentralModel(prepassShader);
+    prepassShader.Unuse();
+    prepassTimer.End();
+    prepassDrawn = true;
+
+    prepassed = true;
+    Compute(scene, depthTexture, normalTexture);
+    prepassed = false;
+}
+
+// The occlusion, from a depth texture and a texture of world space
+// normals (in xyz), both at the frame's size.
+void SSAO::Compute(Scene& scene, const unsigned int depth, const unsigned int normal)
+{
+    if (!enabled) return;
+    if (scene.width != width || scene.height != height)
+        CreateTargets(scene.width, scene.height);
+
+    // Keep to the budget:  a cheaper preset while over it, and back
+    // up when there is room for the next (measured over a while,
+    // since the timer lags).
+    level = std::min(level, quality);
+    double ms = timer.averageMs + (prepassed ? prepassTimer.averageMs : 0.0);
+    if (++framesAtLevel >= BUDGET_FRAMES && ms > 0.0) {
+        if (ms > budgetMs && level > LOW) {
+            level--;
+            framesAtLevel = 0; }
+        else if (ms < 0.5*budgetMs && level < quality) {
+            level++;
+            framesAtLevel = 0; } }
+
+    timer.Begin();
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(emptyVao);
+    glViewport(0, 0, (width+1)/2, (height+1)/2);
+
+    MAT4 ViewProj = scene.WorldProj*scene.WorldView;
+    MAT4 ViewProjInverse = ViewProj.inverse();
+
+    // Occlusion
+    glBindFramebuffer(GL_FRAMEBUFFER, aoFbo[0]);
+    aoShader.Use();
+    int program = aoShader.program;
+    glActiveTexture(GL_TEXTURE0+DEPTH_UNIT);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glActiveTexture(GL_TEXTURE0+NORMAL_UNIT);
+    glBindTexture(GL_TEXTURE_2D, normal);
+    int loc = glGetUniformLocation(program, "depth");
+    glUniform1i(loc, DEPTH_UNIT);
+    loc = glGetUniformLocation(program, "normal");
+    glUniform1i(loc, NORMAL_UNIT);
+    loc = glGetUniformLocation(program, "ViewProjectionInverse");
+    glUniformMatrix4fv(loc, 1, GL_TRUE, ViewProjInverse.Pntr());
+    loc = glGetUniformLocation(program, "directions");
+    glUniform1i(loc, presetDirections[level]);
+    loc = glGetUniformLocation(program, "steps");
+    glUniform1i(loc, presetSteps[level]);
+    loc = glGetUniformLocation(program, "radius");
+    glUniform1f(loc, radius);
+    loc = glGetUniformLocation(program, "intensity");
+    glUniform1f(loc, intensity);
+    // Pixels per world unit, at a view depth of 1
+    loc = glGetUniformLocation(program, "pixelScale");
+    glUniform1f(loc, 0.5f*height*scene.WorldProj[1][1]);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    aoShader.Unuse();
+
+    glActiveTexture(GL_TEXTURE0+NORMAL_UNIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Blur, across the interleaved pattern
+    glBindFramebuffer(GL_FRAMEBUFFER, aoFbo[1]);
+    blurShader.Use();
+    program = blurShader.program;
+    glActiveTexture(GL_TEXTURE0+DEPTH_UNIT);
+    glBindTexture(GL_TEXTURE_2D, aoTexture[0]);
+    loc = glGetUniformLocation(program, "occlusion");
+    glUniform1i(loc, DEPTH_UNIT);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    blurShader.Unuse();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    timer.End();
+}
+
+// As EnvProbe::SetUnits, done for every pass to keep the sampler off
+// unit 0.  No occlusion is applied unless Bind is called.
+void SSAO::SetUnits(const int program)
+{
+    int loc = glGetUniformLocation(program, "aoTexture");
+    glUniform1i(loc, AO_UNIT);
+    loc = glGetUniformLocation(program, "aoEnabled");
+    glUniform1i(loc, 0);
+}
+
+// For the lighting pass, after Draw or Compute.
+void SSAO::Bind(const int program)
+{
+    SetUnits(program);
+    if (!enabled) return;
+    glActiveTexture(GL_TEXTURE0+AO_UNIT);
+    glBindTexture(GL_TEXTURE_2D, aoTexture[1]);
+    glActiveTexture(GL_TEXTURE0);
+    int loc = glGetUniformLocation(program, "aoEnabled");
+    glUniform1i(loc, 1);
+}
+
+void SSAO::Unbind()
+{
+    glActiveTexture(GL_TEXTURE0+AO_UNIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
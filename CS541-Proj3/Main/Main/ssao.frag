@@ -0,0 +1,75 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader computing the ambient occlusion at half size (see
+// ssao.h).  Each half size pixel takes its frame pixel's position
+// (from depth) and normal, and marches directions across the depth
+// buffer out to radius world units:  each sample H above the tangent
+// plane occludes by its elevation's sine (less a small bias against
+// self occlusion on flat surfaces), falling off as |H| nears radius.
+//
+// The directions' rotation, and the steps' offset along them, come
+// from the pixel's place in a 4x4 block, so the block takes all 16
+// rotations (which ssao-blur.frag averages).  Writes the visibility
+// (1 unoccluded) and the view depth, for the depth-aware filters
+// after it.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D depth, normal;
+uniform mat4 ViewProjectionInverse;
+uniform int directions, steps;
+uniform float radius, intensity;
+uniform float pixelScale;       // Pixels per world unit at view depth 1
+
+const float PI = 3.14159;
+const float BIAS = 0.1;
+const float FAR = 60000.0;      // The view depth written for the sky
+
+in vec2 uv;
+
+// The world position at a frame pixel, and its view depth
+vec3 Position(ivec2 p, out float viewDepth)
+{
+    vec2 size = vec2(textureSize(depth, 0));
+    float d = texelFetch(depth, p, 0).r;
+    vec4 P = ViewProjectionInverse*vec4(2.0*(vec2(p) + 0.5)/size - 1.0, 2.0*d - 1.0, 1.0);
+    viewDepth = 1.0/P.w;
+    return P.xyz/P.w;
+}
+
+void main()
+{
+    ivec2 block = ivec2(gl_FragCoord.xy);
+    ivec2 p = 2*block;
+    ivec2 last = textureSize(depth, 0) - 1;
+    if (texelFetch(depth, p, 0).r == 1.0) {
+        gl_FragColor = vec4(1.0, FAR, 0.0, 0.0);
+        return; }
+
+    float viewDepth, sampleDepth;
+    vec3 P = Position(p, viewDepth);
+    vec3 N = normalize(texelFetch(normal, p, 0).xyz);
+
+    // The radius on screen, divided among the steps (at least a pixel
+    // each)
+    float stepPixels = max(radius*pixelScale/viewDepth/float(steps + 1), 1.0);
+
+    int index = (block.x & 3) + 4*(block.y & 3);
+    float rotation = (2.0*PI/float(directions))*float(index)/16.0;
+    float offset = fract(float(index)*0.618034);
+
+    float occlusion = 0.0;
+    for (int d=0;  d<directions;  d++) {
+        float angle = rotation + 2.0*PI*float(d)/float(directions);
+        vec2 D = vec2(cos(angle), sin(angle));
+        for (int s=0;  s<steps;  s++) {
+            ivec2 q = clamp(p + ivec2(round(D*(float(s) + offset + 1.0)*stepPixels)),
+                            ivec2(0), last);
+            vec3 H = Position(q, sampleDepth) - P;
+            float h2 = dot(H, H);
+            if (h2 < 1e-6) continue;
+            float falloff = clamp(1.0 - h2/(radius*radius), 0.0, 1.0);
+            occlusion += max(dot(N, H)*inversesqrt(h2) - BIAS, 0.0)*falloff; } }
+
+    occlusion *= intensity/((1.0 - BIAS)*float(directions*steps));
+    gl_FragColor = vec4(clamp(1.0 - occlusion, 0.0, 1.0), viewDepth, 0.0, 0.0);
+}
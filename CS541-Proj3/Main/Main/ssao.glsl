@@ -0,0 +1,33 @@
+/////////////////////////////////////////////////////////////////////////
+// Ambient occlusion (see ssao.h), for the lighting shaders.  The
+// occlusion is at half size, with the view depth of each texel:  of
+// the four texels around the pixel, each counts by its bilinear
+// weight times how close its depth is to the pixel's, so occlusion
+// does not bleed across silhouettes (a bilateral upsample).
+//
+// #include "ssao.glsl"
+////////////////////////////////////////////////////////////////////////
+
+uniform bool aoEnabled;
+uniform sampler2D aoTexture;
+
+// The visibility (1 unoccluded) at this pixel, at view depth z
+float AmbientOcclusion(float z)
+{
+    if (!aoEnabled) return 1.0;
+
+    vec2 p = 0.5*(gl_FragCoord.xy - 0.5);     // Texel i is the frame's pixel 2i
+    ivec2 i = ivec2(floor(p));
+    vec2 f = p - vec2(i);
+    ivec2 last = textureSize(aoTexture, 0) - 1;
+
+    float sum = 0.0, total = 0.0;
+    for (int y=0;  y<=1;  y++)
+        for (int x=0;  x<=1;  x++) {
+            vec2 s = texelFetch(aoTexture, clamp(i + ivec2(x, y), ivec2(0), last), 0).rg;
+            float w = (x == 1 ? f.x : 1.0 - f.x)*(y == 1 ? f.y : 1.0 - f.y)
+                *(1.0/(0.001 + abs(s.g - z)/z));
+            sum += w*s.r;
+            total += w; }
+    return sum/total;
+}
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////
+// Screen space ambient occlusion, horizon based (after NVIDIA's
+// HBAO+):  for each pixel, a few directions are marched across the
+// depth buffer out to radius world units, and each sample above the
+// pixel's tangent plane occludes it by the sine of its elevation,
+// fading with distance.  The result darkens the ambient term of the
+// lighting (see ssao.glsl), giving the contact shading between the
+// central model and the ground which the SH ambient light lacks.
+//
+// The occlusion is computed at half the frame's size, from the depth
+// and normals of the frame:  the deferred path's G-buffer, or, for
+// the forward paths, a prepass writing just those.  Each 4x4 block of
+// half size pixels uses all 16 rotations of the directions (an
+// interleaved pattern), which a 4x4 depth-aware blur then averages
+// out.  The lighting shaders upsample the result bilaterally:  of the
+// four half size texels around a pixel, those at its depth count
+// most, so the occlusion does not bleed across silhouettes.
+//
+// The quality presets choose the directions and steps.  The passes
+// are timed, and while they run over budgetMs the next cheaper
+// preset is used (going back once well under it).
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SSAO_
+#define _SSAO_
+
+#include "shader.h"
+#include "gputimer.h"
+
+class Scene;
+
+class SSAO
+{
+public:
+    enum { LOW=0, MEDIUM=1, HIGH=2, PRESETS };
+
+    // User controllable parameters
+    bool enabled;
+    int quality;            // One of the presets
+    float radius;           // World units
+    float intensity;
+    float budgetMs;
+
+    int level;              // The preset in use, at most quality
+
+    // The forward paths' prepass:  normals, and depth (which the
+    // depth prepass reuses, see depthprepass.h)
+    unsigned int prepassFbo, normalTexture, depthTexture;
+    bool prepassDrawn;      // By this frame's Draw
+    ShaderVariants prepassShader;
+
+    // Half size occlusion (and view depth), before and after the blur
+    unsigned int aoFbo[2], aoTexture[2];
+    int width, height;      // Of the frame
+
+    ShaderProgram aoShader, blurShader;
+    unsigned int emptyVao;
+
+    GpuTimer timer, prepassTimer;
+
+    SSAO();
+    void Initialize();
+    void Draw(Scene& scene);
+    void Compute(Scene& scene, const unsigned int depth, const unsigned int normal);
+    void SetUnits(const int program);
+    void Bind(const int program);
+    void Unbind();
+
+private:
+    bool prepassed;         // Compute is timing Draw's prepass's output
+    int framesAtLevel;
+
+    void CreateTargets(const int w, const int h);
+    void DeleteTargets();
+};
+
+#endif
@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////
+// The fenced, triple-buffered streaming buffer.  See streambuffer.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+
+#include "streambuffer.h"
+
+// Bound here to map and allocate, so as not to disturb the array,
+// element array (part of the VAO) or uniform bindings.
+#define STREAM_TARGET GL_COPY_WRITE_BUFFER
+
+StreamBuffer::StreamBuffer()
+    :persistent(false), buffer(0), regionSize(0), region(0), used(0), mapped(NULL),
+     pending(false), frames(0), stalls(0), stallMs(0.0), overflows(0), peakBytes(0), grow(0)
+{
+    for (int r=0;  r<STREAM_FRAMES;  r++)
+        fences[r] = NULL;
+}
+
+void StreamBuffer::Initialize(const int bytesPerFrame)
+{
+    persistent = glext_ARB_buffer_storage != 0;
+    Create(bytesPerFrame);
+    printf("Stream buffer: %d x %d KB, %s\n", STREAM_FRAMES, regionSize/1024,
+           persistent ? "persistently mapped" : "unsynchronized maps");
+}
+
+void StreamBuffer::Create(const int bytesPerFrame)
+{
+    regionSize = bytesPerFrame;
+    int size = STREAM_FRAMES*regionSize;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(STREAM_TARGET, buffer);
+    if (persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(STREAM_TARGET, size, NULL, flags);
+        mapped = (char*)glMapBufferRange(STREAM_TARGET, 0, size, flags); }
+    else
+        glBufferData(STREAM_TARGET, size, NULL, GL_STREAM_DRAW);
+    glBindBuffer(STREAM_TARGET, 0);
+}
+
+// Waits for every region to be free, then deletes the buffer.
+void StreamBuffer::Destroy()
+{
+    for (int r=0;  r<STREAM_FRAMES;  r++)
+        if (fences[r]) {
+            glClientWaitSync((GLsync)fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+            glDeleteSync((GLsync)fences[r]);
+            fences[r] = NULL; }
+
+    if (persistent) {
+        glBindBuffer(STREAM_TARGET, buffer);
+        glUnmapBuffer(STREAM_TARGET);
+        glBindBuffer(STREAM_TARGET, 0); }
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    mapped = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Moves to the next region, waiting (only if the GPU is that far
+// behind) until the commands which last read it have finished.
+void StreamBuffer::BeginFrame()
+{
+    if (grow > regionSize) {
+        Destroy();
+        Create(grow);
+        printf("Stream buffer grown to %d x %d KB\n", STREAM_FRAMES, regionSize/1024); }
+    grow = 0;
+
+    region = (region+1)%STREAM_FRAMES;
+    used = 0;
+
+    GLsync fence = (GLsync)fences[region];
+    if (!fence) return;
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        std::chrono::high_resolution_clock::time_point start =
+            std::chrono::high_resolution_clock::now();
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+            ;
+        stalls++;
+        stallMs += std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count(); }
+    glDeleteSync(fence);
+    fences[region] = NULL;
+}
+
+// Fences the region after everything which may read it.
+void StreamBuffer::EndFrame()
+{
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    if (used > peakBytes) peakBytes = used;
+    frames++;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Reserves bytes in the current region, at a multiple of alignment
+// (a power of two).  Returns a pointer to write them through, and
+// their offset in buffer, or NULL if the region is full.
+void* StreamBuffer::Allocate(const int bytes, const int alignment, int& offset)
+{
+    int start = (used + alignment-1) & ~(alignment-1);
+    if (start + bytes > regionSize) {
+        overflows++;
+        int wanted = 2*regionSize;
+        while (wanted < start + bytes) wanted *= 2;
+        if (wanted > grow) grow = wanted;
+        offset = -1;
+        return NULL; }
+
+    used = start + bytes;
+    offset = region*regionSize + start;
+    if (persistent)
+        return mapped + offset;
+
+    // The fences guarantee that the GPU is done with this range.
+    pending = true;
+    glBindBuffer(STREAM_TARGET, buffer);
+    void* p = glMapBufferRange(STREAM_TARGET, offset, bytes,
+                               GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                               GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(STREAM_TARGET, 0);
+    return p;
+}
+
+// Ends the most recent Allocate:  its data may now be drawn from.
+// (A coherent persistent mapping needs nothing.)
+void StreamBuffer::Commit()
+{
+    if (!pending) return;
+    glBindBuffer(STREAM_TARGET, buffer);
+    glUnmapBuffer(STREAM_TARGET);
+    glBindBuffer(STREAM_TARGET, 0);
+    pending = false;
+}
+
+// Allocate, copy and Commit in one step.  Returns the offset, or -1.
+int StreamBuffer::Write(const void* data, const int bytes, const int alignment)
+{
+    int offset;
+    void* p = Allocate(bytes, alignment, offset);
+    if (!p) return -1;
+    memcpy(p, data, bytes);
+    Commit();
+    return offset;
+}
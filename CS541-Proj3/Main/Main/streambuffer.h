@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////
+// A streaming buffer for data written by the CPU every frame (vertex,
+// index, uniform or texture buffer data), without the implicit
+// synchronization of respecifying a buffer with glBufferData.
+//
+// One buffer object is divided into STREAM_FRAMES regions, one per
+// frame in flight.  Each frame allocates from its region by bumping
+// an offset;  EndFrame puts a fence after the frame's commands, and
+// when the region comes around again, BeginFrame waits on that fence
+// (normally long signaled) before reusing it.  So the CPU never
+// writes over data the GPU may still be reading, and never waits
+// except when the GPU is more than STREAM_FRAMES-1 frames behind --
+// which the stall counters record.
+//
+// With GL_ARB_buffer_storage (GL 4.4) the buffer is mapped once,
+// persistently and coherently, and allocations are plain pointers
+// into it.  Otherwise (GL 3.3) each allocation maps just its range
+// with GL_MAP_UNSYNCHRONIZED_BIT, which the fences make safe, and
+// Commit unmaps it.  Either way:
+//
+//   int offset;
+//   float* p = (float*)stream.Allocate(bytes, 16, offset);
+//   if (p) {
+//       ... write bytes to p ...
+//       stream.Commit();
+//       ... draw, sourcing stream.buffer at offset ... }
+//
+// An allocation which does not fit the region returns NULL (the
+// caller falls back to some slower path), and the regions are grown
+// to fit at the next BeginFrame.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _STREAMBUFFER_
+#define _STREAMBUFFER_
+
+#define STREAM_FRAMES 3
+
+class StreamBuffer
+{
+public:
+    bool persistent;        // Mapped once (buffer storage) rather than per allocation
+    unsigned int buffer;
+    int regionSize;         // Bytes per frame
+    int region;             // The current frame's region, 0..STREAM_FRAMES-1
+    int used;               // Bytes allocated from it so far
+    char* mapped;           // Persistent:  the whole buffer
+    bool pending;           // Allocated but not yet committed
+    void* fences[STREAM_FRAMES];    // GLsync objects, or NULL
+
+    // Statistics
+    long long frames;
+    int stalls;             // BeginFrame had to wait for the GPU
+    double stallMs;         //   for this long in total
+    int overflows;          // Allocations which did not fit
+    int peakBytes;          // Largest frame so far
+
+    StreamBuffer();
+    void Initialize(const int bytesPerFrame);
+    void BeginFrame();
+    void EndFrame();
+
+    void* Allocate(const int bytes, const int alignment, int& offset);
+    void Commit();
+    int Write(const void* data, const int bytes, const int alignment);
+
+private:
+    void Create(const int bytesPerFrame);
+    void Destroy();
+    int grow;               // Region size wanted after an overflow
+};
+
+#endif
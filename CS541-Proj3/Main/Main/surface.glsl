@@ -0,0 +1,88 @@
+/////////////////////////////////////////////////////////////////////////
+// Surface detail from a material's normal and height maps (see
+// SceneGraph::Material), for the pixel shaders of the TEXTURED and
+// TERRAIN variants.  surfaceDetail chooses how much is used:
+//
+//   0:  neither map
+//   1:  the normal map, bent into the surface's tangent frame
+//   2:  that, at texture coordinates moved by parallax occlusion
+//       mapping:  the eye ray is marched down through the height
+//       map's layers until it passes below the surface, and the hit
+//       interpolated between the last two layers.  Grazing views
+//       take more (thinner) layers than head on ones.
+//
+// The normal map's green channel points down the texture (towards
+// decreasing t), so is flipped here.  The height map is white high.
+//
+// #include "surface.glsl"
+////////////////////////////////////////////////////////////////////////
+
+uniform int surfaceDetail;
+uniform bool surfaceMaps;       // The material has the two maps
+uniform sampler2D normalMap;
+uniform sampler2D heightMap;
+uniform float parallaxScale;    // Depth of the height map, in texture units
+uniform int parallaxMinSteps, parallaxMaxSteps;
+
+// Returns uv moved to where the eye ray (V, in tangent space, towards
+// the eye) first meets the height field.  dx and dy are uv's screen
+// derivatives, so that the lookups in the loop choose the right MIP
+// level.
+vec2 ParallaxOcclusion(vec2 uv, vec3 V, vec2 dx, vec2 dy)
+{
+    int steps = int(mix(float(parallaxMaxSteps), float(parallaxMinSteps), abs(V.z)));
+    float layer = 1.0/float(steps);
+    vec2 shift = parallaxScale*layer*V.xy/max(V.z, 0.05);
+
+    float depth = 0.0;
+    float surface = 1.0 - textureGrad(heightMap, uv, dx, dy).r;
+    float previous = surface;
+    for (int i=0;  i<steps && depth < surface;  i++) {
+        previous = surface;
+        uv -= shift;
+        depth += layer;
+        surface = 1.0 - textureGrad(heightMap, uv, dx, dy).r; }
+
+    // Between the layer above the surface and the one below it
+    float below = surface - depth;
+    float above = previous - (depth - layer);
+    float t = below < 0.0 ? below/(below - above) : 0.0;
+    return uv + t*shift;
+}
+
+// Applies the surface detail at texture coordinates uv (moving them
+// if parallax mapped) to the surface with normal N, tangent (w the
+// handedness, see Model::ComputeTangents), and direction to the eye
+// V.  Returns the normal to light with.
+vec3 SurfaceDetail(inout vec2 uv, vec3 N, vec4 tangent, vec3 V)
+{
+    if (surfaceDetail == 0 || !surfaceMaps)
+        return N;
+
+    vec3 T = normalize(tangent.xyz - N*dot(N, tangent.xyz));
+    vec3 B = tangent.w*cross(N, T);
+    vec2 dx = dFdx(uv), dy = dFdy(uv);
+    if (surfaceDetail == 2)
+        uv = ParallaxOcclusion(uv, normalize(vec3(dot(V, T), dot(V, B), dot(V, N))), dx, dy);
+
+    vec3 n = textureGrad(normalMap, uv, dx, dy).xyz*2.0 - 1.0;
+    n.y = -n.y;
+    return normalize(n.x*T + n.y*B + n.z*N);
+}
+
+// The ground is lit without an N.L term (see lighting.frag), which
+// would hide the normal map's shading everywhere but the highlights.
+// This is the shading the detail adds:  N.L relative to that of the
+// flat surface (normal flatN), to scale the ground's color by.  The
+// terrain's is relative to level ground, so that its slopes are
+// shaded too.
+float Relief(vec3 flatN, vec3 N, vec3 L)
+{
+#ifdef TERRAIN
+    flatN = vec3(0.0, 0.0, 1.0);
+#else
+    if (surfaceDetail == 0 || !surfaceMaps)
+        return 1.0;
+#endif
+    return min(max(dot(N, L), 0.0)/max(dot(flatN, L), 0.1), 2.0);
+}
@@ -0,0 +1,290 @@
+///////////////////////////////////////////////////////////////////////
+// Geometry clipmap terrain.  See terrain.h.
+////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include <glload/gl_3_3.h>
+#include <glload/gl_load.hpp>
+#include <glimg/glimg.h>
+
+#include "terrain.h"
+#include "allocation.h"
+
+// The texture unit of the height clipmap
+#define TERRAIN_UNIT 18
+
+static int FloorHalf(const int a)
+{
+    return a >= 0 ? a/2 : -((1-a)/2);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Builds the grid, the height texture, and the bounding box;  the
+// heights are loaded by the first Update.
+Terrain::Terrain(const int g, const int l)
+    :grid(std::max(32, g/4*4)), levels(std::max(1, l)), spacing(0.5f),
+     base(-3.0f), amplitude(2.0f), extent(50.0f), texelsUpdated(0),
+     heightTexture(0), gridVao(0), loaded(false), eyeXY(0.0f)
+{
+    diffuseColor = vec3(0.3, 0.2, 0.1);
+    specularColor = vec3(.03, .03, .03);
+    shininess = 0.1;
+    morph = grid/10;
+
+    MemoryScope scope(MEM_MODELS);
+
+    // The heightmap (its first channel), and its box-filtered pyramid
+    try {
+        glimg::ImageSet* img = glimg::loaders::stb::LoadFromFile("images/6670-bump.jpg");
+        glimg::SingleImage image = img->GetImage(0);
+        glimg::Dimensions d = image.GetDimensions();
+        sourceSize = std::min(d.width, d.height);
+        int bytes = image.GetImageByteSize()/(d.width*d.height);
+        const unsigned char* data = (const unsigned char*)image.GetImageData();
+        source.push_back(std::vector<float>(sourceSize*sourceSize));
+        for (int y=0;  y<sourceSize;  y++)
+            for (int x=0;  x<sourceSize;  x++)
+                source[0][y*sourceSize + x] = data[bytes*(y*d.width + x)]/255.0f;
+        delete img; }
+
+    catch (const glimg::loaders::stb::UnableToLoadException& e) {
+        printf("%s\n", e.what());
+        exit(-1); }
+
+    // Stretched to fill 0..1 (the bump map is low contrast)
+    float low = *std::min_element(source[0].begin(), source[0].end());
+    float high = *std::max_element(source[0].begin(), source[0].end());
+    for (unsigned int i=0;  i<source[0].size();  i++)
+        source[0][i] = high > low ? (source[0][i] - low)/(high - low) : 0.0f;
+
+    for (int n=sourceSize/2;  n>=1;  n/=2) {
+        const std::vector<float>& fine = source.back();
+        std::vector<float> coarse(n*n);
+        for (int y=0;  y<n;  y++)
+            for (int x=0;  x<n;  x++)
+                coarse[y*n + x] = 0.25f*(fine[(2*y)*2*n + 2*x] + fine[(2*y)*2*n + 2*x+1]
+                                         + fine[(2*y+1)*2*n + 2*x] + fine[(2*y+1)*2*n + 2*x+1]);
+        source.push_back(coarse); }
+
+    // A layer of heights per level, with room for a level's vertices
+    // and one more all around (for the normals)
+    texels = 1;
+    while (texels < grid+3) texels *= 2;
+    glGenTextures(1, &heightTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, heightTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, texels, texels, levels, 0,
+                 GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // The grid's vertices at their cell coordinates;  the whole grid's
+    // triangles, then each ring's, for the hole offsets (0,0), (1,0),
+    // (0,1) and (1,1).  Every cell is split on the same diagonal,
+    // which terrain.glsl's blending follows.
+    std::vector<vec2> P;
+    for (int b=0;  b<=grid;  b++)
+        for (int a=0;  a<=grid;  a++)
+            P.push_back(vec2(a, b));
+
+    std::vector<unsigned int> I;
+    int lo = grid/4, hi = grid/4 + grid/2;
+    for (int r=0;  r<5;  r++) {
+        rangeFirst[r] = I.size();
+        int ox = (r-1)&1, oy = (r-1)>>1;
+        for (int b=0;  b<grid;  b++)
+            for (int a=0;  a<grid;  a++) {
+                if (r > 0 && a >= lo+ox && a < hi+ox && b >= lo+oy && b < hi+oy)
+                    continue;
+                unsigned int v = b*(grid+1) + a;
+                unsigned int t[6] = {v, v+1, v+grid+2, v, v+grid+2, v+grid+1};
+                I.insert(I.end(), t, t+6); }
+        rangeCount[r] = I.size() - rangeFirst[r]; }
+    triangles = (rangeCount[0] + (levels-1)*rangeCount[1])/3;
+
+    glGenVertexArrays(1, &gridVao);
+    glBindVertexArray(gridVao);
+    GLuint buffers[2];
+    glGenBuffers(2, buffers);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vec2)*P.size(), &P[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*I.size(), &I[0], GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // As a Model:  the box about the outermost level, its bottom face
+    // the one quad
+    float h = 0.5f*grid*ldexpf(spacing, levels-1);
+    Reserve(8, 1, 0);
+    for (int k=0;  k<8;  k++) {
+        Pnt.push_back(vec4(k&1 ? h : -h, k&2 ? h : -h, k&4 ? base : base-amplitude, 1.0f));
+        Nrm.push_back(vec3(0.0f, 0.0f, 1.0f)); }
+    Quad.push_back(ivec4(0, 1, 3, 2));
+    center.resize(levels, ivec2(0));
+    ComputeSize();
+    MakeVAO();
+}
+
+Terrain::~Terrain()
+{
+    glDeleteTextures(1, &heightTexture);
+    glDeleteVertexArrays(1, &gridVao);
+}
+
+// The pyramid level with about a texel per cell of spacing s.
+int Terrain::SourceLevel(const float s) const
+{
+    int k = int(floorf(log2f(s*sourceSize/extent)));
+    return std::max(0, std::min(int(source.size()) - 1, k));
+}
+
+// The heightmap (0..1) at world (x,y), bilinearly from pyramid level k.
+float Terrain::SourceHeight(const float x, const float y, const int k) const
+{
+    const std::vector<float>& s = source[k];
+    int n = sourceSize>>k;
+    float u = (x + extent)/extent*n - 0.5f;
+    float v = (y + extent)/extent*n - 0.5f;
+    float fu = floorf(u), fv = floorf(v);
+    int i = int(fu) % n, j = int(fv) % n;
+    if (i < 0) i += n;
+    if (j < 0) j += n;
+    int i1 = (i+1) % n, j1 = (j+1) % n;
+    float a = u - fu, b = v - fv;
+    return (1.0f-b)*((1.0f-a)*s[j*n + i] + a*s[j*n + i1])
+               + b*((1.0f-a)*s[j1*n + i] + a*s[j1*n + i1]);
+}
+
+// Computes the heights of cells x0..x1 by y0..y1 (inclusive, in the
+// level's cells) into the level's layer, split where they wrap.  The
+// height texture must be bound.
+void Terrain::Load(const int level, const int x0, const int y0, const int x1, const int y1)
+{
+    float s = ldexpf(spacing, level);
+    int k = SourceLevel(s);
+    int mask = texels - 1;
+
+    MemoryScope scope(MEM_MODELS);
+    for (int ya=y0, yb;  ya<=y1;  ya=yb+1) {
+        yb = std::min(y1, ya + mask - (ya & mask));
+        for (int xa=x0, xb;  xa<=x1;  xa=xb+1) {
+            xb = std::min(x1, xa + mask - (xa & mask));
+            int w = xb-xa+1, h = yb-ya+1;
+            scratch.resize(w*h);
+            for (int y=0;  y<h;  y++)
+                for (int x=0;  x<w;  x++)
+                    scratch[y*w + x] = base + amplitude*(SourceHeight((xa+x)*s, (ya+y)*s, k) - 1.0f);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, xa & mask, ya & mask, level, w, h, 1,
+                            GL_RED, GL_FLOAT, &scratch[0]);
+            texelsUpdated += w*h; } }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Recenters the levels about the eye, and loads the heights which
+// have come into them.
+void Terrain::Update(const vec3& eye)
+{
+    eyeXY = vec2(eye[0], eye[1]);
+    texelsUpdated = 0;
+    int r = grid/2 + 1;             // The loaded square's half width
+    glBindTexture(GL_TEXTURE_2D_ARRAY, heightTexture);
+
+    for (int l=0;  l<levels;  l++) {
+        ivec2 next;
+        if (l == 0) {
+            float s = 2.0f*spacing;
+            next = 2*ivec2(int(floorf(eye[0]/s)), int(floorf(eye[1]/s))); }
+        else
+            next = 2*ivec2(FloorHalf(center[l-1][0]/2), FloorHalf(center[l-1][1]/2));
+
+        ivec2 d = next - center[l];
+        int x0 = next[0]-r, x1 = next[0]+r, y0 = next[1]-r, y1 = next[1]+r;
+        if (!loaded || abs(d[0]) > 2*r || abs(d[1]) > 2*r)
+            Load(l, x0, y0, x1, y1);
+        else {
+            // The columns which came in, then the rows (less those columns)
+            if (d[0] > 0)       Load(l, x1-d[0]+1, y0, x1, y1);
+            else if (d[0] < 0)  Load(l, x0, y0, x0-d[0]-1, y1);
+            int xa = d[0] > 0 ? x0 : x0-d[0];
+            int xb = d[0] > 0 ? x1-d[0] : x1;
+            if (d[1] > 0)       Load(l, xa, y1-d[1]+1, xb, y1);
+            else if (d[1] < 0)  Load(l, xa, y0, xb, y0-d[1]-1); }
+        center[l] = next; }
+
+    loaded = true;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+// The height of the terrain's finest level at (x,y).
+float Terrain::Height(const float x, const float y) const
+{
+    return base + amplitude*(SourceHeight(x, y, SourceLevel(spacing)) - 1.0f);
+}
+
+// The transform of the bounding box:  centered on the outermost level.
+MAT4 Terrain::Placement()
+{
+    float s = ldexpf(spacing, levels-1);
+    return Translate(center[levels-1][0]*s, center[levels-1][1]*s, 0.0f);
+}
+
+// Draws each level with program (a TERRAIN variant, see terrain.glsl).
+void Terrain::Draw(const int program)
+{
+    glActiveTexture(GL_TEXTURE0+TERRAIN_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, heightTexture);
+    int loc = glGetUniformLocation(program, "terrainHeights");
+    glUniform1i(loc, TERRAIN_UNIT);
+    loc = glGetUniformLocation(program, "terrainLevels");
+    glUniform1i(loc, levels);
+    loc = glGetUniformLocation(program, "terrainGrid");
+    glUniform1i(loc, grid);
+    loc = glGetUniformLocation(program, "terrainMorph");
+    glUniform1i(loc, morph);
+    loc = glGetUniformLocation(program, "terrainEye");
+    glUniform2fv(loc, 1, &eyeXY[0]);
+    loc = glGetUniformLocation(program, "terrainExtent");
+    glUniform1f(loc, extent);
+
+    glBindVertexArray(gridVao);
+    for (int l=0;  l<levels;  l++) {
+        // The ring whose hole the finer level fills
+        int r = 0;
+        if (l > 0) {
+            ivec2 o = center[l-1]/2 - center[l];
+            r = 1 + o[0] + 2*o[1]; }
+
+        loc = glGetUniformLocation(program, "terrainLevel");
+        glUniform1i(loc, l);
+        loc = glGetUniformLocation(program, "terrainOrigin");
+        glUniform2i(loc, center[l][0] - grid/2, center[l][1] - grid/2);
+        loc = glGetUniformLocation(program, "terrainSpacing");
+        glUniform1f(loc, ldexpf(spacing, l));
+
+        drawStats.drawCalls++;
+        drawStats.triangles += rangeCount[r]/3;
+        glDrawElements(GL_TRIANGLES, rangeCount[r], GL_UNSIGNED_INT,
+                       (const void*)(sizeof(unsigned int)*rangeFirst[r])); }
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE0+TERRAIN_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+// The occluder proxy:  the bounding box's bottom face.
+void Terrain::MakeProxy()
+{
+    proxyBuilt = true;
+    proxy.clear();
+    MemoryScope scope(MEM_MODELS);
+    const int corners[6] = {0, 1, 3, 0, 3, 2};
+    for (int k=0;  k<6;  k++)
+        proxy.push_back(vec3(Pnt[corners[k]]));
+}
@@ -0,0 +1,70 @@
+/////////////////////////////////////////////////////////////////////////
+// The geometry clipmap terrain (see terrain.h), for the vertex shaders
+// of the TERRAIN variant.  The vertex is a cell of the current level's
+// grid;  TerrainVertex places it at terrainOrigin+cell in the level's
+// cells, with its height and normal from the level's layer of
+// terrainHeights, blended towards the next coarser level's near the
+// level's edge.
+//
+// The coarser level's height at a vertex between its own is that of
+// its triangle's edge there:  the two ends of that edge are g>>1 and
+// (g>>1)+(g&1) (both the same at a shared vertex), for the diagonal
+// terrain.cpp splits every cell on.
+//
+// #include "terrain.glsl"
+////////////////////////////////////////////////////////////////////////
+
+#ifdef TERRAIN
+
+uniform sampler2DArray terrainHeights;
+uniform int terrainLevel, terrainLevels;
+uniform int terrainGrid, terrainMorph;
+uniform ivec2 terrainOrigin;    // Of the level's grid, in its cells
+uniform float terrainSpacing;   // Of the level's cells
+uniform vec2 terrainEye;
+uniform float terrainExtent;
+
+float TerrainHeight(ivec2 g, int level)
+{
+    int mask = textureSize(terrainHeights, 0).x - 1;
+    return texelFetch(terrainHeights, ivec3(g & mask, level), 0).r;
+}
+
+// The normal (xyz) and height (w) at cell g of a level
+vec4 TerrainSample(ivec2 g, int level, float spacing)
+{
+    float dx = TerrainHeight(g + ivec2(1, 0), level) - TerrainHeight(g - ivec2(1, 0), level);
+    float dy = TerrainHeight(g + ivec2(0, 1), level) - TerrainHeight(g - ivec2(0, 1), level);
+    return vec4(normalize(vec3(-dx, -dy, 2.0*spacing)), TerrainHeight(g, level));
+}
+
+// TerrainSample of the next coarser level, at the same point
+vec4 TerrainCoarse(ivec2 g, int level, float spacing)
+{
+    ivec2 c = g >> 1;
+    return 0.5*(TerrainSample(c, level+1, 2.0*spacing)
+                + TerrainSample(c + (g & 1), level+1, 2.0*spacing));
+}
+
+void TerrainVertex(vec2 cell, out vec3 worldPos, out vec3 normal, out vec2 tex, out vec4 tangent)
+{
+    ivec2 g = terrainOrigin + ivec2(cell);
+    vec2 xy = vec2(g)*terrainSpacing;
+    vec4 s = TerrainSample(g, terrainLevel, terrainSpacing);
+
+    // The blend reaches the coarser level two cells inside the edge,
+    // the farthest the eye can be from the level's center.
+    if (terrainLevel < terrainLevels-1) {
+        vec2 d = abs(xy - terrainEye)/terrainSpacing;
+        float a = clamp((max(d.x, d.y) - float(terrainGrid/2 - 2 - terrainMorph))/float(terrainMorph),
+                        0.0, 1.0);
+        if (a > 0.0)
+            s = mix(s, TerrainCoarse(g, terrainLevel, terrainSpacing), a); }
+
+    normal = normalize(s.xyz);
+    worldPos = vec3(xy, s.w);
+    tex = (xy + terrainExtent)/(2.0*terrainExtent);
+    tangent = vec4(normal.z, 0.0, -normal.x, 1.0);
+}
+
+#endif
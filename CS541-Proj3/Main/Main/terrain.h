@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////
+// Heightfield terrain drawn as geometry clipmaps (after Losasso and
+// Hoppe's, in the GPU form of Asirvatham and Hoppe):  in place of one
+// fixed grid, a stack of levels nested about the eye, each a grid of
+// grid by grid cells, twice the spacing of the one inside it.  Only
+// level 0 is a whole grid;  the others are rings around the level
+// inside them.  However large the world, the triangles drawn are the
+// same few:  2*grid*grid for level 0, and 3/4 of that for each ring.
+//
+// Each level is centered on the level inside it (level 0 on the eye),
+// snapped to twice its own spacing, so that the finer level's edge
+// always lies on this level's vertices.  The finer level then sits
+// either centered in the ring's hole or one cell off on each axis:
+// the four holes are four index ranges of one shared grid VAO, whose
+// vertices are integer cell coordinates.  The TERRAIN variant of the
+// vertex shaders (see terrain.glsl) turns them into world positions.
+//
+// Heights come from a level's own layer of a texture array, texels
+// by texels with texels a power of two above grid+2, addressed by
+// world cell coordinates modulo texels.  As the eye moves, Update
+// recomputes only the rows and columns which have come into a level's
+// square, and uploads them where they wrap to:  the toroidal update.
+// The heights are sampled from a box-filtered pyramid of a heightmap
+// (6670-bump.jpg, repeating every extent units as the ground's
+// textures do), at the level of the pyramid matching the level's
+// spacing.
+//
+// Approaching its outer edge, each level's heights and normals blend
+// into those of the next coarser level (interpolated along its
+// triangles' edges), reaching them morph cells before the edge, so
+// that the levels meet without cracks or pops.
+//
+// As a Model, the terrain is the box around its outermost level,
+// (moved with the eye by Placement):  the scene graph culls it by
+// that box, and the occlusion passes (see occlusion.h) draw its
+// bottom face, which nothing of the terrain is below.  Draw draws
+// the clipmap itself.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _TERRAIN_
+#define _TERRAIN_
+
+#include <vector>
+
+#include "models.h"
+
+class Terrain: public Model
+{
+public:
+    int grid;               // Cells across a level:  a multiple of 4
+    int levels;
+    int morph;              // Cells of blending before a level's edge
+    float spacing;          // Of level 0's cells
+    float base, amplitude;  // Heights run from base-amplitude up to base
+    float extent;           // The heightmap repeats every extent units
+
+    // Statistics
+    int triangles;          // Per draw
+    int texelsUpdated;      // By the last Update
+
+    Terrain(const int grid=64, const int levels=6);
+    ~Terrain();
+    void Update(const vec3& eye);
+    void Draw(const int program);
+    MAT4 Placement();
+    float Height(const float x, const float y) const;   // At its finest
+    virtual void MakeProxy();
+
+private:
+    int texels;                         // Across each level's texture
+    unsigned int heightTexture;         // GL_TEXTURE_2D_ARRAY, a layer per level
+    unsigned int gridVao;
+    int rangeFirst[5], rangeCount[5];   // The whole grid, then the rings by hole offset
+    std::vector<ivec2> center;          // Per level, in its cells (even)
+    bool loaded;
+    vec2 eyeXY;
+    std::vector<float> scratch;         // Heights on their way to the texture
+
+    // The heightmap, as a pyramid of levels sourceSize>>k across
+    std::vector<std::vector<float> > source;
+    int sourceSize;
+
+    int SourceLevel(const float s) const;
+    float SourceHeight(const float x, const float y, const int k) const;
+    void Load(const int level, const int x0, const int y0, const int x1, const int y1);
+};
+
+#endif
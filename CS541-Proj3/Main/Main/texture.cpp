@@ -1,10 +1,11 @@
 ///////////////////////////////////////////////////////////////////////
 // A slight encapsulation of an OpenGL texture. This contains a method
-// to read an image file into a texture, and methods to bind a texture
+// to read an image file into a texture (or generate one), and methods to bind a texture
 // to a shader for use, and unbind when done.
 ////////////////////////////////////////////////////////////////////////
 
 #include <fstream>
+#include <vector>
 #include "texture.h"
 
 #include <glload/gl_3_3.h>
@@ -35,6 +36,35 @@ void Texture::Read(const std::string &filename)
         exit(-1); }
 }
 
+// Creates a size by size checkerboard texture (with MIPMAPs), its
+// two colors and the number of checks chosen by seed.
+void Texture::Generate(const int size, const unsigned int seed)
+{
+    unsigned int h = seed*2654435761u;
+    unsigned char a[3] = {(unsigned char)(h), (unsigned char)(h>>8), (unsigned char)(h>>16)};
+    unsigned char b[3] = {(unsigned char)(255-a[1]), (unsigned char)(255-a[2]), (unsigned char)(255-a[0])};
+    int checks = 2 << ((h>>24)%4);
+
+    std::vector<unsigned char> data(3*size*size);
+    for (int y=0;  y<size;  y++)
+        for (int x=0;  x<size;  x++) {
+            unsigned char* c = (x*checks/size + y*checks/size)%2 ? a : b;
+            for (int i=0;  i<3;  i++)
+                data[3*(y*size + x) + i] = c[i]; }
+
+    GLuint id;
+    glGenTextures(1, &id);
+    textureId = id;
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, &data[0]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void Texture::Bind(const int unit)
 {
     glActiveTexture(GL_TEXTURE0+unit);
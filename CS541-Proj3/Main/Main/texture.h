@@ -1,6 +1,6 @@
 ///////////////////////////////////////////////////////////////////////
 // A slight encapsulation of an OpenGL texture. This contains a method
-// to read an image file into a texture, and methods to bind a texture
+// to read an image file into a texture (or generate one), and methods to bind a texture
 // to a shader for use, and unbind when done.
 ////////////////////////////////////////////////////////////////////////
 
@@ -14,6 +14,7 @@ class Texture
     
     Texture() :textureId(0) {};
     void Read(const std::string &filename);
+    void Generate(const int size, const unsigned int seed);
     void Bind(const int unit);
     void Unbind();
 };
@@ -106,13 +106,18 @@ MAT4 Translate(const float x, const float y, const float z)
 	return T;
 }
 
-// Returns a perspective projection matrix
+// Returns a perspective projection matrix, its image offset by
+// (jx,jy) in normalized device coordinates (a sub-pixel jitter, for
+// temporal anti-aliasing;  see antialias.h).
 MAT4 Perspective(const float rx, const float ry,
-	const float front, const float back)
+	const float front, const float back,
+	const float jx, const float jy)
 {
 	MAT4 P = Identity();
 	P[0][0] = 1 / rx;
 	P[1][1] = 1 / ry;
+	P[0][2] = -jx;
+	P[1][2] = -jy;
 	P[2][2] = (back + front) / (front - back);
 	P[2][3] = (-2 * front*back) / (back - front);
 	P[3][2] = -1;
@@ -155,6 +160,45 @@ MAT4 operator* (const MAT4 A, const MAT4 B)
 }
 
 
+// Returns a viewing matrix for an eye at "eye" looking toward "center"
+// with the given (approximate) up direction.
+MAT4 LookAt(const vec3 eye, const vec3 center, const vec3 up)
+{
+	vec3 f = normalize(center - eye);
+	vec3 s = normalize(cross(f, up));
+	vec3 u = cross(s, f);
+
+	MAT4 V = Identity();
+	V[0][0] = s.x;   V[0][1] = s.y;   V[0][2] = s.z;   V[0][3] = -dot(s, eye);
+	V[1][0] = u.x;   V[1][1] = u.y;   V[1][2] = u.z;   V[1][3] = -dot(u, eye);
+	V[2][0] = -f.x;  V[2][1] = -f.y;  V[2][2] = -f.z;  V[2][3] = dot(f, eye);
+	return V;
+}
+
+// Extracts the six clipping planes from a combined
+// projection*viewing matrix (Gribb/Hartmann).  Each plane is stored
+// as (normal, d), normalized so that dot(normal,p)+d is a distance.
+void Frustum::FromMatrix(const MAT4& M)
+{
+	for (int i = 0; i < 3; i++) {
+		planes[2*i  ] = vec4(M[3][0] + M[i][0], M[3][1] + M[i][1],
+		                     M[3][2] + M[i][2], M[3][3] + M[i][3]);
+		planes[2*i+1] = vec4(M[3][0] - M[i][0], M[3][1] - M[i][1],
+		                     M[3][2] - M[i][2], M[3][3] - M[i][3]); }
+
+	for (int i = 0; i < 6; i++)
+		planes[i] /= length(vec3(planes[i]));
+}
+
+// True if any part of the sphere (center c, radius r) is inside.
+bool Frustum::SphereInside(const vec3 c, const float r) const
+{
+	for (int i = 0; i < 6; i++)
+		if (dot(vec3(planes[i]), c) + planes[i].w < -r)
+			return false;
+	return true;
+}
+
 MAT4 makeEyeViewingTransform(vec3 view, vec3 up, vec3 w)
 {
 	MAT4 m = Identity();
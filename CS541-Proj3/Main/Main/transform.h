@@ -37,7 +37,20 @@ MAT4 Scale(const float x, const float y, const float z);
 MAT4 Translate(const vec3 t);
 MAT4 Translate(const float x, const float y, const float z);
 MAT4 Perspective(const float rx, const float ry,
-                 const float front, const float back);
+                 const float front, const float back,
+                 const float jx=0.0f, const float jy=0.0f);
+MAT4 LookAt(const vec3 eye, const vec3 center, const vec3 up);
 MAT4 operator* (const MAT4 A, const MAT4 B);
 
+// The bounding planes of a view volume, used to cull objects before
+// they are drawn.
+class Frustum
+{
+public:
+    vec4 planes[6];
+
+    void FromMatrix(const MAT4& M);
+    bool SphereInside(const vec3 c, const float r) const;
+};
+
 #endif
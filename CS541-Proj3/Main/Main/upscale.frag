@@ -0,0 +1,38 @@
+/////////////////////////////////////////////////////////////////////////
+// Pixel shader upscaling the dynamic resolution frame into the output
+// (see dynamicresolution.h).  The frame is sampled bilinearly at the
+// pixel, and one source texel away on each side;  the difference is
+// added back as a sharpening (after AMD's contrast adaptive
+// sharpening), by an amount limited by how far the neighborhood
+// already is from black and white, so that edges with contrast are
+// left alone rather than ringing.
+////////////////////////////////////////////////////////////////////////
+#version 330
+
+uniform sampler2D source;
+uniform vec2 sourceTexel;
+uniform float sharpness;    // 0..1
+
+in vec2 uv;
+
+vec3 Source(float x, float y)
+{
+    return texture(source, uv + sourceTexel*vec2(x, y)).rgb;
+}
+
+void main()
+{
+    vec3 c = Source(0.0, 0.0);
+    vec3 n = Source(0.0, 1.0);
+    vec3 s = Source(0.0, -1.0);
+    vec3 e = Source(1.0, 0.0);
+    vec3 w = Source(-1.0, 0.0);
+
+    vec3 low = min(c, min(min(n, s), min(e, w)));
+    vec3 high = max(c, max(max(n, s), max(e, w)));
+    vec3 amount = sqrt(clamp(min(low, 1.0 - high)/max(high, 1.0/256.0), 0.0, 1.0));
+    vec3 weight = -amount/mix(8.0, 5.0, sharpness);
+
+    vec3 color = (c + weight*(n + s + e + w))/(1.0 + 4.0*weight);
+    gl_FragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}